@@ -99,6 +99,15 @@ namespace mongo {
                 , _ownedBuffer(ownedBuffer.moveFrom()) {
         }
 
+        /** Construct a BSONObj from data somewhere inside 'owner', which it keeps alive.
+         *  All of 'owner' stays allocated for as long as the object does; use copy() to hold
+         *  on to just the object. With an empty 'owner' this is the same as BSONObj(bsonData).
+         */
+        BSONObj(const char *bsonData, const SharedBuffer& owner)
+                : _ownedBuffer(owner) {
+            init(bsonData);
+        }
+
 #if __cplusplus >= 201103L
         /** Move construct a BSONObj */
         BSONObj(BSONObj&& other)
@@ -0,0 +1,181 @@
+/*    Copyright 2014 MongoDB Inc.
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+#define MONGO_LOG_DEFAULT_COMPONENT ::mongo::logger::LogComponent::kNetwork
+
+#include "mongo/platform/basic.h"
+
+#include "mongo/client/batch_dispatcher.h"
+
+#include <algorithm>
+#include <boost/thread/locks.hpp>
+#include <exception>
+
+#include "mongo/client/client_worker.h"
+#include "mongo/util/assert_util.h"
+#include "mongo/util/log.h"
+
+namespace mongo {
+
+    //
+    // BatchDispatcher::Options
+    //
+
+    BatchDispatcher::Options::Options()
+        : _maxThreads(4)
+        , _maxQueuedBatches(8)
+        , _ordered(false) {
+    }
+
+    BatchDispatcher::Options& BatchDispatcher::Options::setMaxThreads(int value) {
+        _maxThreads = value;
+        return *this;
+    }
+
+    int BatchDispatcher::Options::maxThreads() const {
+        return _maxThreads;
+    }
+
+    BatchDispatcher::Options& BatchDispatcher::Options::setMaxQueuedBatches(int value) {
+        _maxQueuedBatches = value;
+        return *this;
+    }
+
+    int BatchDispatcher::Options::maxQueuedBatches() const {
+        return _maxQueuedBatches;
+    }
+
+    BatchDispatcher::Options& BatchDispatcher::Options::setOrdered(bool value) {
+        _ordered = value;
+        return *this;
+    }
+
+    bool BatchDispatcher::Options::ordered() const {
+        return _ordered;
+    }
+
+    //
+    // BatchDispatcher
+    //
+
+    BatchDispatcher::BatchDispatcher(const BatchHandler& handler, const Options& options)
+        : _handler(handler)
+        , _maxQueuedBatches(std::max(options.maxQueuedBatches(), 1))
+        , _finishing(false)
+        , _cancelled(false)
+        , _error(Status::OK()) {
+        const int numWorkers = options.ordered() ? 1 : std::max(options.maxThreads(), 1);
+        for (int i = 0; i < numWorkers; ++i) {
+            _workers.push_back(boost::shared_ptr<ClientWorker>(
+                new ClientWorker("BatchDispatcher", stdx::bind(&BatchDispatcher::_work, this))));
+            _workers.back()->go();
+        }
+    }
+
+    BatchDispatcher::~BatchDispatcher() {
+        DESTRUCTOR_GUARD(
+            _cancel();
+            _join();
+        );
+    }
+
+    void BatchDispatcher::dispatch(std::vector<BSONObj>* batch) {
+        boost::unique_lock<boost::mutex> lk(_mutex);
+        uassert(ErrorCodes::IllegalOperation,
+                "can't dispatch to a BatchDispatcher once it is finishing",
+                !_finishing);
+
+        while (!_cancelled && _queue.size() >= _maxQueuedBatches)
+            _queueChanged.wait(lk);
+
+        if (!_error.isOK()) {
+            const Status error = _error;
+            lk.unlock();
+            uassertStatusOK(error);
+        }
+
+        _queue.push_back(std::vector<BSONObj>());
+        _queue.back().swap(*batch);
+        _queueChanged.notify_all();
+    }
+
+    void BatchDispatcher::finish() {
+        {
+            boost::lock_guard<boost::mutex> lk(_mutex);
+            _finishing = true;
+            _queueChanged.notify_all();
+        }
+        _join();
+
+        Status error = Status::OK();
+        {
+            boost::lock_guard<boost::mutex> lk(_mutex);
+            error = _error;
+        }
+        uassertStatusOK(error);
+    }
+
+    void BatchDispatcher::_work() {
+        while (true) {
+            std::vector<BSONObj> batch;
+            {
+                boost::unique_lock<boost::mutex> lk(_mutex);
+                while (!_cancelled && !_finishing && _queue.empty())
+                    _queueChanged.wait(lk);
+                if (_cancelled || _queue.empty())
+                    return;
+
+                batch.swap(_queue.front());
+                _queue.pop_front();
+                _queueChanged.notify_all();
+            }
+
+            Status status = Status::OK();
+            try {
+                _handler(batch);
+            }
+            catch (const DBException& e) {
+                status = e.toStatus();
+            }
+            catch (const std::exception& e) {
+                status = Status(ErrorCodes::InternalError, e.what());
+            }
+
+            if (!status.isOK()) {
+                LOG(1) << "batch handler failed: " << status;
+                {
+                    boost::lock_guard<boost::mutex> lk(_mutex);
+                    if (_error.isOK())
+                        _error = status;
+                }
+                _cancel();
+                return;
+            }
+        }
+    }
+
+    void BatchDispatcher::_cancel() {
+        boost::lock_guard<boost::mutex> lk(_mutex);
+        _cancelled = true;
+        _queue.clear();
+        _queueChanged.notify_all();
+    }
+
+    void BatchDispatcher::_join() {
+        for (size_t i = 0; i < _workers.size(); ++i)
+            _workers[i]->wait();
+    }
+
+} // namespace mongo
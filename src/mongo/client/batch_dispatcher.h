@@ -0,0 +1,125 @@
+/*    Copyright 2014 MongoDB Inc.
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+#pragma once
+
+#include <boost/noncopyable.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <deque>
+#include <vector>
+
+#include "mongo/base/status.h"
+#include "mongo/client/export_macros.h"
+#include "mongo/db/jsobj.h"
+#include "mongo/stdx/functional.h"
+
+namespace mongo {
+
+    class ClientWorker;
+
+    /**
+     * Runs a handler over batches of documents on a pool of worker threads, so that the thread
+     * reading the batches off the network can go on reading while they are processed.
+     *
+     * dispatch() queues a batch and returns at once unless the queue is full, in which case it
+     * waits for room; a slow handler holds the reader back rather than letting it fill memory.
+     *
+     * If the handler throws, the batches still queued are dropped, and the error is thrown by
+     * the next call to dispatch() or finish().
+     *
+     * @see DBClientBase::query
+     */
+    class MONGO_CLIENT_API BatchDispatcher : private boost::noncopyable {
+    public:
+        /** The number of handler threads, and how far the reader may get ahead of them. */
+        class MONGO_CLIENT_API Options {
+        public:
+            Options();
+
+            /** The number of worker threads running the handler.
+             *
+             *  Default: 4
+             */
+            Options& setMaxThreads(int value);
+            int maxThreads() const;
+
+            /** How many batches can wait for a worker before dispatch() waits.
+             *
+             *  Default: 8
+             */
+            Options& setMaxQueuedBatches(int value);
+            int maxQueuedBatches() const;
+
+            /** Run the handler on one batch at a time, in the order they were dispatched. This
+             *  uses a single worker, which still overlaps the handler with reading.
+             *
+             *  Default: false
+             */
+            Options& setOrdered(bool value);
+            bool ordered() const;
+
+        private:
+            int _maxThreads;
+            int _maxQueuedBatches;
+            bool _ordered;
+        };
+
+        /** Called with each batch, on the worker threads, so possibly concurrently. */
+        typedef stdx::function<void (const std::vector<BSONObj>&)> BatchHandler;
+
+        /** Starts the workers, which run 'handler' on each batch passed to dispatch(). */
+        explicit BatchDispatcher(const BatchHandler& handler, const Options& options = Options());
+
+        /** Drops the batches still queued, and waits for the workers to finish. */
+        ~BatchDispatcher();
+
+        /**
+         * Queues the documents in 'batch', leaving it empty, and waits if the queue is full.
+         * Throws the first error from the handler.
+         */
+        void dispatch(std::vector<BSONObj>* batch);
+
+        /**
+         * Waits until every batch has been handled and the workers have stopped. Throws the
+         * first error from the handler. Nothing can be dispatched afterwards.
+         */
+        void finish();
+
+    private:
+        // The body of each worker thread.
+        void _work();
+
+        // Stops the workers, dropping the batches still queued.
+        void _cancel();
+
+        // Waits for the workers to stop.
+        void _join();
+
+        const BatchHandler _handler;
+        const size_t _maxQueuedBatches;
+        std::vector<boost::shared_ptr<ClientWorker> > _workers;
+
+        // protects everything below
+        boost::mutex _mutex;
+        boost::condition_variable _queueChanged;
+        std::deque<std::vector<BSONObj> > _queue;
+        bool _finishing;
+        bool _cancelled;
+        Status _error;
+    };
+
+} // namespace mongo
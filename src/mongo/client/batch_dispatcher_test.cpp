@@ -0,0 +1,213 @@
+/*    Copyright 2014 MongoDB Inc.
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+#include "mongo/client/batch_dispatcher.h"
+
+#include <algorithm>
+#include <boost/scoped_ptr.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/locks.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+#include <vector>
+
+#include "mongo/platform/atomic_word.h"
+#include "mongo/unittest/unittest.h"
+#include "mongo/util/assert_util.h"
+#include "mongo/util/time_support.h"
+
+namespace {
+
+    using namespace mongo;
+
+    // Records what the handler saw, and lets a test hold the handler back.
+    class Recorder {
+    public:
+        Recorder() : _active(0), _maxActive(0), _held(false) {}
+
+        void handle(const std::vector<BSONObj>& batch) {
+            boost::unique_lock<boost::mutex> lk(_mutex);
+            _maxActive = std::max(_maxActive, ++_active);
+            while (_held)
+                _released.wait(lk);
+
+            for (size_t i = 0; i < batch.size(); ++i) {
+                const int x = batch[i]["x"].numberInt();
+                uassert(ErrorCodes::BadValue, "bad document", x >= 0);
+                _seen.push_back(x);
+            }
+
+            // Gives the other workers a chance to overlap with this one.
+            lk.unlock();
+            sleepmillis(1);
+            lk.lock();
+            _active--;
+        }
+
+        void hold() {
+            boost::lock_guard<boost::mutex> lk(_mutex);
+            _held = true;
+        }
+
+        void release() {
+            boost::lock_guard<boost::mutex> lk(_mutex);
+            _held = false;
+            _released.notify_all();
+        }
+
+        std::vector<int> seen() {
+            boost::lock_guard<boost::mutex> lk(_mutex);
+            return _seen;
+        }
+
+        int maxActive() {
+            boost::lock_guard<boost::mutex> lk(_mutex);
+            return _maxActive;
+        }
+
+    private:
+        boost::mutex _mutex;
+        boost::condition_variable _released;
+        std::vector<int> _seen;
+        int _active;
+        int _maxActive;
+        bool _held;
+    };
+
+    BatchDispatcher::BatchHandler handlerFor(Recorder* recorder) {
+        return stdx::bind(&Recorder::handle, recorder, stdx::placeholders::_1);
+    }
+
+    void dispatchRange(BatchDispatcher* dispatcher, int begin, int end) {
+        for (int i = begin; i < end; ++i) {
+            std::vector<BSONObj> batch;
+            batch.push_back(BSON("x" << i));
+            dispatcher->dispatch(&batch);
+            ASSERT_TRUE(batch.empty());
+        }
+    }
+
+    void dispatchAndCount(BatchDispatcher* dispatcher, int x, AtomicUInt32* dispatched) {
+        dispatchRange(dispatcher, x, x + 1);
+        dispatched->fetchAndAdd(1);
+    }
+
+    TEST(BatchDispatcherTest, HandlesEveryBatch) {
+        Recorder recorder;
+        BatchDispatcher dispatcher(handlerFor(&recorder),
+                                   BatchDispatcher::Options().setMaxThreads(4));
+        dispatchRange(&dispatcher, 0, 100);
+        dispatcher.finish();
+
+        std::vector<int> seen = recorder.seen();
+        ASSERT_EQUALS(100U, seen.size());
+        std::sort(seen.begin(), seen.end());
+        for (int i = 0; i < 100; ++i)
+            ASSERT_EQUALS(i, seen[i]);
+    }
+
+    TEST(BatchDispatcherTest, RunsBatchesConcurrently) {
+        Recorder recorder;
+        BatchDispatcher dispatcher(handlerFor(&recorder),
+                                   BatchDispatcher::Options().setMaxThreads(4));
+
+        // Held back, the workers each take a batch and wait with it.
+        recorder.hold();
+        dispatchRange(&dispatcher, 0, 4);
+        for (int i = 0; i < 1000 && recorder.maxActive() < 4; ++i)
+            sleepmillis(1);
+        recorder.release();
+        dispatcher.finish();
+
+        ASSERT_EQUALS(4, recorder.maxActive());
+    }
+
+    TEST(BatchDispatcherTest, OrderedHandlesOneBatchAtATime) {
+        Recorder recorder;
+        BatchDispatcher dispatcher(handlerFor(&recorder),
+                                   BatchDispatcher::Options().setMaxThreads(4).setOrdered(true));
+        dispatchRange(&dispatcher, 0, 50);
+        dispatcher.finish();
+
+        const std::vector<int> seen = recorder.seen();
+        ASSERT_EQUALS(50U, seen.size());
+        for (int i = 0; i < 50; ++i)
+            ASSERT_EQUALS(i, seen[i]);
+        ASSERT_EQUALS(1, recorder.maxActive());
+    }
+
+    TEST(BatchDispatcherTest, WaitsWhenTheQueueIsFull) {
+        Recorder recorder;
+        BatchDispatcher dispatcher(handlerFor(&recorder),
+                                   BatchDispatcher::Options()
+                                       .setMaxThreads(1)
+                                       .setMaxQueuedBatches(2));
+
+        // One batch held by the worker, then two queued.
+        recorder.hold();
+        dispatchRange(&dispatcher, 0, 1);
+        for (int i = 0; i < 1000 && recorder.maxActive() < 1; ++i)
+            sleepmillis(1);
+        dispatchRange(&dispatcher, 1, 3);
+
+        // A fourth has to wait for room.
+        AtomicUInt32 dispatched;
+        boost::thread dispatcher4(stdx::bind(&dispatchAndCount, &dispatcher, 3, &dispatched));
+        sleepmillis(50);
+        ASSERT_EQUALS(0U, dispatched.load());
+
+        recorder.release();
+        dispatcher4.join();
+        ASSERT_EQUALS(1U, dispatched.load());
+
+        dispatcher.finish();
+        ASSERT_EQUALS(4U, recorder.seen().size());
+    }
+
+    TEST(BatchDispatcherTest, ThrowsTheFirstHandlerError) {
+        Recorder recorder;
+        BatchDispatcher dispatcher(handlerFor(&recorder),
+                                   BatchDispatcher::Options().setMaxThreads(2));
+        dispatchRange(&dispatcher, 0, 5);
+        dispatchRange(&dispatcher, -1, 0);
+        ASSERT_THROWS(dispatcher.finish(), UserException);
+    }
+
+    void releaseLater(Recorder* recorder) {
+        sleepmillis(20);
+        recorder->release();
+    }
+
+    TEST(BatchDispatcherTest, DropsQueuedBatchesWhenDestroyed) {
+        Recorder recorder;
+        boost::scoped_ptr<boost::thread> releaser;
+        {
+            BatchDispatcher dispatcher(handlerFor(&recorder),
+                                       BatchDispatcher::Options()
+                                           .setMaxThreads(1)
+                                           .setMaxQueuedBatches(10));
+            recorder.hold();
+            dispatchRange(&dispatcher, 0, 10);
+            for (int i = 0; i < 1000 && recorder.maxActive() < 1; ++i)
+                sleepmillis(1);
+
+            // Only the batch the worker has already taken gets handled.
+            releaser.reset(new boost::thread(stdx::bind(&releaseLater, &recorder)));
+        }
+        releaser->join();
+        ASSERT_EQUALS(1U, recorder.seen().size());
+    }
+
+} // namespace
@@ -0,0 +1,119 @@
+/*    Copyright 2014 MongoDB Inc.
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+#include "mongo/platform/basic.h"
+
+#include "mongo/client/batch_sizer.h"
+
+#include <algorithm>
+#include <limits>
+
+#include "mongo/db/jsobj.h"
+
+namespace mongo {
+
+#if !defined(_MSC_EXTENSIONS)
+    const int BatchSizer::kMinBatchSize;
+#endif
+
+namespace {
+
+    // Weight of the newest sample in the running averages.
+    const double kSampleWeight = 0.25;
+
+    void addSample(double* average, double sample, bool first) {
+        *average = first ? sample : *average + kSampleWeight * (sample - *average);
+    }
+
+} // namespace
+
+    BatchSizer::Stats::Stats()
+        : batches(0)
+        , docs(0)
+        , bytes(0)
+        , docBytes(0)
+        , roundTripMicros(0)
+        , consumeMicrosPerDoc(0)
+        , lastBatchSize(0)
+        , grows(0)
+        , shrinks(0) {
+    }
+
+    void BatchSizer::Stats::append(BSONObjBuilder* builder) const {
+        builder->append("batches", batches);
+        builder->append("docs", docs);
+        builder->append("bytes", bytes);
+        builder->append("docBytes", docBytes);
+        builder->append("roundTripMicros", roundTripMicros);
+        builder->append("consumeMicrosPerDoc", consumeMicrosPerDoc);
+        builder->append("lastBatchSize", lastBatchSize);
+        builder->append("grows", grows);
+        builder->append("shrinks", shrinks);
+    }
+
+    BatchSizer::BatchSizer(int targetBytes, int maxBytes)
+        : _targetBytes(std::max(targetBytes, 1))
+        , _maxBytes(std::max(maxBytes, _targetBytes))
+        , _roundTripSamples(0)
+        , _consumeSamples(0) {
+    }
+
+    void BatchSizer::recordBatch(int docs, int bytes, long long roundTripMicros) {
+        if (roundTripMicros >= 0) {
+            addSample(&_stats.roundTripMicros, roundTripMicros, _roundTripSamples++ == 0);
+        }
+
+        // An empty batch says nothing about the documents.
+        if (docs > 0) {
+            addSample(&_stats.docBytes, static_cast<double>(bytes) / docs, _stats.docs == 0);
+        }
+
+        _stats.batches++;
+        _stats.docs += docs;
+        _stats.bytes += bytes;
+    }
+
+    void BatchSizer::recordConsumed(int docs, long long micros) {
+        if (docs <= 0 || micros < 0)
+            return;
+        addSample(&_stats.consumeMicrosPerDoc,
+                  static_cast<double>(micros) / docs,
+                  _consumeSamples++ == 0);
+    }
+
+    int BatchSizer::next() {
+        if (_stats.docBytes <= 0)
+            return 0;
+
+        double size = _targetBytes / _stats.docBytes;
+
+        // Documents the consumer would get through while waiting for a reply.
+        if (_stats.roundTripMicros > 0 && _stats.consumeMicrosPerDoc > 0) {
+            size = std::max(size, _stats.roundTripMicros / _stats.consumeMicrosPerDoc);
+        }
+
+        size = std::min(size, _maxBytes / _stats.docBytes);
+        size = std::min(size, static_cast<double>(std::numeric_limits<int>::max()));
+        const int batchSize = std::max(static_cast<int>(size), static_cast<int>(kMinBatchSize));
+
+        if (_stats.lastBatchSize && batchSize > _stats.lastBatchSize)
+            _stats.grows++;
+        else if (batchSize < _stats.lastBatchSize)
+            _stats.shrinks++;
+        _stats.lastBatchSize = batchSize;
+        return batchSize;
+    }
+
+} // namespace mongo
@@ -0,0 +1,82 @@
+/*    Copyright 2014 MongoDB Inc.
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+#pragma once
+
+#include "mongo/client/export_macros.h"
+
+namespace mongo {
+
+    class BSONObjBuilder;
+
+    /**
+     * Picks how many documents a cursor asks for in each getMore, from what earlier batches
+     * looked like.
+     *
+     * The aim is batches of about targetBytes, whatever the size of the documents. When the
+     * consumer is fast enough to get through more than that in one round trip, the batch grows
+     * to cover the round trip instead, but never past maxBytes.
+     */
+    class MONGO_CLIENT_API BatchSizer {
+    public:
+        struct Stats {
+            Stats();
+
+            void append(BSONObjBuilder* builder) const;
+
+            // Batches received, and the documents and bytes in them.
+            long long batches;
+            long long docs;
+            long long bytes;
+
+            // Running averages, or 0 before there is anything to average.
+            double docBytes;
+            double roundTripMicros;
+            double consumeMicrosPerDoc;
+
+            // The last size next() returned, and how often it went up or down.
+            int lastBatchSize;
+            long long grows;
+            long long shrinks;
+        };
+
+        // A batch size of 1 asks the server to close the cursor after the batch.
+        static const int kMinBatchSize = 2;
+
+        BatchSizer(int targetBytes, int maxBytes);
+
+        /**
+         * Records a batch of 'docs' documents taking 'bytes' bytes, which took 'roundTripMicros'
+         * to arrive. A negative 'roundTripMicros' means the time isn't known.
+         */
+        void recordBatch(int docs, int bytes, long long roundTripMicros);
+
+        /** Records that the consumer took 'micros' to get through 'docs' documents. */
+        void recordConsumed(int docs, long long micros);
+
+        /** The number of documents to ask for next, or 0 to leave it to the server. */
+        int next();
+
+        Stats getStats() const { return _stats; }
+
+    private:
+        const int _targetBytes;
+        const int _maxBytes;
+        Stats _stats;
+        long long _roundTripSamples;
+        long long _consumeSamples;
+    };
+
+} // namespace mongo
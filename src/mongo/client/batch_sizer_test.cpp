@@ -0,0 +1,95 @@
+/*    Copyright 2014 MongoDB Inc.
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+#include "mongo/client/batch_sizer.h"
+
+#include "mongo/db/jsobj.h"
+#include "mongo/unittest/unittest.h"
+
+namespace {
+
+    using namespace mongo;
+
+    TEST(BatchSizerTest, LeavesTheFirstBatchToTheServer) {
+        BatchSizer sizer(1000, 4000);
+        ASSERT_EQUALS(0, sizer.next());
+
+        // Nor does an empty batch tell it anything.
+        sizer.recordBatch(0, 0, 100);
+        ASSERT_EQUALS(0, sizer.next());
+    }
+
+    TEST(BatchSizerTest, AimsForTheTargetBytes) {
+        BatchSizer sizer(1000, 4000);
+        sizer.recordBatch(10, 100, -1);
+        ASSERT_EQUALS(100, sizer.next());
+
+        // Bigger documents, fewer of them; the average moves a quarter of the way each batch.
+        sizer.recordBatch(10, 500, -1);
+        ASSERT_EQUALS(50, sizer.next());
+
+        BatchSizer::Stats stats = sizer.getStats();
+        ASSERT_EQUALS(2, stats.batches);
+        ASSERT_EQUALS(20, stats.docs);
+        ASSERT_EQUALS(600, stats.bytes);
+        ASSERT_EQUALS(20.0, stats.docBytes);
+        ASSERT_EQUALS(50, stats.lastBatchSize);
+        ASSERT_EQUALS(0, stats.grows);
+        ASSERT_EQUALS(1, stats.shrinks);
+    }
+
+    TEST(BatchSizerTest, CoversTheRoundTripForFastConsumers) {
+        BatchSizer sizer(1000, 4000);
+        sizer.recordBatch(10, 100, 1000);
+        sizer.recordConsumed(10, 50);
+
+        // 200 documents go by in a round trip, which is 2000 bytes.
+        ASSERT_EQUALS(200, sizer.next());
+        ASSERT_EQUALS(0, sizer.getStats().grows);
+
+        // A slow consumer is back to the target.
+        sizer.recordConsumed(10, 100 * 1000);
+        ASSERT_EQUALS(100, sizer.next());
+    }
+
+    TEST(BatchSizerTest, NeverAsksForMoreThanMaxBytes) {
+        BatchSizer sizer(1000, 4000);
+        sizer.recordBatch(10, 100, 1000 * 1000);
+        sizer.recordConsumed(10, 10);
+        ASSERT_EQUALS(400, sizer.next());
+    }
+
+    TEST(BatchSizerTest, HugeDocumentsStillGetSeveralToABatch) {
+        BatchSizer sizer(1000, 4000);
+        sizer.recordBatch(1, 16 * 1024 * 1024, -1);
+        ASSERT_EQUALS(BatchSizer::kMinBatchSize, sizer.next());
+    }
+
+    TEST(BatchSizerTest, CountsGrowth) {
+        BatchSizer sizer(1000, 4000);
+        sizer.recordBatch(10, 500, -1);
+        ASSERT_EQUALS(20, sizer.next());
+        sizer.recordBatch(10, 100, -1);
+        ASSERT_EQUALS(25, sizer.next());
+        ASSERT_EQUALS(1, sizer.getStats().grows);
+
+        BSONObjBuilder builder;
+        sizer.getStats().append(&builder);
+        BSONObj obj = builder.obj();
+        ASSERT_EQUALS(25, obj["lastBatchSize"].numberInt());
+        ASSERT_EQUALS(1, obj["grows"].numberLong());
+    }
+
+} // namespace
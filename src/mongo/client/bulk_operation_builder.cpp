@@ -51,7 +51,8 @@ namespace mongo {
     }
 
     void BulkOperationBuilder::insert(const BSONObj& doc) {
-        InsertWriteOperation* insert_op = new InsertWriteOperation(doc);
+        // The operation refers to the document rather than a copy until execute().
+        InsertWriteOperation* insert_op = new InsertWriteOperation(doc.getOwned());
         enqueue(insert_op);
     }
 
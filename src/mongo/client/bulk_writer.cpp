@@ -0,0 +1,473 @@
+/*    Copyright 2014 MongoDB Inc.
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+#define MONGO_LOG_DEFAULT_COMPONENT ::mongo::logger::LogComponent::kNetwork
+
+#include "mongo/platform/basic.h"
+
+#include "mongo/client/bulk_writer.h"
+
+#include <algorithm>
+#include <boost/thread/locks.hpp>
+#include <exception>
+#include <memory>
+
+#include "mongo/client/client_worker.h"
+#include "mongo/client/dbclientinterface.h"
+#include "mongo/client/delete_write_operation.h"
+#include "mongo/client/exceptions.h"
+#include "mongo/client/insert_write_operation.h"
+#include "mongo/client/update_write_operation.h"
+#include "mongo/client/write_options.h"
+#include "mongo/client/write_result.h"
+#include "mongo/util/assert_util.h"
+#include "mongo/util/log.h"
+#include "mongo/util/mongoutils/str.h"
+#include "mongo/util/time_support.h"
+
+namespace mongo {
+
+    namespace {
+        // Groups the operations of an unordered batch by type, as BulkOperationBuilder does.
+        inline bool compare(WriteOperation* const lhs, WriteOperation* const rhs) {
+            return lhs->operationType() > rhs->operationType();
+        }
+
+        // Fails if one of the write errors or upserts the server reported is for a write the
+        // batch doesn't have, since the outcomes then can't be matched up with the writes.
+        Status checkIndexes(const std::vector<BSONObj>& entries, size_t numOps, const char* what) {
+            for (size_t i = 0; i < entries.size(); ++i) {
+                const long long index = entries[i]["index"].numberLong();
+                if (index < 0 || static_cast<unsigned long long>(index) >= numOps) {
+                    return Status(ErrorCodes::InternalError,
+                                  str::stream() << "server reported " << what << " for write "
+                                                << index << " of a batch of " << numOps);
+                }
+            }
+            return Status::OK();
+        }
+    } // namespace
+
+    //
+    // BulkWriter::Options
+    //
+
+    BulkWriter::Options::Options()
+        : _maxBatchOperations(1000)
+        , _maxBatchBytes(4 * 1024 * 1024)
+        , _flushIntervalMillis(100)
+        , _maxConnections(2)
+        , _maxQueuedOperations(10000)
+        , _ordered(false)
+        , _writeConcern(WriteConcern::acknowledged) {
+    }
+
+    BulkWriter::Options& BulkWriter::Options::setMaxBatchOperations(int value) {
+        _maxBatchOperations = value;
+        return *this;
+    }
+
+    int BulkWriter::Options::maxBatchOperations() const {
+        return _maxBatchOperations;
+    }
+
+    BulkWriter::Options& BulkWriter::Options::setMaxBatchBytes(int value) {
+        _maxBatchBytes = value;
+        return *this;
+    }
+
+    int BulkWriter::Options::maxBatchBytes() const {
+        return _maxBatchBytes;
+    }
+
+    BulkWriter::Options& BulkWriter::Options::setFlushIntervalMillis(int value) {
+        _flushIntervalMillis = value;
+        return *this;
+    }
+
+    int BulkWriter::Options::flushIntervalMillis() const {
+        return _flushIntervalMillis;
+    }
+
+    BulkWriter::Options& BulkWriter::Options::setMaxConnections(int value) {
+        _maxConnections = value;
+        return *this;
+    }
+
+    int BulkWriter::Options::maxConnections() const {
+        return _maxConnections;
+    }
+
+    BulkWriter::Options& BulkWriter::Options::setMaxQueuedOperations(int value) {
+        _maxQueuedOperations = value;
+        return *this;
+    }
+
+    int BulkWriter::Options::maxQueuedOperations() const {
+        return _maxQueuedOperations;
+    }
+
+    BulkWriter::Options& BulkWriter::Options::setOrdered(bool value) {
+        _ordered = value;
+        return *this;
+    }
+
+    bool BulkWriter::Options::ordered() const {
+        return _ordered;
+    }
+
+    BulkWriter::Options& BulkWriter::Options::setWriteConcern(const WriteConcern& value) {
+        _writeConcern = value;
+        return *this;
+    }
+
+    const WriteConcern& BulkWriter::Options::writeConcern() const {
+        return _writeConcern;
+    }
+
+    //
+    // BulkWriter::Stats
+    //
+
+    BulkWriter::Stats::Stats()
+        : operations(0)
+        , failedOperations(0)
+        , batches(0)
+        , batchesForCount(0)
+        , batchesForBytes(0)
+        , batchesForTime(0)
+        , batchesForFlush(0)
+        , queueWaits(0) {
+    }
+
+    void BulkWriter::Stats::append(BSONObjBuilder* builder) const {
+        builder->append("operations", operations);
+        builder->append("failedOperations", failedOperations);
+        builder->append("batches", batches);
+        builder->append("batchesForCount", batchesForCount);
+        builder->append("batchesForBytes", batchesForBytes);
+        builder->append("batchesForTime", batchesForTime);
+        builder->append("batchesForFlush", batchesForFlush);
+        builder->append("queueWaits", queueWaits);
+    }
+
+    //
+    // BulkWriter
+    //
+
+    BulkWriter::BulkWriter(const StringData& ns,
+                           const stdx::function<DBClientBase* ()>& connectionFactory,
+                           const Options& options)
+        : _connections(new ConnectionSource(connectionFactory))
+        , _ns(ns.toString())
+        , _options(options)
+        , _pendingBytes(0)
+        , _pendingSinceMicros(0)
+        , _nextSequence(0)
+        , _outstanding(0)
+        , _closing(false) {
+        _init();
+    }
+
+    BulkWriter::BulkWriter(ConnectionPool* pool,
+                           const HostAndPort& host,
+                           const BSONObj& authParams,
+                           const StringData& ns,
+                           const Options& options)
+        : _connections(new ConnectionSource(pool, host, authParams))
+        , _ns(ns.toString())
+        , _options(options)
+        , _pendingBytes(0)
+        , _pendingSinceMicros(0)
+        , _nextSequence(0)
+        , _outstanding(0)
+        , _closing(false) {
+        _init();
+    }
+
+    BulkWriter::~BulkWriter() {
+        DESTRUCTOR_GUARD(
+            close();
+        );
+    }
+
+    void BulkWriter::_init() {
+        const int numWriters = _options.ordered() ? 1 : std::max(_options.maxConnections(), 1);
+        for (int i = 0; i < numWriters; ++i) {
+            _writers.push_back(boost::shared_ptr<ClientWorker>(
+                new ClientWorker("BulkWriter", stdx::bind(&BulkWriter::_work, this))));
+            _writers.back()->go();
+        }
+    }
+
+    Future<BSONObj> BulkWriter::insert(const BSONObj& doc) {
+        return _enqueue(new InsertWriteOperation(doc.getOwned()));
+    }
+
+    Future<BSONObj> BulkWriter::update(const BSONObj& selector,
+                                       const BSONObj& update,
+                                       bool upsert,
+                                       bool multi) {
+        int flags = 0;
+        if (upsert) flags |= UpdateOption_Upsert;
+        if (multi) flags |= UpdateOption_Multi;
+        return _enqueue(new UpdateWriteOperation(selector.getOwned(), update.getOwned(), flags));
+    }
+
+    Future<BSONObj> BulkWriter::remove(const BSONObj& selector, bool justOne) {
+        return _enqueue(new DeleteWriteOperation(selector.getOwned(),
+                                                 justOne ? RemoveOption_JustOne : 0));
+    }
+
+    void BulkWriter::flush() {
+        boost::unique_lock<boost::mutex> lk(_mutex);
+        if (!_pending.ops.empty())
+            _makeBatch(kBatchForFlush);
+        if (_unfinishedBatches.empty())
+            return;
+
+        // Batches made afterwards hold only operations queued after this call.
+        const unsigned long long last = *_unfinishedBatches.rbegin();
+        while (!_unfinishedBatches.empty() && *_unfinishedBatches.begin() <= last)
+            _changed.wait(lk);
+    }
+
+    void BulkWriter::close() {
+        {
+            boost::lock_guard<boost::mutex> lk(_mutex);
+            _closing = true;
+            _changed.notify_all();
+        }
+        for (size_t i = 0; i < _writers.size(); ++i)
+            _writers[i]->wait();
+    }
+
+    BulkWriter::Stats BulkWriter::getStats() const {
+        boost::lock_guard<boost::mutex> lk(_mutex);
+        return _stats;
+    }
+
+    Future<BSONObj> BulkWriter::_enqueue(WriteOperation* op) {
+        std::auto_ptr<WriteOperation> owned(op);
+        const size_t bytes = op->incrementalSize();
+        const size_t maxQueued = std::max(_options.maxQueuedOperations(), 1);
+
+        boost::unique_lock<boost::mutex> lk(_mutex);
+        if (!_closing && _outstanding >= maxQueued) {
+            _stats.queueWaits++;
+            do {
+                _changed.wait(lk);
+            } while (!_closing && _outstanding >= maxQueued);
+        }
+        uassert(ErrorCodes::IllegalOperation, "the BulkWriter has been closed", !_closing);
+
+        if (!_pending.ops.empty() &&
+            _pendingBytes + bytes > static_cast<size_t>(_options.maxBatchBytes())) {
+            _makeBatch(kBatchForBytes);
+        }
+
+        const bool first = _pending.ops.empty();
+        if (first)
+            _pendingSinceMicros = curTimeMicros64();
+
+        Promise<BSONObj> promise;
+        _pending.promises.push_back(promise);
+        op->setBulkIndex(_pending.ops.size());
+        _pending.ops.push_back(owned.release());
+        _pendingBytes += bytes;
+        _outstanding++;
+        _stats.operations++;
+
+        if (_pending.ops.size() >= static_cast<size_t>(_options.maxBatchOperations()))
+            _makeBatch(kBatchForCount);
+        else if (first)
+            _changed.notify_all(); // a writer has to start timing the batch
+
+        return promise.getFuture();
+    }
+
+    void BulkWriter::_makeBatch(BatchReason reason) {
+        _batches.push_back(Batch());
+        Batch& batch = _batches.back();
+        batch.sequence = _nextSequence++;
+        batch.ops.swap(_pending.ops);
+        batch.promises.swap(_pending.promises);
+        _unfinishedBatches.insert(batch.sequence);
+        _pendingBytes = 0;
+
+        _stats.batches++;
+        switch (reason) {
+            case kBatchForCount: _stats.batchesForCount++; break;
+            case kBatchForBytes: _stats.batchesForBytes++; break;
+            case kBatchForTime: _stats.batchesForTime++; break;
+            case kBatchForFlush: _stats.batchesForFlush++; break;
+        }
+        _changed.notify_all();
+    }
+
+    void BulkWriter::_work() {
+        DBClientBase* conn = NULL;
+        while (true) {
+            Batch batch;
+            {
+                boost::unique_lock<boost::mutex> lk(_mutex);
+                while (_batches.empty()) {
+                    if (!_pending.ops.empty()) {
+                        if (_closing) {
+                            _makeBatch(kBatchForFlush);
+                            continue;
+                        }
+
+                        const unsigned long long deadline =
+                            _pendingSinceMicros + _options.flushIntervalMillis() * 1000ULL;
+                        const unsigned long long now = curTimeMicros64();
+                        if (now >= deadline) {
+                            _makeBatch(kBatchForTime);
+                            continue;
+                        }
+                        _changed.timed_wait(lk, boost::posix_time::microseconds(deadline - now));
+                    }
+                    else if (_closing) {
+                        break;
+                    }
+                    else {
+                        _changed.wait(lk);
+                    }
+                }
+                if (_batches.empty())
+                    break;
+
+                batch.sequence = _batches.front().sequence;
+                batch.ops.swap(_batches.front().ops);
+                batch.promises.swap(_batches.front().promises);
+                _batches.pop_front();
+            }
+            _write(&conn, &batch);
+        }
+
+        if (conn)
+            _connections->release(conn, false);
+    }
+
+    void BulkWriter::_write(DBClientBase** conn, Batch* batch) {
+        WriteResult result;
+        Status status = Status::OK();
+        try {
+            if (!*conn)
+                *conn = _connections->get();
+
+            std::vector<WriteOperation*> ops(batch->ops);
+            if (!_options.ordered())
+                std::sort(ops.begin(), ops.end(), compare);
+
+            // The outcome of every insert is needed, so the wire protocol writer can't send
+            // them in a single message.
+            result._requiresDetailedInsertResults = true;
+
+            (*conn)->_write(_ns, ops, _options.ordered(), &_options.writeConcern(), &result);
+        }
+        catch (const OperationException&) {
+            // The result has the write errors for the operations which failed.
+        }
+        catch (const DBException& e) {
+            status = e.toStatus();
+        }
+        catch (const std::exception& e) {
+            status = Status(ErrorCodes::InternalError, e.what());
+        }
+
+        if (!status.isOK() && *conn) {
+            LOG(1) << "BulkWriter failed to write a batch of " << batch->ops.size()
+                   << " operations to " << _ns << ": " << status;
+            _connections->release(*conn, true);
+            *conn = NULL;
+        }
+
+        _complete(batch, result, status);
+    }
+
+    void BulkWriter::_complete(Batch* batch, const WriteResult& result, const Status& status) {
+        const size_t numOps = batch->ops.size();
+        Status outcome = status;
+        if (outcome.isOK())
+            outcome = checkIndexes(result.writeErrors(), numOps, "a write error");
+        if (outcome.isOK())
+            outcome = checkIndexes(result.upserted(), numOps, "an upsert");
+
+        std::vector<Status> statuses(numOps, outcome);
+        std::vector<BSONObj> values(numOps);
+
+        if (outcome.isOK()) {
+            // In an ordered batch nothing after the first error was attempted.
+            size_t firstError = numOps;
+            const std::vector<BSONObj>& writeErrors = result.writeErrors();
+            for (size_t i = 0; i < writeErrors.size(); ++i) {
+                const size_t index = writeErrors[i]["index"].numberLong();
+                statuses[index] = Status(ErrorCodes::fromInt(writeErrors[i]["code"].numberInt()),
+                                         writeErrors[i]["errmsg"].str());
+                firstError = std::min(firstError, index);
+            }
+            if (_options.ordered()) {
+                for (size_t i = firstError + 1; i < numOps; ++i) {
+                    statuses[i] = Status(ErrorCodes::OperationFailed,
+                                         "not attempted after an earlier write in the ordered "
+                                         "batch failed");
+                }
+            }
+
+            if (result.hasWriteConcernErrors()) {
+                const BSONObj& error = result.writeConcernErrors().front();
+                for (size_t i = 0; i < numOps; ++i) {
+                    if (statuses[i].isOK())
+                        statuses[i] = Status(ErrorCodes::WriteConcernFailed,
+                                             error["errmsg"].str());
+                }
+            }
+
+            const std::vector<BSONObj>& upserted = result.upserted();
+            for (size_t i = 0; i < upserted.size(); ++i) {
+                BSONObjBuilder builder;
+                builder.appendAs(upserted[i]["_id"], "_id");
+                values[upserted[i]["index"].numberLong()] = builder.obj();
+            }
+        }
+
+        // The stats are up to date by the time anyone sees an outcome, and flush() only
+        // returns once every outcome is in.
+        long long failed = 0;
+        for (size_t i = 0; i < numOps; ++i) {
+            if (!statuses[i].isOK())
+                failed++;
+        }
+        {
+            boost::lock_guard<boost::mutex> lk(_mutex);
+            _stats.failedOperations += failed;
+        }
+
+        for (size_t i = 0; i < numOps; ++i) {
+            delete batch->ops[i];
+            if (statuses[i].isOK())
+                batch->promises[i].setValue(values[i]);
+            else
+                batch->promises[i].setError(statuses[i]);
+        }
+
+        boost::lock_guard<boost::mutex> lk(_mutex);
+        _unfinishedBatches.erase(batch->sequence);
+        _outstanding -= numOps;
+        _changed.notify_all();
+    }
+
+} // namespace mongo
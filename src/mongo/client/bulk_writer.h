@@ -0,0 +1,271 @@
+/*    Copyright 2014 MongoDB Inc.
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+#pragma once
+
+#include <boost/noncopyable.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <deque>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "mongo/base/status.h"
+#include "mongo/base/string_data.h"
+#include "mongo/client/export_macros.h"
+#include "mongo/client/write_concern.h"
+#include "mongo/db/jsobj.h"
+#include "mongo/stdx/functional.h"
+#include "mongo/util/concurrency/future.h"
+#include "mongo/util/net/hostandport.h"
+
+namespace mongo {
+
+    class ClientWorker;
+    class ConnectionPool;
+    class ConnectionSource;
+    class DBClientBase;
+    class WriteOperation;
+    class WriteResult;
+
+    /**
+     * A long-lived writer which any number of threads can hand inserts, updates and deletes to,
+     * and which writes them to a collection in the background.
+     *
+     * Operations are gathered into a batch until it holds maxBatchOperations operations or
+     * maxBatchBytes bytes, or until its first operation has waited flushIntervalMillis. The
+     * batch is then written as one bulk write by one of maxConnections writer threads, each
+     * with its own connection, so several batches can be on the wire at once.
+     *
+     * Every operation gets a Future for its own outcome. It holds an empty object once the
+     * write has been acknowledged, or { _id: ... } for an upsert which inserted a document.
+     * If the write failed it holds the server's error for that operation. If the write concern
+     * wasn't satisfied it holds WriteConcernFailed. If the batch couldn't be written at all it
+     * holds the error which stopped it. With an unacknowledged write concern the future is
+     * ready once the batch has been sent.
+     *
+     * Unless ordered, a batch may be reordered by operation type, and batches may be written
+     * in any order relative to one another.
+     *
+     * Example:
+     *     BulkWriter writer("db.coll", stdx::bind(&newConnection));
+     *     Future<BSONObj> result = writer.insert(BSON("x" << 1));
+     *     ...
+     *     writer.flush();
+     *     uassertStatusOK(result.getStatus());
+     */
+    class MONGO_CLIENT_API BulkWriter : private boost::noncopyable {
+    public:
+        /**
+         * How big a batch may grow and how long it may wait before it is written, how many
+         * connections write batches at once, and how the writes are acknowledged.
+         */
+        class MONGO_CLIENT_API Options {
+        public:
+            Options();
+
+            /** The most operations to put in one batch.
+             *
+             *  Default: 1000
+             */
+            Options& setMaxBatchOperations(int value);
+            int maxBatchOperations() const;
+
+            /** The most bytes of operations to put in one batch. A single operation larger than
+             *  this still gets a batch of its own.
+             *
+             *  Default: 4MB
+             */
+            Options& setMaxBatchBytes(int value);
+            int maxBatchBytes() const;
+
+            /** How long an operation can wait for its batch to fill up before the batch is
+             *  written anyway.
+             *
+             *  Default: 100
+             */
+            Options& setFlushIntervalMillis(int value);
+            int flushIntervalMillis() const;
+
+            /** How many writer threads, each with a connection of its own, to run.
+             *
+             *  Default: 2
+             */
+            Options& setMaxConnections(int value);
+            int maxConnections() const;
+
+            /** How many operations can be queued or being written before insert(), update()
+             *  and remove() wait for room.
+             *
+             *  Default: 10000
+             */
+            Options& setMaxQueuedOperations(int value);
+            int maxQueuedOperations() const;
+
+            /** Whether each batch is written in the order its operations were queued, stopping
+             *  at the first error, and batches one at a time in the order they were made. Only
+             *  one writer thread is used. An error in one batch doesn't stop the next.
+             *
+             *  Default: false
+             */
+            Options& setOrdered(bool value);
+            bool ordered() const;
+
+            /** The write concern for every batch.
+             *
+             *  Default: WriteConcern::acknowledged
+             */
+            Options& setWriteConcern(const WriteConcern& value);
+            const WriteConcern& writeConcern() const;
+
+        private:
+            int _maxBatchOperations;
+            int _maxBatchBytes;
+            int _flushIntervalMillis;
+            int _maxConnections;
+            int _maxQueuedOperations;
+            bool _ordered;
+            WriteConcern _writeConcern;
+        };
+
+        struct MONGO_CLIENT_API Stats {
+            Stats();
+
+            void append(BSONObjBuilder* builder) const;
+
+            // Operations queued so far, and how many of them failed.
+            long long operations;
+            long long failedOperations;
+
+            // Batches made so far, by what made them: reaching maxBatchOperations, reaching
+            // maxBatchBytes, waiting flushIntervalMillis, or a call to flush() or close().
+            long long batches;
+            long long batchesForCount;
+            long long batchesForBytes;
+            long long batchesForTime;
+            long long batchesForFlush;
+
+            // How often an operation had to wait for room in the queue.
+            long long queueWaits;
+        };
+
+        /**
+         * A writer to 'ns' which gets its connections from 'connectionFactory'. They belong to
+         * the writer, which deletes them when it is done with them.
+         */
+        BulkWriter(const StringData& ns,
+                   const stdx::function<DBClientBase* ()>& connectionFactory,
+                   const Options& options = Options());
+
+        /**
+         * A writer to 'ns' on 'host' which gets its connections from 'pool', authenticated
+         * with 'authParams', and hands them back when it is done with them.
+         */
+        BulkWriter(ConnectionPool* pool,
+                   const HostAndPort& host,
+                   const BSONObj& authParams,
+                   const StringData& ns,
+                   const Options& options = Options());
+
+        /** Closes the writer; see close(). */
+        ~BulkWriter();
+
+        /**
+         * Queue an operation and return the future for its outcome. These wait while
+         * maxQueuedOperations operations are outstanding, and throw once the writer is closed.
+         *
+         * Callbacks added with Future::onReady() run on a writer thread, and must not block
+         * or queue more operations.
+         */
+        Future<BSONObj> insert(const BSONObj& doc);
+        Future<BSONObj> update(const BSONObj& selector,
+                               const BSONObj& update,
+                               bool upsert = false,
+                               bool multi = false);
+        Future<BSONObj> remove(const BSONObj& selector, bool justOne = false);
+
+        /**
+         * Writes whatever is queued without waiting for the batch to fill up, and waits until
+         * every operation queued before the call has an outcome.
+         */
+        void flush();
+
+        /**
+         * Writes whatever is queued, waits for it to be written, and stops the writer threads.
+         * Nothing more can be queued afterwards.
+         */
+        void close();
+
+        Stats getStats() const;
+
+    private:
+        enum BatchReason {
+            kBatchForCount,
+            kBatchForBytes,
+            kBatchForTime,
+            kBatchForFlush
+        };
+
+        struct Batch {
+            Batch() : sequence(0) {}
+
+            unsigned long long sequence;
+            std::vector<WriteOperation*> ops;
+            std::vector<Promise<BSONObj> > promises;
+        };
+
+        void _init();
+
+        // Takes ownership of 'op', and queues it.
+        Future<BSONObj> _enqueue(WriteOperation* op);
+
+        // Moves the pending operations to a batch for the writers. Must be called with _mutex
+        // held, and with operations pending.
+        void _makeBatch(BatchReason reason);
+
+        // The body of each writer thread.
+        void _work();
+
+        // Writes 'batch' on '*conn', getting a connection first if it is NULL, and completes
+        // its operations. A connection which fails is returned, and '*conn' reset to NULL.
+        void _write(DBClientBase** conn, Batch* batch);
+
+        // Completes every operation in 'batch' from 'result', or with 'status' if the batch
+        // couldn't be written.
+        void _complete(Batch* batch, const WriteResult& result, const Status& status);
+
+        const boost::scoped_ptr<const ConnectionSource> _connections;
+        const std::string _ns;
+        const Options _options;
+        std::vector<boost::shared_ptr<ClientWorker> > _writers;
+
+        // protects everything below
+        mutable boost::mutex _mutex;
+        boost::condition_variable _changed;
+        Batch _pending;
+        size_t _pendingBytes;
+        unsigned long long _pendingSinceMicros;
+        std::deque<Batch> _batches;
+        std::set<unsigned long long> _unfinishedBatches;
+        unsigned long long _nextSequence;
+        size_t _outstanding;
+        bool _closing;
+        Stats _stats;
+    };
+
+} // namespace mongo
@@ -0,0 +1,81 @@
+/*    Copyright 2014 MongoDB Inc.
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+#include "mongo/platform/basic.h"
+
+#include "mongo/client/client_worker.h"
+
+#include "mongo/client/connection_pool.h"
+#include "mongo/client/dbclientinterface.h"
+#include "mongo/util/assert_util.h"
+
+namespace mongo {
+
+    //
+    // ClientWorker
+    //
+
+    ClientWorker::ClientWorker(const std::string& name, const stdx::function<void ()>& body)
+        : _name(name)
+        , _body(body) {
+    }
+
+    std::string ClientWorker::name() const {
+        return _name;
+    }
+
+    void ClientWorker::run() {
+        _body();
+    }
+
+    //
+    // ConnectionSource
+    //
+
+    ConnectionSource::ConnectionSource(const stdx::function<DBClientBase* ()>& factory)
+        : _factory(factory)
+        , _pool(NULL) {
+    }
+
+    ConnectionSource::ConnectionSource(ConnectionPool* pool,
+                                       const HostAndPort& host,
+                                       const BSONObj& authParams)
+        : _pool(pool)
+        , _host(host)
+        , _authParams(authParams.getOwned()) {
+    }
+
+    DBClientBase* ConnectionSource::get() const {
+        if (_pool)
+            return _pool->get(_host, _authParams);
+
+        DBClientBase* conn = _factory();
+        uassert(ErrorCodes::BadValue, "connection factory returned no connection", conn);
+        return conn;
+    }
+
+    void ConnectionSource::release(DBClientBase* conn, bool failed) const {
+        if (!_pool) {
+            delete conn;
+        }
+        else if (failed) {
+            _pool->discard(_host, _authParams, conn);
+        }
+        else {
+            _pool->release(_host, _authParams, conn);
+        }
+    }
+
+} // namespace mongo
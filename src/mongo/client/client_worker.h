@@ -0,0 +1,69 @@
+/*    Copyright 2014 MongoDB Inc.
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+#pragma once
+
+#include <string>
+
+#include "mongo/db/jsobj.h"
+#include "mongo/stdx/functional.h"
+#include "mongo/util/background.h"
+#include "mongo/util/net/hostandport.h"
+
+namespace mongo {
+
+    class ConnectionPool;
+    class DBClientBase;
+
+    /**
+     * The thread of a client helper which works in the background, such as a BulkWriter
+     * writer or a ParallelCollectionScan worker. Runs 'body' once started with go().
+     */
+    class ClientWorker : public BackgroundJob {
+    public:
+        ClientWorker(const std::string& name, const stdx::function<void ()>& body);
+
+        virtual std::string name() const;
+        virtual void run();
+
+    private:
+        const std::string _name;
+        const stdx::function<void ()> _body;
+    };
+
+    /**
+     * Where the workers of a client helper get their connections: either a factory, whose
+     * connections belong to the helper and are deleted when handed back, or a pool of
+     * connections to one host, which takes them back unless they failed.
+     */
+    class ConnectionSource {
+    public:
+        explicit ConnectionSource(const stdx::function<DBClientBase* ()>& factory);
+        ConnectionSource(ConnectionPool* pool, const HostAndPort& host, const BSONObj& authParams);
+
+        /** A connection for a worker. Throws if there is none to be had. */
+        DBClientBase* get() const;
+
+        /** Hands back a connection from get(). One which 'failed' is not used again. */
+        void release(DBClientBase* conn, bool failed) const;
+
+    private:
+        const stdx::function<DBClientBase* ()> _factory;
+        ConnectionPool* const _pool;
+        const HostAndPort _host;
+        const BSONObj _authParams;
+    };
+
+} // namespace mongo
@@ -17,6 +17,8 @@
 
 #include "mongo/client/command_writer.h"
 
+#include <algorithm>
+
 #include "mongo/client/dbclientinterface.h"
 #include "mongo/client/write_result.h"
 #include "mongo/db/namespace_string.h"
@@ -26,6 +28,14 @@ namespace mongo {
     const int kOverhead = 8 * 1024;
     const char kOrderedKey[] = "ordered";
 
+    namespace {
+        // An unordered batch which has been sent, and is waiting for its reply.
+        struct SentBatch {
+            std::vector<WriteOperation*> ops;
+            Future<BSONObj> reply;
+        };
+    } // namespace
+
     CommandWriter::CommandWriter(DBClientBase* client) : _client(client) {
     }
 
@@ -39,30 +49,40 @@ namespace mongo {
         // Effectively a map of batch relative indexes to WriteOperations
         std::vector<WriteOperation*> batchOps;
 
+        // The batches of an unordered write don't depend on one another, so they are all sent
+        // before waiting for any reply.
+        std::vector<SentBatch> sent;
+
+        const std::string commandNs = nsToDatabase(ns) + ".$cmd";
+
         std::vector<WriteOperation*>::const_iterator batch_begin = write_operations.begin();
         const std::vector<WriteOperation*>::const_iterator end = write_operations.end();
 
         while (batch_begin != end) {
 
-            boost::scoped_ptr<BSONObjBuilder> command(new BSONObjBuilder);
-            boost::scoped_ptr<BSONArrayBuilder> batch(new BSONArrayBuilder);
+            // The command is built straight into the buffer of the query message which carries
+            // it, so each document is copied once. The builders fill in the lengths as they end.
+            BufBuilder message;
+            _startMessage(commandNs, &message);
+            BSONObjBuilder command(message);
             std::vector<WriteOperation*>::const_iterator batch_iter = batch_begin;
 
             // We must be able to fit the first item of the batch. Otherwise, the calling code
             // passed an over size write operation in violation of our contract.
-            invariant(_fits(batch.get(), *batch_iter));
+            invariant(_fits(message, *batch_iter));
 
             // Set the current operation type
             const WriteOpType batchOpType = (*batch_iter)->operationType();
 
             // Begin the command for this batch.
-            (*batch_iter)->startCommand(ns.toString(), command.get());
+            (*batch_iter)->startCommand(ns.toString(), &command);
+            BSONArrayBuilder batch(command.subarrayStart((*batch_iter)->batchName()));
 
             while (true) {
 
                 // Always safe to append here: either we just entered the loop, or all the
                 // checks below passed.
-                (*batch_iter)->appendSelfToCommand(batch.get());
+                (*batch_iter)->appendSelfToCommand(&batch);
 
                 // Associate batch index with WriteOperation
                 batchOps.push_back(*batch_iter);
@@ -84,7 +104,7 @@ namespace mongo {
                     break;
 
                 // If we can't put the next item into the current batch, issue what we have.
-                if (!_fits(batch.get(), *next))
+                if (!_fits(message, *next))
                     break;
 
                 // OK to proceed to next op.
@@ -92,10 +112,29 @@ namespace mongo {
             }
 
             // End the command for this batch.
-            _endCommand(batch.get(), *batch_iter, ordered, command.get());
+            _endCommand(&batch, ordered, writeConcern, &command);
+
+            Message toSend;
+            toSend.setData(dbQuery, message);
+
+            if (!ordered) {
+                sent.push_back(SentBatch());
+                sent.back().ops.swap(batchOps);
+                sent.back().reply = _client->_asyncRunCommand(commandNs, toSend);
+
+                // Without pipelining the batch has already run; stop at a failed one, as
+                // the serial path does.
+                const Future<BSONObj>& reply = sent.back().reply;
+                if (reply.isReady() &&
+                    (!reply.getStatus().isOK() || !reply.get()["ok"].trueValue()))
+                    break;
+
+                batch_begin = ++batch_iter;
+                continue;
+            }
 
             // Issue the complete command.
-            BSONObj batchResult = _send(command.get(), writeConcern, ns);
+            BSONObj batchResult = _send(commandNs, &toSend);
 
             // Merge this batch's result into the result for all batches written.
             writeResult->_mergeCommandResult(batchOps, batchResult);
@@ -110,39 +149,80 @@ namespace mongo {
             batch_begin = ++batch_iter;
         }
 
+        if (sent.empty())
+            return;
+
+        // Merge the replies in the order the batches were sent. Every batch ran, so the results
+        // of those which succeeded are kept even when an earlier one failed.
+        size_t firstFailure = sent.size();
+        BSONObj failedResult;
+        for (size_t i = 0; i < sent.size(); ++i) {
+            if (!sent[i].reply.getStatus().isOK()) {
+                firstFailure = std::min(firstFailure, i);
+                continue;
+            }
+
+            const BSONObj& batchResult = sent[i].reply.get();
+            if (!batchResult["ok"].trueValue()) {
+                if (i < firstFailure) {
+                    firstFailure = i;
+                    failedResult = batchResult;
+                }
+                continue;
+            }
+
+            writeResult->_mergeCommandResult(sent[i].ops, batchResult);
+        }
+
+        if (firstFailure < sent.size()) {
+            if (!failedResult.isEmpty())
+                throw OperationException(failedResult);
+            uassertStatusOK(sent[firstFailure].reply.getStatus());
+        }
+
+        writeResult->_check(true);
     }
 
-    bool CommandWriter::_fits(BSONArrayBuilder* builder, WriteOperation* operation) {
+    void CommandWriter::_startMessage(const std::string& commandNs, BufBuilder* message) {
+        // The header of a query for one document, as findOne() would send it.
+        message->skip(MsgData::MsgDataHeaderSize);
+        message->appendNum(0);
+        message->appendStr(commandNs);
+        message->appendNum(0);
+        message->appendNum(1);
+    }
+
+    bool CommandWriter::_fits(const BufBuilder& message, WriteOperation* operation) {
         int opSize = operation->incrementalSize();
         int maxSize = _client->getMaxBsonObjectSize();
 
         // This update is too large to ever be sent as a command, assert
         uassert(0, "update command exceeds maxBsonObjectSize", opSize <= maxSize);
 
-        return (builder->len() + opSize + kOverhead) <= maxSize;
+        return (message.len() + opSize + kOverhead) <= maxSize;
     }
 
     void CommandWriter::_endCommand(
         BSONArrayBuilder* batch,
-        WriteOperation* operation,
         bool ordered,
+        const WriteConcern* writeConcern,
         BSONObjBuilder* command
     ) {
-        command->append(operation->batchName(), batch->arr());
+        batch->done();
         command->append(kOrderedKey, ordered);
-    }
-
-    BSONObj CommandWriter::_send(
-        BSONObjBuilder* command,
-        const WriteConcern* writeConcern,
-        const StringData& ns
-    ) {
         command->append("writeConcern", writeConcern->obj());
 
-        BSONObj result;
-        bool commandWorked = _client->runCommand(nsToDatabase(ns), command->obj(), result);
+        // The command never goes through runCommand(), so its hook is applied here.
+        if (DBClientWithCommands::RunCommandHookFunc hook = _client->getRunCommandHook())
+            hook(command);
+
+        command->done();
+    }
+
+    BSONObj CommandWriter::_send(const std::string& commandNs, Message* toSend) {
+        BSONObj result = _client->_runCommand(commandNs, *toSend);
 
-        if (!commandWorked) throw OperationException(result);
+        if (!result["ok"].trueValue()) throw OperationException(result);
 
         return result;
     }
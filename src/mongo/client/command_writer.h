@@ -20,6 +20,7 @@
 namespace mongo {
 
     class DBClientBase;
+    class Message;
 
     class CommandWriter : public DBClientWriter {
     public:
@@ -34,19 +35,20 @@ namespace mongo {
         );
 
     private:
+        // Starts 'message' as a query for one document on 'commandNs', to be followed by the
+        // command itself.
+        void _startMessage(const std::string& commandNs, BufBuilder* message);
+
         void _endCommand(
             BSONArrayBuilder* batch,
-            WriteOperation* op, bool ordered,
+            bool ordered,
+            const WriteConcern* writeConcern,
             BSONObjBuilder* command
         );
 
-        BSONObj _send(
-            BSONObjBuilder* command,
-            const WriteConcern* writeConcern,
-            const StringData& ns
-        );
+        BSONObj _send(const std::string& commandNs, Message* toSend);
 
-        bool _fits(BSONArrayBuilder* builder, WriteOperation* operation);
+        bool _fits(const BufBuilder& message, WriteOperation* operation);
 
         DBClientBase* const _client;
     };
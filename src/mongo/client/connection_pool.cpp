@@ -0,0 +1,572 @@
+/*    Copyright 2014 MongoDB Inc.
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+#define MONGO_LOG_DEFAULT_COMPONENT ::mongo::logger::LogComponent::kNetwork
+
+#include "mongo/platform/basic.h"
+
+#include "mongo/client/connection_pool.h"
+
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/locks.hpp>
+#include <memory>
+#include <vector>
+
+#include "mongo/client/dbclientinterface.h"
+#include "mongo/client/sasl_client_authenticate.h"
+#include "mongo/util/assert_util.h"
+#include "mongo/util/log.h"
+#include "mongo/util/time_support.h"
+#include "mongo/util/timer.h"
+
+namespace mongo {
+
+    using std::auto_ptr;
+    using std::string;
+    using std::vector;
+
+    //
+    // ConnectionPool::Options
+    //
+
+    ConnectionPool::Options::Options()
+        : _minConnectionsPerHost(0)
+        , _maxConnectionsPerHost(100)
+        , _maxIdleTimeMillis(10 * 60 * 1000)
+        , _healthCheckIntervalMillis(5 * 1000)
+        , _waitTimeoutMillis(0)
+        , _socketTimeoutSecs(0) {
+    }
+
+    ConnectionPool::Options& ConnectionPool::Options::setMinConnectionsPerHost(int value) {
+        _minConnectionsPerHost = value;
+        return *this;
+    }
+
+    int ConnectionPool::Options::minConnectionsPerHost() const {
+        return _minConnectionsPerHost;
+    }
+
+    ConnectionPool::Options& ConnectionPool::Options::setMaxConnectionsPerHost(int value) {
+        _maxConnectionsPerHost = value;
+        return *this;
+    }
+
+    int ConnectionPool::Options::maxConnectionsPerHost() const {
+        return _maxConnectionsPerHost;
+    }
+
+    ConnectionPool::Options& ConnectionPool::Options::setMaxIdleTimeMillis(unsigned int millis) {
+        _maxIdleTimeMillis = millis;
+        return *this;
+    }
+
+    unsigned int ConnectionPool::Options::maxIdleTimeMillis() const {
+        return _maxIdleTimeMillis;
+    }
+
+    ConnectionPool::Options& ConnectionPool::Options::setHealthCheckIntervalMillis(
+        unsigned int millis) {
+        _healthCheckIntervalMillis = millis;
+        return *this;
+    }
+
+    unsigned int ConnectionPool::Options::healthCheckIntervalMillis() const {
+        return _healthCheckIntervalMillis;
+    }
+
+    ConnectionPool::Options& ConnectionPool::Options::setWaitTimeoutMillis(unsigned int millis) {
+        _waitTimeoutMillis = millis;
+        return *this;
+    }
+
+    unsigned int ConnectionPool::Options::waitTimeoutMillis() const {
+        return _waitTimeoutMillis;
+    }
+
+    ConnectionPool::Options& ConnectionPool::Options::setSocketTimeoutSecs(double secs) {
+        _socketTimeoutSecs = secs;
+        return *this;
+    }
+
+    double ConnectionPool::Options::socketTimeoutSecs() const {
+        return _socketTimeoutSecs;
+    }
+
+    //
+    // ConnectionPool::Stats
+    //
+
+    ConnectionPool::Stats::Stats()
+        : available(0)
+        , inUse(0)
+        , created(0)
+        , destroyed(0)
+        , checkouts(0)
+        , healthCheckFailures(0)
+        , waits(0)
+        , waitTimeouts(0)
+        , totalWaitMicros(0)
+        , maxWaitMicros(0) {
+    }
+
+    ConnectionPool::Stats& ConnectionPool::Stats::operator+=(const Stats& other) {
+        available += other.available;
+        inUse += other.inUse;
+        created += other.created;
+        destroyed += other.destroyed;
+        checkouts += other.checkouts;
+        healthCheckFailures += other.healthCheckFailures;
+        waits += other.waits;
+        waitTimeouts += other.waitTimeouts;
+        totalWaitMicros += other.totalWaitMicros;
+        maxWaitMicros = std::max(maxWaitMicros, other.maxWaitMicros);
+        return *this;
+    }
+
+    void ConnectionPool::Stats::append(BSONObjBuilder* builder) const {
+        builder->append("available", available);
+        builder->append("inUse", inUse);
+        builder->append("created", created);
+        builder->append("destroyed", destroyed);
+        builder->append("checkouts", checkouts);
+        builder->append("healthCheckFailures", healthCheckFailures);
+        builder->append("waits", waits);
+        builder->append("waitTimeouts", waitTimeouts);
+        builder->append("totalWaitMicros", totalWaitMicros);
+        builder->append("maxWaitMicros", maxWaitMicros);
+    }
+
+    //
+    // ConnectionPool::HostPool
+    //
+
+    /**
+     * The connections for a single host and set of credentials. Idle connections are kept in
+     * a stack so that the most recently used, and therefore most likely healthy, connection is
+     * handed out first and the least recently used ones age out at the bottom.
+     */
+    class ConnectionPool::HostPool : private boost::noncopyable {
+    public:
+        HostPool(const ConnectionPool::Options& options,
+                 const HostAndPort& host,
+                 const BSONObj& authParams)
+            : _options(options)
+            , _host(host)
+            , _authParams(authParams)
+            , _inUse(0) {
+        }
+
+        ~HostPool() {
+            clear();
+        }
+
+        DBClientBase* get() {
+            Timer waitTimer;
+            bool waited = false;
+
+            boost::unique_lock<boost::mutex> lk(_mutex);
+            while (true) {
+                while (!_idle.empty()) {
+                    IdleConnection idle = _idle.back();
+                    _idle.pop_back();
+                    _inUse++;
+
+                    // The health check may touch the socket, so don't hold the lock for it.
+                    lk.unlock();
+                    const bool healthy = _isHealthy(idle);
+                    if (!healthy)
+                        delete idle.conn;
+                    lk.lock();
+
+                    if (healthy) {
+                        _recordCheckout(waited, waitTimer.micros());
+                        return idle.conn;
+                    }
+
+                    _inUse--;
+                    _stats.healthCheckFailures++;
+                    _stats.destroyed++;
+                }
+
+                if (_total() < _options.maxConnectionsPerHost()) {
+                    // Reserve the slot before dropping the lock to connect.
+                    _inUse++;
+                    lk.unlock();
+
+                    DBClientBase* conn = NULL;
+                    try {
+                        conn = _connect();
+                    }
+                    catch (...) {
+                        lk.lock();
+                        _inUse--;
+                        _available.notify_one();
+                        throw;
+                    }
+
+                    lk.lock();
+                    _stats.created++;
+                    _recordCheckout(waited, waitTimer.micros());
+                    return conn;
+                }
+
+                waited = true;
+                const unsigned int timeoutMillis = _options.waitTimeoutMillis();
+                if (timeoutMillis == 0) {
+                    _available.wait(lk);
+                    continue;
+                }
+
+                const long long remainingMillis = timeoutMillis - waitTimer.millis();
+                if (remainingMillis <= 0 ||
+                    !_available.timed_wait(lk, boost::posix_time::milliseconds(remainingMillis))) {
+
+                    // A connection may have been released just as we timed out.
+                    if (!_idle.empty() || _total() < _options.maxConnectionsPerHost())
+                        continue;
+
+                    _stats.waitTimeouts++;
+                    _recordWait(waitTimer.micros());
+                    uasserted(ErrorCodes::ExceededTimeLimit, str::stream()
+                              << "timed out after " << timeoutMillis
+                              << "ms waiting for a connection to " << _host.toString()
+                              << " from the pool");
+                }
+            }
+        }
+
+        void release(DBClientBase* conn) {
+            if (conn->isFailed()) {
+                discard(conn);
+                return;
+            }
+
+            boost::lock_guard<boost::mutex> lk(_mutex);
+            _inUse--;
+            _idle.push_back(IdleConnection(conn, curTimeMicros64()));
+            _available.notify_one();
+        }
+
+        void discard(DBClientBase* conn) {
+            delete conn;
+
+            boost::lock_guard<boost::mutex> lk(_mutex);
+            _inUse--;
+            _stats.destroyed++;
+            _available.notify_one();
+        }
+
+        void warmUp() {
+            while (true) {
+                {
+                    boost::lock_guard<boost::mutex> lk(_mutex);
+                    if (static_cast<int>(_idle.size()) >= _options.minConnectionsPerHost() ||
+                        _total() >= _options.maxConnectionsPerHost()) {
+                        return;
+                    }
+                    _inUse++;
+                }
+
+                DBClientBase* conn = NULL;
+                try {
+                    conn = _connect();
+                }
+                catch (...) {
+                    boost::lock_guard<boost::mutex> lk(_mutex);
+                    _inUse--;
+                    _available.notify_one();
+                    throw;
+                }
+
+                {
+                    boost::lock_guard<boost::mutex> lk(_mutex);
+                    _stats.created++;
+                }
+                release(conn);
+            }
+        }
+
+        void evictIdle() {
+            const unsigned int maxIdleMillis = _options.maxIdleTimeMillis();
+            if (maxIdleMillis == 0)
+                return;
+
+            vector<DBClientBase*> toDelete;
+            {
+                boost::lock_guard<boost::mutex> lk(_mutex);
+                const unsigned long long now = curTimeMicros64();
+
+                // The oldest connections are at the front of the stack. Connections that are
+                // checked out don't count towards the minimum.
+                size_t numExpired = 0;
+                while (numExpired < _idle.size() &&
+                       static_cast<int>(_idle.size() - numExpired) >
+                           _options.minConnectionsPerHost() &&
+                       now - _idle[numExpired].returnedMicros > maxIdleMillis * 1000ULL) {
+                    toDelete.push_back(_idle[numExpired].conn);
+                    numExpired++;
+                }
+
+                _idle.erase(_idle.begin(), _idle.begin() + numExpired);
+                _stats.destroyed += numExpired;
+            }
+
+            for (size_t i = 0; i < toDelete.size(); i++)
+                delete toDelete[i];
+        }
+
+        void clear() {
+            vector<IdleConnection> toDelete;
+            {
+                boost::lock_guard<boost::mutex> lk(_mutex);
+                toDelete.swap(_idle);
+                _stats.destroyed += toDelete.size();
+            }
+
+            for (size_t i = 0; i < toDelete.size(); i++)
+                delete toDelete[i].conn;
+        }
+
+        ConnectionPool::Stats getStats() const {
+            boost::lock_guard<boost::mutex> lk(_mutex);
+            ConnectionPool::Stats stats = _stats;
+            stats.available = _idle.size();
+            stats.inUse = _inUse;
+            return stats;
+        }
+
+    private:
+        struct IdleConnection {
+            IdleConnection(DBClientBase* conn, unsigned long long returnedMicros)
+                : conn(conn)
+                , returnedMicros(returnedMicros) {
+            }
+
+            DBClientBase* conn;
+            unsigned long long returnedMicros;
+        };
+
+        // Must be called with _mutex held.
+        int _total() const {
+            return _inUse + static_cast<int>(_idle.size());
+        }
+
+        // Must be called with _mutex held.
+        void _recordCheckout(bool waited, long long waitMicros) {
+            _stats.checkouts++;
+            if (waited)
+                _recordWait(waitMicros);
+        }
+
+        // Must be called with _mutex held.
+        void _recordWait(long long waitMicros) {
+            _stats.waits++;
+            _stats.totalWaitMicros += waitMicros;
+            _stats.maxWaitMicros = std::max(_stats.maxWaitMicros, waitMicros);
+        }
+
+        // Checks are ordered from cheap to expensive, and the expensive one is skipped for
+        // connections that were in use a moment ago.
+        bool _isHealthy(const IdleConnection& idle) const {
+            if (idle.conn->isFailed())
+                return false;
+
+            const unsigned long long idleMicros = curTimeMicros64() - idle.returnedMicros;
+            if (idleMicros < _options.healthCheckIntervalMillis() * 1000ULL)
+                return true;
+
+            return idle.conn->isStillConnected();
+        }
+
+        DBClientBase* _connect() const {
+            LOG(1) << "creating new pooled connection to " << _host.toString();
+
+            string errmsg;
+            auto_ptr<DBClientBase> conn(
+                ConnectionString(_host).connect(errmsg, _options.socketTimeoutSecs()));
+            uassert(ErrorCodes::HostUnreachable,
+                    str::stream() << "failed to connect to " << _host.toString()
+                                  << ": " << errmsg,
+                    conn.get());
+
+            if (!_authParams.isEmpty())
+                conn->auth(_authParams);
+
+            return conn.release();
+        }
+
+        const ConnectionPool::Options& _options;
+        const HostAndPort _host;
+        const BSONObj _authParams;
+
+        // protects everything below
+        mutable boost::mutex _mutex;
+        boost::condition_variable _available;
+
+        vector<IdleConnection> _idle;
+
+        // Connections that are checked out, or being connected or health checked.
+        int _inUse;
+
+        ConnectionPool::Stats _stats;
+    };
+
+    //
+    // ConnectionPool
+    //
+
+    ConnectionPool::PoolKey::PoolKey(const HostAndPort& host, const BSONObj& authParams)
+        : host(host)
+        , authParams(authParams.getOwned()) {
+    }
+
+    bool ConnectionPool::PoolKey::operator<(const PoolKey& other) const {
+        if (host < other.host)
+            return true;
+        if (other.host < host)
+            return false;
+        return authParams.woCompare(other.authParams) < 0;
+    }
+
+    ConnectionPool::ConnectionPool(const Options& options)
+        : _options(options) {
+    }
+
+    ConnectionPool::~ConnectionPool() {
+        for (PoolMap::iterator it = _pools.begin(); it != _pools.end(); ++it)
+            delete it->second;
+    }
+
+    ConnectionPool::HostPool* ConnectionPool::_getPool(const HostAndPort& host,
+                                                       const BSONObj& authParams) {
+        PoolKey key(host, authParams);
+
+        boost::lock_guard<boost::mutex> lk(_mutex);
+        PoolMap::iterator it = _pools.find(key);
+        if (it != _pools.end())
+            return it->second;
+
+        HostPool* pool = new HostPool(_options, key.host, key.authParams);
+        _pools.insert(std::make_pair(key, pool));
+        return pool;
+    }
+
+    DBClientBase* ConnectionPool::get(const HostAndPort& host, const BSONObj& authParams) {
+        return _getPool(host, authParams)->get();
+    }
+
+    void ConnectionPool::release(const HostAndPort& host,
+                                 const BSONObj& authParams,
+                                 DBClientBase* conn) {
+        _getPool(host, authParams)->release(conn);
+    }
+
+    void ConnectionPool::discard(const HostAndPort& host,
+                                 const BSONObj& authParams,
+                                 DBClientBase* conn) {
+        _getPool(host, authParams)->discard(conn);
+    }
+
+    void ConnectionPool::warmUp(const HostAndPort& host, const BSONObj& authParams) {
+        _getPool(host, authParams)->warmUp();
+    }
+
+    void ConnectionPool::evictIdle() {
+        boost::lock_guard<boost::mutex> lk(_mutex);
+        for (PoolMap::iterator it = _pools.begin(); it != _pools.end(); ++it)
+            it->second->evictIdle();
+    }
+
+    void ConnectionPool::clear() {
+        boost::lock_guard<boost::mutex> lk(_mutex);
+        for (PoolMap::iterator it = _pools.begin(); it != _pools.end(); ++it)
+            it->second->clear();
+    }
+
+    ConnectionPool::Stats ConnectionPool::getStats() const {
+        Stats totals;
+
+        boost::lock_guard<boost::mutex> lk(_mutex);
+        for (PoolMap::const_iterator it = _pools.begin(); it != _pools.end(); ++it)
+            totals += it->second->getStats();
+        return totals;
+    }
+
+    ConnectionPool::Stats ConnectionPool::getStats(const HostAndPort& host,
+                                                   const BSONObj& authParams) const {
+        boost::lock_guard<boost::mutex> lk(_mutex);
+        PoolMap::const_iterator it = _pools.find(PoolKey(host, authParams));
+        if (it == _pools.end())
+            return Stats();
+        return it->second->getStats();
+    }
+
+    void ConnectionPool::appendStats(BSONObjBuilder* builder) const {
+        Stats totals;
+
+        boost::lock_guard<boost::mutex> lk(_mutex);
+        BSONObjBuilder hostsBuilder(builder->subobjStart("hosts"));
+        for (PoolMap::const_iterator it = _pools.begin(); it != _pools.end(); ++it) {
+            const Stats stats = it->second->getStats();
+            totals += stats;
+
+            string name = it->first.host.toString();
+            const BSONObj& authParams = it->first.authParams;
+            if (!authParams.isEmpty()) {
+                name = str::stream() << authParams[saslCommandUserDBFieldName].str() << "."
+                                     << authParams[saslCommandUserFieldName].str() << "@"
+                                     << name;
+            }
+
+            BSONObjBuilder hostBuilder(hostsBuilder.subobjStart(name));
+            stats.append(&hostBuilder);
+            hostBuilder.done();
+        }
+        hostsBuilder.done();
+
+        BSONObjBuilder totalsBuilder(builder->subobjStart("totals"));
+        totals.append(&totalsBuilder);
+        totalsBuilder.done();
+    }
+
+    //
+    // ScopedPooledConnection
+    //
+
+    ScopedPooledConnection::ScopedPooledConnection(ConnectionPool& pool,
+                                                   const HostAndPort& host,
+                                                   const BSONObj& authParams)
+        : _pool(pool)
+        , _host(host)
+        , _authParams(authParams.getOwned())
+        , _conn(pool.get(host, authParams)) {
+    }
+
+    ScopedPooledConnection::~ScopedPooledConnection() {
+        if (_conn) {
+            LOG(1) << "closing pooled connection to " << _host.toString()
+                   << " which was not returned with done()";
+            _pool.discard(_host, _authParams, _conn);
+        }
+    }
+
+    void ScopedPooledConnection::done() {
+        invariant(_conn);
+        _pool.release(_host, _authParams, _conn);
+        _conn = NULL;
+    }
+
+} // namespace mongo
@@ -0,0 +1,232 @@
+/*    Copyright 2014 MongoDB Inc.
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+#pragma once
+
+#include <boost/noncopyable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <map>
+#include <string>
+
+#include "mongo/client/export_macros.h"
+#include "mongo/db/jsobj.h"
+#include "mongo/util/net/hostandport.h"
+
+namespace mongo {
+
+    class DBClientBase;
+
+    /**
+     * A thread-safe pool of authenticated connections, keyed by host and credentials.
+     *
+     * Connections are created lazily by get() (or eagerly by warmUp()), authenticated once with
+     * the supplied auth parameters, and handed back to the pool with release() so the next
+     * caller with the same host and credentials can reuse them without paying connect or
+     * authentication costs again. Prefer ScopedPooledConnection over calling get/release
+     * directly.
+     */
+    class MONGO_CLIENT_API ConnectionPool : private boost::noncopyable {
+    public:
+
+        /**
+         * How many connections the pool keeps to each host, when idle ones are checked or
+         * closed, and how long get() waits for one.
+         */
+        class MONGO_CLIENT_API Options {
+        public:
+            Options();
+
+            /** The number of idle connections per host that idle eviction will never close,
+             *  and that warmUp() will establish.
+             *
+             *  Default: 0
+             */
+            Options& setMinConnectionsPerHost(int value);
+            int minConnectionsPerHost() const;
+
+            /** The maximum number of connections per host, counting both idle connections and
+             *  connections that are checked out. get() blocks once this limit is reached.
+             *
+             *  Default: 100
+             */
+            Options& setMaxConnectionsPerHost(int value);
+            int maxConnectionsPerHost() const;
+
+            /** Idle connections older than this are closed by evictIdle(), down to the
+             *  configured minimum. The pool doesn't call evictIdle() itself. A value of 0
+             *  disables idle eviction.
+             *
+             *  Default: 600000 ms (10 minutes)
+             */
+            Options& setMaxIdleTimeMillis(unsigned int millis);
+            unsigned int maxIdleTimeMillis() const;
+
+            /** Idle connections that were returned more recently than this are handed out
+             *  again after only checking their failed flag. Connections that have been idle
+             *  longer are probed with isStillConnected() first.
+             *
+             *  Default: 5000 ms
+             */
+            Options& setHealthCheckIntervalMillis(unsigned int millis);
+            unsigned int healthCheckIntervalMillis() const;
+
+            /** How long get() waits for a connection to be released when the host is at
+             *  its connection limit. A value of 0 waits forever.
+             *
+             *  Default: 0 ms (wait forever)
+             */
+            Options& setWaitTimeoutMillis(unsigned int millis);
+            unsigned int waitTimeoutMillis() const;
+
+            /** The socket timeout applied to new connections, in seconds.
+             *
+             *  Default: 0 (no timeout)
+             */
+            Options& setSocketTimeoutSecs(double secs);
+            double socketTimeoutSecs() const;
+
+        private:
+            int _minConnectionsPerHost;
+            int _maxConnectionsPerHost;
+            unsigned int _maxIdleTimeMillis;
+            unsigned int _healthCheckIntervalMillis;
+            unsigned int _waitTimeoutMillis;
+            double _socketTimeoutSecs;
+        };
+
+        /** Counters for one host/credentials pair, or the sum over all of them. */
+        struct MONGO_CLIENT_API Stats {
+            Stats();
+
+            void append(BSONObjBuilder* builder) const;
+
+            Stats& operator+=(const Stats& other);
+
+            int available;
+            int inUse;
+
+            long long created;
+            long long destroyed;
+            long long checkouts;
+            long long healthCheckFailures;
+
+            // Only get() calls which had to block are counted as waits.
+            long long waits;
+            long long waitTimeouts;
+            long long totalWaitMicros;
+            long long maxWaitMicros;
+        };
+
+        explicit ConnectionPool(const Options& options = Options());
+        ~ConnectionPool();
+
+        /**
+         * Returns a connection to 'host' authenticated with 'authParams' (see
+         * DBClientWithCommands::auth for the format; an empty object means no authentication).
+         * Throws if the connection can't be established or authenticated, or if no connection
+         * becomes available within the wait timeout. The connection must be handed back with
+         * either release() or discard().
+         */
+        DBClientBase* get(const HostAndPort& host, const BSONObj& authParams = BSONObj());
+
+        /**
+         * Returns a connection obtained from get() to the pool. Connections which are in a
+         * failed state are closed instead of being kept.
+         */
+        void release(const HostAndPort& host, const BSONObj& authParams, DBClientBase* conn);
+
+        /**
+         * Closes a connection obtained from get() whose state is unknown, e.g. because an
+         * operation on it threw, freeing its slot for another caller.
+         */
+        void discard(const HostAndPort& host, const BSONObj& authParams, DBClientBase* conn);
+
+        /** Establishes idle connections to 'host' until the configured minimum is reached. */
+        void warmUp(const HostAndPort& host, const BSONObj& authParams = BSONObj());
+
+        /**
+         * Closes idle connections that exceed the max idle time, leaving at least the minimum
+         * number idle. The pool has no thread of its own, so nothing is evicted unless the
+         * application calls this, e.g. every minute or so from a thread it already has.
+         */
+        void evictIdle();
+
+        /** Closes all idle connections. Connections that are checked out are unaffected. */
+        void clear();
+
+        Stats getStats() const;
+        Stats getStats(const HostAndPort& host, const BSONObj& authParams = BSONObj()) const;
+
+        /**
+         * Appends one sub-object of stats per host and user, plus a "totals" sub-object. User
+         * names are reported but passwords never are.
+         */
+        void appendStats(BSONObjBuilder* builder) const;
+
+        const Options& getOptions() const { return _options; }
+
+    private:
+        class HostPool;
+
+        struct PoolKey {
+            PoolKey(const HostAndPort& host, const BSONObj& authParams);
+            bool operator<(const PoolKey& other) const;
+
+            HostAndPort host;
+            BSONObj authParams;
+        };
+
+        typedef std::map<PoolKey, HostPool*> PoolMap;
+
+        HostPool* _getPool(const HostAndPort& host, const BSONObj& authParams);
+
+        const Options _options;
+
+        // protects _pools, but not the HostPools it points to, which have their own locks.
+        mutable boost::mutex _mutex;
+        PoolMap _pools;
+    };
+
+    /**
+     * Checks a connection out of a ConnectionPool for the lifetime of this object.
+     *
+     * Call done() once the connection has been used successfully. If this object is destroyed
+     * without done() having been called, e.g. because an exception unwound the stack, the
+     * connection may be in an unknown state and is closed rather than reused.
+     */
+    class MONGO_CLIENT_API ScopedPooledConnection : private boost::noncopyable {
+    public:
+        ScopedPooledConnection(ConnectionPool& pool,
+                               const HostAndPort& host,
+                               const BSONObj& authParams = BSONObj());
+        ~ScopedPooledConnection();
+
+        DBClientBase* get() const { return _conn; }
+        DBClientBase* operator->() const { return _conn; }
+        DBClientBase& conn() const { return *_conn; }
+
+        const HostAndPort& getHost() const { return _host; }
+
+        /** Returns the connection to the pool. The object must not be used afterwards. */
+        void done();
+
+    private:
+        ConnectionPool& _pool;
+        const HostAndPort _host;
+        const BSONObj _authParams;
+        DBClientBase* _conn;
+    };
+
+} // namespace mongo
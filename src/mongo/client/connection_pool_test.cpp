@@ -0,0 +1,257 @@
+/*    Copyright 2014 MongoDB Inc.
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+/**
+ * This file contains tests for ConnectionPool. Connections are made to mock servers, so the
+ * tests only cover the pooling logic.
+ */
+
+#include "mongo/platform/basic.h"
+
+#include "mongo/client/connection_pool.h"
+
+#include <boost/scoped_ptr.hpp>
+#include <boost/thread/thread.hpp>
+
+#include "mongo/client/dbclientinterface.h"
+#include "mongo/dbtests/mock/mock_conn_registry.h"
+#include "mongo/dbtests/mock/mock_remote_db_server.h"
+#include "mongo/unittest/unittest.h"
+#include "mongo/util/time_support.h"
+
+namespace {
+
+    using mongo::BSONObj;
+    using mongo::BSONObjBuilder;
+    using mongo::ConnectionPool;
+    using mongo::ConnectionString;
+    using mongo::DBClientBase;
+    using mongo::DBException;
+    using mongo::HostAndPort;
+    using mongo::MockConnRegistry;
+    using mongo::MockRemoteDBServer;
+    using mongo::ScopedPooledConnection;
+
+    const char kHostName[] = "$pooltest:27017";
+
+    class ConnectionPoolTest : public mongo::unittest::Test {
+    protected:
+        void setUp() {
+            _server.reset(new MockRemoteDBServer(kHostName));
+            _server->setCommandReply("ping", BSON("ok" << 1));
+            MockConnRegistry::get()->addServer(_server.get());
+            ConnectionString::setConnectionHook(MockConnRegistry::get()->getConnStrHook());
+        }
+
+        void tearDown() {
+            MockConnRegistry::get()->removeServer(kHostName);
+            _server.reset();
+        }
+
+        MockRemoteDBServer* getServer() {
+            return _server.get();
+        }
+
+        HostAndPort getHost() const {
+            return HostAndPort(kHostName);
+        }
+
+    private:
+        boost::scoped_ptr<MockRemoteDBServer> _server;
+    };
+
+    TEST_F(ConnectionPoolTest, ReusesReleasedConnection) {
+        ConnectionPool pool;
+
+        DBClientBase* first = pool.get(getHost());
+        pool.release(getHost(), BSONObj(), first);
+        DBClientBase* second = pool.get(getHost());
+        ASSERT_EQUALS(first, second);
+        pool.release(getHost(), BSONObj(), second);
+
+        ConnectionPool::Stats stats = pool.getStats(getHost());
+        ASSERT_EQUALS(1, stats.created);
+        ASSERT_EQUALS(2, stats.checkouts);
+        ASSERT_EQUALS(1, stats.available);
+        ASSERT_EQUALS(0, stats.inUse);
+    }
+
+    TEST_F(ConnectionPoolTest, ConcurrentCheckoutsGetDistinctConnections) {
+        ConnectionPool pool;
+
+        DBClientBase* first = pool.get(getHost());
+        DBClientBase* second = pool.get(getHost());
+        ASSERT_NOT_EQUALS(first, second);
+        ASSERT_EQUALS(2, pool.getStats(getHost()).inUse);
+
+        pool.release(getHost(), BSONObj(), first);
+        pool.release(getHost(), BSONObj(), second);
+        ASSERT_EQUALS(2, pool.getStats(getHost()).available);
+    }
+
+    TEST_F(ConnectionPoolTest, TimesOutAtMaxConnections) {
+        ConnectionPool pool(ConnectionPool::Options()
+                            .setMaxConnectionsPerHost(1)
+                            .setWaitTimeoutMillis(10));
+
+        DBClientBase* conn = pool.get(getHost());
+        ASSERT_THROWS(pool.get(getHost()), DBException);
+        pool.release(getHost(), BSONObj(), conn);
+
+        ConnectionPool::Stats stats = pool.getStats(getHost());
+        ASSERT_EQUALS(1, stats.waits);
+        ASSERT_EQUALS(1, stats.waitTimeouts);
+        ASSERT_GREATER_THAN_OR_EQUALS(stats.maxWaitMicros, 10 * 1000);
+    }
+
+    void releaseAfterDelay(ConnectionPool* pool, HostAndPort host, DBClientBase* conn) {
+        mongo::sleepmillis(20);
+        pool->release(host, BSONObj(), conn);
+    }
+
+    TEST_F(ConnectionPoolTest, WaitsForReleasedConnection) {
+        ConnectionPool pool(ConnectionPool::Options().setMaxConnectionsPerHost(1));
+
+        DBClientBase* first = pool.get(getHost());
+        boost::thread releaser(releaseAfterDelay, &pool, getHost(), first);
+        DBClientBase* second = pool.get(getHost());
+        releaser.join();
+
+        ASSERT_EQUALS(first, second);
+        pool.release(getHost(), BSONObj(), second);
+
+        ConnectionPool::Stats stats = pool.getStats(getHost());
+        ASSERT_EQUALS(1, stats.created);
+        ASSERT_EQUALS(1, stats.waits);
+        ASSERT_EQUALS(0, stats.waitTimeouts);
+    }
+
+    TEST_F(ConnectionPoolTest, FailedConnectionIsNotReused) {
+        ConnectionPool pool;
+
+        DBClientBase* conn = pool.get(getHost());
+        getServer()->shutdown();
+        BSONObj info;
+        ASSERT_THROWS(conn->runCommand("admin", BSON("ping" << 1), info), DBException);
+        ASSERT(conn->isFailed());
+        pool.release(getHost(), BSONObj(), conn);
+        getServer()->reboot();
+
+        ConnectionPool::Stats stats = pool.getStats(getHost());
+        ASSERT_EQUALS(0, stats.available);
+        ASSERT_EQUALS(0, stats.inUse);
+        ASSERT_EQUALS(1, stats.destroyed);
+    }
+
+    TEST_F(ConnectionPoolTest, ConnectFailureReleasesSlot) {
+        ConnectionPool pool(ConnectionPool::Options().setMaxConnectionsPerHost(1));
+
+        getServer()->shutdown();
+        ASSERT_THROWS(pool.get(getHost()), DBException);
+        ASSERT_THROWS(pool.get(getHost()), DBException);
+        ASSERT_EQUALS(0, pool.getStats(getHost()).inUse);
+
+        getServer()->reboot();
+        pool.release(getHost(), BSONObj(), pool.get(getHost()));
+        ASSERT_EQUALS(1, pool.getStats(getHost()).created);
+    }
+
+    TEST_F(ConnectionPoolTest, ScopedConnectionReturnedByDone) {
+        ConnectionPool pool;
+        {
+            ScopedPooledConnection conn(pool, getHost());
+            BSONObj info;
+            ASSERT(conn->runCommand("admin", BSON("ping" << 1), info));
+            conn.done();
+        }
+
+        ConnectionPool::Stats stats = pool.getStats(getHost());
+        ASSERT_EQUALS(1, stats.available);
+        ASSERT_EQUALS(0, stats.destroyed);
+    }
+
+    TEST_F(ConnectionPoolTest, ScopedConnectionWithoutDoneIsDiscarded) {
+        ConnectionPool pool;
+        {
+            ScopedPooledConnection conn(pool, getHost());
+        }
+
+        ConnectionPool::Stats stats = pool.getStats(getHost());
+        ASSERT_EQUALS(0, stats.available);
+        ASSERT_EQUALS(0, stats.inUse);
+        ASSERT_EQUALS(1, stats.destroyed);
+    }
+
+    TEST_F(ConnectionPoolTest, WarmUpAndEvictIdleRespectMinimum) {
+        ConnectionPool pool(ConnectionPool::Options()
+                            .setMinConnectionsPerHost(2)
+                            .setMaxIdleTimeMillis(1));
+
+        pool.warmUp(getHost());
+        ASSERT_EQUALS(2, pool.getStats(getHost()).available);
+
+        // Check out a third connection and return it, so that one connection is above the
+        // minimum once they are all idle.
+        DBClientBase* conns[3];
+        for (int i = 0; i < 3; i++)
+            conns[i] = pool.get(getHost());
+        for (int i = 0; i < 3; i++)
+            pool.release(getHost(), BSONObj(), conns[i]);
+
+        mongo::sleepmillis(10);
+        pool.evictIdle();
+
+        ConnectionPool::Stats stats = pool.getStats(getHost());
+        ASSERT_EQUALS(2, stats.available);
+        ASSERT_EQUALS(3, stats.created);
+        ASSERT_EQUALS(1, stats.destroyed);
+    }
+
+    TEST_F(ConnectionPoolTest, EvictIdleKeepsMinimumIdleWhileOthersAreCheckedOut) {
+        ConnectionPool pool(ConnectionPool::Options()
+                            .setMinConnectionsPerHost(2)
+                            .setMaxIdleTimeMillis(1));
+
+        DBClientBase* conns[5];
+        for (int i = 0; i < 5; i++)
+            conns[i] = pool.get(getHost());
+        for (int i = 0; i < 3; i++)
+            pool.release(getHost(), BSONObj(), conns[i]);
+
+        mongo::sleepmillis(10);
+        pool.evictIdle();
+
+        ConnectionPool::Stats stats = pool.getStats(getHost());
+        ASSERT_EQUALS(2, stats.available);
+        ASSERT_EQUALS(2, stats.inUse);
+        ASSERT_EQUALS(1, stats.destroyed);
+
+        for (int i = 3; i < 5; i++)
+            pool.release(getHost(), BSONObj(), conns[i]);
+    }
+
+    TEST_F(ConnectionPoolTest, AppendStats) {
+        ConnectionPool pool;
+        pool.release(getHost(), BSONObj(), pool.get(getHost()));
+
+        BSONObjBuilder builder;
+        pool.appendStats(&builder);
+        BSONObj stats = builder.obj();
+
+        ASSERT_EQUALS(1, stats["totals"]["available"].numberInt());
+        ASSERT_EQUALS(1, stats["hosts"][kHostName]["created"].numberInt());
+    }
+
+} // namespace
@@ -43,8 +43,10 @@
 #include "mongo/db/namespace_string.h"
 #include "mongo/util/assert_util.h"
 #include "mongo/util/log.h"
+#include "mongo/util/net/message_compressor.h"
 #include "mongo/util/net/ssl_manager.h"
 #include "mongo/util/password_digest.h"
+#include "mongo/util/time_support.h"
 
 #include <boost/algorithm/string/case_conv.hpp>
 #include <boost/algorithm/string/classification.hpp>
@@ -1678,17 +1680,37 @@ namespace mongo {
         _serverString = _server.toString();
         _serverAddrString.clear();
 
-        // we keep around SockAddr for connection life -- maybe MessagingPort
-        // requires that?
-        std::auto_ptr<SockAddr> serverSockAddr(new SockAddr(_server.host().c_str(),
-                                                            _server.port()));
-        if (!serverSockAddr->isValid()) {
+        // the pipeline reads from the old port, so it has to go first
+        _pipeline.reset();
+
+        // cursors don't survive the old connection
+        {
+            boost::lock_guard<boost::mutex> lk( _deferredKillsMutex );
+            _deferredKills.clear();
+        }
+
+        // Nor do writes held back on it. Sending them from the old port's destructor would fail
+        // without anyone noticing, so say that they were lost.
+        if ( p ) {
+            const int dropped = p->discardHeldBack();
+            if ( dropped )
+                warning() << "dropped " << dropped << " unsent messages to " << _serverString
+                          << " on reconnect" << endl;
+        }
+
+        // Every address the host resolves to is tried, so one that doesn't answer can't hold
+        // up the connect while another would.
+        const vector<SockAddr> serverSockAddrs = SockAddr::createAll(_server.host().c_str(),
+                                                                     _server.port());
+        if (serverSockAddrs.empty()) {
             errmsg = str::stream() << "couldn't initialize connection to host "
                                    << _server.host().c_str() << ", address is invalid";
             return false;
         }
 
-        server.reset(serverSockAddr.release());
+        // we keep around SockAddr for connection life -- maybe MessagingPort
+        // requires that?
+        server.reset(new SockAddr(serverSockAddrs[0]));
         p.reset(new MessagingPort( _so_timeout, _logLevel ));
 
         if (_server.host().empty() ) {
@@ -1705,13 +1727,15 @@ namespace mongo {
             return false;
         }
 
-        if ( !p->connect(*server) ) {
+        if ( !p->connect(serverSockAddrs) ) {
             errmsg = str::stream() << "couldn't connect to server " << toString()
                                    << ", connection attempt failed";
             _failed = true;
             return false;
         }
         else {
+            server.reset(new SockAddr(p->psock->remoteAddr()));
+            _serverAddrString = server->getAddr();
             LOG( 1 ) << "connected to server " << toString() << endl;
         }
 
@@ -1721,8 +1745,21 @@ namespace mongo {
             return false;
         }
 #endif
+        // Offer the configured compressors which this build supports.
+        BSONObjBuilder isMaster;
+        isMaster.append("ismaster", 1);
+        const vector<string>& compressors = client::Options::current().compressors();
+        BSONArrayBuilder offered;
+        for (size_t i = 0; i < compressors.size(); i++) {
+            MessageCompressor::Id id;
+            if (MessageCompressor::parse(compressors[i], &id).isOK())
+                offered.append(compressors[i]);
+        }
+        if (offered.arrSize() > 0)
+            isMaster.append("compression", offered.arr());
+
         BSONObj info;
-        bool worked = simpleCommand("admin", &info, "ismaster");
+        bool worked = runCommand("admin", isMaster.obj(), info);
         if (worked) {
             if (info.hasField("maxBsonObjectSize"))
                 _maxBsonObjectSize = info.getIntField("maxBsonObjectSize");
@@ -1734,6 +1771,24 @@ namespace mongo {
                 _minWireVersion = info.getIntField("minWireVersion");
             if (info.hasField("maxWireVersion"))
                 _maxWireVersion = info.getIntField("maxWireVersion");
+
+            // The server answers with the offered compressors it supports, best first.
+            if (info["compression"].type() == Array) {
+                BSONObjIterator it(info["compression"].Obj());
+                while (it.more()) {
+                    const BSONElement e = it.next();
+                    MessageCompressor::Id id;
+                    if (e.type() == String && MessageCompressor::parse(e.String(), &id).isOK()) {
+                        LOG(1) << "compressing messages to " << toString() << " with "
+                               << e.String() << endl;
+                        p->setCompressor(id);
+                        break;
+                    }
+                }
+            }
+
+            if (_pipelined)
+                _pipeline.reset(new MessagePipeline(p.get()));
         }
 
         return worked;
@@ -1760,7 +1815,7 @@ namespace mongo {
 
 
     void DBClientConnection::_checkConnection() {
-        if ( !_failed )
+        if ( !isFailed() )
             return;
 
         if ( !autoReconnect )
@@ -1800,6 +1855,21 @@ namespace mongo {
         }
     }
 
+    void DBClientConnection::setPipelined(bool pipelined) {
+#ifdef MONGO_SSL
+        uassert(ErrorCodes::IllegalOperation,
+                "request pipelining is not supported on SSL connections",
+                !pipelined || !client::Options::current().SSLEnabled());
+#endif
+        _pipelined = pipelined;
+        if (!pipelined) {
+            _pipeline.reset();
+        }
+        else if (p && !_pipeline && !_failed) {
+            _pipeline.reset(new MessagePipeline(p.get()));
+        }
+    }
+
     uint64_t DBClientConnection::getSockCreationMicroSec() const {
         if (p) {
             return p->getSockCreationMicroSec();
@@ -2005,6 +2075,48 @@ namespace mongo {
         return n;
     }
 
+    namespace {
+        void handleEach(const stdx::function<void(const BSONObj&)>& f,
+                        const std::vector<BSONObj>& batch) {
+            for (size_t i = 0; i < batch.size(); ++i)
+                f(batch[i]);
+        }
+    } // namespace
+
+    unsigned long long DBClientBase::query(
+            stdx::function<void(const BSONObj&)> f,
+            const BatchDispatcher::Options& options,
+            const string& ns,
+            Query query,
+            const BSONObj *fieldsToReturn,
+            int queryOptions ) {
+
+        // mask options
+        queryOptions &= (int)( QueryOption_NoCursorTimeout | QueryOption_SlaveOk );
+
+        auto_ptr<DBClientCursor> c( this->query(ns, query, 0, 0, fieldsToReturn, queryOptions) );
+        uassert( 16090, "socket error for mapping query", c.get() );
+
+        BatchDispatcher dispatcher( stdx::bind( &handleEach, f, stdx::placeholders::_1 ),
+                                    options );
+        unsigned long long n = 0;
+
+        while ( c->more() ) {
+            // The documents share the buffer of the batch they came in, which outlives the
+            // cursor moving on to the next one.
+            std::vector<BSONObj> batch;
+            batch.reserve( c->objsLeftInBatch() );
+            while ( c->moreInCurrentBatch() ) {
+                batch.push_back( c->nextSafe().getOwned() );
+            }
+            n += batch.size();
+            dispatcher.dispatch( &batch );
+        }
+
+        dispatcher.finish();
+        return n;
+    }
+
     void DBClientConnection::setReplSetClientCallback(DBClientReplicaSet* rsClient) {
         clientSet = rsClient;
     }
@@ -2113,6 +2225,220 @@ namespace mongo {
         _write( ns, inserts.ops, ordered, wc, &writeResult );
     }
 
+    namespace {
+
+        // Runs the post-command hook on an asyncRunCommand() reply, then passes it on.
+        void runPostCommandHook(const DBClientWithCommands::PostRunCommandHookFunc& hook,
+                                const string& host,
+                                Promise<BSONObj> promise,
+                                const Future<BSONObj>& reply) {
+            if ( !reply.getStatus().isOK() ) {
+                promise.setError( reply.getStatus() );
+                return;
+            }
+
+            try {
+                hook( reply.get(), host );
+            }
+            catch ( const DBException& e ) {
+                promise.setError( e.toStatus() );
+                return;
+            }
+            promise.setValue( reply.get() );
+        }
+
+        // Returns a future for 'reply' once the post-command hook, if any, has seen it.
+        Future<BSONObj> afterPostCommandHook(const DBClientWithCommands::PostRunCommandHookFunc& hook,
+                                             const string& host,
+                                             const Future<BSONObj>& reply) {
+            if ( !hook )
+                return reply;
+
+            Promise<BSONObj> promise;
+            reply.onReady( stdx::bind( &runPostCommandHook,
+                                       hook,
+                                       host,
+                                       promise,
+                                       stdx::placeholders::_1 ) );
+            return promise.getFuture();
+        }
+
+    } // namespace
+
+    Future<BSONObj> DBClientBase::asyncFindOne( const string &ns,
+                                                const Query& query,
+                                                const BSONObj *fieldsToReturn,
+                                                int queryOptions ) {
+        try {
+            return Future<BSONObj>::makeReady( findOne( ns, query, fieldsToReturn, queryOptions ) );
+        }
+        catch ( const DBException& e ) {
+            return Future<BSONObj>::makeError( e.toStatus() );
+        }
+    }
+
+    Future<BSONObj> DBClientBase::asyncRunCommand( const string &dbname,
+                                                   const BSONObj& cmd,
+                                                   int options ) {
+        const string ns = dbname + ".$cmd";
+
+        Future<BSONObj> reply;
+        if ( _runCommandHook ) {
+            BSONObjBuilder cmdObj;
+            cmdObj.appendElements( cmd );
+            // errors go through the future, including the hook's
+            try {
+                _runCommandHook( &cmdObj );
+            }
+            catch ( const DBException& e ) {
+                return Future<BSONObj>::makeError( e.toStatus() );
+            }
+            catch ( const std::exception& e ) {
+                return Future<BSONObj>::makeError( Status( ErrorCodes::InternalError,
+                                                           e.what() ) );
+            }
+            reply = asyncFindOne( ns, cmdObj.done(), 0, options );
+        }
+        else {
+            reply = asyncFindOne( ns, cmd, 0, options );
+        }
+
+        return afterPostCommandHook( _postRunCommandHook, getServerAddress(), reply );
+    }
+
+    BSONObj DBClientBase::_runCommand( const string& ns, Message& toSend ) {
+        BSONObj info = _findOne( ns, toSend );
+        if ( _postRunCommandHook ) {
+            _postRunCommandHook( info, getServerAddress() );
+        }
+        return info;
+    }
+
+    Future<BSONObj> DBClientBase::_asyncRunCommand( const string& ns, Message& toSend ) {
+        return afterPostCommandHook( _postRunCommandHook,
+                                     getServerAddress(),
+                                     _asyncFindOne( ns, toSend ) );
+    }
+
+    BSONObj DBClientBase::_findOne( const string& ns, Message& toSend ) {
+        DBClientCursor cursor( this, ns, BSONObj(), 1, 0, 0, 0, 0 );
+        Message reply;
+        uassert( 10276, str::stream() << "DBClientBase::findN: transport error: "
+                                      << getServerAddress() << " ns: " << ns,
+                 call( toSend, reply, false, &cursor._originalHost ) && !reply.empty() );
+        cursor.dataReceived( reply );
+        return cursor.more() ? cursor.nextSafe().copy() : BSONObj();
+    }
+
+    Future<BSONObj> DBClientBase::_asyncFindOne( const string& ns, Message& toSend ) {
+        try {
+            return Future<BSONObj>::makeReady( _findOne( ns, toSend ) );
+        }
+        catch ( const DBException& e ) {
+            return Future<BSONObj>::makeError( e.toStatus() );
+        }
+    }
+
+    struct DBClientBase::AsyncInsert {
+        ScopedWriteOperations inserts;
+        Promise<WriteResult> promise;
+    };
+
+    Future<WriteResult> DBClientBase::asyncInsert( const string &ns,
+                                                   const vector<BSONObj>& v,
+                                                   int flags,
+                                                   const WriteConcern* wc ) {
+        const WriteConcern* operationWriteConcern = wc ? wc : &getWriteConcern();
+        const bool ordered = !(flags & InsertOption_ContinueOnError);
+
+        boost::shared_ptr<AsyncInsert> insert( new AsyncInsert() );
+        BSONArrayBuilder documents;
+        int batchSize = 0;
+
+        // Only a single insert command can be matched up with its reply asynchronously, and
+        // only when the server speaks write commands; everything else goes the usual way.
+        bool singleCommand = getMaxWireVersion() >= 2 &&
+                             operationWriteConcern->requiresConfirmation() &&
+                             !v.empty() &&
+                             static_cast<int>(v.size()) <= getMaxWriteBatchSize();
+
+        for ( vector<BSONObj>::const_iterator it = v.begin(); singleCommand && it != v.end(); ++it ) {
+            // the operations outlive the call, and refer to the documents rather than copying them
+            insert->inserts.enqueue( new InsertWriteOperation( it->getOwned() ) );
+            batchSize += insert->inserts.ops.back()->incrementalSize();
+            singleCommand = batchSize + 8 * 1024 <= getMaxBsonObjectSize();
+            if ( singleCommand )
+                insert->inserts.ops.back()->appendSelfToCommand( &documents );
+        }
+
+        if ( !singleCommand ) {
+            try {
+                ScopedWriteOperations inserts;
+                for ( vector<BSONObj>::const_iterator it = v.begin(); it != v.end(); ++it ) {
+                    uassert(0, "document to be inserted exceeds maxBsonObjectSize",
+                            it->objsize() <= getMaxBsonObjectSize());
+                    inserts.enqueue( new InsertWriteOperation( *it ) );
+                }
+
+                WriteResult writeResult;
+                _write( ns, inserts.ops, ordered, operationWriteConcern, &writeResult );
+                return Future<WriteResult>::makeReady( writeResult );
+            }
+            catch ( const DBException& e ) {
+                return Future<WriteResult>::makeError( e.toStatus() );
+            }
+        }
+
+        BSONObjBuilder command;
+        insert->inserts.ops.front()->startCommand( ns, &command );
+        command.append( insert->inserts.ops.front()->batchName(), documents.arr() );
+        command.append( "ordered", ordered );
+        command.append( "writeConcern", operationWriteConcern->obj() );
+
+        asyncRunCommand( nsToDatabase( ns ), command.obj() ).onReady(
+            stdx::bind( &DBClientBase::_finishAsyncInsert, insert, stdx::placeholders::_1 ) );
+        return insert->promise.getFuture();
+    }
+
+    void DBClientBase::_finishAsyncInsert( const boost::shared_ptr<AsyncInsert>& insert,
+                                           const Future<BSONObj>& reply ) {
+        if ( !reply.getStatus().isOK() ) {
+            insert->promise.setError( reply.getStatus() );
+            return;
+        }
+
+        try {
+            const BSONObj& result = reply.get();
+            if ( !result["ok"].trueValue() )
+                throw OperationException( result );
+
+            WriteResult writeResult;
+            writeResult._mergeCommandResult( insert->inserts.ops, result );
+            writeResult._check( true );
+            insert->promise.setValue( writeResult );
+        }
+        catch ( const DBException& e ) {
+            insert->promise.setError( e.toStatus() );
+        }
+    }
+
+    Future<boost::shared_ptr<DBClientCursor> > DBClientBase::asyncGetMore( const string &ns,
+                                                                            long long cursorId,
+                                                                            int nToReturn,
+                                                                            int options ) {
+        typedef Future<boost::shared_ptr<DBClientCursor> > CursorFuture;
+        try {
+            auto_ptr<DBClientCursor> cursor = getMore( ns, cursorId, nToReturn, options );
+            uassert( 10276, str::stream() << "DBClientBase::asyncGetMore: transport error: "
+                                          << getServerAddress() << " ns: " << ns,
+                     cursor.get() );
+            return CursorFuture::makeReady( boost::shared_ptr<DBClientCursor>( cursor.release() ) );
+        }
+        catch ( const DBException& e ) {
+            return CursorFuture::makeError( e.toStatus() );
+        }
+    }
+
     void DBClientBase::remove( const string & ns , Query obj , bool justOne, const WriteConcern* wc ) {
         remove( ns, obj, justOne & RemoveOption_JustOne, wc);
     }
@@ -2348,6 +2674,7 @@ namespace mongo {
         CHECK_OBJECT( query , "assembleRequest query" );
         // see query.h for the protocol we are using here.
         BufBuilder b;
+        b.skip(MsgData::MsgDataHeaderSize);
         int opts = queryOptions;
         b.appendNum(opts);
         b.appendStr(ns);
@@ -2356,13 +2683,17 @@ namespace mongo {
         query.appendSelfToBufBuilder(b);
         if ( fieldsToReturn )
             fieldsToReturn->appendSelfToBufBuilder(b);
-        toSend.setData(dbQuery, b.buf(), b.len());
+        toSend.setData(dbQuery, b);
     }
 
     void DBClientConnection::say( Message &toSend, bool isRetry , string * actualServer ) {
         checkConnection();
         try {
-            port().say( toSend );
+            _sendDeferredKills( true );
+            if ( _pipeline )
+                _pipeline->say( toSend );
+            else
+                port().say( toSend );
         }
         catch( SocketException & ) {
             _failed = true;
@@ -2371,10 +2702,40 @@ namespace mongo {
     }
 
     void DBClientConnection::sayPiggyBack( Message &toSend ) {
-        port().piggyBack( toSend );
+        // as in say(), so nothing is held back on a port a reconnect is about to replace
+        checkConnection();
+        try {
+            _sendDeferredKills( true );
+            if ( _pipeline )
+                _pipeline->piggyBack( toSend );
+            else
+                port().piggyBack( toSend );
+        }
+        catch( SocketException & ) {
+            _failed = true;
+            throw;
+        }
+    }
+
+    void DBClientConnection::flush() {
+        try {
+            _sendDeferredKills( true );
+            if ( _pipeline )
+                _pipeline->flush();
+            else if ( p )
+                p->flush();
+        }
+        catch( SocketException & ) {
+            _failed = true;
+            throw;
+        }
     }
 
     bool DBClientConnection::recv( Message &m ) {
+        uassert( ErrorCodes::IllegalOperation,
+                 "cannot receive unsolicited replies on a pipelined connection",
+                 !_pipeline );
+
         if (port().recv(m)) {
             return true;
         }
@@ -2389,7 +2750,22 @@ namespace mongo {
                  it fails
         */
         checkConnection();
+
+        if ( _pipeline ) {
+            MessagePipeline::ReplyFuture reply = asyncCall( toSend );
+            if ( !reply.getStatus().isOK() ) {
+                _failed = true;
+                if ( assertOk )
+                    uasserted( 10278 , str::stream() << "dbclient error communicating with server: " << getServerAddress() );
+
+                return false;
+            }
+            response = *reply.get();
+            return true;
+        }
+
         try {
+            _sendDeferredKills( true );
             if ( !port().call(toSend, response) ) {
                 _failed = true;
                 if ( assertOk )
@@ -2405,6 +2781,112 @@ namespace mongo {
         return true;
     }
 
+    MessagePipeline::ReplyFuture DBClientConnection::asyncCall( Message& toSend ) {
+        uassert( ErrorCodes::IllegalOperation,
+                 "asyncCall requires a pipelined connection",
+                 _pipelined );
+        checkConnection();
+        verify( _pipeline );
+        try {
+            _sendDeferredKills( true );
+            return _pipeline->call( toSend );
+        }
+        catch( SocketException & ) {
+            _failed = true;
+            throw;
+        }
+    }
+
+    Future<BSONObj> DBClientConnection::asyncFindOne( const string &ns,
+                                                      const Query& query,
+                                                      const BSONObj *fieldsToReturn,
+                                                      int queryOptions ) {
+        if ( !_pipelined )
+            return DBClientBase::asyncFindOne( ns, query, fieldsToReturn, queryOptions );
+
+        Message toSend;
+        assembleRequest( ns, query.obj, 1, 0, fieldsToReturn, queryOptions, toSend );
+        return _asyncFindOne( ns, toSend );
+    }
+
+    Future<BSONObj> DBClientConnection::_asyncFindOne( const string& ns, Message& toSend ) {
+        if ( !_pipelined )
+            return DBClientBase::_asyncFindOne( ns, toSend );
+
+        boost::shared_ptr<DBClientCursor> cursor(
+            new DBClientCursor( this, ns, BSONObj(), 1, 0, 0, 0, 0 ) );
+        Promise<BSONObj> promise;
+        try {
+            asyncCall( toSend ).onReady( stdx::bind( &DBClientConnection::_finishAsyncFindOne,
+                                                     cursor,
+                                                     promise,
+                                                     stdx::placeholders::_1 ) );
+        }
+        catch ( const DBException& e ) {
+            return Future<BSONObj>::makeError( e.toStatus() );
+        }
+        return promise.getFuture();
+    }
+
+    void DBClientConnection::_finishAsyncFindOne( const boost::shared_ptr<DBClientCursor>& cursor,
+                                                  Promise<BSONObj> promise,
+                                                  const MessagePipeline::ReplyFuture& reply ) {
+        if ( !reply.getStatus().isOK() ) {
+            promise.setError( reply.getStatus() );
+            return;
+        }
+
+        try {
+            cursor->dataReceived( *reply.get() );
+            promise.setValue( cursor->more() ? cursor->nextSafe().getOwned() : BSONObj() );
+        }
+        catch ( const DBException& e ) {
+            promise.setError( e.toStatus() );
+        }
+    }
+
+    Future<boost::shared_ptr<DBClientCursor> > DBClientConnection::asyncGetMore( const string &ns,
+                                                                                  long long cursorId,
+                                                                                  int nToReturn,
+                                                                                  int options ) {
+        if ( !_pipelined )
+            return DBClientBase::asyncGetMore( ns, cursorId, nToReturn, options );
+
+        boost::shared_ptr<DBClientCursor> cursor(
+            new DBClientCursor( this, ns, cursorId, nToReturn < 0 ? abs(nToReturn) : 0, options, abs(nToReturn) ) );
+        Promise<boost::shared_ptr<DBClientCursor> > promise;
+        try {
+            Message toSend;
+            cursor->_assembleInit( toSend );
+            asyncCall( toSend ).onReady( stdx::bind( &DBClientConnection::_finishAsyncGetMore,
+                                                     cursor,
+                                                     promise,
+                                                     stdx::placeholders::_1 ) );
+        }
+        catch ( const DBException& e ) {
+            // The server still has the cursor; it is up to the caller to try again or kill it.
+            cursor->decouple();
+            return Future<boost::shared_ptr<DBClientCursor> >::makeError( e.toStatus() );
+        }
+        return promise.getFuture();
+    }
+
+    void DBClientConnection::_finishAsyncGetMore( const boost::shared_ptr<DBClientCursor>& cursor,
+                                                  Promise<boost::shared_ptr<DBClientCursor> > promise,
+                                                  const MessagePipeline::ReplyFuture& reply ) {
+        try {
+            uassertStatusOK( reply.getStatus() );
+            cursor->dataReceived( *reply.get() );
+        }
+        catch ( const DBException& e ) {
+            // Don't let the cursor try to kill itself from the reply thread.
+            cursor->decouple();
+            promise.setError( e.toStatus() );
+            return;
+        }
+        promise.setValue( cursor );
+    }
+
     BSONElement getErrField(const BSONObj& o) {
         BSONElement first = o.firstElement();
         if( strcmp(first.fieldName(), "$err") == 0 )
@@ -2445,18 +2927,51 @@ namespace mongo {
     }
 
     void DBClientConnection::killCursor( long long cursorId ) {
-        StackBufBuilder b;
+        vector<long long> ids;
+        {
+            boost::lock_guard<boost::mutex> lk( _deferredKillsMutex );
+            _deferredKills.push_back( cursorId );
+
+            const size_t batchSize = client::Options::current().killCursorsBatchSize();
+            if ( !_lazyKillCursor || _deferredKills.size() >= batchSize )
+                ids.swap( _deferredKills );
+        }
+
+        if ( !ids.empty() )
+            _sendKills( ids, false );
+    }
+
+    void DBClientConnection::_sendDeferredKills( bool piggyBack ) {
+        vector<long long> ids;
+        {
+            boost::lock_guard<boost::mutex> lk( _deferredKillsMutex );
+            if ( _deferredKills.empty() )
+                return;
+            ids.swap( _deferredKills );
+        }
+        _sendKills( ids, piggyBack );
+    }
+
+    void DBClientConnection::_sendKills( const vector<long long>& ids, bool piggyBack ) {
+        if ( !p || _failed )
+            return; // the cursors went with the connection
+
+        BufBuilder b;
+        b.skip( MsgData::MsgDataHeaderSize );
         b.appendNum( (int)0 ); // reserved
-        b.appendNum( (int)1 ); // number
-        b.appendNum( cursorId );
+        b.appendNum( (int)ids.size() ); // number
+        for ( vector<long long>::const_iterator it = ids.begin(); it != ids.end(); ++it )
+            b.appendNum( *it );
 
         Message m;
-        m.setData( dbKillCursors , b.buf() , b.len() );
-        
-        if ( _lazyKillCursor )
-            sayPiggyBack( m );
+        m.setData( dbKillCursors , b );
+
+        if ( !piggyBack )
+            say( m );
+        else if ( _pipeline )
+            _pipeline->piggyBack( m );
         else
-            say(m);
+            p->piggyBack( m );
     }
 
 #ifdef MONGO_SSL
@@ -56,12 +56,17 @@
 
 #include "mongo/client/autolib.h"
 
+#include "mongo/client/bulk_writer.h"
+#include "mongo/client/connection_pool.h"
 #include "mongo/client/dbclient_rs.h"
 #include "mongo/client/dbclientcursor.h"
 #include "mongo/client/dbclientinterface.h"
+#include "mongo/client/exhaust_reader.h"
 #include "mongo/client/gridfs.h"
 #include "mongo/client/init.h"
+#include "mongo/client/merge_sorted_cursor.h"
 #include "mongo/client/options.h"
+#include "mongo/client/parallel_collection_scan.h"
 #include "mongo/client/sasl_client_authenticate.h"
 #include "mongo/geo/interface.h"
 #include "mongo/version.h"
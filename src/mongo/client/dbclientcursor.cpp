@@ -21,11 +21,14 @@
 
 #include "mongo/client/dbclientcursor.h"
 
+#include <limits>
+
 #include "mongo/db/dbmessage.h"
 #include "mongo/db/namespace_string.h"
 #include "mongo/util/debug_util.h"
 #include "mongo/client/dbclientcursorshim.h"
 #include "mongo/util/log.h"
+#include "mongo/util/time_support.h"
 
 namespace mongo {
 
@@ -48,7 +51,10 @@ namespace mongo {
         resultFlags(0),
         cursorId(),
         _ownCursor( true ),
-        wasError( false ) {
+        wasError( false ),
+        _prefetch( false ),
+        _roundTripMicros( -1 ),
+        _batchReceivedMicros( 0 ) {
         _finishConsInit();
     }
 
@@ -64,7 +70,10 @@ namespace mongo {
         resultFlags(0),
         cursorId(_cursorId),
         _ownCursor(true),
-        wasError(false) {
+        wasError(false),
+        _prefetch(false),
+        _roundTripMicros(-1),
+        _batchReceivedMicros(0) {
         _finishConsInit();
     }
 
@@ -75,16 +84,52 @@ namespace mongo {
     }
 
     int DBClientCursor::nextBatchSize() {
+        int size = batchSize;
+        if (_batchSizer.get() && batchSize >= 0) {
+            const int adaptive = _batchSizer->next();
+            if (adaptive && (!batchSize || adaptive < batchSize))
+                size = adaptive;
+        }
+
         if (nToReturn) {
-            int remaining = nToReturn - nReturned;
+            // the rest of the current batch counts too, in case it hasn't all been read yet
+            int remaining = nToReturn - nReturned - (batch.nReturned - batch.pos);
 
-            if (batchSize && batchSize < remaining)
-                return batchSize;
+            if (size && size < remaining)
+                return size;
 
             return -remaining;
         }
 
-        return batchSize;
+        return size;
+    }
+
+    void DBClientCursor::setAdaptiveBatchSize(int targetBytes) {
+        if (targetBytes <= 0) {
+            _batchSizer.reset();
+            return;
+        }
+
+        // Hold at most a few times the target in memory, however fast the consumer is.
+        const int maxBytes = targetBytes < std::numeric_limits<int>::max() / 4 ?
+            targetBytes * 4 : std::numeric_limits<int>::max();
+        _batchSizer.reset(new BatchSizer(targetBytes, maxBytes));
+
+        // Learn from the batch already here, if any.
+        if (batch.nReturned)
+            _recordBatch();
+    }
+
+    BatchSizer::Stats DBClientCursor::getBatchSizerStats() const {
+        if (!_batchSizer.get())
+            return BatchSizer::Stats();
+        return _batchSizer->getStats();
+    }
+
+    void DBClientCursor::_recordBatch() {
+        const char* start = batch.m->singleData().view2ptr();
+        const int bytes = batch.m->size() - (batch.data - start);
+        _batchSizer->recordBatch(batch.nReturned, bytes, _roundTripMicros);
     }
 
     void DBClientCursor::_assembleInit( Message& toSend ) {
@@ -92,15 +137,20 @@ namespace mongo {
             assembleRequest( ns, query, nextBatchSize() , nToSkip, fieldsToReturn, opts, toSend );
         }
         else {
-            BufBuilder b;
-            b.appendNum( opts );
-            b.appendStr( ns );
-            b.appendNum( nextBatchSize() );
-            b.appendNum( cursorId );
-            toSend.setData( dbGetMore, b.buf(), b.len() );
+            _assembleGetMore( toSend );
         }
     }
 
+    void DBClientCursor::_assembleGetMore( Message& toSend ) {
+        BufBuilder b;
+        b.skip( MsgData::MsgDataHeaderSize );
+        b.appendNum( opts );
+        b.appendStr( ns );
+        b.appendNum( nextBatchSize() );
+        b.appendNum( cursorId );
+        toSend.setData( dbGetMore, b );
+    }
+
     bool DBClientCursor::init() {
         Message toSend;
         _assembleInit( toSend );
@@ -178,21 +228,51 @@ namespace mongo {
     void DBClientCursor::requestMore() {
         verify( cursorId && batch.pos == batch.nReturned );
 
-        BufBuilder b;
-        b.appendNum(opts);
-        b.appendStr(ns);
-        b.appendNum(nextBatchSize());
-        b.appendNum(cursorId);
+        if ( _batchSizer.get() )
+            _batchSizer->recordConsumed( batch.nReturned, curTimeMicros64() - _batchReceivedMicros );
 
-        Message toSend;
-        toSend.setData(dbGetMore, b.buf(), b.len());
         auto_ptr<Message> response(new Message());
+        if ( _prefetched.valid() ) {
+            // how long it took is hidden by the time spent on the previous batch
+            MessagePipeline::ReplyFuture reply = _prefetched;
+            _prefetched = MessagePipeline::ReplyFuture();
+            *response = *reply.get();
+        }
+        else {
+            Message toSend;
+            _assembleGetMore( toSend );
+            const unsigned long long start = curTimeMicros64();
+            _client->call( toSend, *response );
+            _roundTripMicros = curTimeMicros64() - start;
+        }
 
-        _client->call( toSend, *response );
         this->batch.m = response;
         dataReceived();
     }
 
+    void DBClientCursor::_startPrefetch() {
+        if ( !cursorId || tailable() || ( opts & QueryOption_Exhaust ) )
+            return;
+
+        // nothing left to fetch if the limit is reached with this batch
+        if ( nToReturn && nReturned + ( batch.nReturned - batch.pos ) >= nToReturn )
+            return;
+
+        DBClientConnection* conn = dynamic_cast<DBClientConnection*>( _client );
+        if ( !conn || !conn->isPipelined() )
+            return;
+
+        Message toSend;
+        _assembleGetMore( toSend );
+        try {
+            _prefetched = conn->asyncCall( toSend );
+        }
+        catch ( const DBException& e ) {
+            // requestMore() will find out what is wrong with the connection
+            LOG(1) << "prefetching next batch of " << ns << " failed: " << e.toString();
+        }
+    }
+
     /** with QueryOption_Exhaust, the server just blasts data at us (marked at end with cursorid==0). */
     void DBClientCursor::exhaustReceiveMore() {
         verify( cursorId && batch.pos == batch.nReturned );
@@ -232,6 +312,11 @@ namespace mongo {
         batch.pos = 0;
         batch.data = qr.data();
 
+        if ( _batchSizer.get() )
+            _recordBatch();
+        _roundTripMicros = -1;
+        _batchReceivedMicros = curTimeMicros64();
+
         _client->checkResponse( batch.data, batch.nReturned, &retry, &host ); // watches for "not master"
 
         /* this assert would fire the way we currently work:
@@ -274,8 +359,11 @@ namespace mongo {
         uassert(13422, "DBClientCursor next() called but more() is false", batch.pos < batch.nReturned);
 
         batch.pos++;
-        BSONObj o(batch.data);
+        BSONObj o(batch.data, batch.m->sharedBuffer());
         batch.data += o.objsize();
+
+        if ( _prefetch && !_prefetched.valid() && batch.pos * 2 >= batch.nReturned )
+            _startPrefetch();
         /* todo would be good to make data null at end of batch for safety */
         return o;
     }
@@ -323,7 +411,7 @@ namespace mongo {
         int p = batch.pos;
         const char *d = batch.data;
         while( m && p < batch.nReturned ) {
-            BSONObj o(d);
+            BSONObj o(d, batch.m->sharedBuffer());
             d += o.objsize();
             p++;
             m--;
@@ -356,19 +444,26 @@ namespace mongo {
         DESTRUCTOR_GUARD (
 
         if ( cursorId && _ownCursor ) {
-            BufBuilder b;
-            b.appendNum( (int)0 ); // reserved
-            b.appendNum( (int)1 ); // number
-            b.appendNum( cursorId );
-            
-            Message m;
-            m.setData( dbKillCursors , b.buf() , b.len() );
-
-            // Kill the cursor the same way the connection itself would.  Usually, non-lazily
-            if( DBClientConnection::getLazyKillCursor() )
-                _client->sayPiggyBack( m );
-            else
-                _client->say( m );
+            // Connections collect the ids of killed cursors to send several in one message.
+            DBClientConnection* conn = dynamic_cast<DBClientConnection*>( _client );
+            if ( conn ) {
+                conn->killCursor( cursorId );
+            }
+            else {
+                BufBuilder b;
+                b.appendNum( (int)0 ); // reserved
+                b.appendNum( (int)1 ); // number
+                b.appendNum( cursorId );
+
+                Message m;
+                m.setData( dbKillCursors , b.buf() , b.len() );
+
+                // Kill the cursor the same way the connection itself would.  Usually, non-lazily
+                if( DBClientConnection::getLazyKillCursor() )
+                    _client->sayPiggyBack( m );
+                else
+                    _client->say( m );
+            }
         }
 
         );
@@ -19,6 +19,7 @@
 
 #include <stack>
 
+#include "mongo/client/batch_sizer.h"
 #include "mongo/client/dbclientinterface.h"
 #include "mongo/client/export_macros.h"
 #include "mongo/db/jsobj.h"
@@ -65,8 +66,14 @@ namespace mongo {
              { $err: <string> }
            if you do not want to handle that yourself, call nextSafe().
 
-           Warning: The returned BSONObj will become invalid after the next batch
-               is fetched or when this cursor is destroyed.
+           The returned BSONObj shares the buffer of the batch it came from, so it stays
+               valid after the next batch is fetched or the cursor is destroyed, without a
+               copy. Keeping it keeps the whole batch in memory; use copy() to keep just the
+               object.
+
+           Warning: If the batch didn't come off the network, as for initCommand(), the
+               returned BSONObj will become invalid after the next batch is fetched or when
+               this cursor is destroyed. isOwned() tells the two apart.
         */
         BSONObj next();
 
@@ -126,6 +133,32 @@ namespace mongo {
         /// Change batchSize after construction. Can change after requesting first batch.
         void setBatchSize(int newBatchSize) { batchSize = newBatchSize; }
 
+        /**
+         * In prefetch mode the getMore for the next batch is sent once half of the current
+         * batch has been read, so that it has usually arrived by the time the batch runs out.
+         * The current batch is only replaced once it has all been read, so objects returned by
+         * next() behave just as without prefetching.
+         *
+         * Prefetching needs a pipelined DBClientConnection (see
+         * DBClientConnection::setPipelined), and isn't done for tailable or exhaust cursors.
+         * Otherwise batches are fetched as usual.
+         */
+        void setPrefetch(bool prefetch) { _prefetch = prefetch; }
+        bool prefetch() const { return _prefetch; }
+
+        /** Whether the getMore for the next batch has been sent ahead and not yet used. */
+        bool prefetchPending() const { return _prefetched.valid(); }
+
+        /**
+         * Lets the cursor choose how many documents each getMore asks for, aiming at batches of
+         * about 'targetBytes' (see BatchSizer). A batchSize set on the cursor is still the most
+         * it asks for. 0, the default, turns adaptive sizing off.
+         */
+        void setAdaptiveBatchSize(int targetBytes);
+
+        /** What adaptive batch sizing has seen and decided so far; all zero when it is off. */
+        BatchSizer::Stats getBatchSizerStats() const;
+
         DBClientCursor( DBClientBase* client, const std::string &_ns, BSONObj _query, int _nToReturn,
                         int _nToSkip, const BSONObj *_fieldsToReturn, int queryOptions , int bs );
         DBClientCursor( DBClientBase* client, const std::string &_ns, long long _cursorId, int _nToReturn, int options, int _batchSize );
@@ -180,6 +213,7 @@ namespace mongo {
         friend class DBClientCursorShimArray;
         friend class DBClientCursorShimTransform;
         friend class DBClientWithCommands;
+        friend class ExhaustReader;
 
         int nextBatchSize();
         void _finishConsInit();
@@ -210,9 +244,24 @@ namespace mongo {
 
         void dataReceived() { bool retry; std::string lazyHost; dataReceived( retry, lazyHost ); }
         void dataReceived( bool& retry, std::string& lazyHost );
+
+        // Takes over 'reply' as the current batch, for replies received elsewhere.
+        void dataReceived( Message& reply ) { *batch.m = reply; dataReceived(); }
         void requestMore();
         void exhaustReceiveMore(); // for exhaust
 
+        // Prefetch mode; see setPrefetch(). _prefetched is the reply to a getMore sent ahead.
+        bool _prefetch;
+        MessagePipeline::ReplyFuture _prefetched;
+        void _startPrefetch();
+
+        // Adaptive batch sizing; see setAdaptiveBatchSize(). _roundTripMicros is the time the
+        // batch being received took to arrive, or -1 if that isn't known.
+        std::auto_ptr<BatchSizer> _batchSizer;
+        long long _roundTripMicros;
+        unsigned long long _batchReceivedMicros;
+        void _recordBatch();
+
         // Don't call from a virtual function
         void _assertIfNull() const { uassert(13348, "connection died", this); }
 
@@ -222,6 +271,7 @@ namespace mongo {
 
         // init pieces
         void _assembleInit( Message& toSend );
+        void _assembleGetMore( Message& toSend );
     };
 
     /** iterate over objects in current batch only - will not cause a network call
@@ -63,7 +63,7 @@ namespace mongo  {
             uassert(0, "DBClientCursorShimArray next() called but more() is false", more());
         }
         else {
-            b = iter.next().Obj();
+            b = BSONObj(iter.next().Obj().objdata(), cursor.getMessage()->sharedBuffer());
         }
 
         return b;
@@ -59,8 +59,10 @@ namespace mongo  {
     }
 
     BSONObj DBClientCursorShimCursorID::next() {
-        if (in_first_batch && iter.more())
-            return iter.next().Obj();
+        if (in_first_batch && iter.more()) {
+            // the first batch is in the reply the cursor still holds
+            return BSONObj(iter.next().Obj().objdata(), cursor.getMessage()->sharedBuffer());
+        }
 
         return cursor.rawNext();
     }
@@ -26,6 +26,7 @@
 #include "mongo/config.h"
 
 #include "mongo/base/string_data.h"
+#include "mongo/client/batch_dispatcher.h"
 #include "mongo/client/bulk_operation_builder.h"
 #include "mongo/client/exceptions.h"
 #include "mongo/client/export_macros.h"
@@ -36,8 +37,10 @@
 #include "mongo/logger/log_severity.h"
 #include "mongo/platform/atomic_word.h"
 #include "mongo/stdx/functional.h"
+#include "mongo/util/concurrency/future.h"
 #include "mongo/util/mongoutils/str.h"
 #include "mongo/util/net/message.h"
+#include "mongo/util/net/message_pipeline.h"
 #include "mongo/util/net/message_port.h"
 
 namespace mongo {
@@ -1329,6 +1332,8 @@ namespace mongo {
      */
     class MONGO_CLIENT_API DBClientBase : public DBClientWithCommands, public DBConnector {
     friend class BulkOperationBuilder;
+    friend class BulkWriter;
+    friend class CommandWriter;
     protected:
         static AtomicInt64 ConnectionIdSequence;
         long long _connectionId; // unique connection id for this connection
@@ -1345,6 +1350,22 @@ namespace mongo {
             const WriteConcern* writeConcern,
             WriteResult* writeResult
         );
+
+        /**
+         * Runs a command which has already been assembled into 'toSend', as a query for one
+         * document on 'ns', a database's $cmd collection. Returns the reply as runCommand()
+         * returns it in 'info', after the post-command hook. The run-command hook is up to
+         * whoever assembled the command.
+         */
+        BSONObj _runCommand( const std::string& ns, Message& toSend );
+
+        /** As _runCommand(), but only waits for the reply if the connection isn't pipelined. */
+        Future<BSONObj> _asyncRunCommand( const std::string& ns, Message& toSend );
+
+        /** Sends the query in 'toSend' and returns the first document of the reply. */
+        BSONObj _findOne( const std::string& ns, Message& toSend );
+        virtual Future<BSONObj> _asyncFindOne( const std::string& ns, Message& toSend );
+
     public:
         static const uint64_t INVALID_SOCK_CREATION_TIME;
 
@@ -1397,6 +1418,7 @@ namespace mongo {
          * @note Warning: One must delete any new connections created by the connection factory
          *  after use.
          *
+         * @see ParallelCollectionScan, which drains the cursors on its own threads.
          * @see example usage in dbclient_test.cpp -> DBClientTest/ParallelCollectionScan
          *
          * @param ns The namespace to scan
@@ -1439,6 +1461,20 @@ namespace mongo {
                                           const BSONObj *fieldsToReturn = 0,
                                           int queryOptions = 0 );
 
+        /** Like query( f, ... ) above, but runs 'f' on a pool of worker threads while the results
+            are still being read, so that heavy processing of each document doesn't hold up the
+            reads. 'f' may be called concurrently unless 'options' asks for order.
+
+            Batches wait in a bounded queue for the workers; when it is full, reading waits.
+            Returns once every document has been handled, and throws the first error from 'f'.
+         */
+        unsigned long long query( stdx::function<void(const BSONObj&)> f,
+                                  const BatchDispatcher::Options& options,
+                                  const std::string& ns,
+                                  Query query,
+                                  const BSONObj *fieldsToReturn = 0,
+                                  int queryOptions = 0 );
+
 
         /** don't use this - called automatically by DBClientCursor for you
             @param cursorId id of cursor to retrieve
@@ -1447,6 +1483,44 @@ namespace mongo {
          */
         virtual std::auto_ptr<DBClientCursor> getMore( const std::string &ns, long long cursorId, int nToReturn = 0, int options = 0 );
 
+        /**
+         * Asynchronous versions of findOne(), runCommand(), insert() and getMore(). Each sends
+         * its request and returns a future for the result without waiting for the reply, so
+         * several independent requests can be outstanding at once and awaited together.
+         *
+         * Requests only overlap on connections that support it, i.e. a pipelined
+         * DBClientConnection. Other connections run the operation synchronously and return a
+         * future which is already ready. Errors are reported through the future, not thrown.
+         *
+         * The calls themselves must still come from one thread at a time, but the futures may
+         * be waited on from any thread. Callbacks registered with Future::onReady() run on the
+         * connection's reply thread and must not block or use the connection.
+         */
+        virtual Future<BSONObj> asyncFindOne( const std::string &ns,
+                                              const Query& query,
+                                              const BSONObj *fieldsToReturn = 0,
+                                              int queryOptions = 0 );
+
+        /** The result is the command's reply, as runCommand() would return it in 'info'. */
+        Future<BSONObj> asyncRunCommand( const std::string &dbname,
+                                         const BSONObj& cmd,
+                                         int options = 0 );
+
+        /**
+         * Only overlaps with other requests when the documents fit into a single insert
+         * command; unacknowledged and larger inserts are done synchronously.
+         */
+        Future<WriteResult> asyncInsert( const std::string &ns,
+                                         const std::vector<BSONObj>& v,
+                                         int flags = 0,
+                                         const WriteConcern* wc = NULL );
+
+        /** The result is a cursor positioned at the start of the batch that was retrieved. */
+        virtual Future<boost::shared_ptr<DBClientCursor> > asyncGetMore( const std::string &ns,
+                                                                          long long cursorId,
+                                                                          int nToReturn = 0,
+                                                                          int options = 0 );
+
         /**
            insert an object into the database
          */
@@ -1491,6 +1565,11 @@ namespace mongo {
          * Initializes an ordered bulk operation by returning an object that can be
          * used to enqueue multiple operations for batch execution.
          *
+         * The write commands for an unordered bulk operation are all sent before waiting for
+         * any reply, so on a pipelined connection they run back to back on the server. Servers
+         * without write commands get each write followed by its getLastError, likewise all
+         * sent before waiting for any reply.
+         *
          * @param ns Namespace on which to apply the operations.
          * @see BulkOperationBuilder
          */
@@ -1535,6 +1614,12 @@ namespace mongo {
 
         virtual void reset() {}
 
+    private:
+        struct AsyncInsert;
+
+        static void _finishAsyncInsert( const boost::shared_ptr<AsyncInsert>& insert,
+                                        const Future<BSONObj>& reply );
+
     }; // DBClientBase
 
     class DBClientReplicaSet;
@@ -1559,11 +1644,12 @@ namespace mongo {
            Connect timeout is fixed, but short, at 5 seconds.
          */
         DBClientConnection(bool _autoReconnect=false, DBClientReplicaSet* cp=0, double so_timeout=0) :
-            clientSet(cp), _failed(false), autoReconnect(_autoReconnect), autoReconnectBackoff(1000, 2000), _so_timeout(so_timeout) {
+            clientSet(cp), _failed(false), autoReconnect(_autoReconnect), autoReconnectBackoff(1000, 2000), _so_timeout(so_timeout), _pipelined(false) {
             _numConnections.fetchAndAdd(1);
         }
 
         virtual ~DBClientConnection() {
+            DESTRUCTOR_GUARD( _sendDeferredKills( true ); );
             _numConnections.fetchAndAdd(-1);
         }
 
@@ -1624,7 +1710,7 @@ namespace mongo {
            @return true if this connection is currently in a failed state.  When autoreconnect is on,
                    a connection will transition back to an ok state after reconnecting.
          */
-        bool isFailed() const { return _failed; }
+        bool isFailed() const { return _failed || ( _pipeline && _pipeline->isFailed() ); }
 
         bool isStillConnected() { return p ? p->isStillConnected() : true; }
 
@@ -1641,9 +1727,22 @@ namespace mongo {
         std::string getServerAddress() const { return _serverString; }
         const HostAndPort& getServerHostAndPort() const { return _server; }
 
+        /**
+         * Kills a cursor on the server. With lazy killCursors the id is collected and sent
+         * later, in one message with the ids of other cursors killed on this connection; see
+         * client::Options::setKillCursorsBatchSize().
+         */
         virtual void killCursor( long long cursorID );
         virtual bool callRead( Message& toSend , Message& response ) { return call( toSend , response ); }
         virtual void say( Message &toSend, bool isRetry = false , std::string * actualServer = 0 );
+
+        /**
+         * Sends the messages held back to be coalesced with later ones, such as the ids of
+         * lazily killed cursors and, when client::Options::writeCoalescingMaxDelayMillis() is positive,
+         * unacknowledged writes. See client::Options::setWriteCoalescingMaxBytes().
+         */
+        void flush();
+
         virtual bool recv( Message& m );
         virtual void checkResponse( const char *data, int nReturned, bool* retry = NULL, std::string* host = NULL );
         virtual bool call( Message &toSend, Message &response, bool assertOk = true , std::string * actualServer = 0 );
@@ -1669,6 +1768,35 @@ namespace mongo {
          */
         void setReplSetClientCallback(DBClientReplicaSet* rsClient);
 
+        /**
+         * Turns request pipelining on or off. In pipelined mode a request is written as soon as
+         * it is issued, without waiting for the replies to earlier requests, and a background
+         * thread matches replies to requests by their responseTo field. Use asyncCall() to
+         * have several requests outstanding at once; call() keeps working as before.
+         *
+         * The connection itself must still be used by one thread at a time, but the futures
+         * returned by asyncCall() may be waited on from any thread. Pipelining stays enabled
+         * across reconnects. It is not supported on SSL connections, nor with exhaust queries.
+         */
+        void setPipelined(bool pipelined);
+        bool isPipelined() const { return _pipelined; }
+
+        /**
+         * Sends toSend and returns a future for its reply without waiting for it. Requires
+         * pipelined mode. Throws if the request could not be sent.
+         */
+        MessagePipeline::ReplyFuture asyncCall( Message& toSend );
+
+        virtual Future<BSONObj> asyncFindOne( const std::string &ns,
+                                              const Query& query,
+                                              const BSONObj *fieldsToReturn = 0,
+                                              int queryOptions = 0 );
+
+        virtual Future<boost::shared_ptr<DBClientCursor> > asyncGetMore( const std::string &ns,
+                                                                          long long cursorId,
+                                                                          int nToReturn = 0,
+                                                                          int options = 0 );
+
         static void MONGO_CLIENT_FUNC setLazyKillCursor( bool lazy ) { _lazyKillCursor = lazy; }
         static bool MONGO_CLIENT_FUNC getLazyKillCursor() { return _lazyKillCursor; }
 
@@ -1677,6 +1805,7 @@ namespace mongo {
     protected:
         virtual void _auth(const BSONObj& params);
         virtual void sayPiggyBack( Message &toSend );
+        virtual Future<BSONObj> _asyncFindOne( const std::string& ns, Message& toSend );
 
         DBClientReplicaSet *clientSet;
         boost::scoped_ptr<MessagingPort> p;
@@ -1690,18 +1819,47 @@ namespace mongo {
         void _checkConnection();
 
         // throws SocketException if in failed state and not reconnecting or if waiting to reconnect
-        void checkConnection() { if( _failed ) _checkConnection(); }
+        void checkConnection() { if( isFailed() ) _checkConnection(); }
 
         std::map<std::string, BSONObj> authCache;
         double _so_timeout;
         bool _connect( std::string& errmsg );
 
+        // Declared after p, since the pipeline uses the port and must be destroyed first.
+        bool _pipelined;
+        boost::scoped_ptr<MessagePipeline> _pipeline;
+
         static AtomicInt32 _numConnections;
         static bool _lazyKillCursor; // lazy means we piggy back kill cursors on next op
 
+        // Ids of cursors killed lazily but not sent yet. A cursor can be destroyed on the
+        // pipeline's reply thread, so they have a mutex of their own.
+        boost::mutex _deferredKillsMutex;
+        std::vector<long long> _deferredKills;
+
+        // Sends one killCursors message for the ids in _deferredKills, to go out with the next
+        // message if 'piggyBack', or now otherwise.
+        void _sendDeferredKills( bool piggyBack );
+
+        // Sends one killCursors message for 'ids', unless the connection has failed.
+        void _sendKills( const std::vector<long long>& ids, bool piggyBack );
+
 #ifdef MONGO_SSL
         SSLManagerInterface* sslManager();
 #endif
+
+    private:
+        // Closes the connection when it gives up on an exhaust query part way.
+        friend class ExhaustReader;
+
+        // Completions for asyncFindOne() and asyncGetMore(), run on the pipeline's reader.
+        static void _finishAsyncFindOne( const boost::shared_ptr<DBClientCursor>& cursor,
+                                         Promise<BSONObj> promise,
+                                         const MessagePipeline::ReplyFuture& reply );
+
+        static void _finishAsyncGetMore( const boost::shared_ptr<DBClientCursor>& cursor,
+                                         Promise<boost::shared_ptr<DBClientCursor> > promise,
+                                         const MessagePipeline::ReplyFuture& reply );
     };
 
     /** pings server to check if it's up
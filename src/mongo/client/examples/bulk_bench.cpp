@@ -0,0 +1,107 @@
+/*    Copyright 2014 MongoDB Inc.
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+// Compares the throughput of an unordered bulk insert whose batches are written one at a
+// time against the same bulk on a pipelined connection, where they are all in flight at once.
+
+// It is the responsibility of the mongo client consumer to ensure that any necessary windows
+// headers have already been included before including the driver facade headers.
+#if defined(_WIN32)
+#include <winsock2.h>
+#include <windows.h>
+#endif
+
+#include "mongo/client/dbclient.h"
+#include "mongo/util/time_support.h"
+
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+using namespace std;
+using namespace mongo;
+
+namespace {
+
+    const char kNs[] = "test.bulk_bench";
+    const int kDocs = 100000;
+
+    void run(const char* what, DBClientBase* conn, bool ordered) {
+        conn->dropCollection(kNs);
+
+        BulkOperationBuilder bulk(conn, kNs, ordered);
+        for (int i = 0; i < kDocs; ++i)
+            bulk.insert(BSON("_id" << i << "payload" << string(100, 'x')));
+
+        const unsigned long long start = curTimeMicros64();
+        WriteResult result;
+        bulk.execute(&WriteConcern::acknowledged, &result);
+        const unsigned long long micros = curTimeMicros64() - start;
+
+        cout << what << ": " << result.nInserted() << " docs in " << micros / 1000 << "ms, "
+             << (micros ? kDocs * 1000000LL / static_cast<long long>(micros) : 0) << " docs/s"
+             << endl;
+    }
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+
+    if ( argc > 2 ) {
+        std::cout << "usage: " << argv[0] << " [MONGODB_URI]"  << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    mongo::client::GlobalInstance instance;
+    if (!instance.initialized()) {
+        std::cout << "failed to initialize the client driver: " << instance.status() << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    std::string uri = argc == 2 ? argv[1] : "mongodb://localhost:27017";
+    std::string errmsg;
+
+    ConnectionString cs = ConnectionString::parse(uri, errmsg);
+
+    if (!cs.isValid()) {
+        std::cout << "Error parsing connection string " << uri << ": " << errmsg << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    boost::scoped_ptr<DBClientBase> conn(cs.connect(errmsg));
+    if ( !conn || conn->type() != ConnectionString::MASTER ) {
+        cout << "couldn't connect to a single server: " << errmsg << endl;
+        return EXIT_FAILURE;
+    }
+    DBClientConnection* c = static_cast<DBClientConnection*>(conn.get());
+
+    try {
+        DBClientConnection pipelined;
+        pipelined.connect(c->getServerAddress());
+        pipelined.setPipelined(true);
+
+        run("ordered", c, true);
+        run("unordered", c, false);
+        run("unordered, pipelined", &pipelined, false);
+
+        c->dropCollection(kNs);
+    }
+    catch(DBException& e) {
+        cout << "caught DBException " << e.toString() << endl;
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
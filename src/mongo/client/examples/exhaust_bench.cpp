@@ -0,0 +1,137 @@
+/*    Copyright 2014 MongoDB Inc.
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+// Compares reading a whole collection with ExhaustReader against a plain cursor doing a
+// getMore for each batch.
+
+// It is the responsibility of the mongo client consumer to ensure that any necessary windows
+// headers have already been included before including the driver facade headers.
+#if defined(_WIN32)
+#include <winsock2.h>
+#include <windows.h>
+#endif
+
+#include "mongo/client/dbclient.h"
+#include "mongo/util/time_support.h"
+
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+using namespace std;
+using namespace mongo;
+
+namespace {
+
+    const char kNs[] = "test.exhaust_bench";
+    const int kDocs = 200000;
+
+    void report(const char* what, unsigned long long start, long long docs, long long sum) {
+        const unsigned long long micros = curTimeMicros64() - start;
+        cout << what << ": " << docs << " docs in " << micros / 1000 << "ms, "
+             << (micros ? docs * 1000000 / static_cast<long long>(micros) : 0) << " docs/s"
+             << " (sum " << sum << ")" << endl;
+    }
+
+    void getMore(DBClientConnection* conn) {
+        const unsigned long long start = curTimeMicros64();
+        auto_ptr<DBClientCursor> cursor = conn->query(kNs, Query());
+
+        long long docs = 0;
+        long long sum = 0;
+        while (cursor->more()) {
+            sum += cursor->nextSafe()["_id"].numberInt();
+            docs++;
+        }
+        report("getMore", start, docs, sum);
+    }
+
+    void exhaust(DBClientConnection* conn, int maxBufferedBytes) {
+        const unsigned long long start = curTimeMicros64();
+        ExhaustReader reader(conn, kNs, Query(), 0, 0,
+                             ExhaustReader::Options().setMaxBufferedBytes(maxBufferedBytes));
+
+        long long docs = 0;
+        long long sum = 0;
+        vector<BSONObj> batch;
+        while (reader.nextBatch(&batch)) {
+            for (size_t i = 0; i < batch.size(); ++i)
+                sum += batch[i]["_id"].numberInt();
+            docs += batch.size();
+        }
+        report("exhaust", start, docs, sum);
+        cout << "    " << reader.getStats().docsPerSecond() << " docs/s read, "
+             << reader.getStats().readerWaits << " waits for room, buffer "
+             << maxBufferedBytes << " bytes" << endl;
+    }
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+
+    if ( argc > 2 ) {
+        std::cout << "usage: " << argv[0] << " [MONGODB_URI]"  << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    mongo::client::GlobalInstance instance;
+    if (!instance.initialized()) {
+        std::cout << "failed to initialize the client driver: " << instance.status() << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    std::string uri = argc == 2 ? argv[1] : "mongodb://localhost:27017";
+    std::string errmsg;
+
+    ConnectionString cs = ConnectionString::parse(uri, errmsg);
+
+    if (!cs.isValid()) {
+        std::cout << "Error parsing connection string " << uri << ": " << errmsg << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    boost::scoped_ptr<DBClientBase> conn(cs.connect(errmsg));
+    if ( !conn || conn->type() != ConnectionString::MASTER ) {
+        cout << "couldn't connect to a single server: " << errmsg << endl;
+        return EXIT_FAILURE;
+    }
+    DBClientConnection* c = static_cast<DBClientConnection*>(conn.get());
+
+    try {
+        c->dropCollection(kNs);
+
+        vector<BSONObj> docs;
+        for (int i = 0; i < kDocs; ++i) {
+            docs.push_back(BSON("_id" << i << "payload" << string(100, 'x')));
+            if (docs.size() == 1000) {
+                c->insert(kNs, docs);
+                docs.clear();
+            }
+        }
+
+        getMore(c);
+        exhaust(c, 16 * 1024 * 1024);
+        exhaust(c, 64 * 1024);
+
+        c->dropCollection(kNs);
+    }
+    catch(DBException& e) {
+        cout << "caught DBException " << e.toString() << endl;
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,176 @@
+/*    Copyright 2014 MongoDB Inc.
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+// Compares MergeSortedCursor with reading everything and sorting it, for one sorted query
+// against several collections standing in for shards.
+
+// It is the responsibility of the mongo client consumer to ensure that any necessary windows
+// headers have already been included before including the driver facade headers.
+#if defined(_WIN32)
+#include <winsock2.h>
+#include <windows.h>
+#endif
+
+#include "mongo/client/dbclient.h"
+#include "mongo/util/time_support.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+using namespace std;
+using namespace mongo;
+
+namespace {
+
+    const int kShards = 4;
+    const int kDocsPerShard = 25000;
+    const BSONObj kSort = BSON("v" << 1 << "_id" << -1);
+
+    string shardNs(int shard) {
+        return "test.merge_sort_bench_" + BSONObjBuilder::numStr(shard);
+    }
+
+    struct KeyLess {
+        bool operator()(const pair<BSONObj, BSONObj>& l, const pair<BSONObj, BSONObj>& r) const {
+            return l.first.woCompare(r.first, kOrdering, false) < 0;
+        }
+        static const Ordering kOrdering;
+    };
+    const Ordering KeyLess::kOrdering = Ordering::make(kSort);
+
+    void report(const char* what, unsigned long long start, long long docs, long long check) {
+        const unsigned long long micros = curTimeMicros64() - start;
+        cout << what << ": " << docs << " docs in " << micros / 1000 << "ms, "
+             << (micros ? docs * 1000000 / static_cast<long long>(micros) : 0) << " docs/s"
+             << " (check " << check << ")" << endl;
+    }
+
+    // Reads every shard unsorted, then sorts the lot by precomputed keys.
+    void materializeAndSort(const vector<DBClientConnection*>& shards) {
+        const unsigned long long start = curTimeMicros64();
+
+        vector<pair<BSONObj, BSONObj> > all;
+        for (size_t i = 0; i < shards.size(); ++i) {
+            auto_ptr<DBClientCursor> cursor = shards[i]->query(shardNs(i), Query());
+            while (cursor->more()) {
+                const BSONObj doc = cursor->nextSafe().getOwned();
+                all.push_back(make_pair(doc.extractFields(kSort, true), doc));
+            }
+        }
+        sort(all.begin(), all.end(), KeyLess());
+
+        long long check = 0;
+        for (size_t i = 0; i < all.size(); ++i)
+            check = check * 31 + all[i].second["_id"].numberInt();
+        report("materialize and sort", start, all.size(), check);
+    }
+
+    // Reads every shard sorted, and merges them.
+    void merge(const vector<DBClientConnection*>& shards,
+               const char* what,
+               bool precomputeKeys,
+               bool prefetch) {
+        const unsigned long long start = curTimeMicros64();
+
+        MergeSortedCursor merged(kSort, precomputeKeys);
+        for (size_t i = 0; i < shards.size(); ++i) {
+            shards[i]->setPipelined(prefetch);
+            merged.addCursor(shards[i]->query(shardNs(i), Query().sort(kSort)));
+        }
+        merged.setPrefetch(prefetch);
+
+        long long docs = 0;
+        long long check = 0;
+        while (merged.more()) {
+            check = check * 31 + merged.next()["_id"].numberInt();
+            docs++;
+        }
+        report(what, start, docs, check);
+    }
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+
+    if ( argc > 2 ) {
+        std::cout << "usage: " << argv[0] << " [MONGODB_URI]"  << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    mongo::client::GlobalInstance instance;
+    if (!instance.initialized()) {
+        std::cout << "failed to initialize the client driver: " << instance.status() << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    std::string uri = argc == 2 ? argv[1] : "mongodb://localhost:27017";
+    std::string errmsg;
+
+    ConnectionString cs = ConnectionString::parse(uri, errmsg);
+
+    if (!cs.isValid()) {
+        std::cout << "Error parsing connection string " << uri << ": " << errmsg << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    // One connection per shard, as there would be against real shards.
+    vector<DBClientConnection*> shards;
+    for (int i = 0; i < kShards; ++i) {
+        DBClientBase* conn = cs.connect(errmsg);
+        if (!conn || conn->type() != ConnectionString::MASTER) {
+            cout << "couldn't connect to a single server: " << errmsg << endl;
+            delete conn;
+            return EXIT_FAILURE;
+        }
+        shards.push_back(static_cast<DBClientConnection*>(conn));
+    }
+
+    int result = EXIT_SUCCESS;
+    try {
+        srand(1);
+        for (int i = 0; i < kShards; ++i) {
+            shards[i]->dropCollection(shardNs(i));
+            shards[i]->createIndex(shardNs(i), kSort);
+
+            vector<BSONObj> docs;
+            for (int j = 0; j < kDocsPerShard; ++j) {
+                docs.push_back(BSON("_id" << i * kDocsPerShard + j <<
+                                    "v" << rand() % 1000 <<
+                                    "payload" << string(64, 'x')));
+            }
+            shards[i]->insert(shardNs(i), docs);
+        }
+
+        materializeAndSort(shards);
+        merge(shards, "merge, precomputed keys", true, false);
+        merge(shards, "merge, keys looked up per comparison", false, false);
+        merge(shards, "merge, precomputed keys, prefetching", true, true);
+
+        for (int i = 0; i < kShards; ++i)
+            shards[i]->dropCollection(shardNs(i));
+    }
+    catch(DBException& e) {
+        cout << "caught DBException " << e.toString() << endl;
+        result = EXIT_FAILURE;
+    }
+
+    for (size_t i = 0; i < shards.size(); ++i)
+        delete shards[i];
+    return result;
+}
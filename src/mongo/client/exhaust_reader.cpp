@@ -0,0 +1,260 @@
+/*    Copyright 2014 MongoDB Inc.
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+#define MONGO_LOG_DEFAULT_COMPONENT ::mongo::logger::LogComponent::kNetwork
+
+#include "mongo/platform/basic.h"
+
+#include "mongo/client/exhaust_reader.h"
+
+#include <algorithm>
+#include <boost/thread/locks.hpp>
+#include <exception>
+
+#include "mongo/client/client_worker.h"
+#include "mongo/client/dbclientcursor.h"
+#include "mongo/client/dbclientinterface.h"
+#include "mongo/util/assert_util.h"
+#include "mongo/util/log.h"
+#include "mongo/util/time_support.h"
+
+namespace mongo {
+
+    //
+    // ExhaustReader::Options
+    //
+
+    ExhaustReader::Options::Options()
+        : _maxBufferedBytes(16 * 1024 * 1024)
+        , _batchSize(0) {
+    }
+
+    ExhaustReader::Options& ExhaustReader::Options::setMaxBufferedBytes(int value) {
+        _maxBufferedBytes = value;
+        return *this;
+    }
+
+    int ExhaustReader::Options::maxBufferedBytes() const {
+        return _maxBufferedBytes;
+    }
+
+    ExhaustReader::Options& ExhaustReader::Options::setBatchSize(int value) {
+        _batchSize = value;
+        return *this;
+    }
+
+    int ExhaustReader::Options::batchSize() const {
+        return _batchSize;
+    }
+
+    //
+    // ExhaustReader::Stats
+    //
+
+    ExhaustReader::Stats::Stats()
+        : batches(0)
+        , docs(0)
+        , bytes(0)
+        , micros(0)
+        , readerWaits(0)
+        , consumerWaits(0) {
+    }
+
+    double ExhaustReader::Stats::docsPerSecond() const {
+        if (micros <= 0)
+            return 0;
+        return docs * 1000000.0 / micros;
+    }
+
+    double ExhaustReader::Stats::bytesPerSecond() const {
+        if (micros <= 0)
+            return 0;
+        return bytes * 1000000.0 / micros;
+    }
+
+    void ExhaustReader::Stats::append(BSONObjBuilder* builder) const {
+        builder->append("batches", batches);
+        builder->append("docs", docs);
+        builder->append("bytes", bytes);
+        builder->append("micros", micros);
+        builder->append("docsPerSecond", docsPerSecond());
+        builder->append("bytesPerSecond", bytesPerSecond());
+        builder->append("readerWaits", readerWaits);
+        builder->append("consumerWaits", consumerWaits);
+    }
+
+    //
+    // ExhaustReader
+    //
+
+    ExhaustReader::ExhaustReader(DBClientConnection* conn,
+                                 const std::string& ns,
+                                 const Query& query,
+                                 const BSONObj* fieldsToReturn,
+                                 int queryOptions,
+                                 const Options& options)
+        : _conn(conn)
+        , _maxBufferedBytes(std::max(options.maxBufferedBytes(), 1))
+        , _startMicros(curTimeMicros64())
+        , _bufferedBytes(0)
+        , _done(false)
+        , _cancelled(false)
+        , _error(Status::OK())
+        , _endMicros(0) {
+
+        uassert(ErrorCodes::BadValue,
+                "an exhaust query can't be sent on a pipelined connection",
+                !conn->isPipelined());
+        uassert(ErrorCodes::IllegalOperation,
+                "the server doesn't support exhaust queries",
+                conn->availableOptions() & QueryOption_Exhaust);
+
+        // mask options
+        queryOptions &= (int)( QueryOption_NoCursorTimeout | QueryOption_SlaveOk );
+        queryOptions |= (int)QueryOption_Exhaust;
+
+        _cursor = conn->query(ns, query, 0, 0, fieldsToReturn, queryOptions, options.batchSize());
+        uassert(13386, "socket error for mapping query", _cursor.get());
+
+        _reader.reset(new ClientWorker("ExhaustReader", stdx::bind(&ExhaustReader::_read, this)));
+        _reader->go();
+    }
+
+    ExhaustReader::~ExhaustReader() {
+        DESTRUCTOR_GUARD(
+            cancel();
+            _reader->wait();
+        );
+    }
+
+    bool ExhaustReader::nextBatch(std::vector<BSONObj>* batch) {
+        boost::unique_lock<boost::mutex> lk(_mutex);
+        if (_queue.empty() && !_done && !_cancelled) {
+            _stats.consumerWaits++;
+            do {
+                _changed.wait(lk);
+            } while (_queue.empty() && !_done && !_cancelled);
+        }
+
+        // The batches read before an error are still good.
+        if (!_queue.empty()) {
+            batch->swap(_queue.front());
+            _queue.pop_front();
+            _bufferedBytes -= _queueBytes.front();
+            _queueBytes.pop_front();
+            _changed.notify_all();
+            return true;
+        }
+
+        if (!_error.isOK()) {
+            const Status error = _error;
+            lk.unlock();
+            uassertStatusOK(error);
+        }
+        return false;
+    }
+
+    void ExhaustReader::cancel() {
+        boost::lock_guard<boost::mutex> lk(_mutex);
+        if (_done)
+            return;
+        _cancelled = true;
+        _queue.clear();
+        _queueBytes.clear();
+        _bufferedBytes = 0;
+        _changed.notify_all();
+    }
+
+    ExhaustReader::Stats ExhaustReader::getStats() const {
+        boost::lock_guard<boost::mutex> lk(_mutex);
+        Stats stats = _stats;
+        stats.micros = (_endMicros ? _endMicros : curTimeMicros64()) - _startMicros;
+        return stats;
+    }
+
+    void ExhaustReader::_read() {
+        Status status = Status::OK();
+        bool exhausted = false;
+        try {
+            while (true) {
+                const bool queued = _queueBatch();
+                if (!_cursor->getCursorId()) {
+                    exhausted = true;
+                    break;
+                }
+                if (!queued)
+                    break;
+                _cursor->exhaustReceiveMore();
+            }
+        }
+        catch (const DBException& e) {
+            status = e.toStatus();
+        }
+        catch (const std::exception& e) {
+            status = Status(ErrorCodes::InternalError, e.what());
+        }
+
+        if (!exhausted) {
+            // The server is still sending the rest of the results, so the connection can't be
+            // used again; the server drops the cursor when the connection closes.
+            LOG(1) << "closing connection to " << _conn->getServerAddress()
+                   << " after an unfinished exhaust query: " << status;
+            _cursor->decouple();
+            _conn->_failed = true;
+            _conn->p->shutdown();
+        }
+
+        boost::lock_guard<boost::mutex> lk(_mutex);
+        _error = status;
+        _done = true;
+        _endMicros = curTimeMicros64();
+        _changed.notify_all();
+    }
+
+    bool ExhaustReader::_queueBatch() {
+        std::vector<BSONObj> batch;
+        batch.reserve(_cursor->objsLeftInBatch());
+        size_t bytes = 0;
+        while (_cursor->moreInCurrentBatch()) {
+            const BSONObj obj = _cursor->nextSafe().getOwned();
+            bytes += obj.objsize();
+            batch.push_back(obj);
+        }
+
+        boost::unique_lock<boost::mutex> lk(_mutex);
+        _stats.batches++;
+        _stats.docs += batch.size();
+        _stats.bytes += bytes;
+
+        if (!_cancelled && _bufferedBytes && _bufferedBytes + bytes > _maxBufferedBytes) {
+            _stats.readerWaits++;
+            do {
+                _changed.wait(lk);
+            } while (!_cancelled && _bufferedBytes && _bufferedBytes + bytes > _maxBufferedBytes);
+        }
+        if (_cancelled)
+            return false;
+
+        if (!batch.empty()) {
+            _queue.push_back(std::vector<BSONObj>());
+            _queue.back().swap(batch);
+            _queueBytes.push_back(bytes);
+            _bufferedBytes += bytes;
+            _changed.notify_all();
+        }
+        return true;
+    }
+
+} // namespace mongo
@@ -0,0 +1,159 @@
+/*    Copyright 2014 MongoDB Inc.
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+#pragma once
+
+#include <boost/noncopyable.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <deque>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "mongo/base/status.h"
+#include "mongo/client/export_macros.h"
+#include "mongo/db/jsobj.h"
+
+namespace mongo {
+
+    class ClientWorker;
+    class DBClientConnection;
+    class DBClientCursor;
+    class Query;
+
+    /**
+     * Streams the results of a query with QueryOption_Exhaust, where the server sends every
+     * batch without waiting for a getMore, and hands them out a batch at a time.
+     *
+     * A reader thread takes the batches off the socket into a buffer of at most maxBufferedBytes.
+     * When the buffer is full the reader stops reading the socket, so the server in turn stops
+     * sending once the socket buffers fill up: a slow consumer slows the server down rather than
+     * letting results pile up in memory.
+     *
+     * The connection is busy until the last batch has been read off it, and can't be used for
+     * anything else in the meantime. If the reader is cancelled or destroyed before then, the
+     * rest of the results are still on their way, so the connection is closed and has to
+     * reconnect.
+     *
+     * Example:
+     *     ExhaustReader reader(&conn, "db.coll", Query());
+     *     std::vector<BSONObj> batch;
+     *     while (reader.nextBatch(&batch))
+     *         process(batch);
+     */
+    class MONGO_CLIENT_API ExhaustReader : private boost::noncopyable {
+    public:
+        /** How much the reader thread may buffer, and how big the batches it asks for are. */
+        class MONGO_CLIENT_API Options {
+        public:
+            Options();
+
+            /** How many bytes of documents can wait for nextBatch() before the reader stops
+             *  reading the socket. A single batch larger than this is still let through.
+             *
+             *  Default: 16MB
+             */
+            Options& setMaxBufferedBytes(int value);
+            int maxBufferedBytes() const;
+
+            /** The batch size to ask the server for, or 0 to leave it to the server.
+             *
+             *  Default: 0
+             */
+            Options& setBatchSize(int value);
+            int batchSize() const;
+
+        private:
+            int _maxBufferedBytes;
+            int _batchSize;
+        };
+
+        struct MONGO_CLIENT_API Stats {
+            Stats();
+
+            void append(BSONObjBuilder* builder) const;
+
+            double docsPerSecond() const;
+            double bytesPerSecond() const;
+
+            // Batches, documents and bytes read off the socket so far.
+            long long batches;
+            long long docs;
+            long long bytes;
+
+            // Time since the query was sent, until the last batch was read or until now.
+            long long micros;
+
+            // How often the reader waited for room in the buffer, and how often nextBatch()
+            // waited for the reader.
+            long long readerWaits;
+            long long consumerWaits;
+        };
+
+        /**
+         * Sends the query on 'conn', which must not be pipelined, and starts reading the
+         * results. Throws if the query can't be sent or the server doesn't support exhaust.
+         */
+        ExhaustReader(DBClientConnection* conn,
+                      const std::string& ns,
+                      const Query& query,
+                      const BSONObj* fieldsToReturn = 0,
+                      int queryOptions = 0,
+                      const Options& options = Options());
+
+        /** Cancels the reader if the results haven't all been read, and waits for it to stop. */
+        ~ExhaustReader();
+
+        /**
+         * Waits for the next batch and puts it in 'batch'. Returns false once every batch has
+         * been handed out. Throws the error which stopped the reader, if any.
+         */
+        bool nextBatch(std::vector<BSONObj>* batch);
+
+        /** Stops reading, and closes the connection unless every batch has been read off it. */
+        void cancel();
+
+        Stats getStats() const;
+
+    private:
+        // The body of the reader thread.
+        void _read();
+
+        // Queues the documents left in the cursor's current batch. Returns false if cancelled
+        // while waiting for room.
+        bool _queueBatch();
+
+        DBClientConnection* const _conn;
+        const size_t _maxBufferedBytes;
+        std::auto_ptr<DBClientCursor> _cursor;
+        boost::scoped_ptr<ClientWorker> _reader;
+        const unsigned long long _startMicros;
+
+        // protects everything below
+        mutable boost::mutex _mutex;
+        boost::condition_variable _changed;
+        std::deque<std::vector<BSONObj> > _queue;
+        std::deque<size_t> _queueBytes;
+        size_t _bufferedBytes;
+        bool _done;
+        bool _cancelled;
+        Status _error;
+        Stats _stats;
+        unsigned long long _endMicros;
+    };
+
+} // namespace mongo
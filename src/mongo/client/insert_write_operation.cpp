@@ -27,11 +27,20 @@ namespace mongo {
     namespace {
         const char kCommandKey[] = "insert";
         const char kBatchName[] = "documents";
+        const char kIdFieldName[] = "_id";
+
+        // The type byte, field name and value of a generated _id element.
+        const int kGeneratedIdSize = 1 + sizeof(kIdFieldName) + OID::kOIDSize;
     } // namespace
 
     InsertWriteOperation::InsertWriteOperation(const BSONObj& doc)
-        : _doc(_ensureId(doc))
-    {}
+        : _doc(doc)
+        , _generateId(doc.getField(kIdFieldName).eoo())
+        , _id(_generateId ? OID::gen() : OID())
+    {
+        BSONElement id = doc.getField(kIdFieldName);
+        uassert(0, "value of _id element cannot contain any fields starting with $", !id.isABSONObj() || id.Obj().okForStorage());
+    }
 
     WriteOpType InsertWriteOperation::operationType() const {
         return dbWriteInsert;
@@ -42,7 +51,7 @@ namespace mongo {
     }
 
     int InsertWriteOperation::incrementalSize() const {
-        return _doc.objsize();
+        return _doc.objsize() + (_generateId ? kGeneratedIdSize : 0);
     }
 
     void InsertWriteOperation::startRequest(const std::string& ns, bool ordered, BufBuilder* builder) const {
@@ -51,7 +60,7 @@ namespace mongo {
     }
 
     void InsertWriteOperation::appendSelfToRequest(BufBuilder* builder) const {
-        _doc.appendSelfToBufBuilder(*builder);
+        _appendDocument(builder);
     }
 
     void InsertWriteOperation::startCommand(const std::string& ns, BSONObjBuilder* command) const {
@@ -59,24 +68,28 @@ namespace mongo {
     }
 
     void InsertWriteOperation::appendSelfToCommand(BSONArrayBuilder* batch) const {
-        batch->append(_doc);
+        _appendDocument(&batch->subobjStart());
     }
 
     void InsertWriteOperation::appendSelfToBSONObj(BSONObjBuilder* obj) const {
+        if (_generateId)
+            obj->append(kIdFieldName, _id);
         obj->appendElements(_doc);
     }
 
-    BSONObj InsertWriteOperation::_ensureId(const BSONObj& doc) {
-        BSONElement id = doc.getField("_id");
-        if (!id.eoo()) {
-            uassert(0, "value of _id element cannot contain any fields starting with $", !id.isABSONObj() || id.Obj().okForStorage());
-            return doc;
+    void InsertWriteOperation::_appendDocument(BufBuilder* builder) const {
+        if (!_generateId) {
+            _doc.appendSelfToBufBuilder(*builder);
+            return;
         }
 
-        BSONObjBuilder bob;
-        bob.append("_id", OID::gen());
-        bob.appendElements(doc);
-        return bob.obj();
+        // The new size, the _id element, and then the document's own fields and terminating
+        // EOO byte as they are.
+        builder->appendNum(incrementalSize());
+        builder->appendNum(static_cast<char>(jstOID));
+        builder->appendStr(kIdFieldName);
+        builder->appendBuf(_id.view().view(), OID::kOIDSize);
+        builder->appendBuf(_doc.objdata() + sizeof(int), _doc.objsize() - sizeof(int));
     }
 
 } // namespace mongo
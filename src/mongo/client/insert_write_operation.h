@@ -36,9 +36,16 @@ namespace mongo {
         virtual void appendSelfToBSONObj(BSONObjBuilder* obj) const;
 
     private:
-        static BSONObj _ensureId(const BSONObj& doc);
+        // Appends the document, with the generated _id ahead of its own fields if it needs one.
+        void _appendDocument(BufBuilder* builder) const;
 
         const BSONObj _doc;
+
+        // Whether '_doc' lacks an _id. Rather than copying the document into a new one which
+        // starts with '_id', the element is written in front of the document's own fields as
+        // it is appended to a request.
+        const bool _generateId;
+        const OID _id;
     };
 
 } // namespace mongo
@@ -47,4 +47,40 @@ namespace {
         ASSERT_THROWS(InsertWriteOperation w(bob.done()), UserException);
     }
 
+    TEST(InsertWriteOperation, GeneratedIdComesFirst) {
+        InsertWriteOperation w(BSON("a" << 1 << "b" << "two"));
+
+        BufBuilder request;
+        w.appendSelfToRequest(&request);
+        ASSERT_EQUALS(request.len(), w.incrementalSize());
+
+        BSONObj doc(request.buf());
+        ASSERT_TRUE(doc.valid());
+        ASSERT_EQUALS(doc.nFields(), 3);
+        ASSERT_EQUALS(doc.firstElement().fieldNameStringData(), "_id");
+        ASSERT_EQUALS(doc.firstElement().type(), jstOID);
+        ASSERT_EQUALS(doc["a"].numberInt(), 1);
+        ASSERT_EQUALS(doc["b"].String(), "two");
+
+        // Every form of the operation carries the same _id.
+        BSONArrayBuilder batch;
+        w.appendSelfToCommand(&batch);
+        const BSONArray commandDocs = batch.arr();
+        ASSERT_EQUALS(commandDocs["0"].Obj(), doc);
+
+        BSONObjBuilder op;
+        w.appendSelfToBSONObj(&op);
+        ASSERT_EQUALS(op.obj(), doc);
+    }
+
+    TEST(InsertWriteOperation, ExistingIdIsKept) {
+        BSONObj original = BSON("a" << 1 << "_id" << 5);
+        InsertWriteOperation w(original);
+        ASSERT_EQUALS(w.incrementalSize(), original.objsize());
+
+        BufBuilder request;
+        w.appendSelfToRequest(&request);
+        ASSERT_EQUALS(BSONObj(request.buf()), original);
+    }
+
 }  // namespace
@@ -0,0 +1,278 @@
+/*    Copyright 2014 MongoDB Inc.
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+/**
+ * Tests for how DBClientConnection batches lazily killed cursor ids. The connection talks to
+ * one end of a socket pair, and the tests read what it sends from the other.
+ */
+
+#include "mongo/platform/basic.h"
+
+#include <boost/scoped_ptr.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/thread.hpp>
+#include <cstring>
+#include <set>
+#include <vector>
+
+#ifndef _WIN32
+#include <sys/socket.h>
+#include <sys/types.h>
+#endif
+
+#include "mongo/client/dbclientinterface.h"
+#include "mongo/client/options.h"
+#include "mongo/client/private/options.h"
+#include "mongo/stdx/functional.h"
+#include "mongo/unittest/unittest.h"
+#include "mongo/util/net/message_port.h"
+
+// The tests need a connected socket pair, which only UNIX provides natively.
+#ifndef _WIN32
+
+namespace {
+
+    using namespace mongo;
+
+    const int kBatchSize = 10;
+
+    /** A connection which is handed its port rather than connecting to a server. */
+    class SocketPairConnection : public DBClientConnection {
+    public:
+        explicit SocketPairConnection(const boost::shared_ptr<Socket>& socket) {
+            p.reset(new MessagingPort(socket));
+        }
+
+        void setFailed() {
+            _failed = true;
+        }
+    };
+
+    /** Appends the ids in the killCursors 'message' to 'ids'. */
+    void appendIds(const Message& message, std::vector<long long>* ids) {
+        const char* data = message.singleData().data();
+        int count;
+        std::memcpy(&count, data + sizeof(int), sizeof(int));
+        for (int i = 0; i < count; ++i) {
+            long long id;
+            std::memcpy(&id, data + 2 * sizeof(int) + i * sizeof(long long), sizeof(id));
+            ids->push_back(id);
+        }
+    }
+
+    class KillCursorsTest : public unittest::Test {
+    protected:
+        void setUp() {
+            _originalOptions = client::Options::current();
+            client::setOptions(client::Options(_originalOptions)
+                                   .setKillCursorsBatchSize(kBatchSize));
+            _originalLazy = DBClientConnection::getLazyKillCursor();
+            DBClientConnection::setLazyKillCursor(true);
+
+            int socks[2];
+            ASSERT_EQUALS(0, ::socketpair(PF_UNIX, SOCK_STREAM, 0, socks));
+            boost::shared_ptr<Socket> clientSock(new Socket(socks[0], SockAddr()));
+            boost::shared_ptr<Socket> serverSock(new Socket(socks[1], SockAddr()));
+            clientSock->setHandshakeReceived();
+            serverSock->setHandshakeReceived();
+            serverSock->setTimeout(5);
+            _server.reset(new MessagingPort(serverSock));
+            _serverSock = serverSock;
+            _conn.reset(new SocketPairConnection(clientSock));
+        }
+
+        void tearDown() {
+            _conn.reset();
+            _server.reset();
+            DBClientConnection::setLazyKillCursor(_originalLazy);
+            client::setOptions(_originalOptions);
+        }
+
+        SocketPairConnection& conn() {
+            return *_conn;
+        }
+
+        void destroyConnection() {
+            _conn.reset();
+        }
+
+        MessagingPort* server() {
+            return _server.get();
+        }
+
+        /** Returns whether the connection has sent anything which hasn't been read. */
+        bool serverHasData() {
+            char c;
+            return ::recv(_serverSock->rawFD(), &c, 1, MSG_PEEK | MSG_DONTWAIT) > 0;
+        }
+
+        /** Reads the next message. */
+        void receive(Message* message) {
+            ASSERT_TRUE(_server->recv(*message));
+        }
+
+        /** Reads the next message, which must be a killCursors, and returns its ids. */
+        void receiveKills(std::vector<long long>* ids) {
+            Message message;
+            receive(&message);
+            ASSERT_EQUALS(dbKillCursors, message.operation());
+            appendIds(message, ids);
+        }
+
+        /** Sends a message which needs no reply. */
+        void sayNothing() {
+            BufBuilder b;
+            b.skip(MsgData::MsgDataHeaderSize);
+            b.appendNum(0);
+            Message m;
+            m.setData(dbInsert, b);
+            conn().say(m);
+        }
+
+    private:
+        client::Options _originalOptions;
+        bool _originalLazy;
+        boost::shared_ptr<Socket> _serverSock;
+        boost::scoped_ptr<MessagingPort> _server;
+        boost::scoped_ptr<SocketPairConnection> _conn;
+    };
+
+    TEST_F(KillCursorsTest, GoOutWithTheNextMessage) {
+        conn().killCursor(1);
+        conn().killCursor(2);
+        conn().killCursor(3);
+        ASSERT_FALSE(serverHasData());
+
+        sayNothing();
+
+        std::vector<long long> ids;
+        receiveKills(&ids);
+        ASSERT_EQUALS(3U, ids.size());
+        ASSERT_EQUALS(1, ids[0]);
+        ASSERT_EQUALS(3, ids[2]);
+
+        Message next;
+        receive(&next);
+        ASSERT_EQUALS(dbInsert, next.operation());
+        ASSERT_FALSE(serverHasData());
+    }
+
+    TEST_F(KillCursorsTest, SentOnceBatchIsFull) {
+        for (int id = 1; id < kBatchSize; ++id)
+            conn().killCursor(id);
+        ASSERT_FALSE(serverHasData());
+
+        conn().killCursor(kBatchSize);
+        std::vector<long long> ids;
+        receiveKills(&ids);
+        ASSERT_EQUALS(static_cast<size_t>(kBatchSize), ids.size());
+        ASSERT_EQUALS(kBatchSize, ids.back());
+        ASSERT_FALSE(serverHasData());
+    }
+
+    TEST_F(KillCursorsTest, SentWhenConnectionGoes) {
+        conn().killCursor(1);
+        conn().killCursor(2);
+        ASSERT_FALSE(serverHasData());
+
+        destroyConnection();
+        std::vector<long long> ids;
+        receiveKills(&ids);
+        ASSERT_EQUALS(2U, ids.size());
+    }
+
+    TEST_F(KillCursorsTest, SentOnFlush) {
+        conn().killCursor(1);
+        conn().flush();
+        std::vector<long long> ids;
+        receiveKills(&ids);
+        ASSERT_EQUALS(1U, ids.size());
+    }
+
+    TEST_F(KillCursorsTest, SentImmediatelyWhenNotLazy) {
+        DBClientConnection::setLazyKillCursor(false);
+        conn().killCursor(1);
+        std::vector<long long> ids;
+        receiveKills(&ids);
+        ASSERT_EQUALS(1U, ids.size());
+    }
+
+    TEST_F(KillCursorsTest, DroppedWithFailedConnection) {
+        conn().killCursor(1);
+        conn().killCursor(2);
+        conn().setFailed();
+        conn().flush();
+        ASSERT_FALSE(serverHasData());
+    }
+
+    void killRange(DBClientConnection* conn, int begin, int end) {
+        for (int id = begin; id < end; ++id)
+            conn->killCursor(id);
+    }
+
+    /**
+     * Reads from 'server' until 'inserts' inserts and 'kills' killed ids have arrived, so the
+     * connection never blocks on a full socket buffer.
+     */
+    void readUntil(MessagingPort* server, int inserts, int kills, std::vector<long long>* ids) {
+        int inserted = 0;
+        while (inserted < inserts || static_cast<int>(ids->size()) < kills) {
+            Message message;
+            if (!server->recv(message))
+                return;
+            if (message.operation() == dbInsert)
+                inserted++;
+            else if (message.operation() == dbKillCursors)
+                appendIds(message, ids);
+        }
+    }
+
+    TEST_F(KillCursorsTest, KilledFromManyThreads) {
+        // As on the reply thread of a pipelined connection, while its owner keeps sending.
+        conn().setPipelined(true);
+
+        const int kThreads = 4;
+        const int kPerThread = 1000;
+        const int kInserts = 100;
+
+        std::vector<long long> ids;
+        boost::thread reader(stdx::bind(&readUntil,
+                                        server(),
+                                        kInserts,
+                                        kThreads * kPerThread,
+                                        &ids));
+
+        boost::thread_group killers;
+        for (int i = 0; i < kThreads; ++i)
+            killers.create_thread(stdx::bind(&killRange,
+                                             &conn(),
+                                             i * kPerThread,
+                                             (i + 1) * kPerThread));
+        for (int i = 0; i < kInserts; ++i)
+            sayNothing();
+        killers.join_all();
+        conn().flush();
+        reader.join();
+
+        // Every id exactly once.
+        const std::set<long long> killed(ids.begin(), ids.end());
+        ASSERT_EQUALS(ids.size(), killed.size());
+        ASSERT_EQUALS(static_cast<size_t>(kThreads * kPerThread), killed.size());
+        ASSERT_FALSE(serverHasData());
+    }
+
+} // namespace
+
+#endif // _WIN32
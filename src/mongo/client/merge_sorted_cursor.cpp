@@ -0,0 +1,121 @@
+/*    Copyright 2014 MongoDB Inc.
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+#include "mongo/platform/basic.h"
+
+#include "mongo/client/merge_sorted_cursor.h"
+
+#include <algorithm>
+
+#include "mongo/util/assert_util.h"
+
+namespace mongo {
+
+    bool MergeSortedCursor::Later::operator()(size_t l, size_t r) const {
+        const int cmp = _merge->_compare(l, r);
+        return cmp > 0 || (cmp == 0 && l > r);
+    }
+
+    MergeSortedCursor::MergeSortedCursor(const BSONObj& sortSpec, bool precomputeKeys)
+        : _sortSpec(sortSpec.getOwned())
+        , _ordering(Ordering::make(sortSpec))
+        , _precomputeKeys(precomputeKeys)
+        , _started(false) {
+        uassert(ErrorCodes::BadValue, "MergeSortedCursor needs a sort spec", !sortSpec.isEmpty());
+    }
+
+    MergeSortedCursor::~MergeSortedCursor() {
+        for (size_t i = 0; i < _sources.size(); ++i)
+            delete _sources[i].cursor;
+    }
+
+    void MergeSortedCursor::addCursor(std::auto_ptr<DBClientCursorInterface> cursor) {
+        uassert(ErrorCodes::IllegalOperation,
+                "cursors can't be added to a MergeSortedCursor once it has started",
+                !_started);
+        uassert(ErrorCodes::BadValue, "MergeSortedCursor was given no cursor", cursor.get());
+
+        _sources.push_back(Source());
+        _sources.back().clientCursor = dynamic_cast<DBClientCursor*>(cursor.get());
+        _sources.back().cursor = cursor.release();
+    }
+
+    void MergeSortedCursor::addCursor(std::auto_ptr<DBClientCursor> cursor) {
+        addCursor(std::auto_ptr<DBClientCursorInterface>(cursor.release()));
+    }
+
+    void MergeSortedCursor::setPrefetch(bool prefetch) {
+        for (size_t i = 0; i < _sources.size(); ++i) {
+            if (_sources[i].clientCursor)
+                _sources[i].clientCursor->setPrefetch(prefetch);
+        }
+    }
+
+    bool MergeSortedCursor::more() {
+        if (!_started)
+            _start();
+        return !_heap.empty();
+    }
+
+    BSONObj MergeSortedCursor::next() {
+        uassert(ErrorCodes::IllegalOperation, "no more documents in MergeSortedCursor", more());
+
+        const Later later(this);
+        std::pop_heap(_heap.begin(), _heap.end(), later);
+        const size_t index = _heap.back();
+
+        const BSONObj result = _sources[index].head;
+        if (_advance(index))
+            std::push_heap(_heap.begin(), _heap.end(), later);
+        else
+            _heap.pop_back();
+        return result;
+    }
+
+    void MergeSortedCursor::_start() {
+        _started = true;
+        _heap.reserve(_sources.size());
+        for (size_t i = 0; i < _sources.size(); ++i) {
+            if (_advance(i))
+                _heap.push_back(i);
+        }
+        std::make_heap(_heap.begin(), _heap.end(), Later(this));
+    }
+
+    bool MergeSortedCursor::_advance(size_t index) {
+        Source& source = _sources[index];
+        if (!source.cursor->more()) {
+            source.head = BSONObj();
+            source.key = BSONObj();
+            return false;
+        }
+
+        // The cursor may reuse the memory once it moves on, which it does as soon as this
+        // document is returned.
+        source.head = (source.clientCursor ? source.clientCursor->nextSafe()
+                                           : source.cursor->next()).getOwned();
+
+        if (_precomputeKeys)
+            source.key = source.head.extractFields(_sortSpec, true);
+        return true;
+    }
+
+    int MergeSortedCursor::_compare(size_t l, size_t r) const {
+        if (_precomputeKeys)
+            return _sources[l].key.woCompare(_sources[r].key, _ordering, false);
+        return _sources[l].head.woSortOrder(_sources[r].head, _sortSpec, true);
+    }
+
+} // namespace mongo
@@ -0,0 +1,123 @@
+/*    Copyright 2014 MongoDB Inc.
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+#pragma once
+
+#include <memory>
+#include <vector>
+
+#include "mongo/client/dbclientcursor.h"
+#include "mongo/client/export_macros.h"
+#include "mongo/db/jsobj.h"
+
+namespace mongo {
+
+    /**
+     * Merges cursors which are each sorted the same way into a single sorted stream, for
+     * instance the results of one query run against several shards or replica sets.
+     *
+     * Only the next document of each cursor is held, in a heap, so the merge costs about
+     * log(number of cursors) comparisons per document and nothing is materialized.
+     *
+     * Documents are compared as the server sorts them with 'sortSpec', field by field, with a
+     * missing field taken as null. Documents which compare equal come out in the order their
+     * cursors were added.
+     *
+     * Example:
+     *     MergeSortedCursor merged(BSON("ts" << -1));
+     *     merged.addCursor(shardA.query(ns, Query().sort("ts", -1)));
+     *     merged.addCursor(shardB.query(ns, Query().sort("ts", -1)));
+     *     while (merged.more())
+     *         process(merged.next());
+     */
+    class MONGO_CLIENT_API MergeSortedCursor : public DBClientCursorInterface {
+    public:
+        /**
+         * A merge by 'sortSpec', such as BSON("a" << 1 << "b" << -1).
+         *
+         * With 'precomputeKeys', the sort key of each document is pulled out once, when it is
+         * read from its cursor, and comparisons only look at the keys. Otherwise each
+         * comparison looks the fields up in both documents again, which saves building a key
+         * per document when there are few cursors to compare against.
+         */
+        explicit MergeSortedCursor(const BSONObj& sortSpec, bool precomputeKeys = true);
+
+        virtual ~MergeSortedCursor();
+
+        /**
+         * Adds a cursor to merge, which must already be sorted by the sort spec. The merge
+         * deletes it when it is done. Cursors can only be added before the first call to
+         * more() or next().
+         */
+        void addCursor(std::auto_ptr<DBClientCursorInterface> cursor);
+        void addCursor(std::auto_ptr<DBClientCursor> cursor);
+
+        /**
+         * Turns on prefetching in the cursors which are DBClientCursors, so each fetches its
+         * next batch while the merge works through the others; see
+         * DBClientCursor::setPrefetch. Each cursor wants a pipelined connection of its own.
+         */
+        void setPrefetch(bool prefetch);
+
+        virtual bool more();
+
+        /** The next document in sort order. Throws if there is none, or on a query error. */
+        virtual BSONObj next();
+
+    private:
+        // A cursor being merged, and the document it is up to.
+        struct Source {
+            Source() : cursor(NULL), clientCursor(NULL) {}
+
+            DBClientCursorInterface* cursor;
+
+            // 'cursor' if it is a DBClientCursor, or NULL.
+            DBClientCursor* clientCursor;
+
+            BSONObj head;
+
+            // The sort key of 'head' when keys are precomputed.
+            BSONObj key;
+        };
+
+        // Orders the heap of source indexes so that the one to return next is at the front.
+        class Later {
+        public:
+            explicit Later(const MergeSortedCursor* merge) : _merge(merge) {}
+            bool operator()(size_t l, size_t r) const;
+
+        private:
+            const MergeSortedCursor* _merge;
+        };
+
+        // Reads the first document of each cursor into the heap.
+        void _start();
+
+        // Moves the source at 'index' on to its next document. Returns false once it is
+        // exhausted.
+        bool _advance(size_t index);
+
+        int _compare(size_t l, size_t r) const;
+
+        const BSONObj _sortSpec;
+        const Ordering _ordering;
+        const bool _precomputeKeys;
+
+        std::vector<Source> _sources;
+        std::vector<size_t> _heap;
+        bool _started;
+    };
+
+} // namespace mongo
@@ -0,0 +1,150 @@
+/*    Copyright 2014 MongoDB Inc.
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+#include "mongo/client/merge_sorted_cursor.h"
+
+#include <vector>
+
+#include "mongo/client/dbclientmockcursor.h"
+#include "mongo/db/jsobj.h"
+#include "mongo/unittest/unittest.h"
+
+namespace {
+
+    using namespace mongo;
+
+    std::auto_ptr<DBClientCursorInterface> mockCursor(const BSONArray& docs) {
+        return std::auto_ptr<DBClientCursorInterface>(new DBClientMockCursor(docs));
+    }
+
+    std::vector<BSONObj> drain(MergeSortedCursor* merged) {
+        std::vector<BSONObj> docs;
+        while (merged->more())
+            docs.push_back(merged->next().getOwned());
+        return docs;
+    }
+
+    TEST(MergeSortedCursorTest, MergesAscending) {
+        // The arrays have to outlive the cursors reading them.
+        const BSONArray a = BSON_ARRAY(BSON("x" << 1) << BSON("x" << 4) << BSON("x" << 7));
+        const BSONArray b = BSON_ARRAY(BSON("x" << 2) << BSON("x" << 3) << BSON("x" << 9));
+        const BSONArray c = BSON_ARRAY(BSON("x" << 5));
+
+        for (int precomputeKeys = 0; precomputeKeys < 2; ++precomputeKeys) {
+            MergeSortedCursor merged(BSON("x" << 1), precomputeKeys);
+            merged.addCursor(mockCursor(a));
+            merged.addCursor(mockCursor(b));
+            merged.addCursor(mockCursor(c));
+
+            const std::vector<BSONObj> docs = drain(&merged);
+            ASSERT_EQUALS(7U, docs.size());
+            const int expected[] = { 1, 2, 3, 4, 5, 7, 9 };
+            for (size_t i = 0; i < docs.size(); ++i)
+                ASSERT_EQUALS(expected[i], docs[i]["x"].numberInt());
+        }
+    }
+
+    TEST(MergeSortedCursorTest, MergesMixedDirections) {
+        const BSONArray a = BSON_ARRAY(BSON("a" << 1 << "b" << 5) <<
+                                       BSON("a" << 2 << "b" << 1));
+        const BSONArray b = BSON_ARRAY(BSON("a" << 1 << "b" << 7) <<
+                                       BSON("a" << 1 << "b" << 3) <<
+                                       BSON("a" << 2 << "b" << 4));
+
+        for (int precomputeKeys = 0; precomputeKeys < 2; ++precomputeKeys) {
+            MergeSortedCursor merged(BSON("a" << 1 << "b" << -1), precomputeKeys);
+            merged.addCursor(mockCursor(a));
+            merged.addCursor(mockCursor(b));
+
+            const std::vector<BSONObj> docs = drain(&merged);
+            ASSERT_EQUALS(5U, docs.size());
+            const int expected[] = { 7, 5, 3, 4, 1 };
+            for (size_t i = 0; i < docs.size(); ++i)
+                ASSERT_EQUALS(expected[i], docs[i]["b"].numberInt());
+        }
+    }
+
+    TEST(MergeSortedCursorTest, ComparesNestedAndMissingFields) {
+        // A missing field sorts as null, before any number.
+        const BSONArray a = BSON_ARRAY(BSON("_id" << 1) <<
+                                       BSON("_id" << 2 << "s" << BSON("n" << 3)));
+        const BSONArray b = BSON_ARRAY(BSON("_id" << 3 << "s" << BSON("n" << 1)) <<
+                                       BSON("_id" << 4 << "s" << BSON("n" << 5)));
+
+        for (int precomputeKeys = 0; precomputeKeys < 2; ++precomputeKeys) {
+            MergeSortedCursor merged(BSON("s.n" << 1), precomputeKeys);
+            merged.addCursor(mockCursor(a));
+            merged.addCursor(mockCursor(b));
+
+            const std::vector<BSONObj> docs = drain(&merged);
+            ASSERT_EQUALS(4U, docs.size());
+            const int expected[] = { 1, 3, 2, 4 };
+            for (size_t i = 0; i < docs.size(); ++i)
+                ASSERT_EQUALS(expected[i], docs[i]["_id"].numberInt());
+        }
+    }
+
+    TEST(MergeSortedCursorTest, KeepsTiesInCursorOrder) {
+        const BSONArray a = BSON_ARRAY(BSON("x" << 1 << "from" << "a") <<
+                                       BSON("x" << 2 << "from" << "a"));
+        const BSONArray b = BSON_ARRAY(BSON("x" << 1 << "from" << "b") <<
+                                       BSON("x" << 2 << "from" << "b"));
+
+        for (int precomputeKeys = 0; precomputeKeys < 2; ++precomputeKeys) {
+            MergeSortedCursor merged(BSON("x" << 1), precomputeKeys);
+            merged.addCursor(mockCursor(a));
+            merged.addCursor(mockCursor(b));
+
+            const std::vector<BSONObj> docs = drain(&merged);
+            ASSERT_EQUALS(4U, docs.size());
+            ASSERT_EQUALS("a", docs[0]["from"].String());
+            ASSERT_EQUALS("b", docs[1]["from"].String());
+            ASSERT_EQUALS("a", docs[2]["from"].String());
+            ASSERT_EQUALS("b", docs[3]["from"].String());
+        }
+    }
+
+    TEST(MergeSortedCursorTest, SkipsEmptyCursors) {
+        const BSONArray empty;
+        const BSONArray a = BSON_ARRAY(BSON("x" << 1));
+
+        for (int precomputeKeys = 0; precomputeKeys < 2; ++precomputeKeys) {
+            MergeSortedCursor merged(BSON("x" << 1), precomputeKeys);
+            merged.addCursor(mockCursor(empty));
+            merged.addCursor(mockCursor(a));
+            merged.addCursor(mockCursor(empty));
+
+            ASSERT_TRUE(merged.more());
+            ASSERT_EQUALS(1, merged.next()["x"].numberInt());
+            ASSERT_FALSE(merged.more());
+            ASSERT_THROWS(merged.next(), UserException);
+        }
+    }
+
+    TEST(MergeSortedCursorTest, EmptyMerge) {
+        MergeSortedCursor merged(BSON("x" << 1));
+        ASSERT_FALSE(merged.more());
+    }
+
+    TEST(MergeSortedCursorTest, NoCursorsAfterStarting) {
+        const BSONArray a = BSON_ARRAY(BSON("x" << 1));
+
+        MergeSortedCursor merged(BSON("x" << 1));
+        merged.addCursor(mockCursor(a));
+        ASSERT_TRUE(merged.more());
+        ASSERT_THROWS(merged.addCursor(mockCursor(a)), UserException);
+    }
+
+} // namespace
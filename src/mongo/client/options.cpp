@@ -32,6 +32,11 @@ namespace client {
 #if !defined(_MSC_EXTENSIONS)
     const int Options::kDefaultDefaultLocalThresholdMillis;
     const unsigned int Options::kDefaultAutoShutdownGracePeriodMillis;
+    const int Options::kDefaultDNSCacheTTLMillis;
+    const int Options::kDefaultDNSNegativeCacheTTLMillis;
+    const int Options::kDefaultWriteCoalescingMaxBytes;
+    const int Options::kDefaultWriteCoalescingMaxDelayMillis;
+    const int Options::kDefaultKillCursorsBatchSize;
 #endif
 
     void setOptions(const Options& newOptions) {
@@ -50,6 +55,11 @@ namespace client {
         , _sslAllowInvalidCertificates(false)
         , _sslAllowInvalidHostnames(false)
         , _defaultLocalThresholdMillis(kDefaultDefaultLocalThresholdMillis)
+        , _dnsCacheTTLMillis(kDefaultDNSCacheTTLMillis)
+        , _dnsNegativeCacheTTLMillis(kDefaultDNSNegativeCacheTTLMillis)
+        , _writeCoalescingMaxBytes(kDefaultWriteCoalescingMaxBytes)
+        , _writeCoalescingMaxDelayMillis(kDefaultWriteCoalescingMaxDelayMillis)
+        , _killCursorsBatchSize(kDefaultKillCursorsBatchSize)
         , _minLoggedSeverity(logger::LogSeverity::Log())
         , _validateObjects(false)
     {}
@@ -81,6 +91,60 @@ namespace client {
         return _defaultLocalThresholdMillis;
     }
 
+    Options& Options::setCompressors(const std::vector<std::string>& compressors) {
+        _compressors = compressors;
+        return *this;
+    }
+
+    const std::vector<std::string>& Options::compressors() const {
+        return _compressors;
+    }
+
+    Options& Options::setDNSCacheTTLMillis(int millis) {
+        _dnsCacheTTLMillis = millis;
+        return *this;
+    }
+
+    int Options::DNSCacheTTLMillis() const {
+        return _dnsCacheTTLMillis;
+    }
+
+    Options& Options::setDNSNegativeCacheTTLMillis(int millis) {
+        _dnsNegativeCacheTTLMillis = millis;
+        return *this;
+    }
+
+    int Options::DNSNegativeCacheTTLMillis() const {
+        return _dnsNegativeCacheTTLMillis;
+    }
+
+    Options& Options::setWriteCoalescingMaxBytes(int bytes) {
+        _writeCoalescingMaxBytes = bytes;
+        return *this;
+    }
+
+    int Options::writeCoalescingMaxBytes() const {
+        return _writeCoalescingMaxBytes;
+    }
+
+    Options& Options::setWriteCoalescingMaxDelayMillis(int millis) {
+        _writeCoalescingMaxDelayMillis = millis;
+        return *this;
+    }
+
+    int Options::writeCoalescingMaxDelayMillis() const {
+        return _writeCoalescingMaxDelayMillis;
+    }
+
+    Options& Options::setKillCursorsBatchSize(int size) {
+        _killCursorsBatchSize = size;
+        return *this;
+    }
+
+    int Options::killCursorsBatchSize() const {
+        return _killCursorsBatchSize;
+    }
+
     Options& Options::setSSLMode(SSLModes sslMode) {
         _sslMode = sslMode;
         return *this;
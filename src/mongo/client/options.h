@@ -16,6 +16,7 @@
 #pragma once
 
 #include <string>
+#include <vector>
 
 #include "mongo/client/export_macros.h"
 #include "mongo/logger/log_domain.h"
@@ -37,6 +38,11 @@ namespace client {
         // factor or mutation of the default.
         static const unsigned int kDefaultAutoShutdownGracePeriodMillis = 0;
         static const int kDefaultDefaultLocalThresholdMillis = 15;
+        static const int kDefaultDNSCacheTTLMillis = 60 * 1000;
+        static const int kDefaultDNSNegativeCacheTTLMillis = 5 * 1000;
+        static const int kDefaultWriteCoalescingMaxBytes = 1300;
+        static const int kDefaultWriteCoalescingMaxDelayMillis = 0;
+        static const int kDefaultKillCursorsBatchSize = 100;
 
         // Helpful typedefs for logging-related options
         typedef std::auto_ptr<logger::MessageLogDomain::EventAppender> LogAppenderPtr;
@@ -115,6 +121,78 @@ namespace client {
         int defaultLocalThresholdMillis() const;
 
 
+        //
+        // Compression
+        //
+
+        /** Offer these wire protocol compressors to servers when connecting, in order of
+         *  preference, e.g. "zlib". The first one the server also supports is used for the
+         *  rest of the connection. Names this build doesn't support are ignored.
+         *
+         *  Default: none, so messages are never compressed.
+         */
+        Options& setCompressors(const std::vector<std::string>& compressors);
+        const std::vector<std::string>& compressors() const;
+
+
+        //
+        // Name resolution
+        //
+
+        /** How long the addresses a host name resolved to are reused before it is looked up
+         *  again. Entries in use are refreshed in the background shortly before they expire.
+         *  0 disables the cache, so every connection waits for the resolver.
+         *
+         *  Default: 60000 ms
+         */
+        Options& setDNSCacheTTLMillis(int millis);
+        int DNSCacheTTLMillis() const;
+
+        /** How long a failed lookup is remembered, so connecting to a host that doesn't
+         *  resolve fails quickly instead of waiting for the resolver each time. 0 disables
+         *  negative caching.
+         *
+         *  Default: 5000 ms
+         */
+        Options& setDNSNegativeCacheTTLMillis(int millis);
+        int DNSNegativeCacheTTLMillis() const;
+
+
+        //
+        // Write coalescing
+        //
+
+        /** Small messages which need no reply, like lazy killCursors, are held back and sent
+         *  in the same write as the next message on the connection. Messages larger than this
+         *  are sent on their own, and queued messages are sent once they add up to this.
+         *
+         *  Default: 1300 bytes
+         */
+        Options& setWriteCoalescingMaxBytes(int bytes);
+        int writeCoalescingMaxBytes() const;
+
+        /** The longest a held back message waits for the next one before it is sent anyway.
+         *  When this is positive, unacknowledged (w:0) writes are held back too.
+         *
+         *  Default: 0, meaning held back messages wait for the next message or
+         *  DBClientConnection::flush(), and unacknowledged writes are sent immediately.
+         */
+        Options& setWriteCoalescingMaxDelayMillis(int millis);
+        int writeCoalescingMaxDelayMillis() const;
+
+        /** With lazy killCursors (see DBClientConnection::setLazyKillCursor), the ids of
+         *  cursors killed on a connection are collected and sent in one killCursors message.
+         *  The message goes out with the next message on the connection, or on its own once
+         *  this many ids are waiting. There is no time limit: on an idle connection the ids wait
+         *  until it is next used, flushed (DBClientConnection::flush) or destroyed, and the
+         *  server keeps those cursors open until then.
+         *
+         *  Default: 100
+         */
+        Options& setKillCursorsBatchSize(int size);
+        int killCursorsBatchSize() const;
+
+
         //
         // SSL
         //
@@ -231,6 +309,12 @@ namespace client {
         bool _sslAllowInvalidCertificates;
         bool _sslAllowInvalidHostnames;
         int _defaultLocalThresholdMillis;
+        std::vector<std::string> _compressors;
+        int _dnsCacheTTLMillis;
+        int _dnsNegativeCacheTTLMillis;
+        int _writeCoalescingMaxBytes;
+        int _writeCoalescingMaxDelayMillis;
+        int _killCursorsBatchSize;
         LogAppenderFactory _appenderFactory;
         logger::LogSeverity _minLoggedSeverity;
         bool _validateObjects;
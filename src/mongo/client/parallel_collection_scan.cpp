@@ -0,0 +1,623 @@
+/*    Copyright 2014 MongoDB Inc.
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+#define MONGO_LOG_DEFAULT_COMPONENT ::mongo::logger::LogComponent::kNetwork
+
+#include "mongo/platform/basic.h"
+
+#include "mongo/client/parallel_collection_scan.h"
+
+#include <algorithm>
+#include <boost/thread/locks.hpp>
+#include <exception>
+
+#include "mongo/client/client_worker.h"
+#include "mongo/client/dbclientcursor.h"
+#include "mongo/client/dbclientinterface.h"
+#include "mongo/client/exceptions.h"
+#include "mongo/util/assert_util.h"
+#include "mongo/util/log.h"
+#include "mongo/util/time_support.h"
+
+namespace mongo {
+
+    //
+    // ParallelCollectionScan::Options
+    //
+
+    ParallelCollectionScan::Options::Options()
+        : _numCursors(4)
+        , _maxThreads(4)
+        , _batchSize(0)
+        , _maxQueuedBatches(16)
+        , _rangePartitioned(false)
+        , _ordered(false) {
+    }
+
+    ParallelCollectionScan::Options& ParallelCollectionScan::Options::setNumCursors(int value) {
+        _numCursors = value;
+        return *this;
+    }
+
+    int ParallelCollectionScan::Options::numCursors() const {
+        return _numCursors;
+    }
+
+    ParallelCollectionScan::Options& ParallelCollectionScan::Options::setMaxThreads(int value) {
+        _maxThreads = value;
+        return *this;
+    }
+
+    int ParallelCollectionScan::Options::maxThreads() const {
+        return _maxThreads;
+    }
+
+    ParallelCollectionScan::Options& ParallelCollectionScan::Options::setBatchSize(int value) {
+        _batchSize = value;
+        return *this;
+    }
+
+    int ParallelCollectionScan::Options::batchSize() const {
+        return _batchSize;
+    }
+
+    ParallelCollectionScan::Options&
+    ParallelCollectionScan::Options::setMaxQueuedBatches(int value) {
+        _maxQueuedBatches = value;
+        return *this;
+    }
+
+    int ParallelCollectionScan::Options::maxQueuedBatches() const {
+        return _maxQueuedBatches;
+    }
+
+    ParallelCollectionScan::Options&
+    ParallelCollectionScan::Options::setRangePartitioned(bool value) {
+        _rangePartitioned = value;
+        return *this;
+    }
+
+    bool ParallelCollectionScan::Options::rangePartitioned() const {
+        return _rangePartitioned;
+    }
+
+    ParallelCollectionScan::Options& ParallelCollectionScan::Options::setOrdered(bool value) {
+        _ordered = value;
+        return *this;
+    }
+
+    bool ParallelCollectionScan::Options::ordered() const {
+        return _ordered;
+    }
+
+    //
+    // ParallelCollectionScan::Stats
+    //
+
+    ParallelCollectionScan::CursorStats::CursorStats()
+        : cursorId(0)
+        , docs(0)
+        , batches(0)
+        , bytes(0)
+        , micros(0)
+        , exhausted(false) {
+    }
+
+    double ParallelCollectionScan::CursorStats::docsPerSecond() const {
+        if (micros <= 0)
+            return 0;
+        return docs * 1000000.0 / micros;
+    }
+
+    void ParallelCollectionScan::CursorStats::append(BSONObjBuilder* builder) const {
+        if (cursorId)
+            builder->append("cursorId", cursorId);
+        if (!min.isEmpty())
+            builder->append("min", min);
+        if (!max.isEmpty())
+            builder->append("max", max);
+        builder->append("docs", docs);
+        builder->append("batches", batches);
+        builder->append("bytes", bytes);
+        builder->append("micros", micros);
+        builder->append("docsPerSecond", docsPerSecond());
+        builder->append("exhausted", exhausted);
+    }
+
+    void ParallelCollectionScan::Stats::append(BSONObjBuilder* builder) const {
+        if (!splitMethod.empty())
+            builder->append("splitMethod", splitMethod);
+        BSONArrayBuilder array(builder->subarrayStart("cursors"));
+        for (size_t i = 0; i < cursors.size(); ++i) {
+            BSONObjBuilder cursor(array.subobjStart());
+            cursors[i].append(&cursor);
+        }
+    }
+
+    //
+    // ParallelCollectionScan
+    //
+
+    ParallelCollectionScan::ParallelCollectionScan(
+        DBClientBase* conn,
+        const StringData& ns,
+        const stdx::function<DBClientBase* ()>& connectionFactory,
+        const Options& options)
+        : _conn(conn)
+        , _connections(new ConnectionSource(connectionFactory))
+        , _ns(ns.toString())
+        , _options(options)
+        , _queuedBatches(0)
+        , _nextToDeliver(0)
+        , _nextCursor(0)
+        , _runningWorkers(0)
+        , _started(false)
+        , _cancelled(false)
+        , _error(Status::OK()) {
+    }
+
+    ParallelCollectionScan::ParallelCollectionScan(ConnectionPool* pool,
+                                                   const HostAndPort& host,
+                                                   const BSONObj& authParams,
+                                                   const StringData& ns,
+                                                   const Options& options)
+        : _conn(NULL)
+        , _connections(new ConnectionSource(pool, host, authParams))
+        , _ns(ns.toString())
+        , _options(options)
+        , _queuedBatches(0)
+        , _nextToDeliver(0)
+        , _nextCursor(0)
+        , _runningWorkers(0)
+        , _started(false)
+        , _cancelled(false)
+        , _error(Status::OK()) {
+    }
+
+    ParallelCollectionScan::~ParallelCollectionScan() {
+        DESTRUCTOR_GUARD(
+            cancel();
+            _joinWorkers();
+        );
+    }
+
+    void ParallelCollectionScan::run(const DocumentHandler& handler) {
+        _start(handler);
+        wait();
+    }
+
+    void ParallelCollectionScan::start() {
+        _start(DocumentHandler());
+    }
+
+    void ParallelCollectionScan::_start(const DocumentHandler& handler) {
+        {
+            boost::lock_guard<boost::mutex> lk(_mutex);
+            uassert(ErrorCodes::IllegalOperation,
+                    "a ParallelCollectionScan can only be started once",
+                    !_started);
+            _started = true;
+        }
+        _handler = handler;
+
+        DBClientBase* conn = _conn ? _conn : _connections->get();
+        try {
+            if (_options.rangePartitioned())
+                _splitRanges(conn);
+            else
+                _openCursors(conn);
+        }
+        catch (...) {
+            if (!_conn)
+                _connections->release(conn, true);
+            throw;
+        }
+        if (!_conn)
+            _connections->release(conn, false);
+
+        const size_t numWorkers =
+            std::min(_partitions.size(), static_cast<size_t>(std::max(_options.maxThreads(), 1)));
+
+        boost::lock_guard<boost::mutex> lk(_mutex);
+        _stats.resize(_partitions.size());
+        for (size_t i = 0; i < _partitions.size(); ++i) {
+            _stats[i].cursorId = _partitions[i].cursorId;
+            _stats[i].min = _partitions[i].min;
+            _stats[i].max = _partitions[i].max;
+        }
+        _cursorStartMicros.resize(_partitions.size());
+        _queues.resize(_partitions.size());
+        _partitionDone.resize(_partitions.size());
+
+        for (size_t i = 0; i < numWorkers; ++i) {
+            _workers.push_back(boost::shared_ptr<ClientWorker>(new ClientWorker(
+                "ParallelCollectionScan", stdx::bind(&ParallelCollectionScan::_work, this))));
+            _workers.back()->go();
+            _runningWorkers++;
+        }
+    }
+
+    void ParallelCollectionScan::_openCursors(DBClientBase* conn) {
+        BSONObjBuilder cmd;
+        cmd.append("parallelCollectionScan", nsGetCollection(_ns));
+        cmd.append("numCursors", _options.numCursors());
+
+        BSONObj result;
+        if (!conn->runCommand(nsGetDB(_ns), cmd.obj(), result))
+            throw OperationException(result);
+
+        BSONObjIterator it(result.getObjectField("cursors"));
+        while (it.more()) {
+            Partition partition;
+            partition.cursorId = it.next().Obj().getFieldDotted("cursor.id").numberLong();
+            _partitions.push_back(partition);
+        }
+    }
+
+    void ParallelCollectionScan::_splitRanges(DBClientBase* conn) {
+        const std::vector<BSONObj> splitPoints = _splitPoints(conn);
+
+        // Each range runs from one split point, inclusive, to the next, exclusive.
+        for (size_t i = 0; i <= splitPoints.size(); ++i) {
+            Partition partition;
+            if (i > 0)
+                partition.min = splitPoints[i - 1];
+            if (i < splitPoints.size())
+                partition.max = splitPoints[i];
+            _partitions.push_back(partition);
+        }
+    }
+
+    std::vector<BSONObj> ParallelCollectionScan::_splitPoints(DBClientBase* conn) {
+        std::vector<BSONObj> splitPoints;
+        const int numRanges = _options.numCursors();
+        if (numRanges <= 1)
+            return splitPoints;
+
+        const unsigned long long count = conn->count(_ns);
+        if (count < static_cast<unsigned long long>(numRanges))
+            return splitPoints;
+
+        BSONObj result;
+        if (conn->runCommand(nsGetDB(_ns), BSON("collStats" << nsGetCollection(_ns)), result)) {
+            // splitVector aims at chunks of half maxChunkSizeBytes, and maxChunkObjects caps
+            // the documents in each.
+            const long long dataSize = result.getField("size").numberLong();
+            const long long maxChunkSizeBytes = std::max(2 * dataSize / numRanges, 1LL);
+
+            BSONObjBuilder cmd;
+            cmd.append("splitVector", _ns);
+            cmd.append("keyPattern", BSON("_id" << 1));
+            cmd.append("maxChunkSizeBytes", maxChunkSizeBytes);
+            cmd.append("maxChunkObjects",
+                       static_cast<long long>((count + numRanges - 1) / numRanges));
+
+            if (conn->runCommand(nsGetDB(_ns), cmd.obj(), result)) {
+                std::vector<BSONElement> keys = result.getField("splitKeys").Array();
+
+                // There can be a few more than asked for, so spread the ones we take evenly.
+                const size_t wanted = std::min(keys.size(), static_cast<size_t>(numRanges - 1));
+                for (size_t i = 0; i < wanted; ++i) {
+                    splitPoints.push_back(
+                        keys[(i + 1) * keys.size() / (wanted + 1)].Obj().getOwned());
+                }
+                _setSplitMethod("splitVector");
+                return splitPoints;
+            }
+        }
+
+        // splitVector isn't allowed here, e.g. through a mongos or without the privilege. The
+        // _ids at evenly spaced positions in the _id index do as well, at the cost of a skip.
+        LOG(1) << "splitVector on " << _ns << " failed, looking up split points instead: "
+               << result;
+        _setSplitMethod("query");
+
+        const BSONObj idOnly = BSON("_id" << 1);
+        for (int i = 1; i < numRanges; ++i) {
+            const int skip = static_cast<int>(count * i / numRanges);
+            std::auto_ptr<DBClientCursor> cursor =
+                conn->query(_ns, Query().sort(idOnly).hint(idOnly), 1, skip, &idOnly);
+            uassert(ErrorCodes::HostUnreachable, "query for split point failed", cursor.get());
+            if (!cursor->more())
+                break;
+
+            const BSONObj point = cursor->nextSafe().getOwned();
+            if (splitPoints.empty() || point.woCompare(splitPoints.back()) > 0)
+                splitPoints.push_back(point);
+        }
+        return splitPoints;
+    }
+
+    void ParallelCollectionScan::_setSplitMethod(const std::string& method) {
+        boost::lock_guard<boost::mutex> lk(_mutex);
+        _splitMethod = method;
+    }
+
+    bool ParallelCollectionScan::nextBatch(std::vector<BSONObj>* batch) {
+        boost::unique_lock<boost::mutex> lk(_mutex);
+        uassert(ErrorCodes::IllegalOperation,
+                "nextBatch() needs a ParallelCollectionScan started with start()",
+                _started && !_handler);
+
+        while (!_batchReadyOrDone() && _error.isOK())
+            _queueChanged.wait(lk);
+
+        if (!_error.isOK()) {
+            const Status error = _error;
+            lk.unlock();
+            uassertStatusOK(error);
+        }
+
+        if (!_queuedBatches)
+            return false;
+
+        size_t index = _nextToDeliver;
+        if (!_options.ordered()) {
+            while (_queues[index].empty())
+                index++;
+        }
+
+        batch->swap(_queues[index].front());
+        _queues[index].pop_front();
+        _queuedBatches--;
+        _queueChanged.notify_all();
+        return true;
+    }
+
+    bool ParallelCollectionScan::_batchReadyOrDone() {
+        if (_cancelled)
+            return true;
+
+        if (!_options.ordered())
+            return _queuedBatches || _runningWorkers == 0;
+
+        // Done with a range once it is exhausted and its batches are handed out; the next
+        // range starts where it ended.
+        while (_nextToDeliver < _queues.size() &&
+               _queues[_nextToDeliver].empty() &&
+               _partitionDone[_nextToDeliver]) {
+            _nextToDeliver++;
+        }
+        return _nextToDeliver == _queues.size() ||
+               !_queues[_nextToDeliver].empty() ||
+               _runningWorkers == 0;
+    }
+
+    void ParallelCollectionScan::cancel() {
+        boost::lock_guard<boost::mutex> lk(_mutex);
+        _cancelled = true;
+        for (size_t i = 0; i < _queues.size(); ++i)
+            _queues[i].clear();
+        _queuedBatches = 0;
+        _queueChanged.notify_all();
+    }
+
+    void ParallelCollectionScan::wait() {
+        _joinWorkers();
+
+        Status error = Status::OK();
+        {
+            boost::lock_guard<boost::mutex> lk(_mutex);
+            error = _error;
+        }
+        uassertStatusOK(error);
+    }
+
+    ParallelCollectionScan::Stats ParallelCollectionScan::getStats() const {
+        const unsigned long long now = curTimeMicros64();
+
+        Stats stats;
+        boost::lock_guard<boost::mutex> lk(_mutex);
+        stats.splitMethod = _splitMethod;
+        stats.cursors = _stats;
+        for (size_t i = 0; i < stats.cursors.size(); ++i) {
+            if (_cursorStartMicros[i])
+                stats.cursors[i].micros = now - _cursorStartMicros[i];
+        }
+        return stats;
+    }
+
+    void ParallelCollectionScan::_work() {
+        DBClientBase* conn = NULL;
+        bool failed = false;
+
+        try {
+            conn = _connections->get();
+
+            while (true) {
+                size_t index;
+                {
+                    boost::lock_guard<boost::mutex> lk(_mutex);
+                    if (_cancelled || _nextCursor == _partitions.size())
+                        break;
+                    index = _nextCursor++;
+                }
+                _drain(conn, index);
+            }
+        }
+        catch (const DBException& e) {
+            failed = true;
+            _fail(e.toStatus());
+        }
+        catch (const std::exception& e) {
+            failed = true;
+            _fail(Status(ErrorCodes::InternalError, e.what()));
+        }
+
+        // Nobody is going to read the cursors which weren't started. A worker whose connection
+        // failed leaves them to another, or to _joinWorkers() if there is none.
+        if (conn && !failed) {
+            try {
+                _killCursors(conn, _takeUnstartedCursors());
+            }
+            catch (const DBException& e) {
+                failed = true;
+                LOG(1) << "failed to kill unread cursors of " << _ns << ": " << e.toString();
+            }
+        }
+
+        if (conn)
+            _connections->release(conn, failed);
+
+        boost::lock_guard<boost::mutex> lk(_mutex);
+        _runningWorkers--;
+        _queueChanged.notify_all();
+    }
+
+    void ParallelCollectionScan::_joinWorkers() {
+        for (size_t i = 0; i < _workers.size(); ++i)
+            _workers[i]->wait();
+
+        // Only left if every worker's connection failed.
+        const std::vector<long long> unstarted = _takeUnstartedCursors();
+        if (unstarted.empty())
+            return;
+
+        DBClientBase* conn = NULL;
+        try {
+            conn = _connections->get();
+            _killCursors(conn, unstarted);
+            _connections->release(conn, false);
+        }
+        catch (const DBException& e) {
+            LOG(1) << "failed to kill unread cursors of " << _ns << ": " << e.toString();
+            if (conn)
+                _connections->release(conn, true);
+        }
+    }
+
+    std::vector<long long> ParallelCollectionScan::_takeUnstartedCursors() {
+        std::vector<long long> cursorIds;
+        boost::lock_guard<boost::mutex> lk(_mutex);
+        for (; _nextCursor < _partitions.size(); _nextCursor++) {
+            if (_partitions[_nextCursor].cursorId)
+                cursorIds.push_back(_partitions[_nextCursor].cursorId);
+        }
+        return cursorIds;
+    }
+
+    void ParallelCollectionScan::_killCursors(DBClientBase* conn,
+                                              const std::vector<long long>& cursorIds) {
+        for (size_t i = 0; i < cursorIds.size(); ++i)
+            conn->killCursor(cursorIds[i]);
+    }
+
+    void ParallelCollectionScan::_drain(DBClientBase* conn, size_t index) {
+        {
+            boost::lock_guard<boost::mutex> lk(_mutex);
+            _cursorStartMicros[index] = curTimeMicros64();
+        }
+
+        bool exhausted = false;
+        try {
+            // Kills the cursor on the server if it goes before it is exhausted.
+            std::auto_ptr<DBClientCursor> cursorPtr;
+            const Partition& partition = _partitions[index];
+            if (partition.cursorId) {
+                cursorPtr.reset(new DBClientCursor(conn, _ns, partition.cursorId, 0, 0, 0));
+                cursorPtr->setBatchSize(_options.batchSize());
+            }
+            else {
+                // $min and $max go by the _id index, which keeps each range in _id order.
+                Query query;
+                query.hint(BSON("_id" << 1));
+                if (!partition.min.isEmpty())
+                    query.minKey(partition.min);
+                if (!partition.max.isEmpty())
+                    query.maxKey(partition.max);
+                cursorPtr = conn->query(_ns, query, 0, 0, NULL, 0, _options.batchSize());
+                uassert(ErrorCodes::HostUnreachable, "query for range failed", cursorPtr.get());
+            }
+            DBClientCursor& cursor = *cursorPtr;
+
+            while (true) {
+                if (!cursor.more()) {
+                    exhausted = true;
+                    break;
+                }
+
+                std::vector<BSONObj> batch;
+                batch.reserve(cursor.objsLeftInBatch());
+                long long bytes = 0;
+                while (cursor.moreInCurrentBatch()) {
+                    batch.push_back(cursor.nextSafe().getOwned());
+                    bytes += batch.back().objsize();
+                }
+
+                {
+                    boost::lock_guard<boost::mutex> lk(_mutex);
+                    CursorStats& stats = _stats[index];
+                    stats.docs += batch.size();
+                    stats.batches++;
+                    stats.bytes += bytes;
+                }
+
+                if (!_deliver(index, &batch))
+                    break;
+            }
+        }
+        catch (...) {
+            _finishCursor(index, false);
+            throw;
+        }
+        _finishCursor(index, exhausted);
+    }
+
+    void ParallelCollectionScan::_finishCursor(size_t index, bool exhausted) {
+        boost::lock_guard<boost::mutex> lk(_mutex);
+        _stats[index].micros = curTimeMicros64() - _cursorStartMicros[index];
+        _stats[index].exhausted = exhausted;
+        _cursorStartMicros[index] = 0;
+        _partitionDone[index] = true;
+        _queueChanged.notify_all();
+    }
+
+    bool ParallelCollectionScan::_deliver(size_t index, std::vector<BSONObj>* batch) {
+        if (_handler) {
+            for (size_t i = 0; i < batch->size(); ++i)
+                _handler((*batch)[i]);
+
+            boost::lock_guard<boost::mutex> lk(_mutex);
+            return !_cancelled;
+        }
+
+        const size_t maxQueued = std::max(_options.maxQueuedBatches(), 1);
+
+        boost::unique_lock<boost::mutex> lk(_mutex);
+        while (!_cancelled &&
+               (_options.ordered() ? _queues[index].size() : _queuedBatches) >= maxQueued) {
+            _queueChanged.wait(lk);
+        }
+        if (_cancelled)
+            return false;
+
+        _queues[index].push_back(std::vector<BSONObj>());
+        _queues[index].back().swap(*batch);
+        _queuedBatches++;
+        _queueChanged.notify_all();
+        return true;
+    }
+
+    void ParallelCollectionScan::_fail(const Status& status) {
+        LOG(1) << "parallel scan of " << _ns << " failed: " << status;
+        {
+            boost::lock_guard<boost::mutex> lk(_mutex);
+            if (_error.isOK())
+                _error = status;
+        }
+        cancel();
+    }
+
+} // namespace mongo
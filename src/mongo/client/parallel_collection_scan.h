@@ -0,0 +1,300 @@
+/*    Copyright 2014 MongoDB Inc.
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+#pragma once
+
+#include <boost/noncopyable.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <deque>
+#include <string>
+#include <vector>
+
+#include "mongo/base/status.h"
+#include "mongo/base/string_data.h"
+#include "mongo/client/export_macros.h"
+#include "mongo/db/jsobj.h"
+#include "mongo/stdx/functional.h"
+#include "mongo/util/net/hostandport.h"
+
+namespace mongo {
+
+    class ClientWorker;
+    class ConnectionPool;
+    class ConnectionSource;
+    class DBClientBase;
+
+    /**
+     * Reads a whole collection with the parallelCollectionScan command, draining the cursors
+     * it returns on a bounded set of worker threads.
+     *
+     * Documents are either passed to a callback, with run(), or handed out a batch at a time
+     * through a bounded queue, with start() and nextBatch(). When the queue is full the workers
+     * wait, so a slow consumer holds the scan back rather than letting it fill memory.
+     *
+     * cancel() stops the scan and kills the cursors that haven't been exhausted. An error on
+     * any cursor cancels the rest, and is thrown by run(), nextBatch() or wait().
+     *
+     * Where parallelCollectionScan isn't available, a range partitioned scan splits the
+     * collection into ranges of _id instead, and reads each with a query of its own. Its
+     * batches can be handed out in _id order.
+     *
+     * Example:
+     *     ParallelCollectionScan scan(&pool, host, BSONObj(), "db.coll");
+     *     scan.start();
+     *     std::vector<BSONObj> batch;
+     *     while (scan.nextBatch(&batch))
+     *         process(batch);
+     */
+    class MONGO_CLIENT_API ParallelCollectionScan : private boost::noncopyable {
+    public:
+        /**
+         * How the collection is split up, how many threads read the pieces, and how much they
+         * may read ahead of the caller.
+         */
+        class MONGO_CLIENT_API Options {
+        public:
+            Options();
+
+            /** The number of cursors to ask the server for. It may return fewer.
+             *
+             *  Default: 4
+             */
+            Options& setNumCursors(int value);
+            int numCursors() const;
+
+            /** The most worker threads to drain cursors with, each with its own connection.
+             *  With fewer threads than cursors, a thread takes on another cursor when it is done
+             *  with one.
+             *
+             *  Default: 4
+             */
+            Options& setMaxThreads(int value);
+            int maxThreads() const;
+
+            /** The batch size of each getMore, or 0 to leave it to the server.
+             *
+             *  Default: 0
+             */
+            Options& setBatchSize(int value);
+            int batchSize() const;
+
+            /** How many batches the queue used by nextBatch() holds before workers wait.
+             *
+             *  Default: 16
+             */
+            Options& setMaxQueuedBatches(int value);
+            int maxQueuedBatches() const;
+
+            /** Split the collection into numCursors ranges of _id and run a query for each,
+             *  instead of using parallelCollectionScan. The split points come from splitVector,
+             *  or where that isn't allowed from the _ids at evenly spaced positions.
+             *
+             *  Default: false
+             */
+            Options& setRangePartitioned(bool value);
+            bool rangePartitioned() const;
+
+            /** Have nextBatch() hand out the batches of a range partitioned scan in _id order.
+             *  The queue limit then applies to each range on its own.
+             *
+             *  Default: false
+             */
+            Options& setOrdered(bool value);
+            bool ordered() const;
+
+        private:
+            int _numCursors;
+            int _maxThreads;
+            int _batchSize;
+            int _maxQueuedBatches;
+            bool _rangePartitioned;
+            bool _ordered;
+        };
+
+        /** Counters for one cursor, or range, of the scan. */
+        struct MONGO_CLIENT_API CursorStats {
+            CursorStats();
+
+            void append(BSONObjBuilder* builder) const;
+
+            // Documents per second while the cursor was being read, or 0 before it started.
+            double docsPerSecond() const;
+
+            // The cursor from parallelCollectionScan, or the _id range read by a range
+            // partitioned scan, where an empty bound means the range is open on that side.
+            long long cursorId;
+            BSONObj min;
+            BSONObj max;
+
+            long long docs;
+            long long batches;
+            long long bytes;
+
+            // Time from the cursor's first getMore until it was exhausted or abandoned, or until
+            // now while it is still being read.
+            long long micros;
+            bool exhausted;
+        };
+
+        /** Counters for the whole scan; 'cursors' has one entry per cursor or range. */
+        struct MONGO_CLIENT_API Stats {
+            void append(BSONObjBuilder* builder) const;
+
+            // Where a range partitioned scan got its split points: "splitVector", or "query"
+            // when it had to look them up. Empty for other scans, or if the collection was too
+            // small to split.
+            std::string splitMethod;
+
+            std::vector<CursorStats> cursors;
+        };
+
+        /** Called with each document, on the worker threads, so possibly concurrently. */
+        typedef stdx::function<void (const BSONObj&)> DocumentHandler;
+
+        /**
+         * A scan of 'ns' which runs the command on 'conn' and drains the cursors on connections
+         * returned by 'connectionFactory'. These must be to the same server as 'conn'. They
+         * belong to the scan, which deletes them when it is done.
+         */
+        ParallelCollectionScan(DBClientBase* conn,
+                               const StringData& ns,
+                               const stdx::function<DBClientBase* ()>& connectionFactory,
+                               const Options& options = Options());
+
+        /**
+         * A scan of 'ns' on 'host' which gets all its connections from 'pool', authenticated
+         * with 'authParams', and hands them back when it is done.
+         */
+        ParallelCollectionScan(ConnectionPool* pool,
+                               const HostAndPort& host,
+                               const BSONObj& authParams,
+                               const StringData& ns,
+                               const Options& options = Options());
+
+        /** Cancels the scan if it is still running, and waits for the workers to finish. */
+        ~ParallelCollectionScan();
+
+        /**
+         * Scans the collection, passing each document to 'handler', and returns once all
+         * cursors are exhausted. Throws the first error from any cursor or from 'handler'.
+         */
+        void run(const DocumentHandler& handler);
+
+        /**
+         * Runs the command, or splits the collection, and starts the workers, which fill the
+         * queue read by nextBatch(). Throws OperationException if the command fails.
+         */
+        void start();
+
+        /**
+         * Waits for the next batch from any cursor, or from the next range in order if the
+         * scan is ordered, and puts it in 'batch'. Returns false once all cursors are exhausted
+         * and every batch has been handed out. Throws the first error from any cursor.
+         */
+        bool nextBatch(std::vector<BSONObj>* batch);
+
+        /** Stops the scan and kills the cursors which are left. Callable from any thread. */
+        void cancel();
+
+        /** Waits until the workers have finished. Throws the first error from any cursor. */
+        void wait();
+
+        Stats getStats() const;
+
+    private:
+        // A cursor from parallelCollectionScan, or a range of _id to query for.
+        struct Partition {
+            Partition() : cursorId(0) {}
+
+            long long cursorId;
+            BSONObj min;
+            BSONObj max;
+        };
+
+        void _start(const DocumentHandler& handler);
+
+        // Fill in _partitions, from the result of parallelCollectionScan or from the split
+        // points of the collection.
+        void _openCursors(DBClientBase* conn);
+        void _splitRanges(DBClientBase* conn);
+
+        // Returns up to numCursors - 1 _id values which divide the collection evenly.
+        std::vector<BSONObj> _splitPoints(DBClientBase* conn);
+        void _setSplitMethod(const std::string& method);
+
+        // The body of each worker thread.
+        void _work();
+
+        // Waits for the workers, then kills the cursors none of them started, if any.
+        void _joinWorkers();
+
+        // Claims the partitions no worker has started, returning their cursors.
+        std::vector<long long> _takeUnstartedCursors();
+
+        void _killCursors(DBClientBase* conn, const std::vector<long long>& cursorIds);
+
+        // Reads the partition at 'index' to the end, or until the scan is cancelled.
+        void _drain(DBClientBase* conn, size_t index);
+
+        // Records that the cursor at 'index' is no longer being read.
+        void _finishCursor(size_t index, bool exhausted);
+
+        // Hands a batch of the partition at 'index' to the handler or the queue. Returns false
+        // if the scan was cancelled while waiting for room in the queue.
+        bool _deliver(size_t index, std::vector<BSONObj>* batch);
+
+        // Whether nextBatch() has a batch to hand out, or nothing more will come. An ordered
+        // scan moves _nextToDeliver past the ranges which have been handed out in full.
+        bool _batchReadyOrDone();
+
+        // Records the first error and cancels the scan.
+        void _fail(const Status& status);
+
+        DBClientBase* const _conn;
+        const boost::scoped_ptr<const ConnectionSource> _connections;
+        const std::string _ns;
+        const Options _options;
+
+        DocumentHandler _handler;
+        std::vector<Partition> _partitions;
+        std::vector<boost::shared_ptr<ClientWorker> > _workers;
+
+        // protects everything below
+        mutable boost::mutex _mutex;
+        boost::condition_variable _queueChanged;
+
+        // The batches waiting for nextBatch(), for each partition. An ordered scan hands them
+        // out starting from partition _nextToDeliver.
+        std::vector<std::deque<std::vector<BSONObj> > > _queues;
+        size_t _queuedBatches;
+        size_t _nextToDeliver;
+        std::vector<bool> _partitionDone;
+
+        size_t _nextCursor;
+        int _runningWorkers;
+        bool _started;
+        bool _cancelled;
+        Status _error;
+        std::vector<CursorStats> _stats;
+        std::string _splitMethod;
+
+        // When each cursor started being read, or 0 if it isn't being read now.
+        std::vector<unsigned long long> _cursorStartMicros;
+    };
+
+} // namespace mongo
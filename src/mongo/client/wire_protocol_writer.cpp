@@ -17,12 +17,23 @@
 
 #include "mongo/client/wire_protocol_writer.h"
 
+#include <algorithm>
+
 #include "mongo/client/dbclientinterface.h"
+#include "mongo/client/options.h"
 #include "mongo/client/write_result.h"
 #include "mongo/db/namespace_string.h"
 
 namespace mongo {
 
+    namespace {
+        // An unordered write which has been sent, and is waiting for its getLastError reply.
+        struct SentBatch {
+            std::vector<WriteOperation*> ops;
+            Future<BSONObj> reply;
+        };
+    } // namespace
+
     WireProtocolWriter::WireProtocolWriter(DBClientBase* client) : _client(client) {
     }
 
@@ -36,13 +47,22 @@ namespace mongo {
         // Effectively a map of batch relative indexes to WriteOperations
         std::vector<WriteOperation*> batchOps;
 
-        BufBuilder builder;
+        // The writes of an unordered bulk don't depend on one another, so when their outcomes
+        // are wanted each is sent with its getLastError right behind it, without waiting for
+        // the replies to the earlier ones. The server runs a connection's messages in order, so
+        // each getLastError still reports on the write just before it.
+        const bool sendAhead = !ordered && writeConcern->requiresConfirmation();
+        std::vector<SentBatch> sent;
 
         std::vector<WriteOperation*>::const_iterator batch_begin = write_operations.begin();
         const std::vector<WriteOperation*>::const_iterator end = write_operations.end();
 
         while (batch_begin != end) {
 
+            // Each batch gets a fresh builder, since sending it hands the buffer to the message.
+            BufBuilder builder;
+            builder.skip(MsgData::MsgDataHeaderSize);
+
             std::vector<WriteOperation*>::const_iterator batch_iter = batch_begin;
 
             // We must be able to fit the first item of the batch. Otherwise, the calling code
@@ -92,8 +112,24 @@ namespace mongo {
                 batch_iter = next;
             }
 
+            if (sendAhead) {
+                sent.push_back(SentBatch());
+                sent.back().ops.swap(batchOps);
+                sent.back().reply = _sendAsync(batchOpType, &builder, writeConcern, ns);
+
+                // Without pipelining the write has already run; stop at a failed
+                // getLastError, as the serial path does.
+                const Future<BSONObj>& reply = sent.back().reply;
+                if (reply.isReady() &&
+                    (!reply.getStatus().isOK() || !reply.get()["ok"].trueValue()))
+                    break;
+
+                batch_begin = ++batch_iter;
+                continue;
+            }
+
             // Issue the complete command.
-            BSONObj batchResult = _send(batchOpType, builder, writeConcern, ns);
+            BSONObj batchResult = _send(batchOpType, &builder, writeConcern, ns);
 
             // Merge this batch's result into the result for all batches written.
             writeResult->_mergeGleResult(batchOps, batchResult);
@@ -104,13 +140,42 @@ namespace mongo {
             if (ordered || lastOp)
                 writeResult->_check(lastOp);
 
-            // Reset the builder so we can build the next request.
-            builder.reset();
-
             // The next batch begins with the op after the last one in the just issued batch.
             batch_begin = ++batch_iter;
         }
 
+        if (sent.empty())
+            return;
+
+        // Merge the replies in the order the writes were sent. Every write ran, so the results
+        // of those whose getLastError succeeded are kept even when an earlier one failed.
+        size_t firstFailure = sent.size();
+        BSONObj failedResult;
+        for (size_t i = 0; i < sent.size(); ++i) {
+            if (!sent[i].reply.getStatus().isOK()) {
+                firstFailure = std::min(firstFailure, i);
+                continue;
+            }
+
+            const BSONObj& batchResult = sent[i].reply.get();
+            if (!batchResult["ok"].trueValue()) {
+                if (i < firstFailure) {
+                    firstFailure = i;
+                    failedResult = batchResult;
+                }
+                continue;
+            }
+
+            writeResult->_mergeGleResult(sent[i].ops, batchResult);
+        }
+
+        if (firstFailure < sent.size()) {
+            if (!failedResult.isEmpty())
+                throw OperationException(failedResult);
+            uassertStatusOK(sent[firstFailure].reply.getStatus());
+        }
+
+        writeResult->_check(true);
     }
 
     bool WireProtocolWriter::_fits(BufBuilder* builder, WriteOperation* op) {
@@ -119,22 +184,18 @@ namespace mongo {
 
     BSONObj WireProtocolWriter::_send(
         WriteOpType opCode,
-        const BufBuilder& builder,
+        BufBuilder* builder,
         const WriteConcern* writeConcern,
         const StringData& ns
     ) {
-        Message request;
-        request.setData(opCode, builder.buf(), builder.len());
-        _client->say(request);
+        _say(opCode, builder, writeConcern);
 
         BSONObj result;
 
         if (writeConcern->requiresConfirmation()) {
-            BSONObjBuilder bob;
-            bob.append("getlasterror", true);
-            bob.appendElements(writeConcern->obj());
-
-            bool commandWorked = _client->runCommand(nsToDatabase(ns), bob.obj(), result);
+            bool commandWorked = _client->runCommand(nsToDatabase(ns),
+                                                     _getLastErrorCommand(writeConcern),
+                                                     result);
 
             if (!commandWorked) throw OperationException(result);
         }
@@ -142,6 +203,41 @@ namespace mongo {
         return result;
     }
 
+    Future<BSONObj> WireProtocolWriter::_sendAsync(
+        WriteOpType opCode,
+        BufBuilder* builder,
+        const WriteConcern* writeConcern,
+        const StringData& ns
+    ) {
+        _say(opCode, builder, writeConcern);
+        return _client->asyncRunCommand(nsToDatabase(ns), _getLastErrorCommand(writeConcern));
+    }
+
+    void WireProtocolWriter::_say(
+        WriteOpType opCode,
+        BufBuilder* builder,
+        const WriteConcern* writeConcern
+    ) {
+        Message request;
+        request.setData(opCode, *builder);
+
+        // An acknowledged write is followed straight away by its getLastError, which takes it
+        // along in the same send. Nothing waits for an unacknowledged write, so it can share a
+        // send with the next message if that is allowed to hold it back for a bounded time.
+        if (writeConcern->requiresConfirmation() ||
+            client::Options::current().writeCoalescingMaxDelayMillis() > 0)
+            _client->sayPiggyBack(request);
+        else
+            _client->say(request);
+    }
+
+    BSONObj WireProtocolWriter::_getLastErrorCommand(const WriteConcern* writeConcern) {
+        BSONObjBuilder bob;
+        bob.append("getlasterror", true);
+        bob.appendElements(writeConcern->obj());
+        return bob.obj();
+    }
+
     bool WireProtocolWriter::_batchableRequest(WriteOpType opCode, const WriteResult* const writeResult) {
         /*
          * In order to get detailed write information using the legacy MongoDB wire protocol
@@ -16,6 +16,7 @@
 #pragma once
 
 #include "mongo/client/dbclient_writer.h"
+#include "mongo/util/concurrency/future.h"
 
 namespace mongo {
 
@@ -34,13 +35,26 @@ namespace mongo {
         );
 
     private:
+        // Sends the write in 'builder' and, if 'wc' wants it acknowledged, waits for the
+        // reply to its getLastError.
         BSONObj _send(
             WriteOpType opCode,
-            const BufBuilder& builder,
+            BufBuilder* builder,
             const WriteConcern* wc,
             const StringData& ns
         );
 
+        // Sends the write in 'builder' and its getLastError without waiting for the reply.
+        Future<BSONObj> _sendAsync(
+            WriteOpType opCode,
+            BufBuilder* builder,
+            const WriteConcern* wc,
+            const StringData& ns
+        );
+
+        void _say(WriteOpType opCode, BufBuilder* builder, const WriteConcern* wc);
+        BSONObj _getLastErrorCommand(const WriteConcern* wc);
+
         bool _batchableRequest(WriteOpType opCode, const WriteResult* const writeResult);
         bool _fits(BufBuilder* builder, WriteOperation* operation);
 
@@ -35,6 +35,8 @@ namespace mongo {
         friend class WireProtocolWriter;
         friend class CommandWriter;
         friend class BulkOperationBuilder;
+        friend class BulkWriter;
+        friend class DBClientBase;
 
     public:
 
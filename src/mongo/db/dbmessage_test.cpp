@@ -128,6 +128,34 @@ namespace mongo {
         ASSERT_THROWS(d1.nextJsObj(), MsgAssertionException);
     }
 
+    // Test a message which takes over its builder's buffer instead of copying it
+    TEST(DBMessage1, GoodInsertFromBuilder) {
+        BufBuilder b;
+        b.skip( MsgData::MsgDataHeaderSize );
+        string ns("test");
+
+        b.appendNum( static_cast<int>(1) );
+        b.appendStr(ns);
+
+        BSONObj bo = BSON( "ts" << 0 );
+        bo.appendSelfToBufBuilder( b );
+
+        const char* const buf = b.buf();
+        const int len = b.len();
+
+        Message toSend;
+        toSend.setData( dbInsert , b );
+        ASSERT_EQUALS(buf, toSend.singleData().view2ptr());
+        ASSERT_EQUALS(len, toSend.header().getLen());
+        ASSERT_EQUALS(dbInsert, toSend.operation());
+        ASSERT(b.buf() == NULL);
+
+        DbMessage d1(toSend);
+        ASSERT_EQUALS(string("test"), d1.getns());
+        ASSERT_EQUALS(bo, d1.nextJsObj());
+        ASSERT_FALSE(d1.moreJSObjs());
+    }
+
 
 
 } // mongo namespace
@@ -977,4 +977,40 @@ namespace {
         }
     }
 
+    TYPED_TEST(BulkOperationTest, UnorderedOnPipelinedConnection) {
+        if (!this->testSupported()) return;
+
+        this->c->insert(TEST_NS, BSON("_id" << 5));
+        // Already there, so the update at index 100 fails whichever batch goes first.
+        this->c->insert(TEST_NS, BSON("_id" << 1000));
+
+        DBClientConnection pipelined;
+        pipelined.connect(this->c->getServerAddress());
+        pipelined.setWireVersions(this->c->getMinWireVersion(), this->c->getMaxWireVersion());
+        pipelined.setPipelined(true);
+
+        // Many writes in flight at once, with errors in the middle.
+        BulkOperationBuilder bulk(&pipelined, TEST_NS, false);
+        for (int i = 0; i < 300; ++i) {
+            if (i == 100)
+                bulk.find(BSON("_id" << 1000)).updateOne(BSON("$inc" << BSON("_id" << 1)));
+            else if (i == 200)
+                bulk.insert(BSON("_id" << 5));
+            else
+                bulk.find(BSON("_id" << 1000 + i)).upsert().updateOne(BSON("$set" << BSON("a" << i)));
+        }
+
+        WriteResult result;
+        ASSERT_THROWS(bulk.execute(&WriteConcern::acknowledged, &result), OperationException);
+
+        // The upsert at index 0 finds {_id: 1000} rather than inserting it.
+        ASSERT_EQUALS(result.nMatched(), 1);
+        ASSERT_EQUALS(result.nUpserted(), 297);
+        ASSERT_EQUALS(result.upserted().size(), 297U);
+        ASSERT_EQUALS(result.writeErrors().size(), 2U);
+        ASSERT_EQUALS(result.writeErrors()[0]["index"].numberInt(), 200);
+        ASSERT_EQUALS(result.writeErrors()[1]["index"].numberInt(), 100);
+        ASSERT_EQUALS(this->c->count(TEST_NS), 299U);
+    }
+
 } // namespace
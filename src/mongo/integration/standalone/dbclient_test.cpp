@@ -336,6 +336,141 @@ namespace {
         ASSERT_EQUALS(cursor->next().getIntField("num"), 2);
     }
 
+    TEST_F(DBClientTest, PipelinedConnection) {
+        c.setPipelined(true);
+        ASSERT_TRUE(c.isPipelined());
+
+        for(int i = 0; i < 3; ++i) {
+            c.insert(TEST_NS, BSON("num" << i));
+        }
+        ASSERT_EQUALS(c.count(TEST_NS), 3U);
+
+        auto_ptr<DBClientCursor> cursor = c.query(TEST_NS, Query("{}").sort("num"), 0, 0, 0, 0, 2);
+        for(int i = 0; i < 3; ++i) {
+            ASSERT_TRUE(cursor->more());
+            ASSERT_EQUALS(cursor->next().getIntField("num"), i);
+        }
+        ASSERT_FALSE(cursor->more());
+
+        c.setPipelined(false);
+        ASSERT_FALSE(c.isPipelined());
+        ASSERT_EQUALS(c.count(TEST_NS), 3U);
+    }
+
+    TEST_F(DBClientTest, PrefetchOnPipelinedConnection) {
+        for(int i = 0; i < 25; ++i) {
+            c.insert(TEST_NS, BSON("num" << i));
+        }
+        c.setPipelined(true);
+
+        auto_ptr<DBClientCursor> cursor = c.query(TEST_NS, Query().sort("num"), 0, 0, 0, 0, 10);
+        cursor->setPrefetch(true);
+        for(int i = 0; i < 25; ++i) {
+            // The next batch was asked for before this one ran out.
+            if (i == 10 || i == 20)
+                ASSERT_TRUE(cursor->prefetchPending());
+            ASSERT_TRUE(cursor->more());
+            ASSERT_EQUALS(cursor->next().getIntField("num"), i);
+        }
+        ASSERT_FALSE(cursor->more());
+        ASSERT_FALSE(cursor->prefetchPending());
+    }
+
+    TEST_F(DBClientTest, PrefetchSkipped) {
+        for(int i = 0; i < 10; ++i) {
+            c.insert(TEST_NS, BSON("num" << i));
+        }
+
+        // Not pipelined
+        auto_ptr<DBClientCursor> cursor = c.query(TEST_NS, Query().sort("num"), 0, 0, 0, 0, 4);
+        cursor->setPrefetch(true);
+        for(int i = 0; i < 10; ++i) {
+            ASSERT_TRUE(cursor->more());
+            ASSERT_EQUALS(cursor->next().getIntField("num"), i);
+            ASSERT_FALSE(cursor->prefetchPending());
+        }
+        ASSERT_FALSE(cursor->more());
+
+        // Tailable
+        const string cappedNs = TEST_DB + ".capped";
+        c.dropCollection(cappedNs);
+        c.createCollection(cappedNs, 1024 * 1024, true);
+        for(int i = 0; i < 10; ++i) {
+            c.insert(cappedNs, BSON("num" << i));
+        }
+        c.setPipelined(true);
+        cursor = c.query(cappedNs, Query(), 0, 0, 0, QueryOption_CursorTailable, 4);
+        cursor->setPrefetch(true);
+        for(int i = 0; i < 10; ++i) {
+            ASSERT_TRUE(cursor->more());
+            ASSERT_EQUALS(cursor->next().getIntField("num"), i);
+            ASSERT_FALSE(cursor->prefetchPending());
+        }
+        cursor.reset();
+        c.setPipelined(false);
+        c.dropCollection(cappedNs);
+
+        // Exhaust. The server sends every batch unasked, which a pipelined connection can't
+        // take, so this uses a connection of its own and stops after the first batch.
+        DBClientConnection exhaustConn;
+        exhaustConn.connect(c.getServerAddress());
+        exhaustConn.setPipelined(true);
+        cursor = exhaustConn.query(TEST_NS, Query(), 0, 0, 0, QueryOption_Exhaust, 4);
+        cursor->setPrefetch(true);
+        while (cursor->moreInCurrentBatch()) {
+            cursor->next();
+            ASSERT_FALSE(cursor->prefetchPending());
+        }
+        cursor.reset();
+    }
+
+    TEST_F(DBClientTest, AsyncOperations) {
+        c.setPipelined(true);
+
+        std::vector<BSONObj> docs;
+        for(int i = 0; i < 5; ++i) {
+            docs.push_back(BSON("_id" << i << "num" << i));
+        }
+        Future<WriteResult> inserted = c.asyncInsert(TEST_NS, docs);
+        ASSERT_OK(inserted.getStatus());
+        ASSERT_EQUALS(inserted.get().nInserted(), 5);
+
+        // Issue several requests before waiting for any of them.
+        Future<BSONObj> first = c.asyncFindOne(TEST_NS, MONGO_QUERY("_id" << 1));
+        Future<BSONObj> missing = c.asyncFindOne(TEST_NS, MONGO_QUERY("_id" << 100));
+        Future<BSONObj> count = c.asyncRunCommand(TEST_DB, BSON("count" << TEST_COLL));
+        Future<BSONObj> bad = c.asyncRunCommand(TEST_DB, BSON("notARealCommand" << 1));
+
+        ASSERT_EQUALS(first.get().getIntField("num"), 1);
+        ASSERT_TRUE(missing.get().isEmpty());
+        ASSERT_EQUALS(count.get().getIntField("n"), 5);
+        ASSERT_FALSE(bad.get()["ok"].trueValue());
+
+        // Duplicate keys are reported through the future.
+        Future<WriteResult> duplicate = c.asyncInsert(TEST_NS, docs);
+        ASSERT_NOT_OK(duplicate.getStatus());
+
+        auto_ptr<DBClientCursor> cursor = c.query(TEST_NS, Query().sort("num"), 0, 0, 0, 0, 2);
+        ASSERT_EQUALS(cursor->objsLeftInBatch(), 2);
+        const long long cursorId = cursor->getCursorId();
+        ASSERT_NOT_EQUALS(cursorId, 0);
+        cursor->decouple();
+
+        Future<boost::shared_ptr<DBClientCursor> > more = c.asyncGetMore(TEST_NS, cursorId);
+        boost::shared_ptr<DBClientCursor> rest = more.get();
+        for(int i = 2; i < 5; ++i) {
+            ASSERT_TRUE(rest->more());
+            ASSERT_EQUALS(rest->next().getIntField("num"), i);
+        }
+        ASSERT_FALSE(rest->more());
+
+        // Without pipelining the same calls complete synchronously.
+        c.setPipelined(false);
+        Future<BSONObj> sync = c.asyncFindOne(TEST_NS, MONGO_QUERY("_id" << 2));
+        ASSERT_TRUE(sync.isReady());
+        ASSERT_EQUALS(sync.get().getIntField("num"), 2);
+    }
+
     TEST_F(DBClientTest, Distinct) {
         c.insert(TEST_NS, BSON("a" << 1));
         c.insert(TEST_NS, BSON("a" << 2));
@@ -770,6 +905,89 @@ namespace {
         }
     }
 
+    DBClientBase* makeScanConnection(DBClientBase* originalConnection) {
+        DBClientConnection* newConn = new DBClientConnection();
+        newConn->connect(originalConnection->getServerAddress());
+        return newConn;
+    }
+
+    TEST_F(DBClientTest, ManagedParallelCollectionScan) {
+        bool supported = serverGTE(&c, 2, 6);
+
+        if (supported) {
+            const int numItems = 8000;
+            const long long seriesSum = (numItems * (numItems - 1LL)) / 2;
+
+            for (int i = 0; i < numItems; ++i)
+                c.insert(TEST_NS, BSON("_id" << i));
+
+            // The scan owns the connections from the factory, and fewer threads than cursors
+            // have to share them out.
+            ParallelCollectionScan scan(&c, TEST_NS, stdx::bind(&makeScanConnection, &c),
+                                        ParallelCollectionScan::Options()
+                                            .setNumCursors(3)
+                                            .setMaxThreads(2)
+                                            .setMaxQueuedBatches(1));
+            scan.start();
+
+            long long sum = 0;
+            std::vector<BSONObj> batch;
+            while (scan.nextBatch(&batch)) {
+                for (size_t i = 0; i < batch.size(); ++i)
+                    sum += batch[i].getIntField("_id");
+            }
+            scan.wait();
+
+            ASSERT_EQUALS(sum, seriesSum);
+
+            ParallelCollectionScan::Stats stats = scan.getStats();
+            long long docs = 0;
+            for (size_t i = 0; i < stats.cursors.size(); ++i) {
+                ASSERT(stats.cursors[i].exhausted);
+                docs += stats.cursors[i].docs;
+            }
+            ASSERT_EQUALS(docs, numItems);
+        }
+    }
+
+    TEST_F(DBClientTest, RangePartitionedCollectionScan) {
+        const int numItems = 8000;
+        const long long seriesSum = (numItems * (numItems - 1LL)) / 2;
+
+        for (int i = 0; i < numItems; ++i)
+            c.insert(TEST_NS, BSON("_id" << i));
+
+        ParallelCollectionScan scan(&c, TEST_NS, stdx::bind(&makeScanConnection, &c),
+                                    ParallelCollectionScan::Options()
+                                        .setRangePartitioned(true)
+                                        .setOrdered(true)
+                                        .setMaxThreads(2)
+                                        .setBatchSize(100)
+                                        .setMaxQueuedBatches(1));
+        scan.start();
+
+        long long sum = 0;
+        int expected = 0;
+        std::vector<BSONObj> batch;
+        while (scan.nextBatch(&batch)) {
+            for (size_t i = 0; i < batch.size(); ++i) {
+                ASSERT_EQUALS(batch[i].getIntField("_id"), expected++);
+                sum += batch[i].getIntField("_id");
+            }
+        }
+        scan.wait();
+
+        ASSERT_EQUALS(sum, seriesSum);
+
+        ParallelCollectionScan::Stats stats = scan.getStats();
+        ASSERT_EQUALS(stats.splitMethod, "splitVector");
+        ASSERT_EQUALS(stats.cursors.size(), 4U);
+        ASSERT_TRUE(stats.cursors.front().min.isEmpty());
+        ASSERT_TRUE(stats.cursors.back().max.isEmpty());
+        for (size_t i = 0; i < stats.cursors.size(); ++i)
+            ASSERT(stats.cursors[i].exhausted);
+    }
+
     TEST_F(DBClientTest, InsertVectorContinueOnError) {
         vector<BSONObj> v;
         v.push_back(BSON("_id" << 1));
@@ -1041,6 +1259,174 @@ namespace {
         c.query(f, TEST_NS, Query("{}"));
     }
 
+    // Used to test dispatching query results to worker threads below
+    void recordNum(std::vector<int>* nums, boost::mutex* mut, const BSONObj& obj) {
+        boost::lock_guard<boost::mutex> lock(*mut);
+        nums->push_back(obj.getIntField("num"));
+    }
+
+    void failOnNum(int num, const BSONObj& obj) {
+        uassert(0, "handler failed", obj.getIntField("num") != num);
+    }
+
+    TEST_F(DBClientTest, QueryDispatched) {
+        for(int i=0; i<1000; ++i)
+            c.insert(TEST_NS, BSON("num" << i));
+
+        std::vector<int> nums;
+        boost::mutex numsMutex;
+        stdx::function<void(const BSONObj &)> f =
+            stdx::bind(&recordNum, &nums, &numsMutex, stdx::placeholders::_1);
+
+        // A short queue, so reading has to wait for the workers.
+        ASSERT_EQUALS(c.query(f,
+                              BatchDispatcher::Options().setMaxThreads(4).setMaxQueuedBatches(1),
+                              TEST_NS,
+                              Query("{}")),
+                      1000ULL);
+
+        ASSERT_EQUALS(nums.size(), 1000U);
+        std::sort(nums.begin(), nums.end());
+        for (int i = 0; i < 1000; ++i)
+            ASSERT_EQUALS(nums[i], i);
+    }
+
+    TEST_F(DBClientTest, QueryDispatchedOrdered) {
+        for(int i=0; i<1000; ++i)
+            c.insert(TEST_NS, BSON("num" << i));
+
+        std::vector<int> nums;
+        boost::mutex numsMutex;
+        stdx::function<void(const BSONObj &)> f =
+            stdx::bind(&recordNum, &nums, &numsMutex, stdx::placeholders::_1);
+
+        c.query(f, BatchDispatcher::Options().setOrdered(true), TEST_NS, Query().sort("num"));
+
+        ASSERT_EQUALS(nums.size(), 1000U);
+        for (int i = 0; i < 1000; ++i)
+            ASSERT_EQUALS(nums[i], i);
+    }
+
+    TEST_F(DBClientTest, QueryDispatchedHandlerError) {
+        for(int i=0; i<1000; ++i)
+            c.insert(TEST_NS, BSON("num" << i));
+
+        stdx::function<void(const BSONObj &)> f =
+            stdx::bind(&failOnNum, 500, stdx::placeholders::_1);
+        ASSERT_THROWS(c.query(f, BatchDispatcher::Options(), TEST_NS, Query("{}")),
+                      UserException);
+
+        // The results left unread don't get in the way of the next operation.
+        ASSERT_FALSE(c.isFailed());
+        ASSERT_EQUALS(c.count(TEST_NS), 1000U);
+    }
+
+    TEST_F(DBClientTest, ExhaustReader) {
+        for(int i=0; i<1000; ++i)
+            c.insert(TEST_NS, BSON("num" << i));
+
+        {
+            // A small buffer, so the reader has to wait for room.
+            ExhaustReader reader(&c, TEST_NS, Query(), 0, 0,
+                                 ExhaustReader::Options()
+                                     .setBatchSize(100)
+                                     .setMaxBufferedBytes(1024));
+            int expected = 0;
+            std::vector<BSONObj> batch;
+            while (reader.nextBatch(&batch)) {
+                for (size_t i = 0; i < batch.size(); ++i)
+                    ASSERT_EQUALS(batch[i].getIntField("num"), expected++);
+            }
+            ASSERT_EQUALS(expected, 1000);
+
+            ExhaustReader::Stats stats = reader.getStats();
+            ASSERT_EQUALS(stats.docs, 1000);
+            ASSERT_GREATER_THAN(stats.batches, 1);
+        }
+
+        // Once the results have all been read, the connection is free again.
+        ASSERT_FALSE(c.isFailed());
+        ASSERT_EQUALS(c.count(TEST_NS), 1000U);
+    }
+
+    TEST_F(DBClientTest, UnorderedBulkOnPipelinedConnection) {
+        c.insert(TEST_NS, BSON("_id" << 1500));
+        c.insert(TEST_NS, BSON("_id" << 2400));
+
+        DBClientConnection pipelined;
+        pipelined.connect(c.getServerAddress());
+        pipelined.setPipelined(true);
+
+        // Several batches in flight at once, with errors in two of them.
+        BulkOperationBuilder bulk(&pipelined, TEST_NS, false);
+        for (int i = 0; i < 2500; ++i)
+            bulk.insert(BSON("_id" << i));
+        bulk.find(BSON("_id" << 9000)).upsert().updateOne(BSON("$set" << BSON("x" << 1)));
+
+        WriteResult result;
+        ASSERT_THROWS(bulk.execute(&WriteConcern::acknowledged, &result), OperationException);
+
+        ASSERT_EQUALS(result.nInserted(), 2498);
+        ASSERT_EQUALS(result.nUpserted(), 1);
+        ASSERT_EQUALS(result.writeErrors().size(), 2U);
+        ASSERT_EQUALS(result.writeErrors()[0]["index"].numberInt(), 1500);
+        ASSERT_EQUALS(result.writeErrors()[1]["index"].numberInt(), 2400);
+        ASSERT_EQUALS(result.upserted().front()["index"].numberInt(), 2500);
+        ASSERT_EQUALS(c.count(TEST_NS), 2501U);
+    }
+
+    void insertRange(BulkWriter* writer, int begin, int end) {
+        for (int i = begin; i < end; ++i)
+            writer->insert(BSON("_id" << i));
+    }
+
+    TEST_F(DBClientTest, BulkWriter) {
+        c.insert(TEST_NS, BSON("_id" << -1));
+
+        BulkWriter writer(TEST_NS, stdx::bind(&makeScanConnection, &c),
+                          BulkWriter::Options()
+                              .setMaxBatchOperations(100)
+                              .setFlushIntervalMillis(60 * 1000)
+                              .setMaxQueuedOperations(250)
+                              .setMaxConnections(3));
+
+        // Several threads queueing at once.
+        boost::thread_group inserters;
+        for (int i = 0; i < 4; ++i)
+            inserters.create_thread(stdx::bind(&insertRange, &writer, i * 1000, (i + 1) * 1000));
+        inserters.join_all();
+
+        Future<BSONObj> duplicate = writer.insert(BSON("_id" << -1));
+        Future<BSONObj> upsert = writer.update(BSON("_id" << 5000),
+                                               BSON("$set" << BSON("x" << 1)),
+                                               true);
+        Future<BSONObj> removed = writer.remove(BSON("_id" << 0), true);
+        writer.flush();
+
+        ASSERT_EQUALS(duplicate.getStatus().code(), 11000);
+        ASSERT_EQUALS(upsert.get()["_id"].numberInt(), 5000);
+        ASSERT_OK(removed.getStatus());
+        ASSERT_EQUALS(c.count(TEST_NS), 4001U);
+
+        BulkWriter::Stats stats = writer.getStats();
+        ASSERT_EQUALS(stats.operations, 4003);
+        ASSERT_EQUALS(stats.failedOperations, 1);
+        ASSERT_EQUALS(stats.batchesForCount, 40);
+        ASSERT_EQUALS(stats.batchesForFlush, 1);
+
+        writer.close();
+        ASSERT_THROWS(writer.insert(BSON("_id" << 6000)), UserException);
+    }
+
+    TEST_F(DBClientTest, BulkWriterFlushesOnTime) {
+        BulkWriter writer(TEST_NS, stdx::bind(&makeScanConnection, &c),
+                          BulkWriter::Options().setFlushIntervalMillis(10));
+        Future<BSONObj> result = writer.insert(BSON("_id" << 1));
+        ASSERT_OK(result.getStatus());
+        ASSERT_EQUALS(writer.getStats().batchesForTime, 1);
+        ASSERT_EQUALS(c.count(TEST_NS), 1U);
+    }
+
     TEST_F(DBClientTest, GetPrevError) {
         c.insert(TEST_NS, BSON("_id" << 1));
         ASSERT_THROWS(
@@ -0,0 +1,190 @@
+/*    Copyright 2014 MongoDB Inc.
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+#pragma once
+
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/locks.hpp>
+#include <boost/thread/mutex.hpp>
+#include <vector>
+
+#include "mongo/base/status.h"
+#include "mongo/stdx/functional.h"
+#include "mongo/util/assert_util.h"
+
+namespace mongo {
+
+    template <typename T> class Promise;
+
+    /**
+     * The result of an operation which completes on another thread: either a value of type T,
+     * or a non-OK Status describing why there is no value.
+     *
+     * Futures are cheap to copy; all copies refer to the same result. A default constructed
+     * Future is not associated with any Promise, and must not be waited on.
+     *
+     * This class is thread-safe.
+     */
+    template <typename T>
+    class Future {
+    public:
+        typedef stdx::function<void(const Future<T>&)> Callback;
+
+        Future() {}
+
+        /** Returns a Future which is already completed with 'value'. */
+        static Future<T> makeReady(const T& value) {
+            Promise<T> promise;
+            promise.setValue(value);
+            return promise.getFuture();
+        }
+
+        /** Returns a Future which is already completed with the non-OK 'status'. */
+        static Future<T> makeError(const Status& status) {
+            Promise<T> promise;
+            promise.setError(status);
+            return promise.getFuture();
+        }
+
+        bool valid() const {
+            return _state.get() != NULL;
+        }
+
+        bool isReady() const {
+            boost::lock_guard<boost::mutex> lk(_state->mutex);
+            return _state->ready;
+        }
+
+        /** Blocks until the result is available. */
+        void wait() const {
+            boost::unique_lock<boost::mutex> lk(_state->mutex);
+            while (!_state->ready)
+                _state->condition.wait(lk);
+        }
+
+        /** Blocks for at most 'millis' milliseconds. Returns true if the result is available. */
+        bool waitFor(unsigned millis) const {
+            boost::unique_lock<boost::mutex> lk(_state->mutex);
+            if (!_state->ready)
+                _state->condition.timed_wait(lk, boost::posix_time::milliseconds(millis));
+            return _state->ready;
+        }
+
+        /** Blocks until the result is available, then returns OK if there is a value. */
+        Status getStatus() const {
+            wait();
+            return _state->status;
+        }
+
+        /**
+         * Blocks until the result is available, then returns the value. Throws a UserException
+         * carrying the error if the operation failed.
+         */
+        const T& get() const {
+            wait();
+            uassertStatusOK(_state->status);
+            return _state->value;
+        }
+
+        /**
+         * Arranges for 'callback' to be called with this future once the result is available.
+         * If it already is, the callback runs immediately on the calling thread; otherwise it
+         * runs on the thread which completes the Promise, and so must not block.
+         */
+        void onReady(const Callback& callback) const {
+            {
+                boost::lock_guard<boost::mutex> lk(_state->mutex);
+                if (!_state->ready) {
+                    _state->callbacks.push_back(callback);
+                    return;
+                }
+            }
+            callback(*this);
+        }
+
+    private:
+        friend class Promise<T>;
+
+        struct State {
+            State() : ready(false), status(Status::OK()) {}
+
+            boost::mutex mutex;
+            boost::condition_variable condition;
+            bool ready;
+            Status status;
+            T value;
+            std::vector<Callback> callbacks;
+        };
+
+        explicit Future(const boost::shared_ptr<State>& state) : _state(state) {}
+
+        boost::shared_ptr<State> _state;
+    };
+
+    /**
+     * The producing side of a Future. Exactly one of setValue() or setError() must be called,
+     * exactly once, on one of the copies of a Promise.
+     */
+    template <typename T>
+    class Promise {
+    public:
+        Promise() : _state(new typename Future<T>::State()) {}
+
+        Future<T> getFuture() const {
+            return Future<T>(_state);
+        }
+
+        void setValue(const T& value) {
+            std::vector<typename Future<T>::Callback> callbacks;
+            {
+                boost::lock_guard<boost::mutex> lk(_state->mutex);
+                _state->value = value;
+                _complete(&callbacks);
+            }
+            _runCallbacks(callbacks);
+        }
+
+        void setError(const Status& status) {
+            invariant(!status.isOK());
+            std::vector<typename Future<T>::Callback> callbacks;
+            {
+                boost::lock_guard<boost::mutex> lk(_state->mutex);
+                _state->status = status;
+                _complete(&callbacks);
+            }
+            _runCallbacks(callbacks);
+        }
+
+    private:
+        // Must be called with _state->mutex held.
+        void _complete(std::vector<typename Future<T>::Callback>* callbacks) {
+            invariant(!_state->ready);
+            _state->ready = true;
+            _state->condition.notify_all();
+            callbacks->swap(_state->callbacks);
+        }
+
+        // Callbacks are run after the lock is released, since they may inspect the future.
+        void _runCallbacks(const std::vector<typename Future<T>::Callback>& callbacks) {
+            const Future<T> future(_state);
+            for (size_t i = 0; i < callbacks.size(); i++)
+                callbacks[i](future);
+        }
+
+        boost::shared_ptr<typename Future<T>::State> _state;
+    };
+
+} // namespace mongo
@@ -0,0 +1,270 @@
+/*    Copyright 2014 MongoDB Inc.
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+#define MONGO_LOG_DEFAULT_COMPONENT ::mongo::logger::LogComponent::kNetwork
+
+#include "mongo/platform/basic.h"
+
+#include "mongo/util/net/dns_cache.h"
+
+#include <cstring>
+
+#ifndef _WIN32
+#include <netdb.h>
+#include <sys/socket.h>
+#endif
+
+#include "mongo/bson/util/builder.h"
+#include "mongo/client/options.h"
+#include "mongo/db/jsobj.h"
+#include "mongo/util/background.h"
+#include "mongo/util/log.h"
+#include "mongo/util/scopeguard.h"
+#include "mongo/util/time_support.h"
+
+namespace mongo {
+
+#if !defined(_MSC_EXTENSIONS)
+    const int DNSCache::kMaxEntries;
+#endif
+
+    class DNSCache::RefreshThread : public BackgroundJob {
+    public:
+        explicit RefreshThread(DNSCache* cache) : _cache(cache) {}
+
+        virtual std::string name() const {
+            return "DNSCacheRefresh";
+        }
+
+        virtual void run() {
+            _cache->_refreshLoop();
+        }
+
+    private:
+        DNSCache* const _cache;
+    };
+
+    DNSCache::Stats::Stats()
+        : hits(0)
+        , negativeHits(0)
+        , misses(0)
+        , refreshes(0)
+        , entries(0) {
+    }
+
+    void DNSCache::Stats::append(BSONObjBuilder* builder) const {
+        builder->append("hits", hits);
+        builder->append("negativeHits", negativeHits);
+        builder->append("misses", misses);
+        builder->append("refreshes", refreshes);
+        builder->append("entries", entries);
+    }
+
+    DNSCache* DNSCache::get() {
+        static DNSCache* const globalCache =
+            new DNSCache(lookupUncached,
+                         client::Options::current().DNSCacheTTLMillis(),
+                         client::Options::current().DNSNegativeCacheTTLMillis());
+        return globalCache;
+    }
+
+    int DNSCache::lookupUncached(const std::string& host, int port, std::vector<SockAddr>* out) {
+        addrinfo hints;
+        memset(&hints, 0, sizeof(addrinfo));
+        hints.ai_socktype = SOCK_STREAM;
+        hints.ai_family = (IPv6Enabled() ? AF_UNSPEC : AF_INET);
+
+        StringBuilder ss;
+        ss << port;
+
+        addrinfo* addrs = NULL;
+        const int ret = getaddrinfo(host.c_str(), ss.str().c_str(), &hints, &addrs);
+        if (ret)
+            return ret;
+        ON_BLOCK_EXIT(freeaddrinfo, addrs);
+
+        out->clear();
+        for (addrinfo* ai = addrs; ai; ai = ai->ai_next) {
+            out->push_back(SockAddr(ai->ai_addr, ai->ai_addrlen));
+        }
+        return 0;
+    }
+
+    DNSCache::DNSCache(const LookupFunction& lookup, int ttlMillis, int negativeTTLMillis)
+        : _lookup(lookup)
+        , _ttlMillis(ttlMillis > 0 ? ttlMillis : 0)
+        , _negativeTTLMillis(negativeTTLMillis > 0 ? negativeTTLMillis : 0)
+        , _inShutdown(false) {
+    }
+
+    DNSCache::~DNSCache() {
+        {
+            boost::lock_guard<boost::mutex> lk(_mutex);
+            _inShutdown = true;
+        }
+        _refreshNeeded.notify_all();
+
+        if (_refreshThread)
+            _refreshThread->wait();
+    }
+
+    int DNSCache::resolve(const std::string& host, int port, std::vector<SockAddr>* out) {
+        const Key key(host, port);
+
+        if (_ttlMillis || _negativeTTLMillis) {
+            const unsigned long long now = curTimeMillis64();
+
+            boost::lock_guard<boost::mutex> lk(_mutex);
+            EntryMap::iterator it = _entries.find(key);
+            if (it != _entries.end() && now < it->second.expiresMillis &&
+                it->second.ipv6 == IPv6Enabled()) {
+
+                Entry& entry = it->second;
+                if (entry.error) {
+                    _negativeHits.fetchAndAdd(1);
+                    return entry.error;
+                }
+
+                _hits.fetchAndAdd(1);
+                *out = entry.addrs;
+
+                if (!entry.refreshing && now >= entry.refreshAfterMillis) {
+                    entry.refreshing = true;
+                    _scheduleRefresh(key);
+                }
+                return 0;
+            }
+        }
+
+        _misses.fetchAndAdd(1);
+        return _lookupAndStore(key, out);
+    }
+
+    void DNSCache::flush() {
+        boost::lock_guard<boost::mutex> lk(_mutex);
+        _entries.clear();
+        _refreshQueue.clear();
+    }
+
+    DNSCache::Stats DNSCache::getStats() const {
+        Stats stats;
+        stats.hits = _hits.load();
+        stats.negativeHits = _negativeHits.load();
+        stats.misses = _misses.load();
+        stats.refreshes = _refreshes.load();
+
+        boost::lock_guard<boost::mutex> lk(_mutex);
+        stats.entries = _entries.size();
+        return stats;
+    }
+
+    int DNSCache::_lookupAndStore(const Key& key, std::vector<SockAddr>* out) {
+        const bool ipv6 = IPv6Enabled();
+        std::vector<SockAddr> addrs;
+        const int ret = _lookup(key.first, key.second, &addrs);
+
+        boost::lock_guard<boost::mutex> lk(_mutex);
+        _store(key, ret, addrs, ipv6);
+        if (ret == 0)
+            *out = addrs;
+        return ret;
+    }
+
+    void DNSCache::_store(const Key& key,
+                          int error,
+                          const std::vector<SockAddr>& addrs,
+                          bool ipv6) {
+        const unsigned long long ttl = error ? _negativeTTLMillis : _ttlMillis;
+        if (ttl == 0) {
+            _entries.erase(key);
+            return;
+        }
+
+        const unsigned long long now = curTimeMillis64();
+        if (_entries.size() >= static_cast<size_t>(kMaxEntries) && !_entries.count(key)) {
+            for (EntryMap::iterator it = _entries.begin(); it != _entries.end();) {
+                if (it->second.expiresMillis <= now)
+                    _entries.erase(it++);
+                else
+                    ++it;
+            }
+
+            // Still full of live entries, so make room at the expense of an arbitrary one.
+            if (_entries.size() >= static_cast<size_t>(kMaxEntries))
+                _entries.erase(_entries.begin());
+        }
+
+        Entry& entry = _entries[key];
+        entry.error = error;
+        entry.addrs = addrs;
+        entry.expiresMillis = now + ttl;
+        entry.ipv6 = ipv6;
+        entry.refreshing = false;
+        entry.refreshAfterMillis = now + ttl / 4 * 3;
+    }
+
+    void DNSCache::_scheduleRefresh(const Key& key) {
+        _refreshQueue.push_back(key);
+
+        if (!_refreshThread) {
+            _refreshThread.reset(new RefreshThread(this));
+            _refreshThread->go();
+        }
+        _refreshNeeded.notify_one();
+    }
+
+    void DNSCache::_refreshLoop() {
+        boost::unique_lock<boost::mutex> lk(_mutex);
+        while (true) {
+            while (_refreshQueue.empty() && !_inShutdown)
+                _refreshNeeded.wait(lk);
+            if (_inShutdown)
+                return;
+
+            const Key key = _refreshQueue.front();
+            _refreshQueue.pop_front();
+
+            lk.unlock();
+            const bool ipv6 = IPv6Enabled();
+            std::vector<SockAddr> addrs;
+            const int ret = _lookup(key.first, key.second, &addrs);
+            _refreshes.fetchAndAdd(1);
+            lk.lock();
+
+            EntryMap::iterator it = _entries.find(key);
+            if (it == _entries.end()) {
+                // Flushed while we were looking it up.
+                continue;
+            }
+
+            if (ret) {
+                // Keep serving the old addresses until they expire rather than failing for a
+                // host that resolved a moment ago; the next use after that looks it up again.
+                // Meanwhile a resolver which is failing isn't asked on every use.
+                LOG(1) << "refreshing addresses of " << key.first << " failed: "
+                       << getAddrInfoStrError(ret);
+                Entry& entry = it->second;
+                entry.refreshing = false;
+                entry.refreshAfterMillis = _negativeTTLMillis
+                    ? curTimeMillis64() + _negativeTTLMillis
+                    : entry.expiresMillis;
+                continue;
+            }
+
+            _store(key, ret, addrs, ipv6);
+        }
+    }
+
+} // namespace mongo
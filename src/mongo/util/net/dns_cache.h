@@ -0,0 +1,150 @@
+/*    Copyright 2014 MongoDB Inc.
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+#pragma once
+
+#include <boost/noncopyable.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <deque>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "mongo/client/export_macros.h"
+#include "mongo/platform/atomic_word.h"
+#include "mongo/stdx/functional.h"
+#include "mongo/util/net/sock.h"
+
+namespace mongo {
+
+    class BSONObjBuilder;
+
+    /**
+     * Caches the results of resolving host names, so connecting to a host doesn't have to wait
+     * for the resolver every time.
+     *
+     * Successful lookups are kept for the positive TTL and failed ones for the negative TTL.
+     * getaddrinfo doesn't tell us the TTLs of the DNS records, so these are fixed. When an entry
+     * is used in the last quarter of its life it is looked up again on a background thread, so
+     * hosts in regular use don't keep expiring. If that lookup fails, the old addresses are kept
+     * and the next try waits for the negative TTL, or for the entry to expire if that is 0. A
+     * TTL of 0 turns caching of that kind off.
+     *
+     * This class is thread-safe.
+     */
+    class MONGO_CLIENT_API DNSCache : boost::noncopyable {
+    public:
+        /**
+         * Resolves a host name and port, setting 'out' to the addresses in the resolver's order.
+         * Returns 0 or a getaddrinfo error code.
+         */
+        typedef stdx::function<int (const std::string& host,
+                                    int port,
+                                    std::vector<SockAddr>* out)> LookupFunction;
+
+        static const int kMaxEntries = 10000;
+
+        struct Stats {
+            Stats();
+
+            void append(BSONObjBuilder* builder) const;
+
+            // Resolves answered from the cache, split by whether the cached lookup had failed.
+            long long hits;
+            long long negativeHits;
+
+            // Resolves which had to wait for a lookup.
+            long long misses;
+
+            // Lookups made in the background for entries about to expire.
+            long long refreshes;
+
+            long long entries;
+        };
+
+        /**
+         * The cache used by SockAddr for all host names, with the TTLs from client::Options.
+         */
+        static DNSCache* get();
+
+        /** Resolves with getaddrinfo, honoring IPv6Enabled(). */
+        static int lookupUncached(const std::string& host, int port, std::vector<SockAddr>* out);
+
+        DNSCache(const LookupFunction& lookup, int ttlMillis, int negativeTTLMillis);
+        ~DNSCache();
+
+        /**
+         * Like LookupFunction, but answers from the cache where it can.
+         */
+        int resolve(const std::string& host, int port, std::vector<SockAddr>* out);
+
+        /** Drops every entry, so the next resolve of each host does a fresh lookup. */
+        void flush();
+
+        Stats getStats() const;
+
+    private:
+        class RefreshThread;
+
+        struct Entry {
+            int error;
+            std::vector<SockAddr> addrs;
+            unsigned long long expiresMillis;
+
+            // IPv6Enabled() at the time of the lookup; the entry is stale if it has changed.
+            bool ipv6;
+
+            // Whether a refresh is queued or running, and when using the entry may queue the
+            // next one. A failed refresh pushes that back by the negative TTL.
+            bool refreshing;
+            unsigned long long refreshAfterMillis;
+        };
+
+        typedef std::pair<std::string, int> Key;
+        typedef std::map<Key, Entry> EntryMap;
+
+        // Runs a lookup and caches the result, replacing any entry for 'key'.
+        int _lookupAndStore(const Key& key, std::vector<SockAddr>* out);
+
+        // Caches the result of a lookup. Call with _mutex held.
+        void _store(const Key& key, int error, const std::vector<SockAddr>& addrs, bool ipv6);
+
+        // Queues 'key' for the refresh thread. Call with _mutex held.
+        void _scheduleRefresh(const Key& key);
+
+        // Body of the refresh thread.
+        void _refreshLoop();
+
+        const LookupFunction _lookup;
+        const unsigned long long _ttlMillis;
+        const unsigned long long _negativeTTLMillis;
+
+        AtomicInt64 _hits;
+        AtomicInt64 _negativeHits;
+        AtomicInt64 _misses;
+        AtomicInt64 _refreshes;
+
+        // protects everything below
+        mutable boost::mutex _mutex;
+        boost::condition_variable _refreshNeeded;
+        EntryMap _entries;
+        std::deque<Key> _refreshQueue;
+        bool _inShutdown;
+        boost::scoped_ptr<RefreshThread> _refreshThread;
+    };
+
+} // namespace mongo
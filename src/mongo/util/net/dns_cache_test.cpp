@@ -0,0 +1,221 @@
+/*    Copyright 2014 MongoDB Inc.
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+#include "mongo/platform/basic.h"
+
+#include "mongo/util/net/dns_cache.h"
+
+#include <string>
+#include <vector>
+
+#ifndef _WIN32
+#include <netdb.h>
+#endif
+
+#include "mongo/platform/atomic_word.h"
+#include "mongo/unittest/unittest.h"
+#include "mongo/util/mongoutils/str.h"
+#include "mongo/util/time_support.h"
+
+namespace {
+
+    using namespace mongo;
+
+    /**
+     * Stands in for getaddrinfo. Every host resolves to 10.0.0.<n>, where n counts the lookups
+     * made so far, so a test can tell a cached answer from a fresh one.
+     */
+    class FakeResolver {
+    public:
+        FakeResolver() : _error(0) {}
+
+        DNSCache::LookupFunction function() {
+            return stdx::bind(&FakeResolver::lookup, this,
+                              stdx::placeholders::_1,
+                              stdx::placeholders::_2,
+                              stdx::placeholders::_3);
+        }
+
+        void setError(int error) { _error.store(error); }
+
+        int lookups() const { return _lookups.load(); }
+
+    private:
+        int lookup(const std::string& host, int port, std::vector<SockAddr>* out) {
+            const int n = _lookups.addAndFetch(1);
+            if (_error.load())
+                return _error.load();
+
+            out->clear();
+            out->push_back(SockAddr(std::string(str::stream() << "10.0.0." << n).c_str(), port));
+            return 0;
+        }
+
+        AtomicInt32 _lookups;
+        AtomicInt32 _error;
+    };
+
+    // Returns the single address 'host' resolves to, or "failed".
+    std::string resolveOne(DNSCache* cache, const std::string& host) {
+        std::vector<SockAddr> addrs;
+        if (cache->resolve(host, 27017, &addrs) != 0 || addrs.size() != 1)
+            return "failed";
+        return addrs[0].getAddr();
+    }
+
+    TEST(DNSCacheTest, CachesAddresses) {
+        FakeResolver resolver;
+        DNSCache cache(resolver.function(), 60 * 1000, 5 * 1000);
+
+        ASSERT_EQUALS("10.0.0.1", resolveOne(&cache, "db.example.com"));
+        ASSERT_EQUALS("10.0.0.1", resolveOne(&cache, "db.example.com"));
+        ASSERT_EQUALS(1, resolver.lookups());
+
+        // Other hosts have their own entries.
+        ASSERT_EQUALS("10.0.0.2", resolveOne(&cache, "other.example.com"));
+
+        DNSCache::Stats stats = cache.getStats();
+        ASSERT_EQUALS(1, stats.hits);
+        ASSERT_EQUALS(2, stats.misses);
+        ASSERT_EQUALS(2, stats.entries);
+    }
+
+    TEST(DNSCacheTest, CachesFailures) {
+        FakeResolver resolver;
+        resolver.setError(EAI_NONAME);
+        DNSCache cache(resolver.function(), 60 * 1000, 5 * 1000);
+
+        std::vector<SockAddr> addrs;
+        ASSERT_EQUALS(EAI_NONAME, cache.resolve("missing.example.com", 27017, &addrs));
+        ASSERT_EQUALS(EAI_NONAME, cache.resolve("missing.example.com", 27017, &addrs));
+        ASSERT(addrs.empty());
+        ASSERT_EQUALS(1, resolver.lookups());
+        ASSERT_EQUALS(1, cache.getStats().negativeHits);
+    }
+
+    TEST(DNSCacheTest, ExpiredEntriesAreLookedUpAgain) {
+        FakeResolver resolver;
+        resolver.setError(EAI_NONAME);
+        DNSCache cache(resolver.function(), 100, 50);
+
+        std::vector<SockAddr> addrs;
+        ASSERT_EQUALS(EAI_NONAME, cache.resolve("db.example.com", 27017, &addrs));
+        sleepmillis(100);
+
+        // The failure has expired, so the host gets another chance.
+        resolver.setError(0);
+        ASSERT_EQUALS("10.0.0.2", resolveOne(&cache, "db.example.com"));
+        sleepmillis(150);
+        ASSERT_EQUALS("10.0.0.3", resolveOne(&cache, "db.example.com"));
+        ASSERT_EQUALS(3, cache.getStats().misses);
+    }
+
+    TEST(DNSCacheTest, ZeroTTLDisablesCaching) {
+        FakeResolver resolver;
+        DNSCache cache(resolver.function(), 0, 0);
+
+        ASSERT_EQUALS("10.0.0.1", resolveOne(&cache, "db.example.com"));
+        ASSERT_EQUALS("10.0.0.2", resolveOne(&cache, "db.example.com"));
+        ASSERT_EQUALS(0, cache.getStats().entries);
+    }
+
+    TEST(DNSCacheTest, EntriesInUseAreRefreshedInTheBackground) {
+        FakeResolver resolver;
+        DNSCache cache(resolver.function(), 400, 50);
+
+        ASSERT_EQUALS("10.0.0.1", resolveOne(&cache, "db.example.com"));
+
+        // Near the end of its life the entry is still served, and looked up again.
+        sleepmillis(320);
+        ASSERT_EQUALS("10.0.0.1", resolveOne(&cache, "db.example.com"));
+        for (int i = 0; i < 100 && cache.getStats().refreshes == 0; i++)
+            sleepmillis(10);
+        ASSERT_EQUALS(1, cache.getStats().refreshes);
+        ASSERT_EQUALS(2, resolver.lookups());
+
+        // Past the original expiry, the refreshed entry answers without waiting for a lookup.
+        sleepmillis(100);
+        ASSERT_EQUALS("10.0.0.2", resolveOne(&cache, "db.example.com"));
+        ASSERT_EQUALS(1, cache.getStats().misses);
+    }
+
+    TEST(DNSCacheTest, FailedRefreshKeepsOldAddresses) {
+        FakeResolver resolver;
+        DNSCache cache(resolver.function(), 400, 50);
+
+        ASSERT_EQUALS("10.0.0.1", resolveOne(&cache, "db.example.com"));
+
+        resolver.setError(EAI_AGAIN);
+        sleepmillis(320);
+        ASSERT_EQUALS("10.0.0.1", resolveOne(&cache, "db.example.com"));
+        for (int i = 0; i < 100 && cache.getStats().refreshes == 0; i++)
+            sleepmillis(10);
+
+        ASSERT_EQUALS("10.0.0.1", resolveOne(&cache, "db.example.com"));
+        ASSERT_EQUALS(0, cache.getStats().negativeHits);
+    }
+
+    TEST(DNSCacheTest, FailedRefreshBacksOff) {
+        FakeResolver resolver;
+        DNSCache cache(resolver.function(), 1000, 100);
+
+        ASSERT_EQUALS("10.0.0.1", resolveOne(&cache, "db.example.com"));
+
+        resolver.setError(EAI_AGAIN);
+        sleepmillis(760);
+        ASSERT_EQUALS("10.0.0.1", resolveOne(&cache, "db.example.com"));
+        for (int i = 0; i < 100 && cache.getStats().refreshes == 0; i++)
+            sleepmillis(10);
+        ASSERT_EQUALS(1, cache.getStats().refreshes);
+
+        // Within the negative TTL of the failure, using the entry doesn't try again.
+        for (int i = 0; i < 10; i++)
+            ASSERT_EQUALS("10.0.0.1", resolveOne(&cache, "db.example.com"));
+        sleepmillis(20);
+        ASSERT_EQUALS(1, cache.getStats().refreshes);
+        ASSERT_EQUALS(2, resolver.lookups());
+
+        // After it, the next use does.
+        sleepmillis(100);
+        ASSERT_EQUALS("10.0.0.1", resolveOne(&cache, "db.example.com"));
+        for (int i = 0; i < 100 && cache.getStats().refreshes == 1; i++)
+            sleepmillis(10);
+        ASSERT_EQUALS(2, cache.getStats().refreshes);
+        ASSERT_EQUALS(3, resolver.lookups());
+    }
+
+    TEST(DNSCacheTest, Flush) {
+        FakeResolver resolver;
+        DNSCache cache(resolver.function(), 60 * 1000, 5 * 1000);
+
+        ASSERT_EQUALS("10.0.0.1", resolveOne(&cache, "db.example.com"));
+        cache.flush();
+        ASSERT_EQUALS(0, cache.getStats().entries);
+        ASSERT_EQUALS("10.0.0.2", resolveOne(&cache, "db.example.com"));
+    }
+
+    TEST(DNSCacheTest, GlobalCacheResolvesNames) {
+        std::vector<SockAddr> addrs;
+        ASSERT_EQUALS(0, DNSCache::get()->resolve("localhost", 27017, &addrs));
+        ASSERT_FALSE(addrs.empty());
+        ASSERT(addrs[0].isLocalHost());
+
+        // Numeric addresses never reach the cache.
+        const long long misses = DNSCache::get()->getStats().misses;
+        ASSERT_EQUALS("127.0.0.1", hostbyname("127.0.0.1"));
+        ASSERT_EQUALS(misses, DNSCache::get()->getStats().misses);
+    }
+
+} // namespace
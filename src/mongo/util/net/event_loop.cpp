@@ -0,0 +1,666 @@
+/*    Copyright 2014 MongoDB Inc.
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+#define MONGO_LOG_DEFAULT_COMPONENT ::mongo::logger::LogComponent::kNetwork
+
+#include "mongo/platform/basic.h"
+
+#include "mongo/util/net/event_loop.h"
+
+#ifndef _WIN32
+
+#include <boost/thread/locks.hpp>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <vector>
+
+#if defined(__linux__)
+#include <sys/epoll.h>
+#else
+#include "mongo/util/net/socket_poll.h"
+#endif
+
+#include "mongo/util/assert_util.h"
+#include "mongo/util/background.h"
+#include "mongo/util/log.h"
+#include "mongo/util/mongoutils/str.h"
+#include "mongo/util/net/receive_buffer_pool.h"
+
+namespace mongo {
+
+    using std::string;
+    using std::vector;
+
+namespace {
+
+#ifdef MSG_NOSIGNAL
+    const int kSendFlags = MSG_NOSIGNAL;
+#else
+    const int kSendFlags = 0;
+#endif
+
+    void setNonBlocking(int fd) {
+        const int flags = fcntl(fd, F_GETFL, 0);
+        uassert(ErrorCodes::InternalError,
+                str::stream() << "can't get socket flags: " << errnoWithDescription(),
+                flags >= 0);
+        uassert(ErrorCodes::InternalError,
+                str::stream() << "can't make socket non-blocking: " << errnoWithDescription(),
+                fcntl(fd, F_SETFL, flags | O_NONBLOCK) == 0);
+    }
+
+    bool wouldBlock(int err) {
+        return err == EAGAIN || err == EWOULDBLOCK;
+    }
+
+} // namespace
+
+    //
+    // Poller: the readiness notification backend
+    //
+
+    /**
+     * Watches file descriptors for readability and, on request, writability. Level triggered.
+     */
+    class EventLoop::Poller : boost::noncopyable {
+    public:
+        struct Event {
+            int fd;
+            bool readable;
+            bool writable;
+        };
+
+#if defined(__linux__)
+
+        Poller() : _epollFd(epoll_create(1024)) {
+            uassert(ErrorCodes::InternalError,
+                    str::stream() << "epoll_create failed: " << errnoWithDescription(),
+                    _epollFd >= 0);
+        }
+
+        ~Poller() {
+            ::close(_epollFd);
+        }
+
+        void add(int fd) {
+            _control(EPOLL_CTL_ADD, fd, false);
+        }
+
+        void remove(int fd) {
+            epoll_event unused = epoll_event();
+            epoll_ctl(_epollFd, EPOLL_CTL_DEL, fd, &unused);
+        }
+
+        void setWantWrite(int fd, bool wantWrite) {
+            _control(EPOLL_CTL_MOD, fd, wantWrite);
+        }
+
+        void wait(vector<Event>* events) {
+            epoll_event ready[kMaxEvents];
+            const int n = epoll_wait(_epollFd, ready, kMaxEvents, -1);
+            if (n < 0) {
+                massert(ErrorCodes::InternalError,
+                        str::stream() << "epoll_wait failed: " << errnoWithDescription(),
+                        errno == EINTR);
+                return;
+            }
+
+            for (int i = 0; i < n; i++) {
+                // Errors and hangups are reported as readable, so the read reports them.
+                Event event;
+                event.fd = ready[i].data.fd;
+                event.readable = ready[i].events & (EPOLLIN | EPOLLERR | EPOLLHUP);
+                event.writable = ready[i].events & EPOLLOUT;
+                events->push_back(event);
+            }
+        }
+
+    private:
+        static const int kMaxEvents = 256;
+
+        void _control(int op, int fd, bool wantWrite) {
+            epoll_event event = epoll_event();
+            event.events = wantWrite ? (EPOLLIN | EPOLLOUT) : EPOLLIN;
+            event.data.fd = fd;
+            uassert(ErrorCodes::InternalError,
+                    str::stream() << "epoll_ctl failed: " << errnoWithDescription(),
+                    epoll_ctl(_epollFd, op, fd, &event) == 0);
+        }
+
+        const int _epollFd;
+
+#else
+
+        void add(int fd) {
+            _fds[fd] = POLLIN;
+        }
+
+        void remove(int fd) {
+            _fds.erase(fd);
+        }
+
+        void setWantWrite(int fd, bool wantWrite) {
+            _fds[fd] = POLLIN | (wantWrite ? POLLOUT : 0);
+        }
+
+        void wait(vector<Event>* events) {
+            vector<pollfd> pollFds;
+            pollFds.reserve(_fds.size());
+            for (std::map<int, short>::const_iterator it = _fds.begin(); it != _fds.end(); ++it) {
+                pollfd pfd;
+                pfd.fd = it->first;
+                pfd.events = it->second;
+                pfd.revents = 0;
+                pollFds.push_back(pfd);
+            }
+
+            const int n = socketPoll(&pollFds[0], pollFds.size(), -1);
+            if (n < 0) {
+                massert(ErrorCodes::InternalError,
+                        str::stream() << "poll failed: " << errnoWithDescription(),
+                        errno == EINTR);
+                return;
+            }
+
+            for (size_t i = 0; i < pollFds.size(); i++) {
+                if (!pollFds[i].revents)
+                    continue;
+
+                // Errors and hangups are reported as readable, so the read reports them.
+                Event event;
+                event.fd = pollFds[i].fd;
+                event.readable = pollFds[i].revents & (POLLIN | POLLERR | POLLHUP | POLLNVAL);
+                event.writable = pollFds[i].revents & POLLOUT;
+                events->push_back(event);
+            }
+        }
+
+    private:
+        std::map<int, short> _fds;
+
+#endif
+    };
+
+    //
+    // Per-connection state and queued commands
+    //
+
+    struct EventLoop::Connection {
+        struct PendingSend {
+            MessagePtr message;
+            CompletionHandler onSent;
+        };
+
+        Connection(ConnectionId id,
+                   const boost::shared_ptr<Socket>& socket,
+                   const MessageHandler& onMessage,
+                   const CompletionHandler& onClose)
+            : id(id)
+            , socket(socket)
+            , fd(socket->rawFD())
+            , onMessage(onMessage)
+            , onClose(onClose)
+            , headerRead(0)
+            , messageLen(0)
+            , messageRead(0)
+            , writeOffset(0)
+            , wantWrite(false) {
+        }
+
+        const ConnectionId id;
+        const boost::shared_ptr<Socket> socket;
+        const int fd;
+        const MessageHandler onMessage;
+        const CompletionHandler onClose;
+
+        // The message being read: first its header, then the whole message into 'body'.
+        MSGHEADER::Value header;
+        int headerRead;
+        SharedBuffer body;
+        int messageLen;
+        int messageRead;
+
+        // Messages waiting to be written, and how much of the first one has been.
+        std::deque<PendingSend> writes;
+        int writeOffset;
+        bool wantWrite;
+    };
+
+    struct EventLoop::Command {
+        enum Type { kAdd, kSend, kRemove };
+
+        Command(Type type, ConnectionId id)
+            : type(type)
+            , id(id)
+            , newConnection(NULL) {
+        }
+
+        const Type type;
+        const ConnectionId id;
+        Connection* newConnection;
+        MessagePtr message;
+        CompletionHandler onSent;
+    };
+
+    class EventLoop::LoopThread : public BackgroundJob {
+    public:
+        explicit LoopThread(EventLoop* loop) : _loop(loop) {}
+
+        virtual string name() const {
+            return "EventLoop";
+        }
+
+        virtual void run() {
+            _loop->_run();
+        }
+
+    private:
+        EventLoop* const _loop;
+    };
+
+    //
+    // EventLoop
+    //
+
+    EventLoop::Stats::Stats()
+        : connections(0)
+        , messagesSent(0)
+        , messagesReceived(0)
+        , bytesSent(0)
+        , bytesReceived(0)
+        , partialWrites(0)
+        , partialReads(0)
+        , iterations(0) {
+    }
+
+    EventLoop::EventLoop()
+        : _poller(new Poller())
+        , _nextConnectionId(1)
+        , _shutdown(false) {
+        uassert(ErrorCodes::InternalError,
+                str::stream() << "can't create event loop wakeup pipe: " << errnoWithDescription(),
+                pipe(_wakeupPipe) == 0);
+        setNonBlocking(_wakeupPipe[0]);
+        setNonBlocking(_wakeupPipe[1]);
+        _poller->add(_wakeupPipe[0]);
+    }
+
+    EventLoop::~EventLoop() {
+        shutdown();
+        ::close(_wakeupPipe[0]);
+        ::close(_wakeupPipe[1]);
+    }
+
+    void EventLoop::start() {
+        boost::lock_guard<boost::mutex> lk(_mutex);
+        uassert(ErrorCodes::ShutdownInProgress, "event loop has been shut down", !_shutdown);
+        if (_thread)
+            return;
+        _thread.reset(new LoopThread(this));
+        _thread->go();
+    }
+
+    void EventLoop::shutdown() {
+        {
+            boost::lock_guard<boost::mutex> lk(_mutex);
+            if (_shutdown)
+                return;
+            uassert(ErrorCodes::IllegalOperation,
+                    "an event loop can't be shut down from one of its handlers",
+                    _loopThread != boost::this_thread::get_id());
+            _shutdown = true;
+        }
+
+        _wakeUp();
+        if (_thread)
+            _thread->wait();
+
+        // The loop thread has stopped, so it is safe to finish up here.
+        _processCommands();
+        _closeAll(Status(ErrorCodes::ShutdownInProgress, "event loop was shut down"));
+    }
+
+    EventLoop::ConnectionId EventLoop::addConnection(const boost::shared_ptr<Socket>& socket,
+                                                     const MessageHandler& onMessage,
+                                                     const CompletionHandler& onClose) {
+#ifdef MONGO_SSL
+        uassert(ErrorCodes::IllegalOperation,
+                "SSL connections can't be used with the event loop",
+                !socket->isSSL());
+#endif
+        setNonBlocking(socket->rawFD());
+
+        Command* command;
+        {
+            boost::lock_guard<boost::mutex> lk(_mutex);
+            uassert(ErrorCodes::ShutdownInProgress, "event loop has been shut down", !_shutdown);
+            const ConnectionId id = _nextConnectionId++;
+            command = new Command(Command::kAdd, id);
+            command->newConnection = new Connection(id, socket, onMessage, onClose);
+            _commands.push_back(command);
+        }
+
+        _wakeUp();
+        return command->id;
+    }
+
+    void EventLoop::send(ConnectionId id, Message& toSend, const CompletionHandler& onSent) {
+        verify(!toSend.empty());
+
+        Command* command = new Command(Command::kSend, id);
+        command->message.reset(new Message());
+        *command->message = toSend;
+        command->message->concat();
+        command->onSent = onSent;
+
+        {
+            boost::lock_guard<boost::mutex> lk(_mutex);
+            if (_shutdown) {
+                delete command;
+                if (onSent)
+                    onSent(Status(ErrorCodes::ShutdownInProgress, "event loop has been shut down"));
+                return;
+            }
+            _commands.push_back(command);
+        }
+
+        _wakeUp();
+    }
+
+    void EventLoop::removeConnection(ConnectionId id) {
+        {
+            boost::lock_guard<boost::mutex> lk(_mutex);
+            if (_shutdown)
+                return;
+            _commands.push_back(new Command(Command::kRemove, id));
+        }
+
+        _wakeUp();
+    }
+
+    EventLoop::Stats EventLoop::getStats() const {
+        boost::lock_guard<boost::mutex> lk(_mutex);
+        return _stats;
+    }
+
+    void EventLoop::_wakeUp() {
+        const char byte = 0;
+        // If the pipe is full, the loop is already due to wake up.
+        while (write(_wakeupPipe[1], &byte, 1) < 0 && errno == EINTR) {
+        }
+    }
+
+    void EventLoop::_drainWakeups() {
+        char buf[256];
+        while (read(_wakeupPipe[0], buf, sizeof(buf)) > 0) {
+        }
+    }
+
+    void EventLoop::_run() {
+        {
+            boost::lock_guard<boost::mutex> lk(_mutex);
+            _loopThread = boost::this_thread::get_id();
+        }
+
+        vector<Poller::Event> events;
+        while (true) {
+            {
+                boost::lock_guard<boost::mutex> lk(_mutex);
+                if (_shutdown)
+                    return;
+            }
+
+            _processCommands();
+
+            events.clear();
+            _poller->wait(&events);
+
+            {
+                boost::lock_guard<boost::mutex> lk(_mutex);
+                _stats.iterations++;
+            }
+
+            for (size_t i = 0; i < events.size(); i++) {
+                const Poller::Event& event = events[i];
+                if (event.fd == _wakeupPipe[0]) {
+                    _drainWakeups();
+                    continue;
+                }
+
+                // The connection may have been closed while handling an earlier event.
+                FdMap::const_iterator it = _connectionsByFd.find(event.fd);
+                if (it == _connectionsByFd.end())
+                    continue;
+
+                Connection* conn = it->second;
+
+                const ConnectionId id = conn->id;
+                if (event.writable)
+                    _handleWritable(conn);
+                if (event.readable && _connections.count(id))
+                    _handleReadable(conn);
+            }
+        }
+    }
+
+    void EventLoop::_processCommands() {
+        std::deque<Command*> commands;
+        {
+            boost::lock_guard<boost::mutex> lk(_mutex);
+            commands.swap(_commands);
+        }
+
+        for (size_t i = 0; i < commands.size(); i++) {
+            boost::scoped_ptr<Command> command(commands[i]);
+
+            if (command->type == Command::kAdd) {
+                Connection* conn = command->newConnection;
+                _connections[conn->id] = conn;
+                _connectionsByFd[conn->fd] = conn;
+                _poller->add(conn->fd);
+
+                boost::lock_guard<boost::mutex> lk(_mutex);
+                _stats.connections++;
+                continue;
+            }
+
+            ConnectionMap::iterator it = _connections.find(command->id);
+            if (it == _connections.end()) {
+                if (command->type == Command::kSend && command->onSent)
+                    command->onSent(Status(ErrorCodes::HostUnreachable,
+                                           "connection is closed"));
+                continue;
+            }
+
+            Connection* conn = it->second;
+            if (command->type == Command::kRemove) {
+                _closeConnection(conn, Status(ErrorCodes::CallbackCanceled,
+                                              "connection was removed from the event loop"));
+                continue;
+            }
+
+            Connection::PendingSend pending;
+            pending.message = command->message;
+            pending.onSent = command->onSent;
+            conn->writes.push_back(pending);
+
+            // Try to write right away; most messages go out without waiting for the poller.
+            if (!conn->wantWrite)
+                _handleWritable(conn);
+        }
+    }
+
+    void EventLoop::_handleWritable(Connection* conn) {
+        while (!conn->writes.empty()) {
+            Connection::PendingSend& pending = conn->writes.front();
+            const char* data = pending.message->singleData().view2ptr();
+            const int len = pending.message->header().getLen();
+
+            const int toWrite = len - conn->writeOffset;
+            const ssize_t written = ::send(conn->fd, data + conn->writeOffset, toWrite, kSendFlags);
+            if (written < 0) {
+                if (errno == EINTR)
+                    continue;
+                if (wouldBlock(errno))
+                    break;
+                _closeConnection(conn, Status(ErrorCodes::HostUnreachable, str::stream()
+                                              << "error writing to "
+                                              << conn->socket->remoteString() << ": "
+                                              << errnoWithDescription()));
+                return;
+            }
+
+            {
+                boost::lock_guard<boost::mutex> lk(_mutex);
+                _stats.bytesSent += written;
+                if (written < toWrite)
+                    _stats.partialWrites++;
+            }
+
+            conn->writeOffset += written;
+            if (conn->writeOffset < len)
+                break;
+
+            CompletionHandler onSent = pending.onSent;
+            conn->writes.pop_front();
+            conn->writeOffset = 0;
+            {
+                boost::lock_guard<boost::mutex> lk(_mutex);
+                _stats.messagesSent++;
+            }
+            if (onSent)
+                onSent(Status::OK());
+        }
+
+        // Only ask to hear about writability while there is something left to write.
+        const bool wantWrite = !conn->writes.empty();
+        if (wantWrite != conn->wantWrite) {
+            _poller->setWantWrite(conn->fd, wantWrite);
+            conn->wantWrite = wantWrite;
+        }
+    }
+
+    void EventLoop::_handleReadable(Connection* conn) {
+        const ConnectionId id = conn->id;
+        while (_connections.count(id)) {
+            char* target;
+            int wanted;
+            if (conn->headerRead < static_cast<int>(sizeof(MSGHEADER::Value))) {
+                target = reinterpret_cast<char*>(&conn->header) + conn->headerRead;
+                wanted = sizeof(MSGHEADER::Value) - conn->headerRead;
+            }
+            else {
+                target = conn->body.get() + conn->messageRead;
+                wanted = conn->messageLen - conn->messageRead;
+            }
+
+            const ssize_t got = ::recv(conn->fd, target, wanted, 0);
+            if (got < 0) {
+                if (errno == EINTR)
+                    continue;
+                if (wouldBlock(errno))
+                    return;
+                _closeConnection(conn, Status(ErrorCodes::HostUnreachable, str::stream()
+                                              << "error reading from "
+                                              << conn->socket->remoteString() << ": "
+                                              << errnoWithDescription()));
+                return;
+            }
+            if (got == 0) {
+                _closeConnection(conn, Status(ErrorCodes::HostUnreachable, str::stream()
+                                              << "connection closed by "
+                                              << conn->socket->remoteString()));
+                return;
+            }
+
+            {
+                boost::lock_guard<boost::mutex> lk(_mutex);
+                _stats.bytesReceived += got;
+                if (got < wanted)
+                    _stats.partialReads++;
+            }
+
+            if (conn->headerRead < static_cast<int>(sizeof(MSGHEADER::Value))) {
+                conn->headerRead += got;
+                if (conn->headerRead < static_cast<int>(sizeof(MSGHEADER::Value)))
+                    continue;
+
+                const int len = conn->header.constView().getMessageLength();
+                if (static_cast<size_t>(len) < sizeof(MSGHEADER::Value) ||
+                    static_cast<size_t>(len) > MaxMessageSizeBytes) {
+                    _closeConnection(conn, Status(ErrorCodes::ProtocolError, str::stream()
+                                                  << "invalid message length " << len
+                                                  << " from " << conn->socket->remoteString()));
+                    return;
+                }
+
+                conn->body = ReceiveBufferPool::allocateShared(len);
+                memcpy(conn->body.get(), &conn->header, sizeof(MSGHEADER::Value));
+                conn->messageLen = len;
+                conn->messageRead = sizeof(MSGHEADER::Value);
+            }
+            else {
+                conn->messageRead += got;
+            }
+
+            if (conn->messageRead < conn->messageLen)
+                continue;
+
+            MessagePtr message(new Message());
+            message->setSharedData(conn->body.moveFrom());
+            conn->headerRead = 0;
+            conn->messageLen = 0;
+            conn->messageRead = 0;
+
+            {
+                boost::lock_guard<boost::mutex> lk(_mutex);
+                _stats.messagesReceived++;
+            }
+            conn->onMessage(message);
+        }
+    }
+
+    void EventLoop::_closeConnection(Connection* conn, const Status& reason) {
+        LOG(1) << "event loop closing connection to " << conn->socket->remoteString() << ": "
+               << reason;
+
+        _connections.erase(conn->id);
+        _connectionsByFd.erase(conn->fd);
+        _poller->remove(conn->fd);
+        conn->socket->close();
+        {
+            boost::lock_guard<boost::mutex> lk(_mutex);
+            _stats.connections--;
+        }
+
+        boost::scoped_ptr<Connection> owned(conn);
+        for (size_t i = 0; i < conn->writes.size(); i++) {
+            if (conn->writes[i].onSent)
+                conn->writes[i].onSent(reason);
+        }
+        if (conn->onClose)
+            conn->onClose(reason);
+    }
+
+    void EventLoop::_closeAll(const Status& reason) {
+        while (!_connections.empty())
+            _closeConnection(_connections.begin()->second, reason);
+    }
+
+} // namespace mongo
+
+#endif // _WIN32
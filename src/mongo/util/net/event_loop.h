@@ -0,0 +1,169 @@
+/*    Copyright 2014 MongoDB Inc.
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+#pragma once
+
+#include <boost/noncopyable.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+#include <deque>
+#include <map>
+
+#include "mongo/base/status.h"
+#include "mongo/platform/cstdint.h"
+#include "mongo/platform/unordered_map.h"
+#include "mongo/stdx/functional.h"
+#include "mongo/util/net/message.h"
+#include "mongo/util/net/sock.h"
+
+// The event loop relies on POSIX non-blocking sockets and a self-pipe for wakeups, so it is not
+// available on Windows.
+#ifndef _WIN32
+
+namespace mongo {
+
+    /**
+     * Drives many sockets from a single I/O thread.
+     *
+     * Each socket added to the loop is switched to non-blocking mode, and from then on all reads
+     * and writes on it happen on the loop's thread: whole Message frames are assembled from
+     * partial reads and handed to the connection's message handler, and queued messages are
+     * written out as the socket becomes writable, with a completion handler called for each one.
+     *
+     * Uses epoll on Linux and poll(2) elsewhere. SSL sockets are not supported.
+     *
+     * All public methods are thread-safe. Handlers run on the loop's thread, so they must not
+     * block; they may call back into the loop, e.g. to send().
+     *
+     * Nothing in the driver uses the loop yet, so this header isn't installed.
+     */
+    class EventLoop : boost::noncopyable {
+    public:
+        typedef uint64_t ConnectionId;
+        typedef boost::shared_ptr<Message> MessagePtr;
+
+        /** Called with each complete message received on a connection. */
+        typedef stdx::function<void(const MessagePtr&)> MessageHandler;
+
+        /**
+         * Called once an operation is finished: with OK when a message has been written, or
+         * with the reason a connection was closed.
+         */
+        typedef stdx::function<void(const Status&)> CompletionHandler;
+
+        struct Stats {
+            Stats();
+
+            int connections;
+            long long messagesSent;
+            long long messagesReceived;
+            long long bytesSent;
+            long long bytesReceived;
+
+            // Writes and reads that transferred less than was outstanding.
+            long long partialWrites;
+            long long partialReads;
+
+            // Iterations of the loop, i.e. returns from epoll_wait or poll.
+            long long iterations;
+        };
+
+        /** Creates the loop. Throws if the poller or wakeup pipe can't be created. */
+        EventLoop();
+
+        /** Shuts the loop down. See shutdown(). */
+        ~EventLoop();
+
+        /** Starts the loop's I/O thread. */
+        void start();
+
+        /**
+         * Stops the I/O thread and closes all connections. Pending sends and connections are
+         * completed with ErrorCodes::ShutdownInProgress.
+         *
+         * Waits for the I/O thread, so it can't be called from a handler; that throws
+         * ErrorCodes::IllegalOperation rather than deadlocking.
+         */
+        void shutdown();
+
+        /**
+         * Hands 'socket', which must be connected, to the loop. 'onMessage' is called with each
+         * message read from it, and 'onClose' once when the connection is closed for any
+         * reason. The socket must not be used directly afterwards.
+         */
+        ConnectionId addConnection(const boost::shared_ptr<Socket>& socket,
+                                   const MessageHandler& onMessage,
+                                   const CompletionHandler& onClose);
+
+        /**
+         * Queues 'toSend' to be written on the given connection, taking over its buffers. Its
+         * header, including the request id, must already be filled in. 'onSent' may be empty.
+         */
+        void send(ConnectionId id, Message& toSend, const CompletionHandler& onSent);
+
+        /** Closes the given connection; its close handler gets ErrorCodes::CallbackCanceled. */
+        void removeConnection(ConnectionId id);
+
+        Stats getStats() const;
+
+    private:
+        class Poller;
+        class LoopThread;
+        struct Connection;
+        struct Command;
+
+        typedef std::map<ConnectionId, Connection*> ConnectionMap;
+        typedef unordered_map<int, Connection*> FdMap;
+
+        // Runs the loop until shutdown. Only ever runs on the loop thread.
+        void _run();
+
+        void _wakeUp();
+        void _drainWakeups();
+        void _processCommands();
+
+        void _handleReadable(Connection* conn);
+        void _handleWritable(Connection* conn);
+        void _closeConnection(Connection* conn, const Status& reason);
+        void _closeAll(const Status& reason);
+
+        boost::scoped_ptr<Poller> _poller;
+        int _wakeupPipe[2];
+
+        // Connection state is only touched by the loop thread, or by shutdown() once the
+        // loop thread has stopped.
+        ConnectionMap _connections;
+
+        // The same connections by socket, to find the one each ready event is for.
+        FdMap _connectionsByFd;
+
+        // protects everything below
+        mutable boost::mutex _mutex;
+        std::deque<Command*> _commands;
+        ConnectionId _nextConnectionId;
+        bool _shutdown;
+        Stats _stats;
+
+        // The thread running _run(), once it has started.
+        boost::thread::id _loopThread;
+
+        boost::scoped_ptr<LoopThread> _thread;
+    };
+
+} // namespace mongo
+
+#endif // _WIN32
@@ -0,0 +1,363 @@
+/*    Copyright 2014 MongoDB Inc.
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+#include "mongo/platform/basic.h"
+
+#include "mongo/util/net/event_loop.h"
+
+#include <boost/scoped_ptr.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/locks.hpp>
+#include <boost/thread/mutex.hpp>
+#include <string>
+#include <vector>
+
+#ifndef _WIN32
+#include <sys/socket.h>
+#include <sys/types.h>
+#endif
+
+#include "mongo/unittest/unittest.h"
+#include "mongo/util/net/message_port.h"
+
+// These tests need a connected socket pair, which only UNIX provides natively.
+#ifndef _WIN32
+
+namespace {
+
+    using namespace mongo;
+
+    typedef boost::shared_ptr<Socket> SocketPtr;
+
+    const int kWaitMillis = 10 * 1000;
+
+    /**
+     * Collects what the loop reports for one connection, so the test thread can wait for it.
+     */
+    class Recorder {
+    public:
+        void onMessage(const EventLoop::MessagePtr& message) {
+            boost::lock_guard<boost::mutex> lk(_mutex);
+            _messages.push_back(message);
+            _changed.notify_all();
+        }
+
+        void onSent(const Status& status) {
+            boost::lock_guard<boost::mutex> lk(_mutex);
+            _sent.push_back(status);
+            _changed.notify_all();
+        }
+
+        void onClose(const Status& status) {
+            boost::lock_guard<boost::mutex> lk(_mutex);
+            _closed.push_back(status);
+            _changed.notify_all();
+        }
+
+        EventLoop::MessageHandler messageHandler() {
+            return stdx::bind(&Recorder::onMessage, this, stdx::placeholders::_1);
+        }
+
+        EventLoop::CompletionHandler sentHandler() {
+            return stdx::bind(&Recorder::onSent, this, stdx::placeholders::_1);
+        }
+
+        EventLoop::CompletionHandler closeHandler() {
+            return stdx::bind(&Recorder::onClose, this, stdx::placeholders::_1);
+        }
+
+        bool waitForMessages(size_t count) {
+            return _waitFor(_messages, count);
+        }
+
+        bool waitForSent(size_t count) {
+            return _waitFor(_sent, count);
+        }
+
+        bool waitForClose() {
+            return _waitFor(_closed, 1);
+        }
+
+        EventLoop::MessagePtr message(size_t i) {
+            boost::lock_guard<boost::mutex> lk(_mutex);
+            return _messages[i];
+        }
+
+        Status sent(size_t i) {
+            boost::lock_guard<boost::mutex> lk(_mutex);
+            return _sent[i];
+        }
+
+        Status closed() {
+            boost::lock_guard<boost::mutex> lk(_mutex);
+            return _closed[0];
+        }
+
+    private:
+        template <typename T>
+        bool _waitFor(const std::vector<T>& items, size_t count) {
+            boost::unique_lock<boost::mutex> lk(_mutex);
+            while (items.size() < count) {
+                if (!_changed.timed_wait(lk, boost::posix_time::milliseconds(kWaitMillis)))
+                    return false;
+            }
+            return true;
+        }
+
+        boost::mutex _mutex;
+        boost::condition_variable _changed;
+        std::vector<EventLoop::MessagePtr> _messages;
+        std::vector<Status> _sent;
+        std::vector<Status> _closed;
+    };
+
+    /**
+     * Hands one end of a socket pair to an event loop and keeps the other end as a blocking
+     * MessagingPort, which the tests use to play the peer.
+     */
+    class EventLoopTest : public unittest::Test {
+    protected:
+        void setUp() {
+            int socks[2];
+            ASSERT_EQUALS(0, ::socketpair(PF_UNIX, SOCK_STREAM, 0, socks));
+
+            _loopSock.reset(new Socket(socks[0], SockAddr()));
+            SocketPtr peerSock(new Socket(socks[1], SockAddr()));
+            _loopSock->setHandshakeReceived();
+            peerSock->setHandshakeReceived();
+            _peerPort.reset(new MessagingPort(peerSock));
+
+            _loop.reset(new EventLoop());
+            _loop->start();
+        }
+
+        void tearDown() {
+            _loop.reset();
+        }
+
+        EventLoop::ConnectionId addConnection() {
+            return _loop->addConnection(_loopSock,
+                                        _recorder.messageHandler(),
+                                        _recorder.closeHandler());
+        }
+
+        EventLoop* loop() {
+            return _loop.get();
+        }
+
+        const SocketPtr& loopSocket() {
+            return _loopSock;
+        }
+
+        MessagingPort* peerPort() {
+            return _peerPort.get();
+        }
+
+        Recorder& recorder() {
+            return _recorder;
+        }
+
+        static void makeMessage(int op, const std::string& text, Message* out) {
+            out->setData(op, text.c_str());
+            out->header().setId(nextMessageId());
+        }
+
+        static std::string messageText(const Message& m) {
+            return m.singleData().data();
+        }
+
+    private:
+        Recorder _recorder;
+        SocketPtr _loopSock;
+        boost::scoped_ptr<MessagingPort> _peerPort;
+        boost::scoped_ptr<EventLoop> _loop;
+    };
+
+    TEST_F(EventLoopTest, SendAndReceive) {
+        const EventLoop::ConnectionId id = addConnection();
+
+        Message request;
+        makeMessage(dbQuery, "request", &request);
+        loop()->send(id, request, recorder().sentHandler());
+        ASSERT(recorder().waitForSent(1));
+        ASSERT_OK(recorder().sent(0));
+
+        Message received;
+        ASSERT(peerPort()->recv(received));
+        ASSERT_EQUALS("request", messageText(received));
+
+        Message reply;
+        makeMessage(opReply, "reply", &reply);
+        peerPort()->reply(received, reply);
+
+        ASSERT(recorder().waitForMessages(1));
+        EventLoop::MessagePtr message = recorder().message(0);
+        ASSERT_EQUALS("reply", messageText(*message));
+        ASSERT_EQUALS(received.header().getId(), message->header().getResponseTo());
+
+        EventLoop::Stats stats = loop()->getStats();
+        ASSERT_EQUALS(1, stats.connections);
+        ASSERT_EQUALS(1, stats.messagesSent);
+        ASSERT_EQUALS(1, stats.messagesReceived);
+    }
+
+    TEST_F(EventLoopTest, LargeMessagesArriveWhole) {
+        const EventLoop::ConnectionId id = addConnection();
+
+        // Bigger than the socket buffers, so both sides need several reads and writes.
+        const std::string big(4 * 1024 * 1024, 'x');
+        const int kCount = 3;
+        for (int i = 0; i < kCount; i++) {
+            Message request;
+            makeMessage(dbQuery, big, &request);
+            loop()->send(id, request, recorder().sentHandler());
+        }
+
+        for (int i = 0; i < kCount; i++) {
+            Message received;
+            ASSERT(peerPort()->recv(received));
+            ASSERT_EQUALS(big, messageText(received));
+
+            Message reply;
+            makeMessage(opReply, big, &reply);
+            peerPort()->reply(received, reply);
+        }
+
+        ASSERT(recorder().waitForSent(kCount));
+        ASSERT(recorder().waitForMessages(kCount));
+        for (int i = 0; i < kCount; i++) {
+            ASSERT_OK(recorder().sent(i));
+            ASSERT_EQUALS(big, messageText(*recorder().message(i)));
+        }
+
+        EventLoop::Stats stats = loop()->getStats();
+        ASSERT_GREATER_THAN(stats.partialWrites, 0);
+        ASSERT_GREATER_THAN(stats.partialReads, 0);
+    }
+
+    TEST_F(EventLoopTest, PeerCloseIsReported) {
+        addConnection();
+        peerPort()->shutdown();
+
+        ASSERT(recorder().waitForClose());
+        ASSERT_EQUALS(ErrorCodes::HostUnreachable, recorder().closed().code());
+        ASSERT_EQUALS(0, loop()->getStats().connections);
+    }
+
+    TEST_F(EventLoopTest, InvalidMessageLengthClosesConnection) {
+        addConnection();
+
+        Message bogus;
+        makeMessage(dbQuery, "bogus", &bogus);
+        bogus.header().setLen(4);
+        peerPort()->psock->send(bogus.singleData().view2ptr(), 16, "bogus");
+
+        ASSERT(recorder().waitForClose());
+        ASSERT_EQUALS(ErrorCodes::ProtocolError, recorder().closed().code());
+    }
+
+    TEST_F(EventLoopTest, RemoveConnection) {
+        const EventLoop::ConnectionId id = addConnection();
+        loop()->removeConnection(id);
+
+        ASSERT(recorder().waitForClose());
+        ASSERT_EQUALS(ErrorCodes::CallbackCanceled, recorder().closed().code());
+
+        Message request;
+        makeMessage(dbQuery, "request", &request);
+        loop()->send(id, request, recorder().sentHandler());
+        ASSERT(recorder().waitForSent(1));
+        ASSERT_EQUALS(ErrorCodes::HostUnreachable, recorder().sent(0).code());
+    }
+
+    /** Tries to shut 'loop' down from a handler, and records what that threw. */
+    class ShutdownFromHandler {
+    public:
+        explicit ShutdownFromHandler(EventLoop* loop) : _loop(loop), _code(ErrorCodes::OK) {}
+
+        void onMessage(const EventLoop::MessagePtr& message) {
+            try {
+                _loop->shutdown();
+            }
+            catch (const DBException& e) {
+                _code = e.getCode();
+            }
+            _recorder.onMessage(message);
+        }
+
+        EventLoop::MessageHandler messageHandler() {
+            return stdx::bind(&ShutdownFromHandler::onMessage, this, stdx::placeholders::_1);
+        }
+
+        Recorder& recorder() {
+            return _recorder;
+        }
+
+        int code() const {
+            return _code;
+        }
+
+    private:
+        EventLoop* const _loop;
+        Recorder _recorder;
+        int _code;
+    };
+
+    TEST_F(EventLoopTest, ShutdownFromHandlerThrows) {
+        ShutdownFromHandler handler(loop());
+        loop()->addConnection(loopSocket(), handler.messageHandler(), recorder().closeHandler());
+
+        Message request;
+        makeMessage(dbQuery, "request", &request);
+        peerPort()->say(request);
+
+        ASSERT(handler.recorder().waitForMessages(1));
+        ASSERT_EQUALS(ErrorCodes::IllegalOperation, handler.code());
+
+        // The loop is still running, and can be shut down from elsewhere.
+        loop()->shutdown();
+        ASSERT(recorder().waitForClose());
+        ASSERT_EQUALS(ErrorCodes::ShutdownInProgress, recorder().closed().code());
+    }
+
+    TEST_F(EventLoopTest, ShutdownFailsPendingSends) {
+        const EventLoop::ConnectionId id = addConnection();
+
+        // Nobody reads on the other end, so these can't all be written before shutdown.
+        const std::string big(4 * 1024 * 1024, 'x');
+        for (int i = 0; i < 3; i++) {
+            Message request;
+            makeMessage(dbQuery, big, &request);
+            loop()->send(id, request, recorder().sentHandler());
+        }
+
+        loop()->shutdown();
+
+        ASSERT(recorder().waitForSent(3));
+        ASSERT_EQUALS(ErrorCodes::ShutdownInProgress, recorder().sent(2).code());
+        ASSERT(recorder().waitForClose());
+        ASSERT_EQUALS(ErrorCodes::ShutdownInProgress, recorder().closed().code());
+
+        Message late;
+        makeMessage(dbQuery, "late", &late);
+        loop()->send(id, late, recorder().sentHandler());
+        ASSERT(recorder().waitForSent(4));
+        ASSERT_EQUALS(ErrorCodes::ShutdownInProgress, recorder().sent(3).code());
+    }
+
+} // namespace
+
+#endif // _WIN32
@@ -23,10 +23,13 @@
 #include "mongo/platform/cstdint.h"
 #include "mongo/base/data_view.h"
 #include "mongo/base/encoded_value_storage.h"
+#include "mongo/bson/util/builder.h"
 #include "mongo/util/mongoutils/str.h"
 #include "mongo/util/net/hostandport.h"
 #include "mongo/util/net/operation.h"
+#include "mongo/util/net/receive_buffer_pool.h"
 #include "mongo/util/net/sock.h"
+#include "mongo/util/shared_buffer.h"
 
 namespace mongo {
 
@@ -54,6 +57,7 @@ namespace mongo {
         case dbGetMore: return "getmore";
         case dbDelete: return "remove";
         case dbKillCursors: return "killcursors";
+        case dbCompressed: return "compressed";
         default:
             massert( 16141, str::stream() << "cannot translate opcode " << op, !op );
             return "";
@@ -69,6 +73,7 @@ namespace mongo {
         case dbQuery:
         case dbGetMore:
         case dbKillCursors:
+        case dbCompressed:
             return false;
 
         case dbUpdate:
@@ -298,12 +303,12 @@ namespace mongo {
     class Message {
     public:
         // we assume here that a vector with initial size 0 does no allocation (0 is the default, but wanted to make it explicit).
-        Message() : _buf( 0 ), _data( 0 ), _freeIt( false ) {}
+        Message() : _buf( 0 ), _data( 0 ), _freeIt( false ), _pooled( false ) {}
         Message( void * data , bool freeIt ) :
-            _buf( 0 ), _data( 0 ), _freeIt( false ) {
+            _buf( 0 ), _data( 0 ), _freeIt( false ), _pooled( false ) {
             _setData( reinterpret_cast< char* >( data ), freeIt );
         };
-        Message(Message& r) : _buf( 0 ), _data( 0 ), _freeIt( false ) {
+        Message(Message& r) : _buf( 0 ), _data( 0 ), _freeIt( false ), _pooled( false ) {
             *this = r;
         }
         ~Message() {
@@ -374,24 +379,33 @@ namespace mongo {
             if ( r._data.size() > 0 ) {
                 _data.swap( r._data );
             }
+            _shared.swap( r._shared );
             r._freeIt = false;
             _freeIt = true;
+            _pooled = r._pooled;
+            r._pooled = false;
             return *this;
         }
 
         void reset() {
+            if ( _shared.get() ) {
+                // the buffer goes when the last SharedBuffer referring to it does
+                _buf = 0;
+                _shared = SharedBuffer();
+            }
             if ( _freeIt ) {
                 if ( _buf ) {
-                    free( _buf );
+                    _freeBuffer( _buf, _pooled );
                 }
                 for (std::vector< std::pair< char *, int > >::const_iterator i = _data.begin();
                      i != _data.end(); ++i) {
-                    free(i->first);
+                    _freeBuffer( i->first, _pooled && i == _data.begin() );
                 }
             }
             _buf = 0;
             _data.clear();
             _freeIt = false;
+            _pooled = false;
         }
 
         // use to add a buffer
@@ -407,6 +421,7 @@ namespace mongo {
                 return;
             }
             verify( _freeIt );
+            verify( !_shared.get() );
             if ( _buf ) {
                 _data.push_back(std::make_pair(_buf, MsgData::ConstView(_buf).getLen()));
                 _buf = 0;
@@ -420,6 +435,31 @@ namespace mongo {
             verify( empty() );
             _setData( d, freeIt );
         }
+
+        // like setData( d, true ), for a buffer from ReceiveBufferPool::get()
+        void setPooledData(char* d) {
+            verify( empty() );
+            _setData( d, true );
+            _pooled = true;
+        }
+        /**
+         * Holds the message in 'buffer', which others may share; see sharedBuffer(). The
+         * buffer is let go of by reset().
+         */
+        void setSharedData(const SharedBuffer& buffer) {
+            verify( empty() );
+            _shared = buffer;
+            _setData( _shared.get(), true );
+        }
+
+        /**
+         * The buffer holding the message if it was set with setSharedData(), otherwise empty.
+         * Anything keeping a reference to it keeps the message data alive after reset().
+         */
+        const SharedBuffer& sharedBuffer() const {
+            return _shared;
+        }
+
         void setData(int operation, const char *msgtxt) {
             setData(operation, msgtxt, strlen(msgtxt)+1);
         }
@@ -433,6 +473,21 @@ namespace mongo {
             _setData( d.view2ptr(), true );
         }
 
+        /**
+         * Takes over the buffer of 'b' without copying it. 'b' must have started with
+         * b.skip( MsgData::MsgDataHeaderSize ) to leave room for the header, which is filled in
+         * here. Afterwards 'b' owns nothing and must not be appended to again.
+         */
+        void setData(int operation, BufBuilder& b) {
+            verify( empty() );
+            verify( b.len() >= MsgData::MsgDataHeaderSize );
+            MsgData::View d = b.buf();
+            d.setLen(b.len());
+            d.setOperation(operation);
+            b.decouple();
+            _setData( d.view2ptr(), true );
+        }
+
         bool doIFreeIt() {
             return _freeIt;
         }
@@ -446,12 +501,23 @@ namespace mongo {
             _freeIt = freeIt;
             _buf = d;
         }
+
+        static void _freeBuffer( char* d, bool pooled ) {
+            if ( pooled )
+                ReceiveBufferPool::get()->release( d );
+            else
+                free( d );
+        }
         // if just one buffer, keep it in _buf, otherwise keep a sequence of buffers in _data
         char* _buf;
         // byte buffer(s) - the first must contain at least a full MsgData unless using _buf for storage instead
         typedef std::vector< std::pair< char*, int > > MsgVec;
         MsgVec _data;
         bool _freeIt;
+        // the first buffer came from ReceiveBufferPool rather than malloc
+        bool _pooled;
+        // set instead of freeing _buf ourselves, for messages held in a shared buffer
+        SharedBuffer _shared;
     };
 
 
@@ -0,0 +1,275 @@
+/*    Copyright 2014 MongoDB Inc.
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+#include "mongo/platform/basic.h"
+
+#include "mongo/util/net/message_compressor.h"
+
+#include <boost/algorithm/string/case_conv.hpp>
+#include <cstdlib>
+#include <cstring>
+
+#ifdef MONGO_ZLIB
+#include <zlib.h>
+#endif
+
+#include "mongo/base/data_view.h"
+#include "mongo/db/dbmessage.h"
+#include "mongo/db/jsobj.h"
+#include "mongo/db/namespace_string.h"
+#include "mongo/platform/atomic_word.h"
+#include "mongo/platform/cstdint.h"
+#include "mongo/util/mongoutils/str.h"
+#include "mongo/util/net/message.h"
+#include "mongo/util/net/receive_buffer_pool.h"
+#include "mongo/util/scopeguard.h"
+#include "mongo/util/timer.h"
+
+namespace mongo {
+
+namespace {
+
+    // The body of a compressed message starts with the original opcode and body size, and the
+    // compressor id.
+    const int kOriginalOpcodeOffset = 0;
+    const int kUncompressedSizeOffset = 4;
+    const int kCompressorIdOffset = 8;
+    const int kCompressedHeaderSize = 9;
+
+    AtomicInt64 messagesCompressed;
+    AtomicInt64 messagesDecompressed;
+    AtomicInt64 bytesIn;
+    AtomicInt64 bytesOut;
+    AtomicInt64 compressMicros;
+    AtomicInt64 decompressMicros;
+
+    // Commands which must never be compressed: the handshake, since it is what tells the server
+    // we can compress at all, and anything carrying credentials.
+    const char* const kUncompressibleCommands[] = {
+        "ismaster",
+        "saslstart",
+        "saslcontinue",
+        "getnonce",
+        "authenticate",
+        "createuser",
+        "updateuser",
+        "copydbsaslstart",
+        "copydbgetnonce",
+        "copydb",
+    };
+
+    bool isUncompressibleCommand(const BSONObj& query) {
+        BSONObj command = query;
+        if (command.hasField("$query"))
+            command = command["$query"].Obj();
+        else if (command.hasField("query") && command["query"].isABSONObj())
+            command = command["query"].Obj();
+
+        const std::string name = boost::algorithm::to_lower_copy(
+            std::string(command.firstElementFieldName()));
+        for (size_t i = 0; i < sizeof(kUncompressibleCommands) / sizeof(char*); i++) {
+            if (name == kUncompressibleCommands[i])
+                return true;
+        }
+        return false;
+    }
+
+#ifdef MONGO_ZLIB
+    // Writes the header of a compressed message wrapping 'original' into 'out', and returns the
+    // address the compressed body goes to.
+    char* writeCompressedHeader(const Message& original, MessageCompressor::Id id, char* out) {
+        MsgData::View md = out;
+        md.setId(original.header().getId());
+        md.setResponseTo(original.header().getResponseTo());
+        md.setOperation(dbCompressed);
+
+        DataView(md.data())
+            .writeLE<int32_t>(original.operation(), kOriginalOpcodeOffset)
+            .writeLE<int32_t>(original.dataSize(), kUncompressedSizeOffset)
+            .writeLE<uint8_t>(static_cast<uint8_t>(id), kCompressorIdOffset);
+        return md.data() + kCompressedHeaderSize;
+    }
+#endif
+
+} // namespace
+
+    MessageCompressor::Stats::Stats()
+        : messagesCompressed(0)
+        , messagesDecompressed(0)
+        , bytesIn(0)
+        , bytesOut(0)
+        , compressMicros(0)
+        , decompressMicros(0) {
+    }
+
+    double MessageCompressor::Stats::compressionRatio() const {
+        if (bytesOut == 0)
+            return 0;
+        return static_cast<double>(bytesIn) / bytesOut;
+    }
+
+    void MessageCompressor::Stats::append(BSONObjBuilder* builder) const {
+        builder->append("messagesCompressed", messagesCompressed);
+        builder->append("messagesDecompressed", messagesDecompressed);
+        builder->append("bytesIn", bytesIn);
+        builder->append("bytesOut", bytesOut);
+        builder->append("compressionRatio", compressionRatio());
+        builder->append("compressMicros", compressMicros);
+        builder->append("decompressMicros", decompressMicros);
+    }
+
+    std::string MessageCompressor::nameOf(Id id) {
+        switch (id) {
+        case kNoop: return "noop";
+        case kSnappy: return "snappy";
+        case kZlib: return "zlib";
+        }
+        return "unknown";
+    }
+
+    Status MessageCompressor::parse(const std::string& name, Id* id) {
+        const std::vector<std::string> supported = supportedNames();
+        for (size_t i = 0; i < supported.size(); i++) {
+            if (supported[i] != name)
+                continue;
+            if (name == "zlib")
+                *id = kZlib;
+            return Status::OK();
+        }
+        return Status(ErrorCodes::BadValue,
+                      str::stream() << "unsupported message compressor: " << name);
+    }
+
+    std::vector<std::string> MessageCompressor::supportedNames() {
+        std::vector<std::string> names;
+#ifdef MONGO_ZLIB
+        names.push_back("zlib");
+#endif
+        return names;
+    }
+
+    bool MessageCompressor::shouldCompress(const Message& message) {
+        if (message.operation() == dbCompressed || message.dataSize() < kMinCompressSize)
+            return false;
+
+        if (message.operation() != dbQuery)
+            return true;
+
+        DbMessage d(message);
+        if (!nsIsFull(d.getns()) || !NamespaceString(d.getns()).isCommand())
+            return true;
+
+        QueryMessage q(d);
+        return !isUncompressibleCommand(q.query);
+    }
+
+    Status MessageCompressor::compress(Id id, const Message& in, Message* out) {
+        if (id != kZlib || supportedNames().empty())
+            return Status(ErrorCodes::BadValue,
+                          str::stream() << "unsupported message compressor: " << nameOf(id));
+
+#ifdef MONGO_ZLIB
+        Timer timer;
+        const MsgData::View original = in.singleData();
+        const uLong sourceLen = in.dataSize();
+        uLongf destLen = compressBound(sourceLen);
+
+        const size_t prefixLen = MsgData::MsgDataHeaderSize + kCompressedHeaderSize;
+        char* buffer = static_cast<char*>(malloc(prefixLen + destLen));
+        verify(buffer);
+        ScopeGuard guard = MakeGuard(free, buffer);
+
+        Bytef* dest = reinterpret_cast<Bytef*>(writeCompressedHeader(in, id, buffer));
+        const int ret = compress2(dest, &destLen,
+                                  reinterpret_cast<const Bytef*>(original.data()), sourceLen,
+                                  Z_DEFAULT_COMPRESSION);
+        if (ret != Z_OK)
+            return Status(ErrorCodes::InternalError,
+                          str::stream() << "zlib compression failed with error " << ret);
+
+        MsgData::View(buffer).setLen(prefixLen + destLen);
+        guard.Dismiss();
+        out->setData(buffer, true);
+
+        messagesCompressed.fetchAndAdd(1);
+        bytesIn.fetchAndAdd(sourceLen);
+        bytesOut.fetchAndAdd(destLen);
+        compressMicros.fetchAndAdd(timer.micros());
+#endif
+        return Status::OK();
+    }
+
+    Status MessageCompressor::decompress(const Message& in, Message* out) {
+        const MsgData::View compressed = in.singleData();
+        if (in.operation() != dbCompressed || compressed.dataLen() < kCompressedHeaderSize)
+            return Status(ErrorCodes::ProtocolError, "invalid compressed message");
+
+        const ConstDataView body(compressed.data());
+        const int32_t uncompressedSize = body.readLE<int32_t>(kUncompressedSizeOffset);
+        const uint8_t compressorId = body.readLE<uint8_t>(kCompressorIdOffset);
+
+        if (uncompressedSize < 0 ||
+            static_cast<size_t>(uncompressedSize) >
+                MaxMessageSizeBytes - MsgData::MsgDataHeaderSize) {
+            return Status(ErrorCodes::ProtocolError,
+                          str::stream() << "invalid uncompressed message size "
+                                        << uncompressedSize);
+        }
+
+        if (compressorId != kZlib || supportedNames().empty())
+            return Status(ErrorCodes::ProtocolError,
+                          str::stream() << "message compressed with unsupported compressor "
+                                        << static_cast<int>(compressorId));
+
+#ifdef MONGO_ZLIB
+        Timer timer;
+        const size_t len = MsgData::MsgDataHeaderSize + uncompressedSize;
+        SharedBuffer buffer = ReceiveBufferPool::allocateShared(len);
+        MsgData::View md = buffer.get();
+
+        uLongf destLen = uncompressedSize;
+        const int ret = uncompress(reinterpret_cast<Bytef*>(md.data()), &destLen,
+                                   reinterpret_cast<const Bytef*>(compressed.data() +
+                                                                  kCompressedHeaderSize),
+                                   compressed.dataLen() - kCompressedHeaderSize);
+        if (ret != Z_OK || destLen != static_cast<uLongf>(uncompressedSize))
+            return Status(ErrorCodes::ProtocolError,
+                          str::stream() << "zlib decompression failed with error " << ret);
+
+        md.setLen(len);
+        md.setId(compressed.getId());
+        md.setResponseTo(compressed.getResponseTo());
+        md.setOperation(body.readLE<int32_t>(kOriginalOpcodeOffset));
+
+        out->setSharedData(buffer);
+
+        messagesDecompressed.fetchAndAdd(1);
+        decompressMicros.fetchAndAdd(timer.micros());
+#endif
+        return Status::OK();
+    }
+
+    MessageCompressor::Stats MessageCompressor::getStats() {
+        Stats stats;
+        stats.messagesCompressed = messagesCompressed.load();
+        stats.messagesDecompressed = messagesDecompressed.load();
+        stats.bytesIn = bytesIn.load();
+        stats.bytesOut = bytesOut.load();
+        stats.compressMicros = compressMicros.load();
+        stats.decompressMicros = decompressMicros.load();
+        return stats;
+    }
+
+} // namespace mongo
@@ -0,0 +1,100 @@
+/*    Copyright 2014 MongoDB Inc.
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "mongo/base/status.h"
+#include "mongo/client/export_macros.h"
+#include "mongo/config.h"
+
+namespace mongo {
+
+    class BSONObjBuilder;
+    class Message;
+
+    /**
+     * Wraps messages in, and unwraps them from, the compressed message format (dbCompressed).
+     *
+     * A compressed message is a standard header with the dbCompressed opcode, followed by the
+     * opcode and body size of the original message, a byte naming the compressor, and then the
+     * original body as compressed by that compressor. The request id and responseTo of the
+     * original header are carried over unchanged.
+     *
+     * Only the compressors built into this library can be used; see supportedNames().
+     */
+    class MONGO_CLIENT_API MessageCompressor {
+    public:
+        // Values match the compressor byte on the wire.
+        enum Id {
+            kNoop = 0,
+            kSnappy = 1,
+            kZlib = 2
+        };
+
+        // Bodies smaller than this are sent as they are, since compressing them rarely pays.
+        static const int kMinCompressSize = 512;
+
+        struct Stats {
+            Stats();
+
+            void append(BSONObjBuilder* builder) const;
+
+            // Uncompressed bytes divided by compressed bytes, or 0 before anything was compressed.
+            double compressionRatio() const;
+
+            long long messagesCompressed;
+            long long messagesDecompressed;
+
+            // Body bytes before and after compression, for outgoing messages.
+            long long bytesIn;
+            long long bytesOut;
+
+            // Time spent in the compressor and decompressor.
+            long long compressMicros;
+            long long decompressMicros;
+        };
+
+        /** Returns the name used for 'id' when negotiating, e.g. "zlib". */
+        static std::string nameOf(Id id);
+
+        /** Sets 'id' from a compressor name. Fails for names this build doesn't support. */
+        static Status parse(const std::string& name, Id* id);
+
+        /** The names of the compressors built into this library, in order of preference. */
+        static std::vector<std::string> supportedNames();
+
+        /**
+         * Returns whether 'message' may be compressed. Small messages are not worth it, and the
+         * handshake and authentication commands must always go out uncompressed.
+         */
+        static bool shouldCompress(const Message& message);
+
+        /**
+         * Sets 'out' to 'in' compressed with the compressor 'id', which must be supported.
+         * 'in' must have a single buffer; see Message::concat().
+         */
+        static Status compress(Id id, const Message& in, Message* out);
+
+        /** Sets 'out' to the message wrapped in the dbCompressed message 'in'. */
+        static Status decompress(const Message& in, Message* out);
+
+        /** Counters for all messages compressed and decompressed by this process. */
+        static Stats getStats();
+    };
+
+} // namespace mongo
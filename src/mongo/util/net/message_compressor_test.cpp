@@ -0,0 +1,282 @@
+/*    Copyright 2014 MongoDB Inc.
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+#include "mongo/platform/basic.h"
+
+#include "mongo/util/net/message_compressor.h"
+
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/thread.hpp>
+#include <string>
+#include <vector>
+
+#ifndef _WIN32
+#include <sys/socket.h>
+#include <sys/types.h>
+#endif
+
+#include "mongo/db/dbmessage.h"
+#include "mongo/db/jsobj.h"
+#include "mongo/unittest/unittest.h"
+#include "mongo/util/net/message.h"
+#include "mongo/util/net/message_port.h"
+
+namespace {
+
+    using namespace mongo;
+
+    void makeQuery(const std::string& ns, const BSONObj& query, Message* out) {
+        BufBuilder b;
+        b.skip(MsgData::MsgDataHeaderSize);
+        b.appendNum(0);
+        b.appendStr(ns);
+        b.appendNum(0);
+        b.appendNum(1);
+        query.appendSelfToBufBuilder(b);
+        out->setData(dbQuery, b);
+        out->header().setId(nextMessageId());
+    }
+
+    // Large and repetitive, so it compresses well.
+    BSONObj bigDocument() {
+        return BSON("find" << "coll" << "filter" << std::string(64 * 1024, 'x'));
+    }
+
+    TEST(MessageCompressorTest, ParseNames) {
+        MessageCompressor::Id id = MessageCompressor::kNoop;
+        ASSERT_EQUALS(ErrorCodes::BadValue, MessageCompressor::parse("snappy", &id).code());
+        ASSERT_EQUALS(ErrorCodes::BadValue, MessageCompressor::parse("bogus", &id).code());
+
+#ifdef MONGO_ZLIB
+        ASSERT_OK(MessageCompressor::parse("zlib", &id));
+        ASSERT_EQUALS(MessageCompressor::kZlib, id);
+        ASSERT_EQUALS(1U, MessageCompressor::supportedNames().size());
+#else
+        ASSERT(MessageCompressor::supportedNames().empty());
+#endif
+    }
+
+    TEST(MessageCompressorTest, ShouldCompress) {
+        Message small;
+        makeQuery("test.coll", BSON("x" << 1), &small);
+        ASSERT_FALSE(MessageCompressor::shouldCompress(small));
+
+        Message big;
+        makeQuery("test.$cmd", bigDocument(), &big);
+        ASSERT(MessageCompressor::shouldCompress(big));
+
+        // The handshake and authentication always go out as they are, however large.
+        Message isMaster;
+        makeQuery("admin.$cmd",
+                  BSON("isMaster" << 1 << "padding" << std::string(4096, 'x')),
+                  &isMaster);
+        ASSERT_FALSE(MessageCompressor::shouldCompress(isMaster));
+
+        Message saslStart;
+        makeQuery("admin.$cmd",
+                  BSON("$query" << BSON("saslStart" << 1 << "payload" << std::string(4096, 'x'))),
+                  &saslStart);
+        ASSERT_FALSE(MessageCompressor::shouldCompress(saslStart));
+    }
+
+#ifdef MONGO_ZLIB
+
+    BSONObj queryOf(const Message& m) {
+        DbMessage d(m);
+        QueryMessage q(d);
+        return q.query.getOwned();
+    }
+
+    TEST(MessageCompressorTest, RoundTrip) {
+        const MessageCompressor::Stats before = MessageCompressor::getStats();
+
+        Message original;
+        makeQuery("test.$cmd", bigDocument(), &original);
+        original.header().setResponseTo(42);
+
+        Message compressed;
+        ASSERT_OK(MessageCompressor::compress(MessageCompressor::kZlib, original, &compressed));
+        ASSERT_EQUALS(dbCompressed, compressed.operation());
+        ASSERT_EQUALS(original.header().getId(), compressed.header().getId());
+        ASSERT_EQUALS(42, compressed.header().getResponseTo());
+        ASSERT_LESS_THAN(compressed.size(), original.size() / 10);
+
+        Message decompressed;
+        ASSERT_OK(MessageCompressor::decompress(compressed, &decompressed));
+        ASSERT_EQUALS(dbQuery, decompressed.operation());
+        ASSERT_EQUALS(original.size(), decompressed.size());
+        ASSERT_EQUALS(original.header().getId(), decompressed.header().getId());
+        ASSERT_EQUALS(42, decompressed.header().getResponseTo());
+        ASSERT_EQUALS(bigDocument(), queryOf(decompressed));
+
+        const MessageCompressor::Stats after = MessageCompressor::getStats();
+        ASSERT_EQUALS(before.messagesCompressed + 1, after.messagesCompressed);
+        ASSERT_EQUALS(before.messagesDecompressed + 1, after.messagesDecompressed);
+        ASSERT_EQUALS(before.bytesIn + original.dataSize(), after.bytesIn);
+        ASSERT_GREATER_THAN(after.compressionRatio(), 10.0);
+    }
+
+    TEST(MessageCompressorTest, CorruptMessagesAreRejected) {
+        Message original;
+        makeQuery("test.$cmd", bigDocument(), &original);
+
+        Message compressed;
+        ASSERT_OK(MessageCompressor::compress(MessageCompressor::kZlib, original, &compressed));
+
+        // Scribble over the compressed payload.
+        MsgData::View md = compressed.singleData();
+        memset(md.data() + 9, 0xff, 16);
+
+        Message decompressed;
+        ASSERT_EQUALS(ErrorCodes::ProtocolError,
+                      MessageCompressor::decompress(compressed, &decompressed).code());
+        ASSERT(decompressed.empty());
+
+        // A compressor byte nobody knows about.
+        Message unknown;
+        ASSERT_OK(MessageCompressor::compress(MessageCompressor::kZlib, original, &unknown));
+        unknown.singleData().data()[8] = 99;
+        ASSERT_EQUALS(ErrorCodes::ProtocolError,
+                      MessageCompressor::decompress(unknown, &decompressed).code());
+    }
+
+// The stand-in server needs a connected socket pair, which only UNIX provides natively.
+#ifndef _WIN32
+
+    /**
+     * Plays a server which speaks the compressed framing on one end of a socket pair. It reads
+     * raw frames, so it can see whether they arrived compressed, and answers each query with a
+     * zlib compressed reply echoing the query document.
+     */
+    class CompressingServer {
+    public:
+        explicit CompressingServer(boost::shared_ptr<Socket> socket)
+            : _port(socket), _thread(&CompressingServer::run, this) {}
+
+        ~CompressingServer() {
+            _port.shutdown();
+            if (_thread.joinable())
+                _thread.join();
+        }
+
+        /** The opcodes of the frames received, as they were on the wire. */
+        std::vector<int> wireOps() {
+            _thread.join();
+            return _wireOps;
+        }
+
+    private:
+        bool recvRaw(Message* out) {
+            try {
+                MSGHEADER::Value header;
+                _port.psock->recv(reinterpret_cast<char*>(&header), sizeof(header));
+
+                const int len = header.constView().getMessageLength();
+                char* buffer = static_cast<char*>(malloc(len));
+                out->setData(buffer, true);
+                memcpy(buffer, &header, sizeof(header));
+                _port.psock->recv(buffer + sizeof(header), len - sizeof(header));
+                return true;
+            }
+            catch (const SocketException&) {
+                return false;
+            }
+        }
+
+        void run() {
+            while (true) {
+                Message raw;
+                if (!recvRaw(&raw))
+                    return;
+                _wireOps.push_back(raw.operation());
+
+                Message request;
+                if (raw.operation() == dbCompressed)
+                    uassertStatusOK(MessageCompressor::decompress(raw, &request));
+                else
+                    request = raw;
+
+                BufBuilder b;
+                b.skip(MsgData::MsgDataHeaderSize);
+                b.appendNum(0); // resultFlags
+                b.appendNum(0LL); // cursorId
+                b.appendNum(0); // startingFrom
+                b.appendNum(1); // nReturned
+                queryOf(request).appendSelfToBufBuilder(b);
+
+                Message reply;
+                reply.setData(opReply, b);
+                reply.header().setId(nextMessageId());
+                reply.header().setResponseTo(request.header().getId());
+
+                Message compressedReply;
+                uassertStatusOK(MessageCompressor::compress(MessageCompressor::kZlib,
+                                                            reply,
+                                                            &compressedReply));
+                _port.psock->send(compressedReply.singleData().view2ptr(),
+                                  compressedReply.size(),
+                                  "reply");
+            }
+        }
+
+        MessagingPort _port;
+        std::vector<int> _wireOps;
+        boost::thread _thread;
+    };
+
+    TEST(MessageCompressorTest, MessagingPortCompressesAndUnwraps) {
+        int socks[2];
+        ASSERT_EQUALS(0, ::socketpair(PF_UNIX, SOCK_STREAM, 0, socks));
+
+        boost::shared_ptr<Socket> clientSock(new Socket(socks[0], SockAddr()));
+        boost::shared_ptr<Socket> serverSock(new Socket(socks[1], SockAddr()));
+        clientSock->setHandshakeReceived();
+        serverSock->setHandshakeReceived();
+
+        MessagingPort client(clientSock);
+        client.setCompressor(MessageCompressor::kZlib);
+
+        std::vector<int> wireOps;
+        {
+            CompressingServer server(serverSock);
+
+            Message big;
+            makeQuery("test.$cmd", bigDocument(), &big);
+            Message bigReply;
+            ASSERT(client.call(big, bigReply));
+            ASSERT_EQUALS(opReply, bigReply.operation());
+            ASSERT_EQUALS(big.header().getId(), bigReply.header().getResponseTo());
+
+            // Too small to be worth compressing.
+            Message small;
+            makeQuery("test.coll", BSON("x" << 1), &small);
+            Message smallReply;
+            ASSERT(client.call(small, smallReply));
+            ASSERT_EQUALS(small.header().getId(), smallReply.header().getResponseTo());
+
+            client.shutdown();
+            wireOps = server.wireOps();
+        }
+
+        ASSERT_EQUALS(2U, wireOps.size());
+        ASSERT_EQUALS(dbCompressed, wireOps[0]);
+        ASSERT_EQUALS(dbQuery, wireOps[1]);
+    }
+
+#endif // _WIN32
+
+#endif // MONGO_ZLIB
+
+} // namespace
@@ -0,0 +1,213 @@
+/*    Copyright 2014 MongoDB Inc.
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+#define MONGO_LOG_DEFAULT_COMPONENT ::mongo::logger::LogComponent::kNetwork
+
+#include "mongo/platform/basic.h"
+
+#include "mongo/util/net/message_pipeline.h"
+
+#include <boost/thread/locks.hpp>
+
+#include "mongo/util/background.h"
+#include "mongo/util/log.h"
+#include "mongo/util/net/message_port.h"
+
+namespace mongo {
+
+    using std::string;
+
+    class MessagePipeline::ReplyReader : public BackgroundJob {
+    public:
+        explicit ReplyReader(MessagePipeline* pipeline) : _pipeline(pipeline) {}
+
+        virtual string name() const {
+            return "MessagePipeline";
+        }
+
+        virtual void run() {
+            _pipeline->_readReplies();
+        }
+
+    private:
+        MessagePipeline* const _pipeline;
+    };
+
+    MessagePipeline::MessagePipeline(MessagingPort* port)
+        : _port(port)
+        , _shutdown(false)
+        , _failure(Status::OK())
+        , _reader(new ReplyReader(this)) {
+        _reader->go();
+    }
+
+    MessagePipeline::~MessagePipeline() {
+        shutdown();
+    }
+
+    void MessagePipeline::shutdown() {
+        bool readerBlocked = false;
+        {
+            boost::lock_guard<boost::mutex> lk(_mutex);
+            if (_shutdown)
+                return;
+            _shutdown = true;
+            readerBlocked = !_pending.empty();
+            _pendingChanged.notify_all();
+        }
+
+        // The reader is blocked in recv only while replies are outstanding, and closing the
+        // socket is the only way to wake it up.
+        if (readerBlocked)
+            _port->shutdown();
+
+        _reader->wait();
+        _fail(Status(ErrorCodes::ShutdownInProgress, "message pipeline was shut down"));
+    }
+
+    void MessagePipeline::_checkUsable() const {
+        if (_shutdown || !_failure.isOK())
+            throw SocketException(SocketException::FAILED_STATE, _port->psock->remoteString());
+    }
+
+    bool MessagePipeline::isFailed() const {
+        boost::lock_guard<boost::mutex> lk(_mutex);
+        return _shutdown || !_failure.isOK();
+    }
+
+    size_t MessagePipeline::numOutstanding() const {
+        boost::lock_guard<boost::mutex> lk(_mutex);
+        return _pending.size();
+    }
+
+    MessagePipeline::Stats MessagePipeline::getStats() const {
+        boost::lock_guard<boost::mutex> lk(_mutex);
+        return _stats;
+    }
+
+    MessagePipeline::ReplyFuture MessagePipeline::call(Message& toSend) {
+        const MSGID id = nextMessageId();
+        Promise<ReplyPtr> promise;
+        {
+            boost::lock_guard<boost::mutex> lk(_mutex);
+            _checkUsable();
+
+            // Register before sending, so the reader can match a reply that comes back before
+            // the send returns.
+            _pending.insert(std::make_pair(id, promise));
+            _stats.requests++;
+            _stats.maxOutstanding = std::max(_stats.maxOutstanding, _pending.size());
+            _pendingChanged.notify_all();
+        }
+
+        try {
+            boost::lock_guard<boost::mutex> lk(_sendMutex);
+            _port->sayWithId(toSend, id);
+        }
+        catch (const SocketException& e) {
+            _fail(Status(ErrorCodes::HostUnreachable, e.toString()));
+            throw;
+        }
+
+        return promise.getFuture();
+    }
+
+    void MessagePipeline::say(Message& toSend) {
+        {
+            boost::lock_guard<boost::mutex> lk(_mutex);
+            _checkUsable();
+        }
+
+        try {
+            boost::lock_guard<boost::mutex> lk(_sendMutex);
+            _port->say(toSend);
+        }
+        catch (const SocketException& e) {
+            _fail(Status(ErrorCodes::HostUnreachable, e.toString()));
+            throw;
+        }
+    }
+
+    void MessagePipeline::piggyBack(Message& toSend) {
+        boost::lock_guard<boost::mutex> lk(_sendMutex);
+        _port->piggyBack(toSend);
+    }
+
+    void MessagePipeline::flush() {
+        boost::lock_guard<boost::mutex> lk(_sendMutex);
+        _port->flush();
+    }
+
+    void MessagePipeline::_readReplies() {
+        while (true) {
+            {
+                boost::unique_lock<boost::mutex> lk(_mutex);
+                while (!_shutdown && _failure.isOK() && _pending.empty())
+                    _pendingChanged.wait(lk);
+                if (_shutdown || !_failure.isOK())
+                    return;
+            }
+
+            ReplyPtr reply(new Message());
+            bool ok = false;
+            try {
+                ok = _port->recv(*reply);
+            }
+            catch (const DBException& e) {
+                _fail(e.toStatus());
+                return;
+            }
+
+            if (!ok) {
+                _fail(Status(ErrorCodes::HostUnreachable, str::stream()
+                             << "error reading reply from " << _port->psock->remoteString()));
+                return;
+            }
+
+            const MSGID responseTo = reply->header().getResponseTo();
+            Promise<ReplyPtr> promise;
+            {
+                boost::lock_guard<boost::mutex> lk(_mutex);
+                PendingMap::iterator it = _pending.find(responseTo);
+                if (it == _pending.end()) {
+                    error() << "MessagePipeline got a reply to unknown request " << responseTo
+                            << " from " << _port->psock->remoteString();
+                    continue;
+                }
+
+                promise = it->second;
+                _pending.erase(it);
+                _stats.replies++;
+            }
+
+            promise.setValue(reply);
+        }
+    }
+
+    void MessagePipeline::_fail(const Status& status) {
+        PendingMap failed;
+        {
+            boost::lock_guard<boost::mutex> lk(_mutex);
+            if (_failure.isOK())
+                _failure = status;
+            failed.swap(_pending);
+            _pendingChanged.notify_all();
+        }
+
+        for (PendingMap::iterator it = failed.begin(); it != failed.end(); ++it)
+            it->second.setError(status);
+    }
+
+} // namespace mongo
@@ -0,0 +1,127 @@
+/*    Copyright 2014 MongoDB Inc.
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+#pragma once
+
+#include <boost/noncopyable.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <map>
+
+#include "mongo/base/status.h"
+#include "mongo/util/concurrency/future.h"
+#include "mongo/util/net/message.h"
+
+namespace mongo {
+
+    class MessagingPort;
+
+    /**
+     * Lets many requests be outstanding on a single MessagingPort at once.
+     *
+     * Requests are written back to back, each under its own request id, and a background
+     * thread reads replies as they arrive and hands each one to the future of the request
+     * whose id matches the reply's responseTo. call() and say() may be used concurrently from
+     * any number of threads.
+     *
+     * Once the pipeline is running, the port must not be used directly for sending or
+     * receiving. Since the reply reader and the senders use the socket at the same time,
+     * pipelining is not supported on SSL connections.
+     */
+    class MessagePipeline : boost::noncopyable {
+    public:
+        typedef boost::shared_ptr<Message> ReplyPtr;
+        typedef Future<ReplyPtr> ReplyFuture;
+
+        struct Stats {
+            Stats() : requests(0), replies(0), maxOutstanding(0) {}
+
+            long long requests;
+            long long replies;
+            size_t maxOutstanding;
+        };
+
+        /**
+         * Starts reading replies from 'port', which must already be connected and must outlive
+         * the pipeline.
+         */
+        explicit MessagePipeline(MessagingPort* port);
+
+        /** Shuts the pipeline down. See shutdown(). */
+        ~MessagePipeline();
+
+        /**
+         * Sends a request which expects a reply, and returns a future for the reply. Throws
+         * SocketException if the request couldn't be sent. If the connection fails before the
+         * reply arrives, the future holds an error instead.
+         */
+        ReplyFuture call(Message& toSend);
+
+        /** Sends a request which does not expect a reply. */
+        void say(Message& toSend);
+
+        /** Queues a small request to go out with the next one, like MessagingPort::piggyBack. */
+        void piggyBack(Message& toSend);
+
+        /** Sends anything queued by piggyBack(), like MessagingPort::flush. */
+        void flush();
+
+        /**
+         * Stops reading replies. Requests that are still waiting for replies fail, and if there
+         * are any, the port is shut down, since their replies can no longer be matched up.
+         */
+        void shutdown();
+
+        /** Returns true once the connection has failed or the pipeline has been shut down. */
+        bool isFailed() const;
+
+        size_t numOutstanding() const;
+
+        Stats getStats() const;
+
+    private:
+        class ReplyReader;
+
+        typedef std::map<MSGID, Promise<ReplyPtr> > PendingMap;
+
+        // Runs on the reader thread until the pipeline fails or is shut down.
+        void _readReplies();
+
+        // Marks the pipeline failed and fails all outstanding requests with 'status'.
+        void _fail(const Status& status);
+
+        // Throws if the pipeline can no longer be used. Must be called with _mutex held.
+        void _checkUsable() const;
+
+        MessagingPort* const _port;
+
+        // serializes writes to the port
+        boost::mutex _sendMutex;
+
+        // protects everything below
+        mutable boost::mutex _mutex;
+        boost::condition_variable _pendingChanged;
+
+        PendingMap _pending;
+        bool _shutdown;
+        Status _failure;
+        Stats _stats;
+
+        boost::scoped_ptr<ReplyReader> _reader;
+    };
+
+} // namespace mongo
@@ -0,0 +1,191 @@
+/*    Copyright 2014 MongoDB Inc.
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+#include "mongo/platform/basic.h"
+
+#include "mongo/util/net/message_pipeline.h"
+
+#include <boost/scoped_ptr.hpp>
+#include <boost/shared_ptr.hpp>
+#include <string>
+
+#ifndef _WIN32
+#include <sys/socket.h>
+#include <sys/types.h>
+#endif
+
+#include "mongo/unittest/unittest.h"
+#include "mongo/util/net/message_port.h"
+
+// These tests need a connected socket pair, which only UNIX provides natively.
+#ifndef _WIN32
+
+namespace {
+
+    using namespace mongo;
+
+    typedef boost::shared_ptr<Socket> SocketPtr;
+
+    /**
+     * A client port and a "server" port connected to each other. The tests play the server by
+     * hand, which lets them control the order of replies.
+     */
+    class MessagePipelineTest : public unittest::Test {
+    protected:
+        void setUp() {
+            int socks[2];
+            ASSERT_EQUALS(0, ::socketpair(PF_UNIX, SOCK_STREAM, 0, socks));
+
+            SocketPtr clientSock(new Socket(socks[0], SockAddr()));
+            SocketPtr serverSock(new Socket(socks[1], SockAddr()));
+            clientSock->setHandshakeReceived();
+            serverSock->setHandshakeReceived();
+
+            _clientPort.reset(new MessagingPort(clientSock));
+            _serverPort.reset(new MessagingPort(serverSock));
+        }
+
+        MessagingPort* clientPort() {
+            return _clientPort.get();
+        }
+
+        MessagingPort* serverPort() {
+            return _serverPort.get();
+        }
+
+        static void makeMessage(int op, const std::string& text, Message* out) {
+            out->setData(op, text.c_str());
+        }
+
+        static std::string messageText(const Message& m) {
+            return m.singleData().data();
+        }
+
+        // Receives a request on the server port and replies to it with its own text.
+        void echo(Message& request) {
+            Message reply;
+            makeMessage(opReply, messageText(request), &reply);
+            serverPort()->reply(request, reply);
+        }
+
+    private:
+        boost::scoped_ptr<MessagingPort> _clientPort;
+        boost::scoped_ptr<MessagingPort> _serverPort;
+    };
+
+    TEST_F(MessagePipelineTest, RepliesMatchedByResponseTo) {
+        MessagePipeline pipeline(clientPort());
+
+        Message first;
+        Message second;
+        Message third;
+        makeMessage(dbQuery, "first", &first);
+        makeMessage(dbQuery, "second", &second);
+        makeMessage(dbQuery, "third", &third);
+
+        MessagePipeline::ReplyFuture firstReply = pipeline.call(first);
+        MessagePipeline::ReplyFuture secondReply = pipeline.call(second);
+        MessagePipeline::ReplyFuture thirdReply = pipeline.call(third);
+        ASSERT_EQUALS(3U, pipeline.numOutstanding());
+
+        Message received[3];
+        for (int i = 0; i < 3; i++)
+            ASSERT(serverPort()->recv(received[i]));
+
+        // Reply out of order.
+        echo(received[2]);
+        echo(received[0]);
+        echo(received[1]);
+
+        ASSERT_EQUALS("first", messageText(*firstReply.get()));
+        ASSERT_EQUALS("second", messageText(*secondReply.get()));
+        ASSERT_EQUALS("third", messageText(*thirdReply.get()));
+        ASSERT_EQUALS(0U, pipeline.numOutstanding());
+
+        MessagePipeline::Stats stats = pipeline.getStats();
+        ASSERT_EQUALS(3, stats.requests);
+        ASSERT_EQUALS(3, stats.replies);
+        ASSERT_EQUALS(3U, stats.maxOutstanding);
+    }
+
+    TEST_F(MessagePipelineTest, SayDoesNotWaitForReply) {
+        MessagePipeline pipeline(clientPort());
+
+        Message insert;
+        Message query;
+        makeMessage(dbInsert, "insert", &insert);
+        makeMessage(dbQuery, "query", &query);
+
+        pipeline.say(insert);
+        MessagePipeline::ReplyFuture reply = pipeline.call(query);
+        ASSERT_EQUALS(1U, pipeline.numOutstanding());
+
+        Message receivedInsert;
+        Message receivedQuery;
+        ASSERT(serverPort()->recv(receivedInsert));
+        ASSERT(serverPort()->recv(receivedQuery));
+        ASSERT_EQUALS("insert", messageText(receivedInsert));
+        echo(receivedQuery);
+
+        ASSERT_EQUALS("query", messageText(*reply.get()));
+    }
+
+    TEST_F(MessagePipelineTest, ConnectionFailureFailsOutstandingRequests) {
+        MessagePipeline pipeline(clientPort());
+
+        Message request;
+        makeMessage(dbQuery, "request", &request);
+        MessagePipeline::ReplyFuture reply = pipeline.call(request);
+
+        serverPort()->shutdown();
+
+        ASSERT_EQUALS(ErrorCodes::HostUnreachable, reply.getStatus().code());
+        ASSERT(pipeline.isFailed());
+
+        Message another;
+        makeMessage(dbQuery, "another", &another);
+        ASSERT_THROWS(pipeline.call(another), SocketException);
+    }
+
+    TEST_F(MessagePipelineTest, ShutdownFailsOutstandingRequests) {
+        MessagePipeline pipeline(clientPort());
+
+        Message request;
+        makeMessage(dbQuery, "request", &request);
+        MessagePipeline::ReplyFuture reply = pipeline.call(request);
+
+        pipeline.shutdown();
+
+        ASSERT(!reply.getStatus().isOK());
+        ASSERT(pipeline.isFailed());
+    }
+
+    TEST_F(MessagePipelineTest, ShutdownWhenIdleLeavesPortOpen) {
+        {
+            MessagePipeline pipeline(clientPort());
+        }
+
+        Message request;
+        makeMessage(dbQuery, "request", &request);
+        clientPort()->say(request);
+
+        Message received;
+        ASSERT(serverPort()->recv(received));
+        ASSERT_EQUALS("request", messageText(received));
+    }
+
+} // namespace
+
+#endif // _WIN32
@@ -31,8 +31,9 @@
 #include "mongo/util/background.h"
 #include "mongo/util/log.h"
 #include "mongo/util/net/message.h"
+#include "mongo/util/net/receive_buffer_pool.h"
 #include "mongo/util/net/ssl_manager.h"
-#include "mongo/util/scopeguard.h"
+#include "mongo/util/net/write_coalescer.h"
 #include "mongo/util/time_support.h"
 
 #ifndef _WIN32
@@ -62,47 +63,6 @@ namespace mongo {
 
     /* messagingport -------------------------------------------------------------- */
 
-    class PiggyBackData {
-    public:
-        PiggyBackData( MessagingPort * port ) {
-            _port = port;
-            _buf = new char[1300];
-            _cur = _buf;
-        }
-
-        ~PiggyBackData() {
-            DESTRUCTOR_GUARD (
-                flush();
-                delete[]( _cur );
-            );
-        }
-
-        void append( Message& m ) {
-            verify( m.header().getLen() <= 1300 );
-
-            if ( len() + m.header().getLen() > 1300 )
-                flush();
-
-            memcpy( _cur , m.singleData().view2ptr() , m.header().getLen() );
-            _cur += m.header().getLen();
-        }
-
-        void flush() {
-            if ( _buf == _cur )
-                return;
-
-            _port->send( _buf , len(), "flush" );
-            _cur = _buf;
-        }
-
-        int len() const { return _cur - _buf; }
-
-    private:
-        MessagingPort* _port;
-        char * _buf;
-        char * _cur;
-    };
-
     class Ports {
         std::set<MessagingPort*> ports;
         boost::mutex m;
@@ -135,18 +95,17 @@ namespace mongo {
     }
 
     MessagingPort::MessagingPort(int fd, const SockAddr& remote) 
-        : psock( new Socket( fd , remote ) ) , piggyBackData(0) {
+        : psock( new Socket( fd , remote ) ) , _compressor( MessageCompressor::kNoop ) {
         ports.insert(this);
     }
 
     MessagingPort::MessagingPort( double timeout, logger::LogSeverity ll ) 
-        : psock( new Socket( timeout, ll ) ) {
+        : psock( new Socket( timeout, ll ) ), _compressor( MessageCompressor::kNoop ) {
         ports.insert(this);
-        piggyBackData = 0;
     }
 
     MessagingPort::MessagingPort( boost::shared_ptr<Socket> sock )
-        : psock( sock ), piggyBackData( 0 ) {
+        : psock( sock ), _compressor( MessageCompressor::kNoop ) {
         ports.insert(this);
     }
 
@@ -159,8 +118,8 @@ namespace mongo {
     }
 
     MessagingPort::~MessagingPort() {
-        if ( piggyBackData )
-            delete( piggyBackData );
+        // sends anything still held back, while the socket is open
+        _coalescer.reset();
         shutdown();
         ports.erase(this);
     }
@@ -222,19 +181,27 @@ again:
             }
 
             psock->setHandshakeReceived();
-            int z = (len+1023)&0xfffffc00;
-            verify(z>=len);
-            MsgData::View md = reinterpret_cast<char *>(malloc(z));
-            ScopeGuard guard = MakeGuard(free, md.view2ptr());
-            verify(md.view2ptr());
+            // Shared, so cursors can hand out objects that keep the reply alive.
+            SharedBuffer buffer = ReceiveBufferPool::allocateShared(len);
+            MsgData::View md = buffer.get();
 
             memcpy(md.view2ptr(), &header, headerLen);
             int left = len - headerLen;
 
             psock->recv( md.data(), left );
 
-            guard.Dismiss();
-            m.setData(md.view2ptr(), true);
+            m.setSharedData(buffer);
+
+            if ( m.operation() == dbCompressed ) {
+                Message decompressed;
+                Status status = MessageCompressor::decompress( m, &decompressed );
+                m.reset();
+                if ( !status.isOK() ) {
+                    LOG(0) << "recv(): " << status.reason();
+                    return false;
+                }
+                m = decompressed;
+            }
             return true;
 
         }
@@ -289,43 +256,86 @@ again:
     }
 
     void MessagingPort::say(Message& toSend, int responseTo) {
+        sayWithId(toSend, nextMessageId(), responseTo);
+    }
+
+    void MessagingPort::sayWithId(Message& toSend, MSGID id, int responseTo) {
         verify( !toSend.empty() );
         mmm( log() << "*  say()  thr:" << GetCurrentThreadId() << endl; )
-        toSend.header().setId(nextMessageId());
+        toSend.header().setId(id);
         toSend.header().setResponseTo(responseTo);
 
-        if ( piggyBackData && piggyBackData->len() ) {
-            mmm( log() << "*     have piggy back" << endl; )
-            if ( ( piggyBackData->len() + toSend.header().getLen() ) > 1300 ) {
-                // won't fit in a packet - so just send it off
-                piggyBackData->flush();
-            }
-            else {
-                piggyBackData->append( toSend );
-                piggyBackData->flush();
-                return;
-            }
+        // toSend keeps its uncompressed contents, since callers may look at them afterwards
+        Message compressed;
+        Message* out;
+        _compress( toSend, compressed, &out );
+
+        if ( _coalescer ) {
+            // goes out with anything held back, and can't interleave with a delayed flush
+            _coalescer->send( *out, "say" );
+            return;
         }
 
-        toSend.send( *this, "say" );
+        out->send( *this, "say" );
     }
 
     void MessagingPort::piggyBack( Message& toSend , int responseTo ) {
-
-        if ( toSend.header().getLen() > 1300 ) {
-            // not worth saving because its almost an entire packet
-            say( toSend );
-            return;
+        if ( !_coalescer ) {
+            const client::Options& options = client::Options::current();
+#ifdef MONGO_SSL
+            if ( options.writeCoalescingMaxDelayMillis() > 0 && psock->isSSL() ) {
+                // the timer would write while we may be reading, which SSL doesn't allow
+                say( toSend, responseTo );
+                return;
+            }
+#endif
+            _coalescer.reset( new WriteCoalescer( psock.get(),
+                                                  options.writeCoalescingMaxBytes(),
+                                                  options.writeCoalescingMaxDelayMillis() ) );
         }
 
         // we're going to be storing this, so need to set it up
         toSend.header().setId(nextMessageId());
         toSend.header().setResponseTo(responseTo);
 
-        if ( ! piggyBackData )
-            piggyBackData = new PiggyBackData( this );
+        Message compressed;
+        Message* out;
+        _compress( toSend, compressed, &out );
+
+        if ( !_coalescer->fits( *out ) ) {
+            // not worth saving because it is a packet or more by itself
+            _coalescer->send( *out, "say" );
+            return;
+        }
+
+        _coalescer->queue( *out );
+    }
+
+    void MessagingPort::flush() {
+        if ( _coalescer )
+            _coalescer->flush();
+    }
+
+    int MessagingPort::discardHeldBack() {
+        if ( !_coalescer )
+            return 0;
+        return _coalescer->discard();
+    }
+
+    void MessagingPort::_compress( Message& toSend, Message& compressed, Message** out ) {
+        *out = &toSend;
+        if ( _compressor == MessageCompressor::kNoop )
+            return;
+
+        toSend.concat();
+        if ( !MessageCompressor::shouldCompress( toSend ) )
+            return;
 
-        piggyBackData->append( toSend );
+        Status status = MessageCompressor::compress( _compressor, toSend, &compressed );
+        if ( status.isOK() )
+            *out = &compressed;
+        else
+            LOG(1) << "sending uncompressed message: " << status.reason();
     }
 
     HostAndPort MessagingPort::remote() const {
@@ -19,17 +19,19 @@
 
 #include "mongo/config.h"
 
+#include <boost/scoped_ptr.hpp>
 #include <boost/shared_ptr.hpp>
 #include <boost/utility.hpp>
 #include <vector>
 
 #include "mongo/util/net/message.h"
+#include "mongo/util/net/message_compressor.h"
 #include "mongo/util/net/sock.h"
 
 namespace mongo {
 
     class MessagingPort;
-    class PiggyBackData;
+    class WriteCoalescer;
 
     class AbstractMessagingPort : boost::noncopyable {
     public:
@@ -93,6 +95,12 @@ namespace mongo {
 
         void say(Message& toSend, int responseTo = 0);
 
+        /**
+         * Like say(), but sends toSend with the given request id rather than a new one, so the
+         * caller can get ready for the reply before the request goes out.
+         */
+        void sayWithId(Message& toSend, MSGID id, int responseTo = 0);
+
         /**
          * this is used for doing 'async' queries
          * instead of doing call( to , from )
@@ -104,8 +112,30 @@ namespace mongo {
          */
         bool recv( const Message& sent , Message& response );
 
+        /**
+         * Like say(), but toSend may be held back to go out in the same write as later
+         * messages; see client::Options::setWriteCoalescingMaxBytes(). Only for messages which
+         * get no reply.
+         */
         void piggyBack( Message& toSend , int responseTo = 0 );
 
+        /** Sends any messages held back by piggyBack(). */
+        void flush();
+
+        /**
+         * Drops the messages held back by piggyBack() without sending them, for when the
+         * connection has failed. Returns how many there were.
+         */
+        int discardHeldBack();
+
+        /**
+         * Compress outgoing messages with 'id' from now on, where MessageCompressor allows it.
+         * The remote end must have agreed to this compressor. Compressed incoming messages are
+         * always unwrapped by recv(), whatever this is set to.
+         */
+        void setCompressor(MessageCompressor::Id id) { _compressor = id; }
+        MessageCompressor::Id compressor() const { return _compressor; }
+
         unsigned remotePort() const { return psock->remotePort(); }
         virtual HostAndPort remote() const;
         virtual SockAddr remoteAddr() const;
@@ -122,6 +152,9 @@ namespace mongo {
         bool connect(SockAddr& farEnd) {
             return psock->connect( farEnd );
         }
+        bool connect(const std::vector<SockAddr>& farEnds) {
+            return psock->connect( farEnds );
+        }
 #ifdef MONGO_SSL
         /**
          * Initiates the TLS/SSL handshake on this MessagingPort.
@@ -144,8 +177,13 @@ namespace mongo {
         }
 
     private:
-        
-        PiggyBackData * piggyBackData;
+
+        // Sets *out to toSend, or to a compressed copy of it in 'compressed' if it should be.
+        void _compress( Message& toSend, Message& compressed, Message** out );
+
+        boost::scoped_ptr<WriteCoalescer> _coalescer;
+
+        MessageCompressor::Id _compressor;
 
         // this is the parsed version of remote
         // mutable because its initialized only on call to remote()
@@ -153,8 +191,6 @@ namespace mongo {
 
     public:
         static void closeAllSockets(unsigned tagMask = 0xffffffff);
-
-        friend class PiggyBackData;
     };
 
 
@@ -26,7 +26,8 @@ namespace mongo {
         dbQuery = 2004,
         dbGetMore = 2005,
         dbDelete = 2006,
-        dbKillCursors = 2007
+        dbKillCursors = 2007,
+        dbCompressed = 2012 /* another message, compressed. see MessageCompressor */
     };
 
     enum WriteOpType {
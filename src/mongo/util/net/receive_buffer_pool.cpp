@@ -0,0 +1,238 @@
+/*    Copyright 2014 MongoDB Inc.
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+#include "mongo/platform/basic.h"
+
+#include "mongo/util/net/receive_buffer_pool.h"
+
+#include <boost/thread/locks.hpp>
+#include <cstdlib>
+
+#include "mongo/db/jsobj.h"
+#include "mongo/platform/cstdint.h"
+#include "mongo/util/assert_util.h"
+
+namespace mongo {
+
+namespace {
+
+    /**
+     * Sits in front of every buffer handed out, so release() can tell which size class the
+     * buffer belongs to. Its size keeps the buffer itself 16 byte aligned.
+     */
+    struct Prefix {
+        int32_t magic;
+        int32_t sizeClass;
+        int64_t unused;
+    };
+
+    const int32_t kMagic = 0x52425046; // "RBPF"
+
+    // Per-thread caches hold at most this many bytes, and only buffers up to kThreadCacheMax.
+    const size_t kThreadCacheBytes = 1024 * 1024;
+    const size_t kThreadCacheMax = 256 * 1024;
+
+    Prefix* prefixOf(char* buffer) {
+        Prefix* prefix = reinterpret_cast<Prefix*>(buffer) - 1;
+        verify(prefix->magic == kMagic);
+        return prefix;
+    }
+
+    void freeBuffer(char* buffer) {
+        free(prefixOf(buffer));
+    }
+
+    void releaseToGlobalPool(void* buffer) {
+        ReceiveBufferPool::get()->release(static_cast<char*>(buffer));
+    }
+
+} // namespace
+
+    class ReceiveBufferPool::ThreadCache : boost::noncopyable {
+    public:
+        ThreadCache() : bytes(0) {}
+
+        // Runs at thread exit, possibly after the pool is gone, so it can't give buffers back.
+        ~ThreadCache() {
+            for (int i = 0; i < kNumSizeClasses; i++) {
+                for (size_t j = 0; j < buffers[i].size(); j++)
+                    freeBuffer(buffers[i][j]);
+            }
+        }
+
+        std::vector<char*> buffers[kNumSizeClasses];
+        size_t bytes;
+    };
+
+    // Intentionally leaked, so messages destroyed during shutdown can still release buffers.
+    ReceiveBufferPool* ReceiveBufferPool::get() {
+        static ReceiveBufferPool* const globalPool = new ReceiveBufferPool();
+        return globalPool;
+    }
+
+    ReceiveBufferPool::Stats::Stats()
+        : hits(0)
+        , misses(0)
+        , releases(0)
+        , discards(0)
+        , bytesCached(0) {
+    }
+
+    void ReceiveBufferPool::Stats::append(BSONObjBuilder* builder) const {
+        builder->append("hits", hits);
+        builder->append("misses", misses);
+        builder->append("releases", releases);
+        builder->append("discards", discards);
+        builder->append("bytesCached", bytesCached);
+    }
+
+    ReceiveBufferPool::ReceiveBufferPool() : _bytesCached(0) {
+    }
+
+    ReceiveBufferPool::~ReceiveBufferPool() {
+        clear();
+    }
+
+    int ReceiveBufferPool::_sizeClassFor(size_t size) {
+        size_t capacity = kMinPooledSize;
+        for (int sizeClass = 0; sizeClass < kNumSizeClasses; sizeClass++) {
+            if (size <= capacity)
+                return sizeClass;
+            capacity <<= 1;
+        }
+        return kUnpooled;
+    }
+
+    size_t ReceiveBufferPool::_capacityOf(int sizeClass) {
+        return kMinPooledSize << sizeClass;
+    }
+
+    ReceiveBufferPool::ThreadCache* ReceiveBufferPool::_threadCache() {
+        ThreadCache* cache = _threadCaches.get();
+        if (!cache) {
+            cache = new ThreadCache();
+            _threadCaches.reset(cache);
+        }
+        return cache;
+    }
+
+    char* ReceiveBufferPool::allocate(size_t size) {
+        const int sizeClass = _sizeClassFor(size);
+
+        if (sizeClass != kUnpooled) {
+            char* buffer = NULL;
+
+            ThreadCache* cache = _threadCache();
+            if (!cache->buffers[sizeClass].empty()) {
+                buffer = cache->buffers[sizeClass].back();
+                cache->buffers[sizeClass].pop_back();
+                cache->bytes -= _capacityOf(sizeClass);
+            }
+            else {
+                boost::lock_guard<boost::mutex> lk(_mutex);
+                if (!_free[sizeClass].empty()) {
+                    buffer = _free[sizeClass].back();
+                    _free[sizeClass].pop_back();
+                    _bytesCached -= _capacityOf(sizeClass);
+                }
+            }
+
+            if (buffer) {
+                _hits.fetchAndAdd(1);
+                return buffer;
+            }
+        }
+
+        _misses.fetchAndAdd(1);
+
+        const size_t capacity = sizeClass == kUnpooled ? size : _capacityOf(sizeClass);
+        Prefix* prefix = static_cast<Prefix*>(malloc(sizeof(Prefix) + capacity));
+        verify(prefix);
+        prefix->magic = kMagic;
+        prefix->sizeClass = sizeClass;
+        return reinterpret_cast<char*>(prefix + 1);
+    }
+
+    void ReceiveBufferPool::release(char* buffer) {
+        const int sizeClass = prefixOf(buffer)->sizeClass;
+        _releases.fetchAndAdd(1);
+
+        if (sizeClass == kUnpooled) {
+            _discards.fetchAndAdd(1);
+            freeBuffer(buffer);
+            return;
+        }
+
+        const size_t capacity = _capacityOf(sizeClass);
+        if (capacity <= kThreadCacheMax) {
+            ThreadCache* cache = _threadCache();
+            if (cache->bytes + capacity <= kThreadCacheBytes) {
+                cache->buffers[sizeClass].push_back(buffer);
+                cache->bytes += capacity;
+                return;
+            }
+        }
+
+        _releaseShared(buffer, sizeClass);
+    }
+
+    SharedBuffer ReceiveBufferPool::allocateShared(size_t size) {
+        char* buffer = get()->allocate(SharedBuffer::kFreeFunctionPrefixBytes + size);
+        return SharedBuffer::takeOwnership(buffer, releaseToGlobalPool);
+    }
+
+    void ReceiveBufferPool::_releaseShared(char* buffer, int sizeClass) {
+        const size_t capacity = _capacityOf(sizeClass);
+        {
+            boost::lock_guard<boost::mutex> lk(_mutex);
+            if (_bytesCached + capacity <= kMaxCachedBytes) {
+                _free[sizeClass].push_back(buffer);
+                _bytesCached += capacity;
+                return;
+            }
+        }
+
+        _discards.fetchAndAdd(1);
+        freeBuffer(buffer);
+    }
+
+    void ReceiveBufferPool::clear() {
+        std::vector<char*> toFree;
+        {
+            boost::lock_guard<boost::mutex> lk(_mutex);
+            for (int i = 0; i < kNumSizeClasses; i++) {
+                toFree.insert(toFree.end(), _free[i].begin(), _free[i].end());
+                _free[i].clear();
+            }
+            _bytesCached = 0;
+        }
+
+        for (size_t i = 0; i < toFree.size(); i++)
+            freeBuffer(toFree[i]);
+    }
+
+    ReceiveBufferPool::Stats ReceiveBufferPool::getStats() const {
+        Stats stats;
+        stats.hits = _hits.load();
+        stats.misses = _misses.load();
+        stats.releases = _releases.load();
+        stats.discards = _discards.load();
+
+        boost::lock_guard<boost::mutex> lk(_mutex);
+        stats.bytesCached = _bytesCached;
+        return stats;
+    }
+
+} // namespace mongo
@@ -0,0 +1,125 @@
+/*    Copyright 2014 MongoDB Inc.
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+#pragma once
+
+#include <boost/noncopyable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/tss.hpp>
+#include <cstddef>
+#include <vector>
+
+#include "mongo/client/export_macros.h"
+#include "mongo/platform/atomic_word.h"
+#include "mongo/util/shared_buffer.h"
+
+namespace mongo {
+
+    class BSONObjBuilder;
+
+    /**
+     * A pool of the buffers that incoming messages are read into.
+     *
+     * Buffers come in power of two size classes from 1KB up to kMaxPooledSize. Released
+     * buffers are first kept in a small per-thread cache, which needs no locking, and beyond
+     * that in a shared free list per size class, up to kMaxCachedBytes in total. Requests
+     * larger than kMaxPooledSize are passed straight to malloc and free.
+     *
+     * Buffers may be released on a different thread than the one which allocated them.
+     *
+     * This class is thread-safe.
+     */
+    class MONGO_CLIENT_API ReceiveBufferPool : boost::noncopyable {
+    public:
+        static const size_t kMinPooledSize = 1024;
+        static const size_t kMaxPooledSize = 16 * 1024 * 1024;
+
+        // The most the shared free lists hold, over all size classes.
+        static const size_t kMaxCachedBytes = 64 * 1024 * 1024;
+
+        struct Stats {
+            Stats();
+
+            void append(BSONObjBuilder* builder) const;
+
+            // Allocations served from a cached buffer, and those which needed a new one.
+            long long hits;
+            long long misses;
+
+            // Buffers handed back, and those freed because the pool had no room for them.
+            long long releases;
+            long long discards;
+
+            // Bytes currently held in the shared free lists.
+            long long bytesCached;
+        };
+
+        /** The pool used for all incoming messages. */
+        static ReceiveBufferPool* get();
+
+        ReceiveBufferPool();
+        ~ReceiveBufferPool();
+
+        /**
+         * Returns a buffer of at least 'size' bytes. It must be given back with release(), never
+         * with free().
+         */
+        char* allocate(size_t size);
+
+        /** Returns 'buffer', which must have come from allocate() on this pool. */
+        void release(char* buffer);
+
+        /**
+         * Like allocate() on the pool returned by get(), but the buffer is handed out as a
+         * SharedBuffer and goes back to the pool once nothing refers to it.
+         */
+        static SharedBuffer allocateShared(size_t size);
+
+        /** Frees the buffers in the shared free lists. Per-thread caches are left alone. */
+        void clear();
+
+        Stats getStats() const;
+
+    private:
+        class ThreadCache;
+
+        static const int kNumSizeClasses = 15;
+
+        // Sizes above kMaxPooledSize get this class, and are never cached.
+        static const int kUnpooled = kNumSizeClasses;
+
+        static int _sizeClassFor(size_t size);
+        static size_t _capacityOf(int sizeClass);
+
+        // Returns the calling thread's cache for this pool, creating it if necessary.
+        ThreadCache* _threadCache();
+
+        // Moves 'buffer' into the shared free lists, or frees it if they are full.
+        void _releaseShared(char* buffer, int sizeClass);
+
+        boost::thread_specific_ptr<ThreadCache> _threadCaches;
+
+        AtomicInt64 _hits;
+        AtomicInt64 _misses;
+        AtomicInt64 _releases;
+        AtomicInt64 _discards;
+
+        // protects everything below
+        mutable boost::mutex _mutex;
+        std::vector<char*> _free[kNumSizeClasses];
+        size_t _bytesCached;
+    };
+
+} // namespace mongo
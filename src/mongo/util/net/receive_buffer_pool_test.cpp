@@ -0,0 +1,157 @@
+/*    Copyright 2014 MongoDB Inc.
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+#include "mongo/platform/basic.h"
+
+#include "mongo/util/net/receive_buffer_pool.h"
+
+#include <boost/thread/thread.hpp>
+#include <cstring>
+
+#include "mongo/db/jsobj.h"
+#include "mongo/unittest/unittest.h"
+#include "mongo/util/net/message.h"
+
+namespace {
+
+    using namespace mongo;
+
+    TEST(ReceiveBufferPoolTest, ReusesReleasedBuffers) {
+        ReceiveBufferPool pool;
+
+        char* first = pool.allocate(3000);
+        memset(first, 'x', 3000);
+        pool.release(first);
+
+        // Any size in the same class gets the same buffer back.
+        char* second = pool.allocate(4000);
+        ASSERT_EQUALS(first, second);
+        pool.release(second);
+
+        ReceiveBufferPool::Stats stats = pool.getStats();
+        ASSERT_EQUALS(1, stats.hits);
+        ASSERT_EQUALS(1, stats.misses);
+        ASSERT_EQUALS(2, stats.releases);
+        ASSERT_EQUALS(0, stats.discards);
+    }
+
+    TEST(ReceiveBufferPoolTest, SizeClassesAreSeparate) {
+        ReceiveBufferPool pool;
+
+        char* small = pool.allocate(100);
+        pool.release(small);
+
+        char* large = pool.allocate(100 * 1024);
+        ASSERT_NOT_EQUALS(small, large);
+        pool.release(large);
+
+        ASSERT_EQUALS(0, pool.getStats().hits);
+        ASSERT_EQUALS(2, pool.getStats().misses);
+    }
+
+    TEST(ReceiveBufferPoolTest, LargeBuffersGoToSharedLists) {
+        ReceiveBufferPool pool;
+
+        const size_t size = 4 * 1024 * 1024;
+        char* buffer = pool.allocate(size);
+        memset(buffer, 'x', size);
+        pool.release(buffer);
+        ASSERT_EQUALS(static_cast<long long>(size), pool.getStats().bytesCached);
+
+        ASSERT_EQUALS(buffer, pool.allocate(size));
+        ASSERT_EQUALS(0, pool.getStats().bytesCached);
+        pool.release(buffer);
+
+        pool.clear();
+        ASSERT_EQUALS(0, pool.getStats().bytesCached);
+    }
+
+    TEST(ReceiveBufferPoolTest, OversizedBuffersAreNotCached) {
+        ReceiveBufferPool pool;
+
+        char* buffer = pool.allocate(ReceiveBufferPool::kMaxPooledSize + 1);
+        pool.release(buffer);
+
+        ReceiveBufferPool::Stats stats = pool.getStats();
+        ASSERT_EQUALS(1, stats.discards);
+        ASSERT_EQUALS(0, stats.bytesCached);
+    }
+
+    void releaseBuffer(ReceiveBufferPool* pool, char* buffer) {
+        pool->release(buffer);
+    }
+
+    TEST(ReceiveBufferPoolTest, ReleaseOnAnotherThread) {
+        ReceiveBufferPool pool;
+
+        const size_t size = 1024 * 1024;
+        char* buffer = pool.allocate(size);
+        boost::thread releaser(releaseBuffer, &pool, buffer);
+        releaser.join();
+
+        // Too big for the other thread's cache, so it is in the shared lists.
+        ASSERT_EQUALS(buffer, pool.allocate(size));
+        pool.release(buffer);
+    }
+
+    TEST(ReceiveBufferPoolTest, MessageReleasesPooledBuffer) {
+        ReceiveBufferPool* pool = ReceiveBufferPool::get();
+        const long long releases = pool->getStats().releases;
+
+        MsgData::View md = pool->allocate(64);
+        md.setLen(64);
+        md.setOperation(opReply);
+        {
+            Message first;
+            first.setPooledData(md.view2ptr());
+
+            // Ownership moves with the buffer.
+            Message second;
+            second = first;
+            ASSERT(first.empty());
+            ASSERT_EQUALS(opReply, second.operation());
+        }
+
+        ASSERT_EQUALS(releases + 1, pool->getStats().releases);
+    }
+
+    TEST(ReceiveBufferPoolTest, SharedBufferOutlivesMessage) {
+        ReceiveBufferPool* pool = ReceiveBufferPool::get();
+        const long long releases = pool->getStats().releases;
+
+        const BSONObj doc = BSON("x" << 1);
+        BSONObj obj;
+        {
+            SharedBuffer buffer = ReceiveBufferPool::allocateShared(64);
+            MsgData::View md = buffer.get();
+            md.setLen(64);
+            md.setOperation(opReply);
+            memcpy(md.data(), doc.objdata(), doc.objsize());
+
+            Message message;
+            message.setSharedData(buffer);
+            obj = BSONObj(md.data(), message.sharedBuffer());
+        }
+
+        // The object still holds the buffer, and gives it back to the pool when it goes.
+        ASSERT(obj.isOwned());
+        ASSERT_EQUALS(doc, obj);
+        ASSERT_EQUALS(releases, pool->getStats().releases);
+
+        obj = BSONObj();
+        ASSERT_EQUALS(releases + 1, pool->getStats().releases);
+    }
+
+} // namespace
@@ -21,6 +21,8 @@
 
 #include "mongo/util/net/sock.h"
 
+#include <algorithm>
+
 #if !defined(_WIN32)
 # include <sys/socket.h>
 # include <sys/types.h>
@@ -29,6 +31,7 @@
 # include <netinet/tcp.h>
 # include <arpa/inet.h>
 # include <errno.h>
+# include <fcntl.h>
 # include <netdb.h>
 # if defined(__openbsd__)
 #  include <sys/uio.h>
@@ -36,14 +39,18 @@
 #endif
 
 #include "mongo/client/private/options.h"
+#include "mongo/platform/atomic_word.h"
 #include "mongo/util/background.h"
 #include "mongo/util/debug_util.h"
 #include "mongo/util/fail_point_service.h"
 #include "mongo/util/mongoutils/str.h"
 #include "mongo/util/log.h"
+#include "mongo/util/net/dns_cache.h"
 #include "mongo/util/net/message.h"
 #include "mongo/util/net/ssl_manager.h"
 #include "mongo/util/net/socket_poll.h"
+#include "mongo/util/scopeguard.h"
+#include "mongo/util/time_support.h"
 
 namespace mongo {
 
@@ -151,6 +158,125 @@ namespace mongo {
 #endif
     }
 
+namespace {
+
+    /**
+     * Resolves 'target', trying it as a numeric address before asking the DNS cache. Sets
+     * 'addrs' to the addresses in the resolver's order and returns 0, or returns a getaddrinfo
+     * error code.
+     */
+    int resolveAddrs(const string& target, int port, std::vector<SockAddr>* addrs) {
+        addrinfo hints;
+        memset(&hints, 0, sizeof(addrinfo));
+        hints.ai_socktype = SOCK_STREAM;
+        //hints.ai_flags = AI_ADDRCONFIG; // This is often recommended but don't do it. 
+                                          // SERVER-1579
+        hints.ai_flags |= AI_NUMERICHOST; // first pass tries w/o DNS lookup
+        hints.ai_family = (IPv6Enabled() ? AF_UNSPEC : AF_INET);
+
+        StringBuilder ss;
+        ss << port;
+        addrinfo* numeric = NULL;
+        int ret = getaddrinfo(target.c_str(), ss.str().c_str(), &hints, &numeric);
+
+        // old C compilers on IPv6-capable hosts return EAI_NODATA error
+#ifdef EAI_NODATA
+        int nodata = (ret == EAI_NODATA);
+#else
+        int nodata = false;
+#endif
+        if ( (ret == EAI_NONAME || nodata) ) {
+            // iporhost isn't an IP address, allow DNS lookup
+            return DNSCache::get()->resolve(target, port, addrs);
+        }
+        if (ret)
+            return ret;
+
+        addrs->clear();
+        for (addrinfo* ai = numeric; ai; ai = ai->ai_next) {
+            addrs->push_back(SockAddr(ai->ai_addr, ai->ai_addrlen));
+        }
+        freeaddrinfo(numeric);
+        return 0;
+    }
+
+    const unsigned int connectTimeoutMillis = 5000;
+
+    struct ConnectCounters {
+        AtomicInt64 attempts;
+        AtomicInt64 failures;
+        AtomicInt64 wins;
+        AtomicInt64 canceled;
+        AtomicInt64 winMicros;
+    };
+
+    ConnectCounters ipv4ConnectCounters;
+    ConnectCounters ipv6ConnectCounters;
+    ConnectCounters otherConnectCounters; // not reported
+
+    ConnectCounters& connectCountersFor(const SockAddr& remote) {
+        switch (remote.getType()) {
+        case AF_INET: return ipv4ConnectCounters;
+        case AF_INET6: return ipv6ConnectCounters;
+        default: return otherConnectCounters;
+        }
+    }
+
+    void loadConnectCounters(const ConnectCounters& counters,
+                             ConnectAttemptStats::Family* family) {
+        family->attempts = counters.attempts.load();
+        family->failures = counters.failures.load();
+        family->wins = counters.wins.load();
+        family->canceled = counters.canceled.load();
+        family->winMicros = counters.winMicros.load();
+    }
+
+    bool setBlocking(int fd, bool blocking) {
+#if defined(_WIN32)
+        u_long nonBlocking = blocking ? 0 : 1;
+        return ioctlsocket(fd, FIONBIO, &nonBlocking) == 0;
+#else
+        int flags = fcntl(fd, F_GETFL, 0);
+        if (flags < 0)
+            return false;
+        flags = blocking ? (flags & ~O_NONBLOCK) : (flags | O_NONBLOCK);
+        return fcntl(fd, F_SETFL, flags) == 0;
+#endif
+    }
+
+    // One of the connects made by Socket::connect(const std::vector<SockAddr>&).
+    struct ConnectAttempt {
+        int fd;
+        size_t index;
+        unsigned long long startMicros;
+    };
+
+    // Whether a non-blocking ::connect() which returned an error is merely still going.
+    bool connectInProgress() {
+#if defined(_WIN32)
+        return WSAGetLastError() == WSAEWOULDBLOCK;
+#else
+        return errno == EINPROGRESS;
+#endif
+    }
+
+} // namespace
+
+    ConnectAttemptStats::Family::Family()
+        : attempts(0)
+        , failures(0)
+        , wins(0)
+        , canceled(0)
+        , winMicros(0) {
+    }
+
+    ConnectAttemptStats getConnectAttemptStats() {
+        ConnectAttemptStats stats;
+        loadConnectCounters(ipv4ConnectCounters, &stats.ipv4);
+        loadConnectCounters(ipv6ConnectCounters, &stats.ipv6);
+        return stats;
+    }
+
     // --- SockAddr
     SockAddr::SockAddr() {
         addressSize = sizeof(sa);
@@ -187,30 +313,8 @@ namespace mongo {
             return;
         }
 
-        addrinfo* addrs = NULL;
-        addrinfo hints;
-        memset(&hints, 0, sizeof(addrinfo));
-        hints.ai_socktype = SOCK_STREAM;
-        //hints.ai_flags = AI_ADDRCONFIG; // This is often recommended but don't do it. 
-                                          // SERVER-1579
-        hints.ai_flags |= AI_NUMERICHOST; // first pass tries w/o DNS lookup
-        hints.ai_family = (IPv6Enabled() ? AF_UNSPEC : AF_INET);
-
-        StringBuilder ss;
-        ss << port;
-        int ret = getaddrinfo(target.c_str(), ss.str().c_str(), &hints, &addrs);
-
-        // old C compilers on IPv6-capable hosts return EAI_NODATA error
-#ifdef EAI_NODATA
-        int nodata = (ret == EAI_NODATA);
-#else
-        int nodata = false;
-#endif
-        if ( (ret == EAI_NONAME || nodata) ) {
-            // iporhost isn't an IP address, allow DNS lookup
-            hints.ai_flags &= ~AI_NUMERICHOST;
-            ret = getaddrinfo(target.c_str(), ss.str().c_str(), &hints, &addrs);
-        }
+        std::vector<SockAddr> addrs;
+        int ret = resolveAddrs(target, port, &addrs);
 
         if (ret) {
             // we were unsuccessful
@@ -225,14 +329,57 @@ namespace mongo {
             return;
         }
 
-        //TODO: handle other addresses in linked list;
-        fassert(16501, addrs->ai_addrlen <= sizeof(sa));
-        memcpy(&sa, addrs->ai_addr, addrs->ai_addrlen);
-        addressSize = addrs->ai_addrlen;
-        freeaddrinfo(addrs);
+        // see createAll() for the other addresses
+        *this = addrs.front();
+    }
+
+    SockAddr::SockAddr(const sockaddr* addr, socklen_t size) {
+        fassert(16501, size <= sizeof(sa));
+        memset(&sa, 0, sizeof(sa));
+        memcpy(&sa, addr, size);
+        addressSize = size;
         _isValid = true;
     }
 
+    std::vector<SockAddr> SockAddr::createAll(const char* iporhost, int port) {
+        std::vector<SockAddr> result;
+
+        string target = iporhost;
+        if (target == "localhost" || mongoutils::str::contains(target, '/')) {
+            // these only ever have one address
+            SockAddr addr(iporhost, port);
+            if (addr.isValid())
+                result.push_back(addr);
+            return result;
+        }
+
+        std::vector<SockAddr> addrs;
+        int ret = resolveAddrs(target, port, &addrs);
+        if (ret) {
+            log() << "getaddrinfo(\"" << target << "\") failed: " <<
+                getAddrInfoStrError(ret) << endl;
+            return result;
+        }
+
+        // Split by family, keeping the resolver's order within each, then interleave them.
+        std::vector<SockAddr> byFamily[2];
+        const int firstFamily = addrs.front().getType();
+        for (size_t i = 0; i < addrs.size(); i++) {
+            const SockAddr& addr = addrs[i];
+            std::vector<SockAddr>& list = byFamily[addr.getType() == firstFamily ? 0 : 1];
+            if (std::find(list.begin(), list.end(), addr) == list.end())
+                list.push_back(addr);
+        }
+
+        for (size_t i = 0; i < byFamily[0].size() || i < byFamily[1].size(); i++) {
+            if (i < byFamily[0].size())
+                result.push_back(byFamily[0][i]);
+            if (i < byFamily[1].size())
+                result.push_back(byFamily[1][i]);
+        }
+        return result;
+    }
+
     bool SockAddr::isLocalHost() const {
         switch (getType()) {
         case AF_INET: return getAddr() == "127.0.0.1";
@@ -460,7 +607,7 @@ namespace mongo {
             return false;
         }
         _sslManager = mgr;
-        _sslConnection.reset(_sslManager->connect(this));
+        _sslConnection.reset(_sslManager->connect(this, remoteHost));
         mgr->parseAndValidatePeerCertificate(_sslConnection.get(), remoteHost);
         return true;
     }
@@ -530,7 +677,6 @@ namespace mongo {
             setTimeout( _timeout );
         }
 
-        static const unsigned int connectTimeoutMillis = 5000;
         ConnectBG bg(_fd, remote);
         bg.go();
         if ( bg.wait(connectTimeoutMillis) ) {
@@ -552,7 +698,149 @@ namespace mongo {
             return false;
         }
 
-        if (remote.getType() != AF_UNIX)
+        _postConnect();
+        return true;
+    }
+
+    bool Socket::connect(const std::vector<SockAddr>& farEnds) {
+        if (farEnds.empty())
+            return false;
+
+        // Without poll we can't wait on several connects at once, so take the first address.
+        if (!isPollSupported()) {
+            SockAddr remote = farEnds[0];
+            return connect(remote);
+        }
+
+        const unsigned long long deadline = curTimeMicros64() + connectTimeoutMillis * 1000ULL;
+        const unsigned long long delayMicros = kConnectAttemptDelayMillis * 1000ULL;
+
+        std::vector<ConnectAttempt> pending;
+        size_t next = 0;
+        unsigned long long lastStartMicros = 0;
+        ConnectAttempt winner;
+        winner.fd = INVALID_SOCKET;
+
+        while (winner.fd == INVALID_SOCKET) {
+            unsigned long long now = curTimeMicros64();
+            if (now >= deadline)
+                break;
+
+            // Start the next attempt once the last one has had its head start, or at once if
+            // nothing is in flight.
+            if (next < farEnds.size() && (pending.empty() || now - lastStartMicros >= delayMicros)) {
+                ConnectAttempt attempt;
+                attempt.index = next++;
+                attempt.startMicros = lastStartMicros = now;
+                attempt.fd = _startConnect(farEnds[attempt.index]);
+                if (attempt.fd != INVALID_SOCKET)
+                    pending.push_back(attempt);
+                continue;
+            }
+
+            if (pending.empty())
+                break; // every address failed
+
+            unsigned long long waitMicros = deadline - now;
+            if (next < farEnds.size())
+                waitMicros = std::min(waitMicros, lastStartMicros + delayMicros - now);
+
+            std::vector<pollfd> fds(pending.size());
+            for (size_t i = 0; i < pending.size(); i++) {
+                fds[i].fd = pending[i].fd;
+                fds[i].events = POLLOUT;
+                fds[i].revents = 0;
+            }
+            if (socketPoll(&fds[0], fds.size(), (waitMicros + 999) / 1000) <= 0)
+                continue; // timed out, or interrupted; either way look at the clock again
+
+            for (size_t i = fds.size(); i-- > 0; ) {
+                if (!fds[i].revents)
+                    continue;
+
+                const ConnectAttempt attempt = pending[i];
+                pending.erase(pending.begin() + i);
+                if (winner.fd == INVALID_SOCKET &&
+                    _isConnected(attempt.fd, farEnds[attempt.index])) {
+                    winner = attempt;
+                }
+                else if (winner.fd == INVALID_SOCKET) {
+                    closesocket(attempt.fd);
+                }
+                else {
+                    // connected too, but we already have one
+                    pending.push_back(attempt);
+                }
+            }
+        }
+
+        for (size_t i = 0; i < pending.size(); i++) {
+            closesocket(pending[i].fd);
+            connectCountersFor(farEnds[pending[i].index]).canceled.fetchAndAdd(1);
+        }
+
+        if (winner.fd == INVALID_SOCKET) {
+            warning() << "Failed to connect to any of " << farEnds.size() << " addresses for "
+                      << farEnds[0].toString() << " within " << connectTimeoutMillis
+                      << " milliseconds, giving up." << endl;
+            return false;
+        }
+
+        const SockAddr& remote = farEnds[winner.index];
+        const long long micros = curTimeMicros64() - winner.startMicros;
+        ConnectCounters& counters = connectCountersFor(remote);
+        counters.wins.fetchAndAdd(1);
+        counters.winMicros.fetchAndAdd(micros);
+        LOG(1) << "connected to " << remote.toString() << " in " << micros << " micros, after "
+               << winner.index << " other addresses" << endl;
+
+        setBlocking(winner.fd, true);
+        _fd = winner.fd;
+        _remote = remote;
+        if ( _timeout > 0 ) {
+            setTimeout( _timeout );
+        }
+        _postConnect();
+        return true;
+    }
+
+    int Socket::_startConnect(const SockAddr& remote) {
+        ConnectCounters& counters = connectCountersFor(remote);
+        counters.attempts.fetchAndAdd(1);
+
+        const int fd = socket(remote.getType(), SOCK_STREAM, 0);
+        if ( fd == INVALID_SOCKET ) {
+            LOG(_logLevel) << "ERROR: connect invalid socket " << errnoWithDescription() << endl;
+            counters.failures.fetchAndAdd(1);
+            return INVALID_SOCKET;
+        }
+
+        if (!setBlocking(fd, false) ||
+            (::connect(fd, remote.raw(), remote.addressSize) != 0 && !connectInProgress())) {
+            warning() << "Failed to connect to " << remote.toString()
+                      << ", reason: " << errnoWithDescription() << endl;
+            closesocket(fd);
+            counters.failures.fetchAndAdd(1);
+            return INVALID_SOCKET;
+        }
+        return fd;
+    }
+
+    bool Socket::_isConnected(int fd, const SockAddr& remote) {
+        int error = 0;
+        socklen_t len = sizeof(error);
+        const int ret = getsockopt(fd, SOL_SOCKET, SO_ERROR, reinterpret_cast<char*>(&error), &len);
+        if (ret == 0 && error == 0)
+            return true;
+
+        warning() << "Failed to connect to " << remote.toString() << ", reason: "
+                  << (ret == 0 ? errnoWithDescription(error) : errnoWithDescription()) << endl;
+        connectCountersFor(remote).failures.fetchAndAdd(1);
+        return false;
+    }
+
+    void Socket::_postConnect() {
+        if (_remote.getType() != AF_UNIX)
             disableNagle(_fd);
 
 #ifdef SO_NOSIGPIPE
@@ -566,8 +854,6 @@ namespace mongo {
         _fdCreationMicroSec = curTimeMicros64();
 
         _awaitingHandshake = false;
-
-        return true;
     }
 
     // throws if SSL_write or send fails 
@@ -807,6 +1093,10 @@ namespace mongo {
     // -1 : never check
     const int Socket::errorPollIntervalSecs( 5 );
 
+#if !defined(_MSC_EXTENSIONS)
+    const int Socket::kConnectAttemptDelayMillis;
+#endif
+
     // Patch to allow better tolerance of flaky network connections that get broken
     // while we aren't looking.
     // TODO: Remove when better async changes come.
@@ -88,6 +88,9 @@ namespace mongo {
     bool IPv6Enabled();
     void setSockTimeouts(int sock, double secs);
 
+    /** Describes an error code returned by getaddrinfo. */
+    std::string getAddrInfoStrError(int code);
+
     /**
      * wrapped around os representation of network address
      */
@@ -95,6 +98,15 @@ namespace mongo {
         SockAddr();
         explicit SockAddr(int sourcePort); /* listener side */
         SockAddr(const char *ip, int port); /* EndPoint (remote) side, or if you want to specify which interface locally */
+        SockAddr(const sockaddr* addr, socklen_t size); /* copies an address, e.g. from getaddrinfo */
+
+        /**
+         * Like SockAddr(iporhost, port), but returns every address iporhost resolves to rather
+         * than only the first. They are ordered for connecting: alternating between address
+         * families, starting with the family the resolver put first. Returns an empty vector if
+         * iporhost can't be resolved.
+         */
+        static std::vector<SockAddr> createAll(const char* iporhost, int port);
 
         template <typename T> T& as() { return *(T*)(&sa); }
         template <typename T> const T& as() const { return *(const T*)(&sa); }
@@ -131,6 +143,32 @@ namespace mongo {
 
     extern SockAddr unknownAddress; // ( "0.0.0.0", 0 )
 
+    /**
+     * Counters for the connection attempts made by Socket::connect() with a list of addresses,
+     * by address family, so one can see which family tends to win.
+     */
+    struct MONGO_CLIENT_API ConnectAttemptStats {
+        struct Family {
+            Family();
+
+            // Attempts started, and those refused, unreachable or timed out.
+            long long attempts;
+            long long failures;
+
+            // Attempts whose socket was kept, and those abandoned because another one won.
+            long long wins;
+            long long canceled;
+
+            // Time from starting each winning attempt until it connected, summed.
+            long long winMicros;
+        };
+
+        Family ipv4;
+        Family ipv6;
+    };
+
+    ConnectAttemptStats getConnectAttemptStats();
+
     /** this is not cache and does a syscall */
     std::string getHostName();
 
@@ -206,6 +244,17 @@ namespace mongo {
          */
         bool connect(SockAddr& farEnd);
 
+        /**
+         * Connects to the first of 'farEnds' which answers, in the manner of RFC 8305 ("happy
+         * eyeballs"). Attempts start in order, each kConnectAttemptDelayMillis after the one
+         * before or as soon as the one before fails, and run in parallel. The first to connect
+         * is kept and the others are abandoned. Returns false if none connects within the
+         * connect timeout.
+         */
+        bool connect(const std::vector<SockAddr>& farEnds);
+
+        static const int kConnectAttemptDelayMillis = 250;
+
         void close();
         void send( const char * data , int len, const char *context );
         void send( const std::vector< std::pair< char *, int > > &data, const char *context );
@@ -247,6 +296,9 @@ namespace mongo {
         bool secure( SSLManagerInterface* ssl, const std::string& remoteHost);
 
         void secureAccepted( SSLManagerInterface* ssl );
+
+        /** @return true if traffic on this socket goes through SSL */
+        bool isSSL() const { return _sslConnection.get() != NULL; }
 #endif
         
         /**
@@ -275,6 +327,18 @@ namespace mongo {
     private:
         void _init();
 
+        /** Sets the socket up for use once _fd has connected to _remote. */
+        void _postConnect();
+
+        /**
+         * Starts a non-blocking connect to 'remote'. Returns the new socket, or INVALID_SOCKET
+         * if the attempt failed straight away.
+         */
+        int _startConnect(const SockAddr& remote);
+
+        /** Whether the connect started on 'fd', which poll says is done, succeeded. */
+        bool _isConnected(int fd, const SockAddr& remote);
+
         /** sends dumbly, just each buffer at a time */
         void _send( const std::vector< std::pair< char *, int > > &data, const char *context );
 
@@ -20,6 +20,7 @@
 #include <boost/thread.hpp>
 
 #ifndef _WIN32
+#include <fcntl.h>
 #include <netdb.h>
 #include <sys/socket.h>
 #include <sys/types.h>
@@ -28,6 +29,8 @@
 #include "mongo/unittest/unittest.h"
 #include "mongo/util/concurrency/synchronization.h"
 #include "mongo/util/fail_point_service.h"
+#include "mongo/util/scopeguard.h"
+#include "mongo/util/time_support.h"
 
 namespace {
 
@@ -330,5 +333,111 @@ namespace {
         ASSERT_TRUE(tryRecv());
     }
 
+    TEST(SockAddrTest, CreateAllNumeric) {
+        const std::vector<SockAddr> addrs = SockAddr::createAll("127.0.0.1", 27017);
+        ASSERT_EQUALS(1U, addrs.size());
+        ASSERT_EQUALS("127.0.0.1", addrs[0].getAddr());
+        ASSERT_EQUALS(27017U, addrs[0].getPort());
+    }
+
+#ifndef _WIN32
+
+    /**
+     * A loopback listening socket on a port of the system's choosing. Connections to it are
+     * never accepted.
+     */
+    class Listener {
+    public:
+        explicit Listener(int backlog = 16) : _fd(::socket(AF_INET, SOCK_STREAM, 0)) {
+            SockAddr addr("127.0.0.1", 0);
+            verify(::bind(_fd, addr.raw(), addr.addressSize) == 0);
+            verify(::listen(_fd, backlog) == 0);
+            _addr.addressSize = sizeof(sockaddr_storage);
+            verify(::getsockname(_fd, _addr.raw(), &_addr.addressSize) == 0);
+        }
+
+        ~Listener() {
+            ::close(_fd);
+        }
+
+        const SockAddr& addr() const {
+            return _addr;
+        }
+
+    private:
+        const int _fd;
+        SockAddr _addr;
+    };
+
+    SockAddr refusingAddress() {
+        // Nothing listens on the port once the listener is gone.
+        return Listener().addr();
+    }
+
+    TEST(SocketConnectTest, FallsBackToAddressThatAnswers) {
+        const ConnectAttemptStats before = getConnectAttemptStats();
+
+        Listener listener;
+        std::vector<SockAddr> addrs;
+        addrs.push_back(refusingAddress());
+        addrs.push_back(listener.addr());
+
+        Socket socket;
+        ASSERT(socket.connect(addrs));
+        ASSERT_EQUALS(listener.addr(), socket.remoteAddr());
+
+        const ConnectAttemptStats after = getConnectAttemptStats();
+        ASSERT_EQUALS(before.ipv4.attempts + 2, after.ipv4.attempts);
+        ASSERT_EQUALS(before.ipv4.failures + 1, after.ipv4.failures);
+        ASSERT_EQUALS(before.ipv4.wins + 1, after.ipv4.wins);
+    }
+
+    TEST(SocketConnectTest, FailsWhenNothingAnswers) {
+        std::vector<SockAddr> addrs;
+        addrs.push_back(refusingAddress());
+        addrs.push_back(refusingAddress());
+
+        Socket socket;
+        ASSERT_FALSE(socket.connect(addrs));
+    }
+
+    void closeAll(const std::vector<int>& fds) {
+        for (size_t i = 0; i < fds.size(); i++)
+            ::close(fds[i]);
+    }
+
+    TEST(SocketConnectTest, UnresponsiveAddressDoesNotStall) {
+        // A listener whose accept queue is full drops further connection requests, so connects
+        // to it hang much like connects to an unreachable host.
+        Listener blackHole(0);
+        std::vector<int> queued;
+        for (int i = 0; i < 3; i++) {
+            const int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+            ::fcntl(fd, F_SETFL, O_NONBLOCK);
+            ::connect(fd, blackHole.addr().raw(), blackHole.addr().addressSize);
+            queued.push_back(fd);
+        }
+        ON_BLOCK_EXIT(closeAll, queued);
+        sleepmillis(100);
+
+        const ConnectAttemptStats before = getConnectAttemptStats();
+
+        Listener listener;
+        std::vector<SockAddr> addrs;
+        addrs.push_back(blackHole.addr());
+        addrs.push_back(listener.addr());
+
+        Socket socket;
+        const unsigned long long start = curTimeMillis64();
+        ASSERT(socket.connect(addrs));
+        ASSERT_LESS_THAN(curTimeMillis64() - start, 2000ULL);
+        ASSERT_EQUALS(listener.addr(), socket.remoteAddr());
+
+        const ConnectAttemptStats after = getConnectAttemptStats();
+        ASSERT_EQUALS(before.ipv4.canceled + 1, after.ipv4.canceled);
+        ASSERT_EQUALS(before.ipv4.wins + 1, after.ipv4.wins);
+    }
+
+#endif // _WIN32
 
 } // namespace
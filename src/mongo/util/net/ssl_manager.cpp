@@ -30,10 +30,12 @@
 #include "mongo/base/init.h"
 #include "mongo/platform/atomic_word.h"
 #include "mongo/client/options.h"
+#include "mongo/stdx/functional.h"
 #include "mongo/util/debug_util.h"
 #include "mongo/util/log.h"
 #include "mongo/util/mongoutils/str.h"
 #include "mongo/util/net/sock.h"
+#include "mongo/util/net/ssl_session_cache.h"
 #include "mongo/util/scopeguard.h"
 
 #ifdef MONGO_SSL
@@ -174,7 +176,7 @@ namespace mongo {
 
             virtual ~SSLManager();
 
-            virtual SSLConnection* connect(Socket* socket);
+            virtual SSLConnection* connect(Socket* socket, const std::string& remoteHost);
 
             virtual SSLConnection* accept(Socket* socket, const char* initialBytes, int len);
 
@@ -193,6 +195,10 @@ namespace mongo {
 
             virtual std::string getSSLErrorMessage(int code);
 
+            virtual SessionCacheStats getSessionCacheStats();
+
+            virtual void flushSessionCache();
+
             virtual int SSL_read(SSLConnection* conn, void* buf, int num);
 
             virtual int SSL_write(SSLConnection* conn, const void* buf, int num);
@@ -218,6 +224,13 @@ namespace mongo {
             std::string _serverSubjectName;
             std::string _clientSubjectName;
 
+            // Client sessions which may be resumed, by "host:port".
+            static const size_t kMaxCachedSessions = 1024;
+
+            AtomicInt64 _sessionHits;
+            AtomicInt64 _sessionMisses;
+            SSLSessionCache<SSL_SESSION, SSL_SESSION_free> _sessions;
+
             /**
              * creates an SSL object to be used for this file descriptor.
              * caller must SSL_free it.
@@ -282,6 +295,7 @@ namespace mongo {
              */
             static int password_cb( char *buf,int num, int rwflag,void *userdata );
             static int verify_cb(int ok, X509_STORE_CTX *ctx);
+            static int new_session_cb(SSL* ssl, SSL_SESSION* session);
 
         };
 
@@ -370,6 +384,9 @@ namespace mongo {
 
     SSLConnection::~SSLConnection() {
         if (ssl) {   // The internalBIO is automatically freed as part of SSL_free
+            // Sockets are closed without a close_notify, which would otherwise make OpenSSL
+            // invalidate the session. Since TLS 1.1 that is no reason not to resume it.
+            SSL_set_shutdown(ssl, SSL_get_shutdown(ssl) | SSL_SENT_SHUTDOWN);
             SSL_free(ssl);
         }
         if (networkBIO) {
@@ -383,7 +400,8 @@ namespace mongo {
         _validateCertificates(false),
         _weakValidation(params.weakCertificateValidation),
         _allowInvalidCertificates(params.allowInvalidCertificates),
-        _allowInvalidHostnames(params.allowInvalidHostnames) {
+        _allowInvalidHostnames(params.allowInvalidHostnames),
+        _sessions(kMaxCachedSessions) {
 
         SSL_library_init();
         SSL_load_error_strings();
@@ -442,6 +460,8 @@ namespace mongo {
     }
 
     SSLManager::~SSLManager() {
+        flushSessionCache();
+
         CRYPTO_set_id_callback(0);
         ERR_free_strings();
         EVP_cleanup();
@@ -564,6 +584,17 @@ namespace mongo {
                     static_cast<unsigned char*>(static_cast<void*>(context)),
                     sizeof(*context)));
 
+        // Outgoing sessions are cached by remote host in _sessions rather than by OpenSSL, which
+        // has no idea which host a session belongs to. It hands us each new session, including
+        // TLS 1.3 tickets which arrive after the handshake, through new_session_cb.
+        if (context == &_clientContext) {
+            SSL_CTX_set_app_data(*context, this);
+            SSL_CTX_set_session_cache_mode(*context,
+                                           SSL_SESS_CACHE_CLIENT |
+                                           SSL_SESS_CACHE_NO_INTERNAL_STORE);
+            SSL_CTX_sess_set_new_cb(*context, &SSLManager::new_session_cb);
+        }
+
         // Use the clusterfile for internal outgoing SSL connections if specified 
         if (context == &_clientContext && !params.clusterfile.empty()) {
             EVP_set_pw_prompt("Enter cluster certificate passphrase");
@@ -765,24 +796,67 @@ namespace mongo {
         }
     }
 
-    SSLConnection* SSLManager::connect(Socket* socket) {
+    SSLConnection* SSLManager::connect(Socket* socket, const std::string& remoteHost) {
         SSLConnection* sslConn = new SSLConnection(_clientContext, socket, NULL, 0);
         ScopeGuard sslGuard = MakeGuard(::SSL_free, sslConn->ssl);
         ScopeGuard bioGuard = MakeGuard(::BIO_free, sslConn->networkBIO);
+
+        sslConn->sessionKey = mongoutils::str::stream() << remoteHost << ':'
+                                                        << socket->remotePort();
+        SSL_set_app_data(sslConn->ssl, sslConn);
+        // SSL_set_session takes its own reference to a cached session.
+        _sessions.use(sslConn->sessionKey, stdx::bind(&::SSL_set_session,
+                                                      sslConn->ssl,
+                                                      stdx::placeholders::_1));
  
         int ret;
         do {
             ret = ::SSL_connect(sslConn->ssl);
         } while(!_doneWithSSLOp(sslConn, ret));
  
-        if (ret != 1)
+        if (ret != 1) {
+            // Don't let a session the server no longer likes fail the next attempt too.
+            _sessions.drop(sslConn->sessionKey);
             _handleSSLError(SSL_get_error(sslConn, ret), ret);
+        }
+
+        if (SSL_session_reused(sslConn->ssl)) {
+            _sessionHits.fetchAndAdd(1);
+        }
+        else {
+            _sessionMisses.fetchAndAdd(1);
+        }
  
         sslGuard.Dismiss();
         bioGuard.Dismiss();
         return sslConn;
     }
 
+    int SSLManager::new_session_cb(SSL* ssl, SSL_SESSION* session) {
+        SSLManager* manager =
+            static_cast<SSLManager*>(SSL_CTX_get_app_data(SSL_get_SSL_CTX(ssl)));
+        SSLConnection* conn = static_cast<SSLConnection*>(SSL_get_app_data(ssl));
+        if (!manager || !conn)
+            return 0;
+
+        // Returning 1 tells OpenSSL we kept its reference to the session.
+        manager->_sessions.save(conn->sessionKey, session);
+        return 1;
+    }
+
+    SSLManagerInterface::SessionCacheStats SSLManager::getSessionCacheStats() {
+        SessionCacheStats stats;
+        stats.hits = _sessionHits.load();
+        stats.misses = _sessionMisses.load();
+
+        stats.cachedSessions = _sessions.size();
+        return stats;
+    }
+
+    void SSLManager::flushSessionCache() {
+        _sessions.clear();
+    }
+
     SSLConnection* SSLManager::accept(Socket* socket, const char* initialBytes, int len) {
         SSLConnection* sslConn = new SSLConnection(_serverContext, socket, initialBytes, len);
         ScopeGuard sslGuard = MakeGuard(::SSL_free, sslConn->ssl);
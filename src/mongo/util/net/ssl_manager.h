@@ -46,6 +46,9 @@ namespace mongo {
         BIO* internalBIO;
         Socket* socket;
 
+        // For outgoing connections, the key of this peer in the session cache.
+        std::string sessionKey;
+
         SSLConnection(SSL_CTX* ctx, Socket* sock, const char* initialBytes, int len); 
 
         ~SSLConnection();
@@ -53,14 +56,27 @@ namespace mongo {
 
     class SSLManagerInterface {
     public:
+        struct SessionCacheStats {
+            SessionCacheStats() : hits(0), misses(0), cachedSessions(0) {}
+
+            // Handshakes which resumed a cached session, and those which needed a full one.
+            long long hits;
+            long long misses;
+
+            // Sessions currently held, at most one per remote host and port.
+            long long cachedSessions;
+        };
+
         virtual ~SSLManagerInterface();
 
         /**
-         * Initiates a TLS connection.
+         * Initiates a TLS connection to remoteHost.
+         * If an earlier connection to the same host and port left a session in the cache, it is
+         * offered to the server so the handshake can be abbreviated.
          * Throws SocketException on failure.
          * @return a pointer to an SSLConnection. Resources are freed in SSLConnection's destructor
          */
-        virtual SSLConnection* connect(Socket* socket) = 0;
+        virtual SSLConnection* connect(Socket* socket, const std::string& remoteHost) = 0;
 
         /**
          * Waits for the other side to initiate a TLS connection.
@@ -100,6 +116,16 @@ namespace mongo {
         * Fetches the error text for an error code, in a thread-safe manner.
         */
         virtual std::string getSSLErrorMessage(int code) = 0;
+
+        /**
+         * Counters for the client session cache used by connect().
+         */
+        virtual SessionCacheStats getSessionCacheStats() = 0;
+
+        /**
+         * Drops all cached sessions, so the next connection to each host does a full handshake.
+         */
+        virtual void flushSessionCache() = 0;
  
         /**
          * ssl.h wrappers 
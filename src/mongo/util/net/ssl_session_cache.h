@@ -0,0 +1,127 @@
+/*    Copyright 2014 MongoDB Inc.
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+#pragma once
+
+#include <boost/noncopyable.hpp>
+#include <boost/thread/locks.hpp>
+#include <boost/thread/mutex.hpp>
+#include <map>
+#include <string>
+
+namespace mongo {
+
+    /**
+     * The TLS sessions of outgoing connections which may be resumed, at most one per remote
+     * "host:port". The cache holds one reference to each session, and gives it up with 'Free'
+     * when the session is replaced, dropped or evicted.
+     *
+     * The session type is a parameter so the bookkeeping doesn't depend on OpenSSL; SSLManager
+     * uses SSLSessionCache<SSL_SESSION, SSL_SESSION_free>.
+     *
+     * Thread-safe.
+     */
+    template <typename Session, void (*Free)(Session*)>
+    class SSLSessionCache : boost::noncopyable {
+    public:
+        explicit SSLSessionCache(size_t maxSessions) : _maxSessions(maxSessions) {}
+
+        ~SSLSessionCache() {
+            clear();
+        }
+
+        /**
+         * If a session is cached for 'key', calls 'use' with it while it is still held, so
+         * 'use' can take a reference of its own. Returns whether there was one.
+         */
+        template <typename Use>
+        bool use(const std::string& key, Use use) const {
+            boost::lock_guard<boost::mutex> lk(_mutex);
+            typename SessionMap::const_iterator it = _sessions.find(key);
+            if (it == _sessions.end())
+                return false;
+            use(it->second);
+            return true;
+        }
+
+        /**
+         * Caches 'session' for 'key', taking over the caller's reference. A session already
+         * cached for 'key' is released. When the cache is full, some other session makes room.
+         */
+        void save(const std::string& key, Session* session) {
+            Session* released = NULL;
+            {
+                boost::lock_guard<boost::mutex> lk(_mutex);
+                typename SessionMap::iterator it = _sessions.find(key);
+                if (it != _sessions.end()) {
+                    released = it->second;
+                    it->second = session;
+                }
+                else {
+                    // Keep the cache bounded if we talk to a great many hosts; which one goes
+                    // doesn't matter much.
+                    if (_sessions.size() >= _maxSessions && !_sessions.empty()) {
+                        released = _sessions.begin()->second;
+                        _sessions.erase(_sessions.begin());
+                    }
+                    _sessions[key] = session;
+                }
+            }
+            if (released)
+                Free(released);
+        }
+
+        /** Releases the session cached for 'key', if any. */
+        void drop(const std::string& key) {
+            Session* dropped = NULL;
+            {
+                boost::lock_guard<boost::mutex> lk(_mutex);
+                typename SessionMap::iterator it = _sessions.find(key);
+                if (it == _sessions.end())
+                    return;
+                dropped = it->second;
+                _sessions.erase(it);
+            }
+            Free(dropped);
+        }
+
+        /** Releases every cached session. */
+        void clear() {
+            SessionMap sessions;
+            {
+                boost::lock_guard<boost::mutex> lk(_mutex);
+                sessions.swap(_sessions);
+            }
+            for (typename SessionMap::const_iterator it = sessions.begin();
+                 it != sessions.end(); ++it)
+                Free(it->second);
+        }
+
+        size_t size() const {
+            boost::lock_guard<boost::mutex> lk(_mutex);
+            return _sessions.size();
+        }
+
+    private:
+        typedef std::map<std::string, Session*> SessionMap;
+
+        const size_t _maxSessions;
+
+        // protects _sessions
+        mutable boost::mutex _mutex;
+        SessionMap _sessions;
+    };
+
+} // namespace mongo
@@ -0,0 +1,156 @@
+/*    Copyright 2014 MongoDB Inc.
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+#include "mongo/platform/basic.h"
+
+#include "mongo/util/net/ssl_session_cache.h"
+
+#include <algorithm>
+#include <vector>
+
+#include "mongo/unittest/unittest.h"
+
+namespace mongo {
+namespace ssl_session_cache_test {
+
+    // Stands in for SSL_SESSION; the cache only ever holds and frees it.
+    struct Session {
+        explicit Session(int id) : id(id) {}
+        const int id;
+    };
+
+    std::vector<int> freed;
+
+    // A template argument, so it needs external linkage.
+    void freeSession(Session* session) {
+        freed.push_back(session->id);
+        delete session;
+    }
+
+    typedef SSLSessionCache<Session, freeSession> Cache;
+
+    /** Records the id of the session the cache hands out. */
+    class Remember {
+    public:
+        explicit Remember(int* id) : _id(id) {}
+        void operator()(Session* session) const { *_id = session->id; }
+    private:
+        int* const _id;
+    };
+
+    class SSLSessionCacheTest : public unittest::Test {
+    protected:
+        virtual void setUp() {
+            freed.clear();
+        }
+
+        // The id of the session cached for 'key', or 0 if there is none.
+        int cached(const Cache& cache, const std::string& key) {
+            int id = 0;
+            cache.use(key, Remember(&id));
+            return id;
+        }
+
+        bool wasFreed(int id) {
+            return std::find(freed.begin(), freed.end(), id) != freed.end();
+        }
+    };
+
+    TEST_F(SSLSessionCacheTest, OneSessionPerHost) {
+        Cache cache(10);
+        ASSERT_EQUALS(cached(cache, "a:27017"), 0);
+
+        cache.save("a:27017", new Session(1));
+        cache.save("a:27018", new Session(2));
+        cache.save("b:27017", new Session(3));
+
+        ASSERT_EQUALS(cache.size(), 3U);
+        ASSERT_EQUALS(cached(cache, "a:27017"), 1);
+        ASSERT_EQUALS(cached(cache, "a:27018"), 2);
+        ASSERT_EQUALS(cached(cache, "b:27017"), 3);
+        ASSERT_TRUE(freed.empty());
+    }
+
+    TEST_F(SSLSessionCacheTest, NewSessionReplacesOld) {
+        Cache cache(10);
+        cache.save("a:27017", new Session(1));
+        cache.save("a:27017", new Session(2));
+
+        ASSERT_EQUALS(cache.size(), 1U);
+        ASSERT_EQUALS(cached(cache, "a:27017"), 2);
+        ASSERT_EQUALS(freed.size(), 1U);
+        ASSERT_TRUE(wasFreed(1));
+    }
+
+    TEST_F(SSLSessionCacheTest, DropReleasesSession) {
+        Cache cache(10);
+        cache.save("a:27017", new Session(1));
+        cache.save("b:27017", new Session(2));
+
+        cache.drop("a:27017");
+        cache.drop("c:27017");
+
+        ASSERT_EQUALS(cache.size(), 1U);
+        ASSERT_EQUALS(cached(cache, "a:27017"), 0);
+        ASSERT_EQUALS(cached(cache, "b:27017"), 2);
+        ASSERT_EQUALS(freed.size(), 1U);
+        ASSERT_TRUE(wasFreed(1));
+    }
+
+    TEST_F(SSLSessionCacheTest, FullCacheEvictsAnotherHost) {
+        Cache cache(2);
+        cache.save("a:27017", new Session(1));
+        cache.save("b:27017", new Session(2));
+        cache.save("c:27017", new Session(3));
+
+        ASSERT_EQUALS(cache.size(), 2U);
+        ASSERT_EQUALS(cached(cache, "c:27017"), 3);
+        ASSERT_EQUALS(freed.size(), 1U);
+        ASSERT_TRUE(wasFreed(1) || wasFreed(2));
+
+        // Replacing a session for a cached host makes no room.
+        cache.save("c:27017", new Session(4));
+        ASSERT_EQUALS(cache.size(), 2U);
+        ASSERT_EQUALS(freed.size(), 2U);
+        ASSERT_TRUE(wasFreed(3));
+    }
+
+    TEST_F(SSLSessionCacheTest, ClearReleasesEverySession) {
+        Cache cache(10);
+        cache.save("a:27017", new Session(1));
+        cache.save("b:27017", new Session(2));
+
+        cache.clear();
+
+        ASSERT_EQUALS(cache.size(), 0U);
+        ASSERT_EQUALS(cached(cache, "a:27017"), 0);
+        ASSERT_EQUALS(freed.size(), 2U);
+
+        // Still usable afterwards.
+        cache.save("a:27017", new Session(3));
+        ASSERT_EQUALS(cached(cache, "a:27017"), 3);
+    }
+
+    TEST_F(SSLSessionCacheTest, DestructorReleasesEverySession) {
+        {
+            Cache cache(10);
+            cache.save("a:27017", new Session(1));
+            cache.save("b:27017", new Session(2));
+        }
+        ASSERT_EQUALS(freed.size(), 2U);
+    }
+
+} // namespace ssl_session_cache_test
+} // namespace mongo
@@ -0,0 +1,317 @@
+/*    Copyright 2014 MongoDB Inc.
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+#define MONGO_LOG_DEFAULT_COMPONENT ::mongo::logger::LogComponent::kNetwork
+
+#include "mongo/platform/basic.h"
+
+#include "mongo/util/net/write_coalescer.h"
+
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/locks.hpp>
+#include <map>
+#include <utility>
+
+#include "mongo/db/jsobj.h"
+#include "mongo/platform/atomic_word.h"
+#include "mongo/util/background.h"
+#include "mongo/util/log.h"
+#include "mongo/util/net/message.h"
+#include "mongo/util/net/sock.h"
+#include "mongo/util/time_support.h"
+
+namespace mongo {
+
+namespace {
+
+    AtomicInt64 frames;
+    AtomicInt64 writes;
+    AtomicInt64 bytes;
+    AtomicInt64 sizeFlushes;
+    AtomicInt64 delayFlushes;
+    AtomicInt64 explicitFlushes;
+
+} // namespace
+
+    /**
+     * Flushes coalescers whose oldest queued message has waited its maximum delay.
+     *
+     * A flush can block on a slow peer, so it happens without _mutex held; scheduling and
+     * unscheduling other coalescers goes on meanwhile. The coalescer being flushed is marked,
+     * and unschedule() waits for that flush to finish, so the coalescer can be destroyed as soon
+     * as it returns.
+     */
+    class WriteCoalescer::Timer : public BackgroundJob {
+    public:
+        static Timer* get() {
+            static Timer* const globalTimer = new Timer();
+            return globalTimer;
+        }
+
+        Timer() : _started(false), _flushing(NULL), _flushingUnscheduled(false) {}
+
+        virtual std::string name() const {
+            return "WriteCoalescerTimer";
+        }
+
+        void schedule(WriteCoalescer* coalescer, unsigned long long deadline) {
+            boost::lock_guard<boost::mutex> lk(_mutex);
+            if (!_setDeadline(coalescer, deadline))
+                return;
+
+            if (!_started) {
+                _started = true;
+                go();
+            }
+            _changed.notify_one();
+        }
+
+        void unschedule(WriteCoalescer* coalescer) {
+            boost::unique_lock<boost::mutex> lk(_mutex);
+            _deadlines.erase(coalescer);
+            if (_flushing != coalescer)
+                return;
+
+            _flushingUnscheduled = true;
+            do {
+                _flushed.wait(lk);
+            } while (_flushing == coalescer);
+        }
+
+        virtual void run() {
+            boost::unique_lock<boost::mutex> lk(_mutex);
+            while (true) {
+                if (_deadlines.empty()) {
+                    _changed.wait(lk);
+                    continue;
+                }
+
+                DeadlineMap::iterator next = _deadlines.begin();
+                for (DeadlineMap::iterator it = next; it != _deadlines.end(); ++it) {
+                    if (it->second < next->second)
+                        next = it;
+                }
+
+                const unsigned long long now = curTimeMillis64();
+                if (now < next->second) {
+                    _changed.timed_wait(lk, boost::posix_time::milliseconds(next->second - now));
+                    continue;
+                }
+
+                WriteCoalescer* const coalescer = next->first;
+                _deadlines.erase(next);
+                _flushing = coalescer;
+                _flushingUnscheduled = false;
+
+                lk.unlock();
+                const unsigned long long again = coalescer->_flushDue(now);
+                lk.lock();
+
+                // Once unscheduled, the coalescer may be gone as soon as we let go of it.
+                if (again && !_flushingUnscheduled)
+                    _setDeadline(coalescer, again);
+                _flushing = NULL;
+                _flushed.notify_all();
+            }
+        }
+
+    private:
+        typedef std::map<WriteCoalescer*, unsigned long long> DeadlineMap;
+
+        // Makes 'deadline' the coalescer's deadline unless it already has an earlier one.
+        // Returns whether it changed. Must be called with _mutex held.
+        bool _setDeadline(WriteCoalescer* coalescer, unsigned long long deadline) {
+            std::pair<DeadlineMap::iterator, bool> result =
+                _deadlines.insert(std::make_pair(coalescer, deadline));
+            if (!result.second) {
+                if (result.first->second <= deadline)
+                    return false;
+                result.first->second = deadline;
+            }
+            return true;
+        }
+
+        boost::mutex _mutex;
+        boost::condition_variable _changed;
+        boost::condition_variable _flushed;
+        DeadlineMap _deadlines;
+        bool _started;
+
+        // The coalescer the timer thread is flushing, if any, and whether it was unscheduled
+        // meanwhile.
+        WriteCoalescer* _flushing;
+        bool _flushingUnscheduled;
+    };
+
+    WriteCoalescer::Stats::Stats()
+        : frames(0)
+        , writes(0)
+        , bytes(0)
+        , sizeFlushes(0)
+        , delayFlushes(0)
+        , explicitFlushes(0) {
+    }
+
+    double WriteCoalescer::Stats::framesPerWrite() const {
+        if (writes == 0)
+            return 0;
+        return static_cast<double>(frames) / writes;
+    }
+
+    void WriteCoalescer::Stats::append(BSONObjBuilder* builder) const {
+        builder->append("frames", frames);
+        builder->append("writes", writes);
+        builder->append("framesPerWrite", framesPerWrite());
+        builder->append("bytes", bytes);
+        builder->append("sizeFlushes", sizeFlushes);
+        builder->append("delayFlushes", delayFlushes);
+        builder->append("explicitFlushes", explicitFlushes);
+    }
+
+    WriteCoalescer::WriteCoalescer(Socket* socket, int maxBytes, int maxDelayMillis)
+        : _socket(socket)
+        , _maxBytes(maxBytes)
+        , _maxDelayMillis(maxDelayMillis)
+        , _pendingFrames(0)
+        , _oldestQueuedMillis(0) {
+    }
+
+    WriteCoalescer::~WriteCoalescer() {
+        if (_maxDelayMillis > 0)
+            Timer::get()->unschedule(this);
+
+        DESTRUCTOR_GUARD(
+            flush();
+        );
+    }
+
+    bool WriteCoalescer::fits(const Message& message) const {
+        return message.size() <= _maxBytes;
+    }
+
+    void WriteCoalescer::queue(Message& message) {
+        verify(fits(message));
+        message.concat();
+
+        bool first;
+        unsigned long long deadline;
+        {
+            boost::lock_guard<boost::mutex> lk(_mutex);
+            if (static_cast<int>(_pending.size()) + message.size() > _maxBytes) {
+                sizeFlushes.fetchAndAdd(1);
+                _write(NULL, "flush");
+            }
+
+            first = _pending.empty();
+            if (first)
+                _oldestQueuedMillis = curTimeMillis64();
+            deadline = _oldestQueuedMillis + _maxDelayMillis;
+
+            const char* data = message.singleData().view2ptr();
+            _pending.insert(_pending.end(), data, data + message.size());
+            _pendingFrames++;
+        }
+
+        // Outside _mutex, so queueing never waits on the timer's lock while holding ours.
+        if (first && _maxDelayMillis > 0)
+            Timer::get()->schedule(this, deadline);
+    }
+
+    void WriteCoalescer::send(Message& message, const char* context) {
+        boost::lock_guard<boost::mutex> lk(_mutex);
+        _write(&message, context);
+    }
+
+    void WriteCoalescer::flush() {
+        boost::lock_guard<boost::mutex> lk(_mutex);
+        if (_pending.empty())
+            return;
+        explicitFlushes.fetchAndAdd(1);
+        _write(NULL, "flush");
+    }
+
+    int WriteCoalescer::discard() {
+        boost::lock_guard<boost::mutex> lk(_mutex);
+        const int dropped = _pendingFrames;
+        _pending.clear();
+        _pendingFrames = 0;
+        return dropped;
+    }
+
+    int WriteCoalescer::pendingBytes() const {
+        boost::lock_guard<boost::mutex> lk(_mutex);
+        return _pending.size();
+    }
+
+    WriteCoalescer::Stats WriteCoalescer::getStats() {
+        Stats stats;
+        stats.frames = frames.load();
+        stats.writes = writes.load();
+        stats.bytes = bytes.load();
+        stats.sizeFlushes = sizeFlushes.load();
+        stats.delayFlushes = delayFlushes.load();
+        stats.explicitFlushes = explicitFlushes.load();
+        return stats;
+    }
+
+    void WriteCoalescer::_write(Message* message, const char* context) {
+        // Take the queue first, so it is dropped rather than resent if the write fails.
+        std::vector<char> pending;
+        pending.swap(_pending);
+        const int pendingFrames = _pendingFrames;
+        _pendingFrames = 0;
+
+        std::vector<std::pair<char*, int> > buffers;
+        if (!pending.empty())
+            buffers.push_back(std::make_pair(&pending[0], static_cast<int>(pending.size())));
+        if (message) {
+            message->concat();
+            buffers.push_back(std::make_pair(message->singleData().view2ptr(), message->size()));
+        }
+        if (buffers.empty())
+            return;
+
+        _socket->send(buffers, context);
+
+        frames.fetchAndAdd(pendingFrames + (message ? 1 : 0));
+        writes.fetchAndAdd(1);
+        bytes.fetchAndAdd(pending.size() + (message ? message->size() : 0));
+
+        // Keep the allocation for the next batch.
+        pending.clear();
+        _pending.swap(pending);
+    }
+
+    unsigned long long WriteCoalescer::_flushDue(unsigned long long now) {
+        boost::lock_guard<boost::mutex> lk(_mutex);
+        if (_pending.empty())
+            return 0;
+
+        const unsigned long long due = _oldestQueuedMillis + _maxDelayMillis;
+        if (now < due)
+            return due;
+
+        delayFlushes.fetchAndAdd(1);
+        try {
+            _write(NULL, "flush");
+        }
+        catch (const SocketException& e) {
+            // The owner finds out when it next uses the socket.
+            LOG(1) << "failed to send coalesced messages: " << e;
+        }
+        return 0;
+    }
+
+} // namespace mongo
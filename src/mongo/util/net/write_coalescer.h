@@ -0,0 +1,112 @@
+/*    Copyright 2014 MongoDB Inc.
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+#pragma once
+
+#include <boost/noncopyable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <vector>
+
+#include "mongo/client/export_macros.h"
+
+namespace mongo {
+
+    class BSONObjBuilder;
+    class Message;
+    class Socket;
+
+    /**
+     * Holds back small messages that don't need a reply, so several can go out in one write.
+     *
+     * Queued messages are sent, in order, ahead of the next message passed to send(), in the
+     * same write. They are also sent when queueing another would take them past maxBytes, when
+     * flush() is called, and, if maxDelayMillis is positive, once the oldest has waited that
+     * long. With a maxDelayMillis of 0 queued messages wait for one of the others.
+     *
+     * The delay is enforced by a thread shared by all coalescers, which writes to the socket
+     * while the owner may be reading from it. So a positive maxDelayMillis must not be used on
+     * SSL sockets. While that thread is blocked writing to one slow peer, delayed flushes of
+     * other coalescers wait for it, but queueing, sending and destroying them don't.
+     */
+    class MONGO_CLIENT_API WriteCoalescer : boost::noncopyable {
+    public:
+        struct Stats {
+            Stats();
+
+            void append(BSONObjBuilder* builder) const;
+
+            // Messages sent per write, or 0 before anything was written.
+            double framesPerWrite() const;
+
+            // Messages and writes which went through a coalescer, and the bytes written.
+            long long frames;
+            long long writes;
+            long long bytes;
+
+            // Why queued messages went out, other than with a message passed to send().
+            long long sizeFlushes;
+            long long delayFlushes;
+            long long explicitFlushes;
+        };
+
+        /** 'socket' must outlive the coalescer. */
+        WriteCoalescer(Socket* socket, int maxBytes, int maxDelayMillis);
+
+        /** Sends anything still queued. */
+        ~WriteCoalescer();
+
+        /** Returns whether queue() would accept 'message' rather than it being too big. */
+        bool fits(const Message& message) const;
+
+        /** Holds a copy of 'message' back to go out with later ones. 'message' must fit(). */
+        void queue(Message& message);
+
+        /** Sends 'message' now, together with anything queued. */
+        void send(Message& message, const char* context);
+
+        /** Sends anything queued. */
+        void flush();
+
+        /** Drops anything queued without sending it, and returns how many messages that was. */
+        int discard();
+
+        /** The number of bytes waiting to be sent. */
+        int pendingBytes() const;
+
+        /** Counters for all coalescers in this process. */
+        static Stats getStats();
+
+    private:
+        class Timer;
+
+        // Writes the queue followed by 'message', which may be NULL. Call with _mutex held.
+        void _write(Message* message, const char* context);
+
+        // Called by the timer thread. Sends the queue if the oldest message in it is due, and
+        // returns when the next one will be, or 0 if nothing is queued.
+        unsigned long long _flushDue(unsigned long long now);
+
+        Socket* const _socket;
+        const int _maxBytes;
+        const int _maxDelayMillis;
+
+        // protects everything below, and writes to _socket
+        mutable boost::mutex _mutex;
+        std::vector<char> _pending;
+        int _pendingFrames;
+        unsigned long long _oldestQueuedMillis;
+    };
+
+} // namespace mongo
@@ -0,0 +1,258 @@
+/*    Copyright 2014 MongoDB Inc.
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+#include "mongo/platform/basic.h"
+
+#include "mongo/util/net/write_coalescer.h"
+
+#include <boost/scoped_ptr.hpp>
+#include <boost/thread/thread.hpp>
+#include <vector>
+
+#ifndef _WIN32
+#include <sys/socket.h>
+#include <sys/types.h>
+#endif
+
+#include "mongo/stdx/functional.h"
+#include "mongo/unittest/unittest.h"
+#include "mongo/util/net/message.h"
+#include "mongo/util/net/sock.h"
+#include "mongo/util/time_support.h"
+
+namespace {
+
+    using namespace mongo;
+
+// The tests need a connected socket pair, which only UNIX provides natively.
+#ifndef _WIN32
+
+    /** A connected pair of sockets; messages are written to 'client' and read from 'server'. */
+    class SocketPair {
+    public:
+        SocketPair() {
+            int socks[2];
+            verify(::socketpair(PF_UNIX, SOCK_STREAM, 0, socks) == 0);
+            client.reset(new Socket(socks[0], SockAddr()));
+            server.reset(new Socket(socks[1], SockAddr()));
+            client->setHandshakeReceived();
+            server->setHandshakeReceived();
+            server->setTimeout(5);
+        }
+
+        /** Returns whether anything is waiting to be read on 'server'. */
+        bool serverHasData() {
+            char c;
+            return ::recv(server->rawFD(), &c, 1, MSG_PEEK | MSG_DONTWAIT) > 0;
+        }
+
+        /** Fills the socket buffers until writing to 'client' would block. Returns the bytes. */
+        int fill() {
+            std::vector<char> junk(4096, 'j');
+            int filled = 0;
+            while (true) {
+                const ssize_t n = ::send(client->rawFD(), &junk[0], junk.size(), MSG_DONTWAIT);
+                if (n <= 0)
+                    return filled;
+                filled += n;
+            }
+        }
+
+        /** Reads and discards 'len' bytes from 'server'. */
+        void discard(int len) {
+            std::vector<char> junk(len);
+            server->recv(&junk[0], len);
+        }
+
+        /** Reads one message from 'server' and returns its request id. */
+        int readId() {
+            MSGHEADER::Value header;
+            server->recv(reinterpret_cast<char*>(&header), sizeof(header));
+            std::vector<char> body(header.constView().getMessageLength() - sizeof(header));
+            if (!body.empty())
+                server->recv(&body[0], body.size());
+            return header.constView().getRequestID();
+        }
+
+        boost::scoped_ptr<Socket> client;
+        boost::scoped_ptr<Socket> server;
+    };
+
+    void makeMessage(int id, int bodySize, Message* out) {
+        std::vector<char> body(bodySize, 'x');
+        out->setData(dbKillCursors, &body[0], body.size());
+        out->header().setId(id);
+    }
+
+    TEST(WriteCoalescerTest, QueuedMessagesGoOutWithTheNext) {
+        SocketPair pair;
+        const WriteCoalescer::Stats before = WriteCoalescer::getStats();
+        WriteCoalescer coalescer(pair.client.get(), 1300, 0);
+
+        for (int id = 1; id <= 3; id++) {
+            Message m;
+            makeMessage(id, 20, &m);
+            ASSERT(coalescer.fits(m));
+            coalescer.queue(m);
+        }
+        ASSERT_EQUALS(3 * 36, coalescer.pendingBytes());
+        ASSERT_FALSE(pair.serverHasData());
+
+        Message next;
+        makeMessage(4, 2000, &next);
+        ASSERT_FALSE(coalescer.fits(next));
+        coalescer.send(next, "test");
+        ASSERT_EQUALS(0, coalescer.pendingBytes());
+
+        for (int id = 1; id <= 4; id++)
+            ASSERT_EQUALS(id, pair.readId());
+
+        const WriteCoalescer::Stats after = WriteCoalescer::getStats();
+        ASSERT_EQUALS(before.frames + 4, after.frames);
+        ASSERT_EQUALS(before.writes + 1, after.writes);
+        ASSERT_EQUALS(before.bytes + 3 * 36 + 2016, after.bytes);
+    }
+
+    TEST(WriteCoalescerTest, FlushesWhenFull) {
+        SocketPair pair;
+        const long long sizeFlushes = WriteCoalescer::getStats().sizeFlushes;
+        WriteCoalescer coalescer(pair.client.get(), 100, 0);
+
+        for (int id = 1; id <= 3; id++) {
+            Message m;
+            makeMessage(id, 24, &m);
+            coalescer.queue(m);
+        }
+
+        // The third didn't fit with the first two, which went out without it.
+        ASSERT_EQUALS(40, coalescer.pendingBytes());
+        ASSERT_EQUALS(1, pair.readId());
+        ASSERT_EQUALS(2, pair.readId());
+        ASSERT_FALSE(pair.serverHasData());
+        ASSERT_EQUALS(sizeFlushes + 1, WriteCoalescer::getStats().sizeFlushes);
+
+        coalescer.flush();
+        ASSERT_EQUALS(3, pair.readId());
+    }
+
+    TEST(WriteCoalescerTest, FlushesAfterMaxDelay) {
+        SocketPair pair;
+        const long long delayFlushes = WriteCoalescer::getStats().delayFlushes;
+        WriteCoalescer coalescer(pair.client.get(), 1300, 50);
+
+        const unsigned long long start = curTimeMillis64();
+        Message m;
+        makeMessage(1, 20, &m);
+        coalescer.queue(m);
+
+        // Nothing else is sent, but the message arrives anyway.
+        ASSERT_EQUALS(1, pair.readId());
+        ASSERT_GREATER_THAN_OR_EQUALS(curTimeMillis64() - start, 40ULL);
+        ASSERT_EQUALS(0, coalescer.pendingBytes());
+        ASSERT_EQUALS(delayFlushes + 1, WriteCoalescer::getStats().delayFlushes);
+
+        // Sending something sooner takes the queue with it, and the timer finds nothing to do.
+        Message queued;
+        makeMessage(2, 20, &queued);
+        coalescer.queue(queued);
+        Message next;
+        makeMessage(3, 20, &next);
+        coalescer.send(next, "test");
+        ASSERT_EQUALS(2, pair.readId());
+        ASSERT_EQUALS(3, pair.readId());
+
+        sleepmillis(100);
+        ASSERT_FALSE(pair.serverHasData());
+        ASSERT_EQUALS(delayFlushes + 1, WriteCoalescer::getStats().delayFlushes);
+    }
+
+    TEST(WriteCoalescerTest, DestructorSendsQueuedMessages) {
+        SocketPair pair;
+        {
+            WriteCoalescer coalescer(pair.client.get(), 1300, 60 * 1000);
+            Message m;
+            makeMessage(1, 20, &m);
+            coalescer.queue(m);
+        }
+        ASSERT_EQUALS(1, pair.readId());
+    }
+
+    TEST(WriteCoalescerTest, DiscardDropsQueuedMessages) {
+        SocketPair pair;
+        {
+            WriteCoalescer coalescer(pair.client.get(), 1300, 60 * 1000);
+            for (int id = 1; id <= 2; id++) {
+                Message m;
+                makeMessage(id, 20, &m);
+                coalescer.queue(m);
+            }
+            ASSERT_EQUALS(2, coalescer.discard());
+            ASSERT_EQUALS(0, coalescer.pendingBytes());
+            ASSERT_EQUALS(0, coalescer.discard());
+
+            Message next;
+            makeMessage(3, 20, &next);
+            coalescer.send(next, "test");
+        }
+        ASSERT_EQUALS(3, pair.readId());
+        ASSERT_FALSE(pair.serverHasData());
+    }
+
+    void queueFlushAndDestroy(Socket* socket) {
+        WriteCoalescer coalescer(socket, 1300, 60 * 1000);
+        Message m;
+        makeMessage(1, 20, &m);
+        coalescer.queue(m);
+        coalescer.flush();
+        coalescer.queue(m);
+    }
+
+    void destroy(WriteCoalescer* coalescer) {
+        delete coalescer;
+    }
+
+    TEST(WriteCoalescerTest, BlockedFlushDoesNotHoldUpOthers) {
+        SocketPair blocked;
+        const int filled = blocked.fill();
+        const long long delayFlushes = WriteCoalescer::getStats().delayFlushes;
+
+        // The timer thread flushes this one, and blocks writing to the full socket.
+        WriteCoalescer* stuck = new WriteCoalescer(blocked.client.get(), 1300, 1);
+        Message m;
+        makeMessage(1, 20, &m);
+        stuck->queue(m);
+        while (WriteCoalescer::getStats().delayFlushes == delayFlushes)
+            sleepmillis(1);
+        sleepmillis(20);
+
+        // Other coalescers can still be scheduled, flushed and unscheduled.
+        SocketPair other;
+        boost::thread worker(stdx::bind(&queueFlushAndDestroy, other.client.get()));
+        ASSERT_TRUE(worker.timed_join(boost::posix_time::seconds(5)));
+        ASSERT_EQUALS(1, other.readId());
+        ASSERT_EQUALS(1, other.readId());
+
+        // The stuck one can't be destroyed until its flush is over.
+        boost::thread destroyer(stdx::bind(&destroy, stuck));
+        ASSERT_FALSE(destroyer.timed_join(boost::posix_time::milliseconds(100)));
+
+        blocked.discard(filled);
+        ASSERT_EQUALS(1, blocked.readId());
+        ASSERT_TRUE(destroyer.timed_join(boost::posix_time::seconds(5)));
+    }
+
+#endif // _WIN32
+
+} // namespace
@@ -17,6 +17,8 @@
 #pragma once
 
 #include <boost/intrusive_ptr.hpp>
+#include <cstdlib>
+#include <cstring>
 
 #include "mongo/platform/atomic_word.h"
 
@@ -24,6 +26,10 @@ namespace mongo {
 
     class SharedBuffer {
     public:
+        /** Frees the memory of a buffer from takeOwnership(data, freeFunction) once the last
+         *  reference goes. It is passed the start of the memory, where the function is kept. */
+        typedef void (*FreeFunction)(void* freeFunctionPrefixedData);
+
         SharedBuffer() {}
 
         void swap(SharedBuffer& other) {
@@ -60,12 +66,27 @@ namespace mongo {
             return SharedBuffer(new(holderPrefixedData) Holder(1U));
         }
 
+        /**
+         * Like takeOwnership() above, for memory which 'freeFunction' rather than free() must
+         * give back. The Holder is preceded by the function, so the data must be prefixed by
+         * kFreeFunctionPrefixBytes rather than by a Holder alone.
+         */
+        static SharedBuffer takeOwnership(char* freeFunctionPrefixedData,
+                                          FreeFunction freeFunction) {
+            memcpy(freeFunctionPrefixedData, &freeFunction, sizeof(freeFunction));
+            char* holderPrefixedData = freeFunctionPrefixedData + sizeof(freeFunction);
+            return SharedBuffer(new(holderPrefixedData) Holder(1U | Holder::kFreeFunctionFlag));
+        }
+
         char* get() const {
             return _holder ? _holder->data() : NULL;
         }
 
         class Holder {
         public:
+            // Set in the refcount of a Holder whose FreeFunction is stored just before it.
+            static const AtomicUInt32::WordType kFreeFunctionFlag = 1U << 31;
+
             explicit Holder(AtomicUInt32::WordType initial = AtomicUInt32::WordType())
                 : _refCount(initial) {}
 
@@ -75,11 +96,20 @@ namespace mongo {
             }
 
             friend void intrusive_ptr_release(Holder* h) {
-                if (h->_refCount.subtractAndFetch(1) == 0) {
+                const AtomicUInt32::WordType count = h->_refCount.subtractAndFetch(1);
+                if ((count & ~kFreeFunctionFlag) == 0) {
                     // We placement new'ed a Holder in takeOwnership above,
                     // so we must destroy the object here.
                     h->~Holder();
-                    free(h);
+                    if (count & kFreeFunctionFlag) {
+                        char* start = reinterpret_cast<char*>(h) - sizeof(FreeFunction);
+                        FreeFunction freeFunction;
+                        memcpy(&freeFunction, start, sizeof(freeFunction));
+                        freeFunction(start);
+                    }
+                    else {
+                        free(h);
+                    }
                 }
             }
 
@@ -95,6 +125,9 @@ namespace mongo {
             AtomicUInt32 _refCount;
         };
 
+        /** The room takeOwnership(data, freeFunction) needs in front of the data. */
+        static const size_t kFreeFunctionPrefixBytes = sizeof(FreeFunction) + sizeof(Holder);
+
     private:
         explicit SharedBuffer(Holder* holder)
             : _holder(holder, /*add_ref=*/ false) {